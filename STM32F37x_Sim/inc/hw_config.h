@@ -0,0 +1,23 @@
+/**
+  ******************************************************************************
+  * @file    hw_config.h
+  * @brief   Hardware configuration header of the simulation build, used to
+  *          compile the USB-FS device driver into libstm32f37x_sim.a.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HW_CONFIG_H
+#define __HW_CONFIG_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f37x.h"
+#include "usb_type.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/* External variables --------------------------------------------------------*/
+
+#endif  /*__HW_CONFIG_H*/
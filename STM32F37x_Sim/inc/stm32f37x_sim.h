@@ -0,0 +1,216 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim.h
+  * @brief   Host-native simulation of the STM32F37x peripheral register space.
+  *
+  *          The simulation build (make sim) compiles the Standard Peripheral
+  *          Library, system_stm32f37x.c and the USB-FS device driver for the
+  *          host. The peripheral base addresses of stm32f37x.h are left
+  *          untouched: SIM_Init() maps an in-process register file at the
+  *          very same addresses (0x40000000 APB/AHB, 0x48000000 GPIO,
+  *          0xE0000000 PPB, ...). The pages holding modelled peripherals are
+  *          access protected; every CPU access to them is trapped, single
+  *          stepped and handed to a small behavioural model that drives the
+  *          status flags (RXNE/TXE, DMA TCIF, CRC data, RCC ready bits, USB
+  *          CTR, ...). All other pages behave like plain memory, in
+  *          particular the USB packet memory (PMA).
+  *
+  *          Interrupts raised by the models are latched in the NVIC pending
+  *          registers and dispatched by SIM_ServiceIRQs(), __WFI(), __WFE(),
+  *          __enable_irq() and SIM_AdvanceTime(). Handlers are bound by name
+  *          exactly like with the startup file (weak *_IRQHandler symbols).
+  *
+  *          DMA channels and the system bus use 32-bit addresses: programs
+  *          that hand buffers to a DMA channel must be linked with -no-pie so
+  *          that static data is located below 4 Gbytes.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F37X_SIM_H
+#define __STM32F37X_SIM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "stm32f37x.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  SPI slave device model: returns the byte shifted out on MISO while
+  *         Data is shifted in on MOSI.
+  */
+typedef uint8_t (*SIM_SPI_SlaveTypeDef)(uint8_t Data);
+
+/**
+  * @brief  SDADC analog source model: returns the next conversion result of
+  *         the given channel.
+  */
+typedef int16_t (*SIM_SDADC_SourceTypeDef)(uint32_t Channel);
+
+/**
+  * @brief  SD card model delays, in bytes on the bus (8 SPI clocks each)
+  */
+typedef struct
+{
+  uint32_t ReadAccess;       /*!< 0xFF bytes before the first block of a read   */
+  uint32_t ReadGap;          /*!< 0xFF bytes between the blocks of CMD18        */
+  uint32_t WriteBusy;        /*!< Busy bytes after a written block              */
+  uint32_t WriteBusyErased;  /*!< Busy bytes after a block pre-erased by ACMD23 */
+} SIM_SD_Timing_TypeDef;
+
+/**
+  * @brief  SD card model bus statistics
+  */
+typedef struct
+{
+  uint32_t Commands;       /*!< Commands received                        */
+  uint32_t BlocksRead;     /*!< Data blocks sent by the card             */
+  uint32_t BlocksWritten;  /*!< Data blocks programmed                   */
+  uint32_t Bytes;          /*!< Bytes clocked on the bus                 */
+  uint64_t BusTime;        /*!< Duration of these bytes at the SPI clock, in ns */
+} SIM_SD_Stats_TypeDef;
+
+/**
+  * @brief  NAND flash model statistics
+  */
+typedef struct
+{
+  uint32_t PagesRead;        /*!< Reads of the data area of a page          */
+  uint32_t SparesRead;       /*!< Reads of the spare area alone             */
+  uint32_t PagesProgrammed;  /*!< Programs of the data area of a page       */
+  uint32_t SparesProgrammed; /*!< Programs of the spare area alone          */
+  uint32_t BlocksErased;     /*!< Block erases                              */
+  uint32_t Overwrites;       /*!< Programs of a byte, other than 0xFF, that did not take its value */
+  uint32_t Lost;             /*!< Programs and erases dropped by a power cut */
+} SIM_NAND_Stats_TypeDef;
+
+/**
+  * @brief  Simulation statistics
+  */
+typedef struct
+{
+  uint32_t Reads;          /*!< Trapped register reads                   */
+  uint32_t Writes;         /*!< Trapped register writes                  */
+  uint32_t IRQs;           /*!< Interrupt handlers dispatched            */
+  uint32_t UnhandledIRQs;  /*!< Interrupts that reached the default handler */
+  uint32_t DMAItems;       /*!< Data items moved by the DMA controllers  */
+  uint32_t USARTTxBytes;   /*!< Bytes shifted out by all USARTs          */
+  uint32_t USARTRxBytes;   /*!< Bytes received by all USARTs             */
+  uint32_t USBFrames;      /*!< USB start of frames generated            */
+} SIM_Stats_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+/** @defgroup SIM_Memory
+  * @{
+  */
+#define SIM_FLASH_SIZE          ((uint32_t)0x00040000) /*!< STM32F372CC: 256 Kbytes */
+#define SIM_FLASH_PAGE_SIZE     ((uint32_t)0x00000800) /*!< 2 Kbytes erase pages   */
+/**
+  * @}
+  */
+
+/** @defgroup SIM_USART_Fifo
+  * @{
+  */
+#define SIM_USART_FIFO_SIZE     ((uint32_t)4096)       /*!< Wire buffer per direction */
+/**
+  * @}
+  */
+
+/** @defgroup SIM_NAND_Geometry
+  * @{
+  */
+#define SIM_NAND_PAGE_SIZE      ((uint32_t)512)        /*!< Data bytes per page        */
+#define SIM_NAND_SPARE_SIZE     ((uint32_t)16)         /*!< Spare bytes per page       */
+#define SIM_NAND_BLOCK_PAGES    ((uint32_t)32)         /*!< Pages per erase block      */
+#define SIM_NAND_MAX_BLOCKS     ((uint32_t)4096)       /*!< NAND128W3A: 128 Mbits      */
+#define SIM_NAND_BLOCK_BYTES    (SIM_NAND_BLOCK_PAGES * (SIM_NAND_PAGE_SIZE + SIM_NAND_SPARE_SIZE))
+/**
+  * @}
+  */
+
+/** @defgroup SIM_NAND_Status
+  * @{
+  */
+#define SIM_NAND_STATUS_FAIL    ((uint8_t)0x01)        /*!< Status register bit 0      */
+#define SIM_NAND_STATUS_READY   ((uint8_t)0x40)        /*!< Status register bit 6      */
+#define SIM_NAND_NO_POWER_CUT   ((uint32_t)0xFFFFFFFF)
+/**
+  * @}
+  */
+
+/** @defgroup SIM_USB_Handshake
+  * @{
+  */
+#define SIM_USB_NAK             ((int32_t)-1)
+#define SIM_USB_STALL           ((int32_t)-2)
+#define SIM_USB_DISABLED        ((int32_t)-3)
+/**
+  * @}
+  */
+
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+
+/* Simulator control **********************************************************/
+void     SIM_Init(void);
+void     SIM_Reset(void);
+void     SIM_AdvanceTime(uint32_t Microseconds);
+uint64_t SIM_GetTime(void);
+void     SIM_RaiseIRQ(IRQn_Type IRQn);
+void     SIM_ServiceIRQs(void);
+void     SIM_GetStats(SIM_Stats_TypeDef* SIM_Stats);
+void     SIM_ClearStats(void);
+void     SIM_InsnCountStart(void);
+uint64_t SIM_InsnCountStop(void);
+
+/* USART wire model ***********************************************************/
+uint32_t SIM_USART_Inject(USART_TypeDef* USARTx, const uint8_t* pData, uint32_t Length);
+uint32_t SIM_USART_Collect(USART_TypeDef* USARTx, uint8_t* pData, uint32_t Length);
+
+/* SPI slave model ************************************************************/
+void     SIM_SPI_AttachSlave(SPI_TypeDef* SPIx, SIM_SPI_SlaveTypeDef Slave);
+
+/* SD card model (SPI mode) ***************************************************/
+void     SIM_SD_Attach(SPI_TypeDef* SPIx, GPIO_TypeDef* CS_Port, uint16_t CS_Pin,
+                       uint8_t* pImage, uint32_t Blocks);
+void     SIM_SD_SetTiming(const SIM_SD_Timing_TypeDef* pTiming);
+void     SIM_SD_GetStats(SIM_SD_Stats_TypeDef* pStats);
+void     SIM_SD_ClearStats(void);
+
+/* NAND flash model *********************************************************/
+void     SIM_NAND_Attach(uint8_t* pImage, uint32_t Blocks);
+uint8_t  SIM_NAND_Read(uint32_t Row, uint32_t Column, uint8_t* pData, uint32_t Length);
+uint8_t  SIM_NAND_Program(uint32_t Row, uint32_t Column, const uint8_t* pData, uint32_t Length);
+uint8_t  SIM_NAND_Erase(uint32_t Row);
+void     SIM_NAND_PowerCut(uint32_t Operations);
+uint32_t SIM_NAND_GetEraseCount(uint32_t Block);
+void     SIM_NAND_GetStats(SIM_NAND_Stats_TypeDef* pStats);
+void     SIM_NAND_ClearStats(void);
+
+/* SDADC analog source model **************************************************/
+void     SIM_SDADC_SetSource(SDADC_TypeDef* SDADCx, SIM_SDADC_SourceTypeDef Source);
+
+/* EXTI line model ************************************************************/
+void     SIM_EXTI_Trigger(uint32_t EXTI_Line);
+
+/* USB host model *************************************************************/
+void     SIM_USB_BusReset(void);
+void     SIM_USB_Frame(void);
+int32_t  SIM_USB_HostSetup(const uint8_t* pSetup);
+int32_t  SIM_USB_HostOut(uint8_t bEpNum, const uint8_t* pData, uint16_t wLength);
+int32_t  SIM_USB_HostIn(uint8_t bEpNum, uint8_t* pData);
+
+/* USB driver event trace (USB_TRACE) *****************************************/
+void     SIM_USB_TraceReport(FILE* pFile);
+void     SIM_USB_TraceClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F37X_SIM_H */
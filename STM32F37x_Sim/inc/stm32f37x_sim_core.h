@@ -0,0 +1,325 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_core.h
+  * @brief   Host replacements for the CMSIS core intrinsics.
+  *          This file is force-included (-include) by the simulation build
+  *          before any CMSIS header. It claims the include guards of
+  *          core_cmInstr.h and core_cmFunc.h so that the ARM inline assembly
+  *          of these files is never seen by the host compiler, and provides
+  *          functionally equivalent C implementations instead.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F37X_SIM_CORE_H
+#define __STM32F37X_SIM_CORE_H
+
+#define __CORE_CMINSTR_H
+#define __CORE_CMFUNC_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+/** 
+  * @brief Simulated core special registers
+  */
+typedef struct
+{
+  uint32_t PRIMASK;
+  uint32_t FAULTMASK;
+  uint32_t BASEPRI;
+  uint32_t CONTROL;
+  uint32_t IPSR;
+  uint32_t PSP;
+  uint32_t MSP;
+  uint32_t FPSCR;
+} SIM_Core_TypeDef;
+
+/** 
+  * @brief Simulated local exclusive monitor (LDREX/STREX)
+  */
+typedef struct
+{
+  volatile void *Address;
+  uint32_t       Value;
+  uint32_t       Valid;
+} SIM_Monitor_TypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern SIM_Core_TypeDef    SIM_Core;
+extern SIM_Monitor_TypeDef SIM_Monitor;
+
+/* Exported functions --------------------------------------------------------*/
+void SIM_WaitForInterrupt(void);
+void SIM_ServiceIRQs(void);
+
+/* ########################## Core Instruction Access ######################### */
+
+static inline void __NOP(void)
+{
+}
+
+static inline void __WFI(void)
+{
+  SIM_WaitForInterrupt();
+}
+
+static inline void __WFE(void)
+{
+  SIM_WaitForInterrupt();
+}
+
+static inline void __SEV(void)
+{
+}
+
+static inline void __ISB(void)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __DSB(void)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __DMB(void)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t __REV(uint32_t value)
+{
+  return __builtin_bswap32(value);
+}
+
+static inline uint32_t __REV16(uint32_t value)
+{
+  return ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
+}
+
+static inline int32_t __REVSH(int32_t value)
+{
+  return (int32_t)(int16_t)__builtin_bswap16((uint16_t)value);
+}
+
+static inline uint32_t __ROR(uint32_t op1, uint32_t op2)
+{
+  op2 &= 31;
+  return (op2 == 0) ? op1 : ((op1 >> op2) | (op1 << (32 - op2)));
+}
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+  uint32_t result = 0;
+  uint32_t i;
+
+  for (i = 0; i < 32; i++)
+  {
+    result = (result << 1) | (value & 1);
+    value >>= 1;
+  }
+  return result;
+}
+
+static inline uint8_t __LDREXB(volatile uint8_t *addr)
+{
+  SIM_Monitor.Address = addr;
+  SIM_Monitor.Value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+  SIM_Monitor.Valid = 1;
+  return (uint8_t)SIM_Monitor.Value;
+}
+
+static inline uint16_t __LDREXH(volatile uint16_t *addr)
+{
+  SIM_Monitor.Address = addr;
+  SIM_Monitor.Value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+  SIM_Monitor.Valid = 1;
+  return (uint16_t)SIM_Monitor.Value;
+}
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr)
+{
+  SIM_Monitor.Address = addr;
+  SIM_Monitor.Value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+  SIM_Monitor.Valid = 1;
+  return SIM_Monitor.Value;
+}
+
+/* A STREX succeeds only if the monitor still holds the address and the
+   location was not modified in between, which is what an exception or a
+   competing writer would have caused on the target. */
+static inline uint32_t __STREXB(uint8_t value, volatile uint8_t *addr)
+{
+  uint8_t expected = (uint8_t)SIM_Monitor.Value;
+  uint32_t ok = SIM_Monitor.Valid && (SIM_Monitor.Address == addr) &&
+    __atomic_compare_exchange_n(addr, &expected, value, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  SIM_Monitor.Valid = 0;
+  return ok ? 0 : 1;
+}
+
+static inline uint32_t __STREXH(uint16_t value, volatile uint16_t *addr)
+{
+  uint16_t expected = (uint16_t)SIM_Monitor.Value;
+  uint32_t ok = SIM_Monitor.Valid && (SIM_Monitor.Address == addr) &&
+    __atomic_compare_exchange_n(addr, &expected, value, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  SIM_Monitor.Valid = 0;
+  return ok ? 0 : 1;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+  uint32_t expected = SIM_Monitor.Value;
+  uint32_t ok = SIM_Monitor.Valid && (SIM_Monitor.Address == addr) &&
+    __atomic_compare_exchange_n(addr, &expected, value, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  SIM_Monitor.Valid = 0;
+  return ok ? 0 : 1;
+}
+
+static inline void __CLREX(void)
+{
+  SIM_Monitor.Valid = 0;
+}
+
+#define __SSAT(ARG1,ARG2) \
+({                          \
+  int32_t __ARG1 = (int32_t)(ARG1); \
+  int32_t __MAX = (int32_t)((1UL << ((ARG2) - 1)) - 1); \
+  int32_t __MIN = -__MAX - 1; \
+  (uint32_t)((__ARG1 > __MAX) ? __MAX : ((__ARG1 < __MIN) ? __MIN : __ARG1)); \
+ })
+
+#define __USAT(ARG1,ARG2) \
+({                          \
+  int32_t __ARG1 = (int32_t)(ARG1); \
+  int32_t __MAX = (int32_t)((1UL << (ARG2)) - 1); \
+  (uint32_t)((__ARG1 > __MAX) ? __MAX : ((__ARG1 < 0) ? 0 : __ARG1)); \
+ })
+
+static inline uint8_t __CLZ(uint32_t value)
+{
+  return (value == 0) ? 32 : (uint8_t)__builtin_clz(value);
+}
+
+/* ########################### Core Function Access ########################### */
+
+static inline void __enable_irq(void)
+{
+  SIM_Core.PRIMASK = 0;
+  SIM_ServiceIRQs();
+}
+
+static inline void __disable_irq(void)
+{
+  SIM_Core.PRIMASK = 1;
+}
+
+static inline uint32_t __get_CONTROL(void)
+{
+  return SIM_Core.CONTROL;
+}
+
+static inline void __set_CONTROL(uint32_t control)
+{
+  SIM_Core.CONTROL = control;
+}
+
+static inline uint32_t __get_IPSR(void)
+{
+  return SIM_Core.IPSR;
+}
+
+static inline uint32_t __get_APSR(void)
+{
+  return 0;
+}
+
+static inline uint32_t __get_xPSR(void)
+{
+  return SIM_Core.IPSR;
+}
+
+static inline uint32_t __get_PSP(void)
+{
+  return SIM_Core.PSP;
+}
+
+static inline void __set_PSP(uint32_t topOfProcStack)
+{
+  SIM_Core.PSP = topOfProcStack;
+}
+
+static inline uint32_t __get_MSP(void)
+{
+  return SIM_Core.MSP;
+}
+
+static inline void __set_MSP(uint32_t topOfMainStack)
+{
+  SIM_Core.MSP = topOfMainStack;
+}
+
+static inline uint32_t __get_PRIMASK(void)
+{
+  return SIM_Core.PRIMASK;
+}
+
+static inline void __set_PRIMASK(uint32_t priMask)
+{
+  SIM_Core.PRIMASK = priMask & 1;
+  if (SIM_Core.PRIMASK == 0)
+  {
+    SIM_ServiceIRQs();
+  }
+}
+
+static inline void __enable_fault_irq(void)
+{
+  SIM_Core.FAULTMASK = 0;
+}
+
+static inline void __disable_fault_irq(void)
+{
+  SIM_Core.FAULTMASK = 1;
+}
+
+static inline uint32_t __get_BASEPRI(void)
+{
+  return SIM_Core.BASEPRI;
+}
+
+static inline void __set_BASEPRI(uint32_t value)
+{
+  SIM_Core.BASEPRI = value & 0xFF;
+}
+
+static inline uint32_t __get_FAULTMASK(void)
+{
+  return SIM_Core.FAULTMASK;
+}
+
+static inline void __set_FAULTMASK(uint32_t faultMask)
+{
+  SIM_Core.FAULTMASK = faultMask & 1;
+}
+
+static inline uint32_t __get_FPSCR(void)
+{
+  return SIM_Core.FPSCR;
+}
+
+static inline void __set_FPSCR(uint32_t fpscr)
+{
+  SIM_Core.FPSCR = fpscr;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F37X_SIM_CORE_H */
@@ -0,0 +1,36 @@
+/**
+  ******************************************************************************
+  * @file    usb_conf.h
+  * @brief   USB-FS device driver configuration of the simulation build.
+  *
+  *          The driver only takes IMR_MSK (USB_SIL_Init) and USB_TRACE from
+  *          this file. The endpoint and packet memory layout stay with the
+  *          application, which may change the interrupt mask at run time
+  *          through wInterrupt_Mask.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_CONF_H
+#define __USB_CONF_H
+
+/* Includes ------------------------------------------------------------------*/
+/* Exported types ------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+#define EP_NUM              (8)
+#define BTABLE_ADDRESS      (0x00)
+
+/* IMR_MSK */
+/* mask defining which events has to be handled */
+/* by the device application software */
+#define IMR_MSK (CNTR_CTRM  | CNTR_WKUPM | CNTR_SUSPM | CNTR_ERRM  | CNTR_SOFM \
+                 | CNTR_ESOFM | CNTR_RESETM )
+
+/* USB event trace, reported by SIM_USB_TraceReport() */
+#define USB_TRACE
+
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/* External variables --------------------------------------------------------*/
+
+#endif /* __USB_CONF_H */
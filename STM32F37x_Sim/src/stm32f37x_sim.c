@@ -0,0 +1,694 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim.c
+  * @brief   Simulator core: register file mapping, access trapping, NVIC
+  *          dispatch and simulated time.
+  *
+  *          Trapping works as follows: the pages covered by a behavioural
+  *          model are mapped PROT_NONE. A CPU access to one of them raises
+  *          SIGSEGV; the handler opens all model pages, runs the model
+  *          PreAccess hook and resumes the faulting instruction with the x86
+  *          trap flag set. The resulting SIGTRAP runs the PostAccess hook and
+  *          closes the pages again. Each register access is therefore seen
+  *          by its model exactly once, with its address, width and direction.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "stm32f37x_sim_int.h"
+
+#if !defined(__x86_64__) || !defined(__linux__)
+  #error "The STM32F37x simulation build supports x86-64 Linux hosts only"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Base;
+  uint32_t Size;
+  uint8_t  Fill;
+} SIM_Region_TypeDef;
+
+typedef struct
+{
+  uint32_t Base;
+  uint32_t Size;
+} SIM_Range_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_EFLAGS_TF        ((greg_t)0x100)  /* x86 single-step trap flag    */
+#define SIM_PF_WRITE         ((greg_t)0x002)  /* page fault error code: write */
+#define SIM_MAX_RANGES       32
+#define SIM_SYSTICK_VECTOR   0xFFFFFFFF
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_PAGE_FLOOR(a)    ((a) & ~(SIM_PAGE_SIZE - 1))
+#define SIM_PAGE_CEIL(a)     (((a) + SIM_PAGE_SIZE - 1) & ~(SIM_PAGE_SIZE - 1))
+
+/* Private variables ---------------------------------------------------------*/
+static const SIM_Region_TypeDef SIM_Regions[] =
+{
+  { FLASH_BASE,       SIM_FLASH_SIZE,  0xFF }, /* Main flash memory                   */
+  { 0x1FFFF000,       0x00001000,      0xFF }, /* System memory, UID and option bytes */
+  { APB1PERIPH_BASE,  0x0000A000,      0x00 }, /* APB1 peripherals, USB and PMA       */
+  { APB2PERIPH_BASE,  0x00007000,      0x00 }, /* APB2 peripherals                    */
+  { AHB1PERIPH_BASE,  0x00005000,      0x00 }, /* DMA, RCC, FLASH, CRC, TSC           */
+  { AHB2PERIPH_BASE,  0x00002000,      0x00 }, /* GPIOA..GPIOF                        */
+  { PERIPH_BB_BASE,   0x00600000,      0x00 }, /* Bit-band alias of APB1..AHB1        */
+  { 0xE0000000,       0x00100000,      0x00 }, /* Private peripheral bus              */
+};
+
+static SIM_Range_TypeDef  SIM_Ranges[SIM_MAX_RANGES];
+static uint32_t           SIM_RangeCount;
+static uint32_t           SIM_LockDepth;
+static uint32_t           SIM_Mapped;
+static SIM_Access_TypeDef SIM_Pending;
+static const SIM_Model_TypeDef* SIM_PendingModel;
+static uint32_t           SIM_PendingActive;
+static uint32_t           SIM_InHandler;
+static uint64_t           SIM_Time;
+static uint64_t           SIM_CycleOrigin;
+static volatile uint32_t  SIM_InsnState;   /* 0: off, 1: counting, 2: stopping */
+static volatile uint64_t  SIM_InsnCount;
+
+/* Exported variables --------------------------------------------------------*/
+SIM_Core_TypeDef    SIM_Core;
+SIM_Monitor_TypeDef SIM_Monitor;
+SIM_Stats_TypeDef   SIM_Statistics;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_Protect(int Prot);
+static const SIM_Model_TypeDef* SIM_FindModel(uint32_t Address);
+static uint32_t SIM_Trapped(uintptr_t Address);
+static uint8_t SIM_DecodeWidth(const uint8_t* pc);
+static void SIM_SegvHandler(int sig, siginfo_t* si, void* ctx);
+static void SIM_TrapHandler(int sig, siginfo_t* si, void* ctx);
+static uint32_t SIM_NextIRQ(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Maps the register file and installs the access trap handlers.
+  * @note   Must be called once before any peripheral access, typically as the
+  *         first statement of main(), before SystemInit().
+  * @param  None
+  * @retval None
+  */
+void SIM_Init(void)
+{
+  struct sigaction sa;
+  uint32_t i, j;
+
+  if (SIM_Mapped != 0)
+  {
+    SIM_Reset();
+    return;
+  }
+
+  for (i = 0; i < sizeof(SIM_Regions) / sizeof(SIM_Regions[0]); i++)
+  {
+    void* want = (void*)(uintptr_t)SIM_Regions[i].Base;
+    void* got = mmap(want, SIM_Regions[i].Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (got != want)
+    {
+      fprintf(stderr, "SIM: cannot map register file at 0x%08X\n", (unsigned)SIM_Regions[i].Base);
+      abort();
+    }
+  }
+
+  /* Coalesce the model address ranges into page ranges */
+  for (i = 0; i < SIM_ModelCount; i++)
+  {
+    uint32_t base = SIM_PAGE_FLOOR(SIM_Models[i].Base);
+    uint32_t end = SIM_PAGE_CEIL(SIM_Models[i].Base + SIM_Models[i].Size);
+
+    for (j = 0; j < SIM_RangeCount; j++)
+    {
+      if ((base <= SIM_Ranges[j].Base + SIM_Ranges[j].Size) && (end >= SIM_Ranges[j].Base))
+      {
+        uint32_t lo = (base < SIM_Ranges[j].Base) ? base : SIM_Ranges[j].Base;
+        uint32_t hi = (end > SIM_Ranges[j].Base + SIM_Ranges[j].Size) ? end : SIM_Ranges[j].Base + SIM_Ranges[j].Size;
+        SIM_Ranges[j].Base = lo;
+        SIM_Ranges[j].Size = hi - lo;
+        break;
+      }
+    }
+    if ((j == SIM_RangeCount) && (SIM_RangeCount < SIM_MAX_RANGES))
+    {
+      SIM_Ranges[SIM_RangeCount].Base = base;
+      SIM_Ranges[SIM_RangeCount].Size = end - base;
+      SIM_RangeCount++;
+    }
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_flags = SA_SIGINFO;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = SIM_SegvHandler;
+  sigaction(SIGSEGV, &sa, NULL);
+  sa.sa_sigaction = SIM_TrapHandler;
+  sigaction(SIGTRAP, &sa, NULL);
+
+  SIM_Mapped = 1;
+  SIM_LockDepth = 1;
+  SIM_Reset();
+  SIM_Lock();
+}
+
+/**
+  * @brief  Puts the register file and all models in their reset state.
+  * @param  None
+  * @retval None
+  */
+void SIM_Reset(void)
+{
+  uint32_t i;
+
+  SIM_Unlock();
+  for (i = 0; i < sizeof(SIM_Regions) / sizeof(SIM_Regions[0]); i++)
+  {
+    memset((void*)(uintptr_t)SIM_Regions[i].Base, SIM_Regions[i].Fill, SIM_Regions[i].Size);
+  }
+  memset(&SIM_Core, 0, sizeof(SIM_Core));
+  memset(&SIM_Monitor, 0, sizeof(SIM_Monitor));
+  memset(&SIM_Statistics, 0, sizeof(SIM_Statistics));
+  SIM_Time = 0;
+  SIM_CycleOrigin = 0;
+  SIM_ModelsReset();
+  SIM_USB_Reset();
+  SIM_Lock();
+}
+
+/**
+  * @brief  Closes the model pages (end of a model critical section).
+  * @param  None
+  * @retval None
+  */
+void SIM_Lock(void)
+{
+  if ((SIM_LockDepth != 0) && (--SIM_LockDepth == 0))
+  {
+    SIM_Protect(PROT_NONE);
+  }
+}
+
+/**
+  * @brief  Opens the model pages so that models can access the register file
+  *         without being trapped. Calls nest.
+  * @param  None
+  * @retval None
+  */
+void SIM_Unlock(void)
+{
+  if (SIM_LockDepth++ == 0)
+  {
+    SIM_Protect(PROT_READ | PROT_WRITE);
+  }
+}
+
+/**
+  * @brief  Returns the host time scaled to the simulated core clock.
+  * @param  None
+  * @retval Elapsed core cycles since SIM_Init().
+  */
+uint64_t SIM_GetCycles(void)
+{
+  struct timespec ts;
+  uint64_t ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  if (SIM_CycleOrigin == 0)
+  {
+    SIM_CycleOrigin = ns;
+  }
+  return ((ns - SIM_CycleOrigin) * SystemCoreClock) / 1000000000ULL;
+}
+
+/**
+  * @brief  Advances simulated time: SysTick counts down and the USB core
+  *         generates one start of frame per millisecond. Pending interrupts
+  *         are dispatched along the way.
+  * @param  Microseconds: time to advance.
+  * @retval None
+  */
+void SIM_AdvanceTime(uint32_t Microseconds)
+{
+  while (Microseconds != 0)
+  {
+    uint32_t step = 1000 - (uint32_t)(SIM_Time % 1000);
+
+    if (step > Microseconds)
+    {
+      step = Microseconds;
+    }
+    SIM_Time += step;
+    Microseconds -= step;
+
+    SIM_SysTickAdvance(step);
+    if ((SIM_Time % 1000) == 0)
+    {
+      SIM_USB_Frame();
+    }
+    SIM_ServiceIRQs();
+  }
+}
+
+/**
+  * @brief  Returns the simulated time.
+  * @param  None
+  * @retval Microseconds elapsed since the last reset.
+  */
+uint64_t SIM_GetTime(void)
+{
+  return SIM_Time;
+}
+
+/**
+  * @brief  Latches an interrupt in the NVIC pending register.
+  * @param  IRQn: interrupt number (device specific interrupts only).
+  * @retval None
+  */
+void SIM_RaiseIRQ(IRQn_Type IRQn)
+{
+  if ((int32_t)IRQn >= 0)
+  {
+    SIM_Unlock();
+    NVIC->ISPR[(uint32_t)IRQn >> 5] |= (uint32_t)1 << ((uint32_t)IRQn & 0x1F);
+    NVIC->ICPR[(uint32_t)IRQn >> 5] = NVIC->ISPR[(uint32_t)IRQn >> 5];
+    SIM_Lock();
+  }
+}
+
+/**
+  * @brief  Dispatches all pending and enabled interrupts, highest priority
+  *         first. Handlers do not nest.
+  * @param  None
+  * @retval None
+  */
+void SIM_ServiceIRQs(void)
+{
+  uint32_t irq;
+
+  if ((SIM_Mapped == 0) || (SIM_InHandler != 0))
+  {
+    return;
+  }
+  SIM_InHandler = 1;
+
+  while ((SIM_Core.PRIMASK == 0) && ((irq = SIM_NextIRQ()) != SIM_VectorCount))
+  {
+    SIM_Statistics.IRQs++;
+    if (irq == SIM_SYSTICK_VECTOR)
+    {
+      SIM_Core.IPSR = 15;
+      SysTick_Handler();
+    }
+    else
+    {
+      SIM_Core.IPSR = irq + 16;
+      SIM_Vectors[irq]();
+    }
+    SIM_Core.IPSR = 0;
+
+    /* Interrupt lines are level sensitive: re-evaluate them */
+    SIM_Unlock();
+    SIM_ModelsUpdate();
+    SIM_Lock();
+  }
+
+  SIM_InHandler = 0;
+}
+
+/**
+  * @brief  Implements __WFI()/__WFE(): dispatches pending interrupts or, when
+  *         there are none, lets simulated time run to the next millisecond.
+  * @param  None
+  * @retval None
+  */
+void SIM_WaitForInterrupt(void)
+{
+  uint32_t irqs = SIM_Statistics.IRQs;
+
+  SIM_ServiceIRQs();
+  if ((irqs == SIM_Statistics.IRQs) && (SIM_InHandler == 0))
+  {
+    SIM_AdvanceTime(1000 - (uint32_t)(SIM_Time % 1000));
+  }
+}
+
+/**
+  * @brief  Copies the simulation statistics.
+  * @param  SIM_Stats: pointer to the structure to fill.
+  * @retval None
+  */
+void SIM_GetStats(SIM_Stats_TypeDef* SIM_Stats)
+{
+  *SIM_Stats = SIM_Statistics;
+}
+
+/**
+  * @brief  Clears the simulation statistics.
+  * @param  None
+  * @retval None
+  */
+void SIM_ClearStats(void)
+{
+  memset(&SIM_Statistics, 0, sizeof(SIM_Statistics));
+}
+
+/**
+  * @brief  Starts counting the host instructions executed by the calling
+  *         code, by single-stepping it. The signal handlers, hence the
+  *         models, are not counted; a trapped register access counts as one
+  *         instruction. Slow: for short measured sections only.
+  * @param  None
+  * @retval None
+  */
+void SIM_InsnCountStart(void)
+{
+  SIM_InsnCount = 0;
+  SIM_InsnState = 1;
+  __asm__ volatile ("pushfq\n\torq $0x100, (%%rsp)\n\tpopfq" ::: "memory", "cc");
+}
+
+/**
+  * @brief  Stops the count started by SIM_InsnCountStart().
+  * @param  None
+  * @retval Host instructions executed since SIM_InsnCountStart().
+  */
+uint64_t SIM_InsnCountStop(void)
+{
+  /* The trap following this store clears the trap flag */
+  SIM_InsnState = 2;
+  return SIM_InsnCount;
+}
+
+/**
+  * @brief  Bit-band alias access, before the CPU access: presents the target
+  *         bit in the alias word.
+  * @param  Access: trapped access.
+  * @retval None
+  */
+void SIM_BitBandPreAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t offset = Access->Address - PERIPH_BB_BASE;
+  uint32_t target = PERIPH_BASE + ((offset >> 5) & ~(uint32_t)3);
+  uint32_t bit = (offset >> 2) & 0x1F;
+  const SIM_Model_TypeDef* model = SIM_FindModel(target);
+  SIM_Access_TypeDef access = { target, SIM_REG32(target), 4, 0 };
+
+  if ((model != NULL) && (model->PreAccess != NULL))
+  {
+    model->PreAccess(&access);
+  }
+  SIM_WORD(Access->Address) = (SIM_REG32(target) >> bit) & 1;
+  Access->Old = SIM_WORD(Access->Address);
+}
+
+/**
+  * @brief  Bit-band alias access, after the CPU access: a write to the alias
+  *         is turned into a read-modify-write of the target word, which its
+  *         model sees like any other write.
+  * @param  Access: trapped access.
+  * @retval None
+  */
+void SIM_BitBandPostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t offset = Access->Address - PERIPH_BB_BASE;
+  uint32_t target = PERIPH_BASE + ((offset >> 5) & ~(uint32_t)3);
+  uint32_t bit = (offset >> 2) & 0x1F;
+  const SIM_Model_TypeDef* model = SIM_FindModel(target);
+  SIM_Access_TypeDef access = { target, SIM_REG32(target), 4, 1 };
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if ((SIM_WORD(Access->Address) & 1) != 0)
+  {
+    SIM_REG32(target) = access.Old | ((uint32_t)1 << bit);
+  }
+  else
+  {
+    SIM_REG32(target) = access.Old & ~((uint32_t)1 << bit);
+  }
+  if ((model != NULL) && (model->PostAccess != NULL))
+  {
+    model->PostAccess(&access);
+  }
+}
+
+/**
+  * @brief  Changes the protection of all model pages.
+  * @param  Prot: mmap() protection flags.
+  * @retval None
+  */
+static void SIM_Protect(int Prot)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_RangeCount; i++)
+  {
+    mprotect((void*)(uintptr_t)SIM_Ranges[i].Base, SIM_Ranges[i].Size, Prot);
+  }
+}
+
+/**
+  * @brief  Looks up the model covering an address.
+  * @param  Address: register address.
+  * @retval Model or NULL.
+  */
+static const SIM_Model_TypeDef* SIM_FindModel(uint32_t Address)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_ModelCount; i++)
+  {
+    if ((Address >= SIM_Models[i].Base) && (Address - SIM_Models[i].Base < SIM_Models[i].Size))
+    {
+      return &SIM_Models[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Returns whether an address lies in a trapped page.
+  * @param  Address: faulting address.
+  * @retval Non-zero if trapped.
+  */
+static uint32_t SIM_Trapped(uintptr_t Address)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_RangeCount; i++)
+  {
+    if ((Address >= SIM_Ranges[i].Base) && (Address - SIM_Ranges[i].Base < SIM_Ranges[i].Size))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Returns the operand size of the x86-64 instruction at pc. Only
+  *         the instruction forms emitted for volatile register accesses are
+  *         recognised; anything else is assumed to be a 32-bit access.
+  * @param  pc: faulting instruction.
+  * @retval Access width in bytes.
+  */
+static uint8_t SIM_DecodeWidth(const uint8_t* pc)
+{
+  uint8_t width = 4;
+  uint8_t op;
+
+  for (;;)
+  {
+    op = *pc;
+    if (op == 0x66)
+    {
+      width = 2;
+    }
+    else if ((op & 0xF0) == 0x40)
+    {
+      if ((op & 0x08) != 0)
+      {
+        width = 8;
+      }
+    }
+    else if ((op != 0xF0) && (op != 0xF2) && (op != 0xF3) && (op != 0x2E) &&
+             (op != 0x3E) && (op != 0x26) && (op != 0x36) && (op != 0x64) && (op != 0x65) &&
+             (op != 0x67))
+    {
+      break;
+    }
+    pc++;
+  }
+
+  /* 8-bit ALU forms: ADD/OR/ADC/SBB/AND/SUB/XOR/CMP r/m8 */
+  if ((op < 0x40) && ((op & 0x07) <= 0x02) && ((op & 0x01) == 0))
+  {
+    return 1;
+  }
+  switch (op)
+  {
+    case 0x80: case 0x84: case 0x86: case 0x88: case 0x8A: case 0xC6: case 0xF6: case 0xFE:
+      return 1;
+    case 0x0F:
+      if ((pc[1] == 0xB6) || (pc[1] == 0xBE))
+      {
+        return 1;
+      }
+      if ((pc[1] == 0xB7) || (pc[1] == 0xBF))
+      {
+        return 2;
+      }
+      break;
+    default:
+      break;
+  }
+  return width;
+}
+
+/**
+  * @brief  First half of a trapped access: runs the PreAccess hook and
+  *         resumes the instruction in single-step mode.
+  * @param  sig, si, ctx: signal handler arguments.
+  * @retval None
+  */
+static void SIM_SegvHandler(int sig, siginfo_t* si, void* ctx)
+{
+  ucontext_t* uc = (ucontext_t*)ctx;
+  uintptr_t addr = (uintptr_t)si->si_addr;
+  const SIM_Model_TypeDef* model;
+
+  if ((SIM_PendingActive != 0) || (SIM_LockDepth != 0) || (SIM_Trapped(addr) == 0))
+  {
+    /* Not a register access: let the fault kill the process as usual */
+    signal(SIGSEGV, SIG_DFL);
+    return;
+  }
+
+  /* Unmodelled registers sharing a page with a model are only counted */
+  model = SIM_FindModel((uint32_t)addr);
+  SIM_Unlock();
+  SIM_Pending.Address = (uint32_t)addr;
+  SIM_Pending.Write = ((uc->uc_mcontext.gregs[REG_ERR] & SIM_PF_WRITE) != 0) ? 1 : 0;
+  SIM_Pending.Width = SIM_DecodeWidth((const uint8_t*)uc->uc_mcontext.gregs[REG_RIP]);
+  SIM_Pending.Old = SIM_WORD(addr);
+  SIM_PendingModel = model;
+  SIM_PendingActive = 1;
+
+  if (SIM_Pending.Write != 0)
+  {
+    SIM_Statistics.Writes++;
+  }
+  else
+  {
+    SIM_Statistics.Reads++;
+  }
+  if ((model != NULL) && (model->PreAccess != NULL))
+  {
+    model->PreAccess(&SIM_Pending);
+  }
+  uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+  (void)sig;
+}
+
+/**
+  * @brief  Second half of a trapped access: runs the PostAccess hook and
+  *         closes the model pages again.
+  * @param  sig, si, ctx: signal handler arguments.
+  * @retval None
+  */
+static void SIM_TrapHandler(int sig, siginfo_t* si, void* ctx)
+{
+  ucontext_t* uc = (ucontext_t*)ctx;
+
+  /* Instruction count: every instruction traps until the count is stopped */
+  if (SIM_InsnState == 1)
+  {
+    SIM_InsnCount++;
+  }
+  else
+  {
+    if ((SIM_InsnState == 0) && (SIM_PendingActive == 0))
+    {
+      signal(SIGTRAP, SIG_DFL);
+      return;
+    }
+    SIM_InsnState = 0;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+  }
+
+  if (SIM_PendingActive == 0)
+  {
+    return;
+  }
+
+  if ((SIM_PendingModel != NULL) && (SIM_PendingModel->PostAccess != NULL))
+  {
+    SIM_PendingModel->PostAccess(&SIM_Pending);
+  }
+  SIM_ModelsUpdate();
+  SIM_PendingActive = 0;
+  SIM_Lock();
+  (void)sig;
+  (void)si;
+}
+
+/**
+  * @brief  Selects the next interrupt to dispatch.
+  * @param  None
+  * @retval Device IRQ number, SIM_SYSTICK_VECTOR, or SIM_VectorCount if
+  *         nothing is pending.
+  */
+static uint32_t SIM_NextIRQ(void)
+{
+  uint32_t best = SIM_VectorCount;
+  uint32_t bestprio = 0x100;
+  uint32_t basepri = SIM_Core.BASEPRI ? SIM_Core.BASEPRI : 0x100;
+  uint32_t irq;
+
+  SIM_Unlock();
+  if (SIM_SysTickPending() != 0)
+  {
+    best = SIM_SYSTICK_VECTOR;
+    bestprio = SCB->SHP[11];
+  }
+  for (irq = 0; irq < SIM_VectorCount; irq++)
+  {
+    uint32_t mask = (uint32_t)1 << (irq & 0x1F);
+
+    if (((NVIC->ISPR[irq >> 5] & NVIC->ISER[irq >> 5] & mask) != 0) && (NVIC->IP[irq] < bestprio))
+    {
+      best = irq;
+      bestprio = NVIC->IP[irq];
+    }
+  }
+  if (bestprio >= basepri)
+  {
+    best = SIM_VectorCount;
+  }
+  else if (best == SIM_SYSTICK_VECTOR)
+  {
+    SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+  }
+  else if (best != SIM_VectorCount)
+  {
+    NVIC->ISPR[best >> 5] &= ~((uint32_t)1 << (best & 0x1F));
+    NVIC->ICPR[best >> 5] = NVIC->ISPR[best >> 5];
+  }
+  SIM_Lock();
+  return best;
+}
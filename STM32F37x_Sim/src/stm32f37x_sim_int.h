@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_int.h
+  * @brief   Definitions shared between the simulator core and the models.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F37X_SIM_INT_H
+#define __STM32F37X_SIM_INT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f37x_sim.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  One trapped CPU access
+  */
+typedef struct
+{
+  uint32_t Address;  /*!< Target address of the access                  */
+  uint32_t Old;      /*!< Aligned 32-bit word before the access          */
+  uint8_t  Width;    /*!< Access width in bytes                          */
+  uint8_t  Write;    /*!< 0: read, 1: write or read-modify-write         */
+} SIM_Access_TypeDef;
+
+/**
+  * @brief  Behavioural model bound to an address range
+  */
+typedef struct
+{
+  uint32_t Base;
+  uint32_t Size;
+  void (*PreAccess)(SIM_Access_TypeDef* Access);   /*!< Before the CPU access  */
+  void (*PostAccess)(SIM_Access_TypeDef* Access);  /*!< After the CPU access   */
+} SIM_Model_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+#define SIM_PAGE_SIZE       ((uint32_t)0x1000)
+#define SIM_USB_BASE        ((uint32_t)0x40005C00)  /*!< USB registers     */
+#define SIM_USB_PMA_BASE    ((uint32_t)0x40006000)  /*!< USB packet memory */
+
+/* Exported macro ------------------------------------------------------------*/
+#define SIM_REG32(addr)     (*(volatile uint32_t *)(uintptr_t)(addr))
+#define SIM_REG16(addr)     (*(volatile uint16_t *)(uintptr_t)(addr))
+#define SIM_REG8(addr)      (*(volatile uint8_t *)(uintptr_t)(addr))
+#define SIM_WORD(addr)      SIM_REG32((addr) & ~(uint32_t)3)
+
+/* Exported variables --------------------------------------------------------*/
+extern SIM_Stats_TypeDef        SIM_Statistics;
+extern const SIM_Model_TypeDef  SIM_Models[];
+extern const uint32_t           SIM_ModelCount;
+
+/* Exported functions ------------------------------------------------------- */
+/* stm32f37x_sim.c */
+void     SIM_Lock(void);
+void     SIM_Unlock(void);
+uint64_t SIM_GetCycles(void);
+void     SIM_BitBandPreAccess(SIM_Access_TypeDef* Access);
+void     SIM_BitBandPostAccess(SIM_Access_TypeDef* Access);
+
+/* stm32f37x_sim_models.c */
+void     SIM_ModelsReset(void);
+void     SIM_ModelsUpdate(void);
+void     SIM_SysTickAdvance(uint32_t Microseconds);
+uint32_t SIM_SysTickPending(void);
+
+/* stm32f37x_sim_usb.c */
+void     SIM_USB_Reset(void);
+void     SIM_USB_Update(void);
+void     SIM_USB_PostAccess(SIM_Access_TypeDef* Access);
+
+/* stm32f37x_sim_vectors.c */
+extern void (* const SIM_Vectors[])(void);
+extern const uint32_t SIM_VectorCount;
+void     SysTick_Handler(void);
+
+#endif /* __STM32F37X_SIM_INT_H */
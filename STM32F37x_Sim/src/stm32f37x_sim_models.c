@@ -0,0 +1,1426 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_models.c
+  * @brief   Behavioural models of the STM32F37x peripherals.
+  *
+  *          The models are functional, not timed: a byte written to a USART
+  *          TDR is on the wire as soon as the write completes, a DMA channel
+  *          moves every item its peripheral can supply or accept right away,
+  *          and conversions complete as soon as they are started. What they
+  *          reproduce faithfully is the register protocol: set/clear flags,
+  *          write-1-to-clear registers, read side effects and interrupt
+  *          requests.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "stm32f37x_sim_int.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  Data[SIM_USART_FIFO_SIZE];
+  uint32_t Head;
+  uint32_t Tail;
+} SIM_Fifo_TypeDef;
+
+typedef struct
+{
+  USART_TypeDef*    USARTx;
+  IRQn_Type         IRQn;
+  SIM_Fifo_TypeDef  Rx;        /*!< Wire to RDR  */
+  SIM_Fifo_TypeDef  Tx;        /*!< TDR to wire  */
+  uint32_t          Burst;     /*!< Bytes received since the line was last idle */
+} SIM_USART_TypeDef;
+
+typedef struct
+{
+  SPI_TypeDef*          SPIx;
+  IRQn_Type             IRQn;
+  SIM_SPI_SlaveTypeDef  Slave;
+  uint8_t               Fifo[4];
+  uint32_t              Level;
+} SIM_SPI_TypeDef;
+
+typedef struct
+{
+  DMA_TypeDef*          DMAx;
+  DMA_Channel_TypeDef*  Channel;
+  uint32_t              Index;     /*!< Channel index within its controller */
+  IRQn_Type             IRQn;
+  uint32_t              Reload;    /*!< CNDTR value programmed at enable    */
+} SIM_DMA_TypeDef;
+
+typedef struct
+{
+  SDADC_TypeDef*           SDADCx;
+  IRQn_Type                IRQn;
+  SIM_SDADC_SourceTypeDef  Source;
+  uint32_t                 Injected;  /*!< Next channel of the injected group */
+  int16_t                  Ramp;
+} SIM_SDADC_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_USART_ICR_MASK   ((uint32_t)0x00121B5F)
+#define SIM_SDADC_ICR_MASK   (SDADC_ISR_CLREOCALF | SDADC_ISR_CLRJOVRF | SDADC_ISR_CLRROVRF)
+#define SIM_SPI_FIFO_SIZE    4
+#define SIM_FLASH_KEY1       ((uint32_t)0x45670123)
+#define SIM_FLASH_KEY2       ((uint32_t)0xCDEF89AB)
+#define SIM_SYSTICK_OFFSET   (SysTick_BASE - SCS_BASE)
+#define SIM_NVIC_OFFSET      (NVIC_BASE - SCS_BASE)
+#define SIM_SCB_OFFSET       (SCB_BASE - SCS_BASE)
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_COUNT(a)         (sizeof(a) / sizeof((a)[0]))
+#define SIM_OFFSET(p, reg)   ((uint32_t)(uintptr_t)&(p)->reg - (uint32_t)(uintptr_t)(p))
+
+/* Private variables ---------------------------------------------------------*/
+static SIM_USART_TypeDef SIM_USART[] =
+{
+  { USART1, USART1_IRQn },
+  { USART2, USART2_IRQn },
+  { USART3, USART3_IRQn },
+};
+
+static SIM_SPI_TypeDef SIM_SPI[] =
+{
+  { SPI1, SPI1_IRQn },
+  { SPI2, SPI2_IRQn },
+  { SPI3, SPI3_IRQn },
+};
+
+static SIM_DMA_TypeDef SIM_DMA[] =
+{
+  { DMA1, DMA1_Channel1, 0, DMA1_Channel1_IRQn },
+  { DMA1, DMA1_Channel2, 1, DMA1_Channel2_IRQn },
+  { DMA1, DMA1_Channel3, 2, DMA1_Channel3_IRQn },
+  { DMA1, DMA1_Channel4, 3, DMA1_Channel4_IRQn },
+  { DMA1, DMA1_Channel5, 4, DMA1_Channel5_IRQn },
+  { DMA1, DMA1_Channel6, 5, DMA1_Channel6_IRQn },
+  { DMA1, DMA1_Channel7, 6, DMA1_Channel7_IRQn },
+  { DMA2, DMA2_Channel1, 0, DMA2_Channel1_IRQn },
+  { DMA2, DMA2_Channel2, 1, DMA2_Channel2_IRQn },
+  { DMA2, DMA2_Channel3, 2, DMA2_Channel3_IRQn },
+  { DMA2, DMA2_Channel4, 3, DMA2_Channel4_IRQn },
+  { DMA2, DMA2_Channel5, 4, DMA2_Channel5_IRQn },
+};
+
+static SIM_SDADC_TypeDef SIM_SDADC[] =
+{
+  { SDADC1, SDADC1_IRQn },
+  { SDADC2, SDADC2_IRQn },
+  { SDADC3, SDADC3_IRQn },
+};
+
+static uint32_t SIM_CRCState;
+static uint32_t SIM_FlashKeyState;
+static uint32_t SIM_FlashOptKeyState;
+static uint32_t SIM_SysTickRemainder;
+static uint32_t SIM_CycleOffset;
+static uint32_t SIM_DMABusy;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_USART_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_SPI_PreAccess(SIM_Access_TypeDef* Access);
+static void SIM_SPI_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_SDADC_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_DMA_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_RCC_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_FLASH_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_CRC_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_GPIO_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_EXTI_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_DWT_PreAccess(SIM_Access_TypeDef* Access);
+static void SIM_DWT_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_SCS_PostAccess(SIM_Access_TypeDef* Access);
+static void SIM_DMA_Service(void);
+
+/* Model table ---------------------------------------------------------------*/
+const SIM_Model_TypeDef SIM_Models[] =
+{
+  { SPI2_BASE,       0x00000800, SIM_SPI_PreAccess,     SIM_SPI_PostAccess    }, /* SPI2, SPI3     */
+  { USART2_BASE,     0x00000800, NULL,                  SIM_USART_PostAccess  }, /* USART2, USART3 */
+  { SIM_USB_BASE,    0x00000400, NULL,                  SIM_USB_PostAccess    },
+  { EXTI_BASE,       0x00000400, NULL,                  SIM_EXTI_PostAccess   },
+  { SPI1_BASE,       0x00000400, SIM_SPI_PreAccess,     SIM_SPI_PostAccess    },
+  { USART1_BASE,     0x00000400, NULL,                  SIM_USART_PostAccess  },
+  { SDADC1_BASE,     0x00000C00, NULL,                  SIM_SDADC_PostAccess  }, /* SDADC1..3      */
+  { DMA1_BASE,       0x00000800, NULL,                  SIM_DMA_PostAccess    }, /* DMA1, DMA2     */
+  { RCC_BASE,        0x00000400, NULL,                  SIM_RCC_PostAccess    },
+  { FLASH_R_BASE,    0x00000400, NULL,                  SIM_FLASH_PostAccess  },
+  { CRC_BASE,        0x00000400, NULL,                  SIM_CRC_PostAccess    },
+  { GPIOA_BASE,      0x00001800, NULL,                  SIM_GPIO_PostAccess   }, /* GPIOA..GPIOF   */
+  { PERIPH_BB_BASE,  0x00600000, SIM_BitBandPreAccess,  SIM_BitBandPostAccess },
+  { DWT_BASE,        0x00001000, SIM_DWT_PreAccess,     SIM_DWT_PostAccess    },
+  { SCS_BASE,        0x00001000, NULL,                  SIM_SCS_PostAccess    }, /* NVIC, SysTick, SCB */
+};
+const uint32_t SIM_ModelCount = SIM_COUNT(SIM_Models);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Loads the reset values of the modelled registers.
+  * @note   Called with the model pages open.
+  * @param  None
+  * @retval None
+  */
+void SIM_ModelsReset(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_COUNT(SIM_USART); i++)
+  {
+    memset(&SIM_USART[i].Rx, 0, sizeof(SIM_USART[i].Rx));
+    memset(&SIM_USART[i].Tx, 0, sizeof(SIM_USART[i].Tx));
+    SIM_USART[i].Burst = 0;
+    SIM_USART[i].USARTx->ISR = USART_ISR_TXE | USART_ISR_TC;
+  }
+  for (i = 0; i < SIM_COUNT(SIM_SPI); i++)
+  {
+    SIM_SPI[i].Level = 0;
+    SIM_SPI[i].SPIx->CR2 = 0x0700;
+    SIM_SPI[i].SPIx->SR = SPI_SR_TXE;
+  }
+  for (i = 0; i < SIM_COUNT(SIM_DMA); i++)
+  {
+    SIM_DMA[i].Reload = 0;
+  }
+  for (i = 0; i < SIM_COUNT(SIM_SDADC); i++)
+  {
+    SIM_SDADC[i].Injected = 0;
+    SIM_SDADC[i].Ramp = 0;
+  }
+
+  RCC->CR = 0x00000080 | RCC_CR_HSION | RCC_CR_HSIRDY;
+  RCC->CSR = 0x0C000000;
+  FLASH->CR = FLASH_CR_LOCK;
+  FLASH->WRPR = 0xFFFFFFFF;
+  OB->RDP = 0x55AA;
+  OB->USER = 0x00FF;
+  CRC->DR = 0xFFFFFFFF;
+  CRC->INIT = 0xFFFFFFFF;
+  CRC->POL = 0x04C11DB7;
+  SIM_CRCState = 0xFFFFFFFF;
+  SIM_FlashKeyState = 0;
+  SIM_FlashOptKeyState = 0;
+
+  GPIOA->MODER = 0x28000000;
+  GPIOB->MODER = 0x00000280;
+  GPIOA->PUPDR = 0x24000000;
+  GPIOB->OSPEEDR = 0x000000C0;
+
+  DBGMCU->IDCODE = 0x20006432;
+  SIM_REG32(&SCB->CPUID) = 0x410FC241;
+  SIM_REG32(&SysTick->CALIB) = 0x00002328;
+  *(__IO uint32_t*)0x1FFFF7AC = 0x00380028;   /* Unique device ID */
+  *(__IO uint32_t*)0x1FFFF7B0 = 0x3035470A;
+  *(__IO uint32_t*)0x1FFFF7B4 = 0x20383950;
+  *(__IO uint16_t*)0x1FFFF7CC = 0x0100;       /* Flash size: 256 Kbytes */
+
+  SIM_SysTickRemainder = 0;
+  SIM_CycleOffset = 0;
+  SIM_DMABusy = 0;
+}
+
+/**
+  * @brief  Re-evaluates the level sensitive interrupt request lines and the
+  *         DMA requests of all models.
+  * @note   Called with the model pages open.
+  * @param  None
+  * @retval None
+  */
+void SIM_ModelsUpdate(void)
+{
+  uint32_t i, isr, cr;
+
+  SIM_DMA_Service();
+
+  for (i = 0; i < SIM_COUNT(SIM_USART); i++)
+  {
+    USART_TypeDef* u = SIM_USART[i].USARTx;
+    isr = u->ISR;
+    cr = u->CR1;
+    if ((((cr & USART_CR1_RXNEIE) != 0) && ((isr & (USART_ISR_RXNE | USART_ISR_ORE)) != 0)) ||
+        (((cr & USART_CR1_TCIE) != 0) && ((isr & USART_ISR_TC) != 0)) ||
+        (((cr & USART_CR1_TXEIE) != 0) && ((isr & USART_ISR_TXE) != 0)) ||
+        (((cr & USART_CR1_IDLEIE) != 0) && ((isr & USART_ISR_IDLE) != 0)) ||
+        (((cr & USART_CR1_RTOIE) != 0) && ((isr & USART_ISR_RTOF) != 0)))
+    {
+      SIM_RaiseIRQ(SIM_USART[i].IRQn);
+    }
+  }
+
+  for (i = 0; i < SIM_COUNT(SIM_SPI); i++)
+  {
+    SPI_TypeDef* s = SIM_SPI[i].SPIx;
+    if ((((s->CR2 & SPI_CR2_RXNEIE) != 0) && ((s->SR & SPI_SR_RXNE) != 0)) ||
+        (((s->CR2 & SPI_CR2_TXEIE) != 0) && ((s->SR & SPI_SR_TXE) != 0)))
+    {
+      SIM_RaiseIRQ(SIM_SPI[i].IRQn);
+    }
+  }
+
+  for (i = 0; i < SIM_COUNT(SIM_DMA); i++)
+  {
+    isr = SIM_DMA[i].DMAx->ISR >> (SIM_DMA[i].Index * 4);
+    cr = SIM_DMA[i].Channel->CCR;
+    if ((isr & cr & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE)) != 0)
+    {
+      SIM_RaiseIRQ(SIM_DMA[i].IRQn);
+    }
+  }
+
+  for (i = 0; i < SIM_COUNT(SIM_SDADC); i++)
+  {
+    SDADC_TypeDef* a = SIM_SDADC[i].SDADCx;
+    isr = a->ISR;
+    cr = a->CR1;
+    if ((((cr & SDADC_CR1_EOCALIE) != 0) && ((isr & SDADC_ISR_EOCALF) != 0)) ||
+        (((cr & SDADC_CR1_JEOCIE) != 0) && ((isr & SDADC_ISR_JEOCF) != 0)) ||
+        (((cr & SDADC_CR1_REOCIE) != 0) && ((isr & SDADC_ISR_REOCF) != 0)))
+    {
+      SIM_RaiseIRQ(SIM_SDADC[i].IRQn);
+    }
+  }
+
+  isr = EXTI->PR & EXTI->IMR;
+  if ((isr & 0x0001) != 0) SIM_RaiseIRQ(EXTI0_IRQn);
+  if ((isr & 0x0002) != 0) SIM_RaiseIRQ(EXTI1_IRQn);
+  if ((isr & 0x0004) != 0) SIM_RaiseIRQ(EXTI2_TS_IRQn);
+  if ((isr & 0x0008) != 0) SIM_RaiseIRQ(EXTI3_IRQn);
+  if ((isr & 0x0010) != 0) SIM_RaiseIRQ(EXTI4_IRQn);
+  if ((isr & 0x03E0) != 0) SIM_RaiseIRQ(EXTI9_5_IRQn);
+  if ((isr & 0xFC00) != 0) SIM_RaiseIRQ(EXTI15_10_IRQn);
+
+  SIM_USB_Update();
+}
+
+/* FIFO helpers ***************************************************************/
+
+static uint32_t SIM_FifoLevel(const SIM_Fifo_TypeDef* f)
+{
+  return f->Head - f->Tail;
+}
+
+static uint32_t SIM_FifoPush(SIM_Fifo_TypeDef* f, uint8_t Data)
+{
+  if (SIM_FifoLevel(f) >= SIM_USART_FIFO_SIZE)
+  {
+    return 0;
+  }
+  f->Data[f->Head++ % SIM_USART_FIFO_SIZE] = Data;
+  return 1;
+}
+
+static uint8_t SIM_FifoPop(SIM_Fifo_TypeDef* f)
+{
+  return f->Data[f->Tail++ % SIM_USART_FIFO_SIZE];
+}
+
+/* USART **********************************************************************/
+
+static SIM_USART_TypeDef* SIM_USART_Find(uint32_t Address)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_COUNT(SIM_USART); i++)
+  {
+    uint32_t base = (uint32_t)(uintptr_t)SIM_USART[i].USARTx;
+    if ((Address >= base) && (Address < base + sizeof(USART_TypeDef)))
+    {
+      return &SIM_USART[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Moves the next byte from the wire into RDR if RDR is free.
+  */
+static void SIM_USART_Load(SIM_USART_TypeDef* u)
+{
+  if (((u->USARTx->ISR & USART_ISR_RXNE) == 0) && (SIM_FifoLevel(&u->Rx) != 0))
+  {
+    u->USARTx->RDR = SIM_FifoPop(&u->Rx);
+    u->USARTx->ISR |= USART_ISR_RXNE;
+    u->Burst++;
+  }
+}
+
+/**
+  * @brief  RDR has been read (by the CPU or a DMA channel).
+  */
+static void SIM_USART_Consume(SIM_USART_TypeDef* u)
+{
+  u->USARTx->ISR &= ~USART_ISR_RXNE;
+  SIM_USART_Load(u);
+  if (((u->USARTx->ISR & USART_ISR_RXNE) == 0) && (u->Burst != 0))
+  {
+    /* End of burst: the line goes idle and the receiver times out */
+    u->Burst = 0;
+    u->USARTx->ISR |= USART_ISR_IDLE;
+    if ((u->USARTx->CR2 & USART_CR2_RTOEN) != 0)
+    {
+      u->USARTx->ISR |= USART_ISR_RTOF;
+    }
+  }
+}
+
+/**
+  * @brief  TDR has been written (by the CPU or a DMA channel).
+  */
+static void SIM_USART_Transmit(SIM_USART_TypeDef* u, uint16_t Data)
+{
+  if ((u->USARTx->CR1 & (USART_CR1_UE | USART_CR1_TE)) == (USART_CR1_UE | USART_CR1_TE))
+  {
+    if (SIM_FifoPush(&u->Tx, (uint8_t)Data) != 0)
+    {
+      SIM_Statistics.USARTTxBytes++;
+    }
+  }
+  u->USARTx->ISR |= USART_ISR_TXE | USART_ISR_TC;
+}
+
+static void SIM_USART_PostAccess(SIM_Access_TypeDef* Access)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find(Access->Address);
+  USART_TypeDef* r;
+  uint32_t offset;
+
+  if (u == NULL)
+  {
+    return;
+  }
+  r = u->USARTx;
+  offset = (Access->Address & ~(uint32_t)3) - (uint32_t)(uintptr_t)r;
+
+  if (Access->Write == 0)
+  {
+    if (offset == SIM_OFFSET(r, RDR))
+    {
+      SIM_USART_Consume(u);
+    }
+    return;
+  }
+
+  if (offset == SIM_OFFSET(r, CR1))
+  {
+    r->ISR = (r->ISR & ~(USART_ISR_TEACK | USART_ISR_REACK)) |
+             (((r->CR1 & USART_CR1_TE) != 0) ? USART_ISR_TEACK : 0) |
+             (((r->CR1 & USART_CR1_RE) != 0) ? USART_ISR_REACK : 0);
+  }
+  else if (offset == SIM_OFFSET(r, RQR))
+  {
+    if ((r->RQR & USART_RQR_RXFRQ) != 0)
+    {
+      SIM_USART_Consume(u);
+    }
+    r->RQR = 0;
+  }
+  else if (offset == SIM_OFFSET(r, ISR))
+  {
+    SIM_WORD(Access->Address) = Access->Old;
+  }
+  else if (offset == SIM_OFFSET(r, ICR))
+  {
+    r->ISR &= ~(r->ICR & SIM_USART_ICR_MASK);
+    r->ICR = 0;
+  }
+  else if (offset == SIM_OFFSET(r, RDR))
+  {
+    SIM_WORD(Access->Address) = Access->Old;
+  }
+  else if (offset == SIM_OFFSET(r, TDR))
+  {
+    SIM_USART_Transmit(u, r->TDR);
+  }
+}
+
+/**
+  * @brief  Puts bytes on the RX wire of a USART.
+  * @param  USARTx: USART1, USART2 or USART3.
+  * @param  pData: bytes to receive.
+  * @param  Length: number of bytes.
+  * @retval Number of bytes accepted: the receiver must be enabled, and the
+  *         wire buffer holds SIM_USART_FIFO_SIZE bytes.
+  */
+uint32_t SIM_USART_Inject(USART_TypeDef* USARTx, const uint8_t* pData, uint32_t Length)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find((uint32_t)(uintptr_t)USARTx);
+  uint32_t n = 0;
+
+  if (u == NULL)
+  {
+    return 0;
+  }
+  SIM_Unlock();
+  if ((USARTx->CR1 & (USART_CR1_UE | USART_CR1_RE)) == (USART_CR1_UE | USART_CR1_RE))
+  {
+    while ((n < Length) && (SIM_FifoPush(&u->Rx, pData[n]) != 0))
+    {
+      n++;
+    }
+    SIM_Statistics.USARTRxBytes += n;
+    SIM_USART_Load(u);
+    SIM_ModelsUpdate();
+  }
+  SIM_Lock();
+  return n;
+}
+
+/**
+  * @brief  Takes the bytes transmitted by a USART off its TX wire.
+  * @param  USARTx: USART1, USART2 or USART3.
+  * @param  pData: destination buffer.
+  * @param  Length: size of the destination buffer.
+  * @retval Number of bytes copied.
+  */
+uint32_t SIM_USART_Collect(USART_TypeDef* USARTx, uint8_t* pData, uint32_t Length)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find((uint32_t)(uintptr_t)USARTx);
+  uint32_t n = 0;
+
+  if (u == NULL)
+  {
+    return 0;
+  }
+  while ((n < Length) && (SIM_FifoLevel(&u->Tx) != 0))
+  {
+    pData[n++] = SIM_FifoPop(&u->Tx);
+  }
+  return n;
+}
+
+/* SPI ************************************************************************/
+
+static SIM_SPI_TypeDef* SIM_SPI_Find(uint32_t Address)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_COUNT(SIM_SPI); i++)
+  {
+    uint32_t base = (uint32_t)(uintptr_t)SIM_SPI[i].SPIx;
+    if ((Address >= base) && (Address < base + sizeof(SPI_TypeDef)))
+    {
+      return &SIM_SPI[i];
+    }
+  }
+  return NULL;
+}
+
+static void SIM_SPI_Status(SIM_SPI_TypeDef* s)
+{
+  uint16_t sr = s->SPIx->SR & ~(SPI_SR_RXNE | SPI_SR_FRLVL);
+
+  if (s->Level != 0)
+  {
+    sr |= SPI_SR_RXNE;
+  }
+  sr |= (uint16_t)(((s->Level > 3) ? 3 : s->Level) << 9);
+  s->SPIx->SR = sr | SPI_SR_TXE;
+}
+
+/**
+  * @brief  Shifts one byte through the slave into the RX FIFO.
+  */
+static void SIM_SPI_Shift(SIM_SPI_TypeDef* s, uint8_t Data)
+{
+  uint8_t miso = (s->Slave != NULL) ? s->Slave(Data) : 0xFF;
+
+  if (s->Level < SIM_SPI_FIFO_SIZE)
+  {
+    s->Fifo[s->Level++] = miso;
+  }
+  else
+  {
+    s->SPIx->SR |= SPI_SR_OVR;
+  }
+  SIM_SPI_Status(s);
+}
+
+static uint8_t SIM_SPI_Pop(SIM_SPI_TypeDef* s)
+{
+  uint8_t data = 0;
+
+  if (s->Level != 0)
+  {
+    data = s->Fifo[0];
+    memmove(&s->Fifo[0], &s->Fifo[1], --s->Level);
+  }
+  SIM_SPI_Status(s);
+  return data;
+}
+
+static void SIM_SPI_PreAccess(SIM_Access_TypeDef* Access)
+{
+  SIM_SPI_TypeDef* s = SIM_SPI_Find(Access->Address);
+
+  if ((s == NULL) || (Access->Write != 0) ||
+      ((Access->Address & ~(uint32_t)3) != (uint32_t)(uintptr_t)&s->SPIx->DR))
+  {
+    return;
+  }
+  /* A data register read pops one byte, or two with a 16-bit access */
+  if (Access->Width == 1)
+  {
+    *(__IO uint8_t*)&s->SPIx->DR = SIM_SPI_Pop(s);
+  }
+  else
+  {
+    uint16_t lo = SIM_SPI_Pop(s);
+    s->SPIx->DR = (uint16_t)(lo | (SIM_SPI_Pop(s) << 8));
+  }
+}
+
+static void SIM_SPI_PostAccess(SIM_Access_TypeDef* Access)
+{
+  SIM_SPI_TypeDef* s = SIM_SPI_Find(Access->Address);
+  uint32_t offset;
+
+  if ((s == NULL) || (Access->Write == 0))
+  {
+    return;
+  }
+  offset = (Access->Address & ~(uint32_t)3) - (uint32_t)(uintptr_t)s->SPIx;
+
+  if (offset == SIM_OFFSET(s->SPIx, DR))
+  {
+    uint16_t data = s->SPIx->DR;
+    SIM_SPI_Shift(s, (uint8_t)data);
+    if (Access->Width != 1)
+    {
+      SIM_SPI_Shift(s, (uint8_t)(data >> 8));
+    }
+  }
+  else if (offset == SIM_OFFSET(s->SPIx, SR))
+  {
+    /* Only CRCERR is writable (clear by writing 0) */
+    s->SPIx->SR = (uint16_t)((Access->Old & ~0x0010) | (Access->Old & s->SPIx->SR & 0x0010));
+  }
+}
+
+/**
+  * @brief  Connects a slave device model to an SPI bus.
+  * @param  SPIx: SPI1, SPI2 or SPI3.
+  * @param  Slave: slave model, or NULL to leave MISO high.
+  * @retval None
+  */
+void SIM_SPI_AttachSlave(SPI_TypeDef* SPIx, SIM_SPI_SlaveTypeDef Slave)
+{
+  SIM_SPI_TypeDef* s = SIM_SPI_Find((uint32_t)(uintptr_t)SPIx);
+
+  if (s != NULL)
+  {
+    s->Slave = Slave;
+  }
+}
+
+/* DMA ************************************************************************/
+
+/**
+  * @brief  Returns whether the peripheral behind a DMA address can supply
+  *         (Read != 0) or accept one more data item.
+  */
+static uint32_t SIM_DMA_Ready(uint32_t Address, uint32_t Read)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find(Address);
+  SIM_SPI_TypeDef* s = SIM_SPI_Find(Address);
+
+  if (u != NULL)
+  {
+    if (Read != 0)
+    {
+      return ((u->USARTx->CR3 & USART_CR3_DMAR) != 0) && ((u->USARTx->ISR & USART_ISR_RXNE) != 0);
+    }
+    return (u->USARTx->CR3 & USART_CR3_DMAT) != 0;
+  }
+  if (s != NULL)
+  {
+    if (Read != 0)
+    {
+      return ((s->SPIx->CR2 & SPI_CR2_RXDMAEN) != 0) && (s->Level != 0);
+    }
+    return ((s->SPIx->CR2 & SPI_CR2_TXDMAEN) != 0) &&
+           (((s->SPIx->CR2 & SPI_CR2_RXDMAEN) == 0) || (s->Level < SIM_SPI_FIFO_SIZE));
+  }
+  /* Memory and unmodelled peripherals are always ready */
+  return 1;
+}
+
+static uint32_t SIM_DMA_Read(uint32_t Address, uint32_t Size)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find(Address);
+  SIM_SPI_TypeDef* s = SIM_SPI_Find(Address);
+  uint32_t data;
+
+  if (u != NULL)
+  {
+    data = u->USARTx->RDR;
+    SIM_USART_Consume(u);
+    return data;
+  }
+  if (s != NULL)
+  {
+    return SIM_SPI_Pop(s);
+  }
+  switch (Size)
+  {
+    case 1:  return SIM_REG8(Address);
+    case 2:  return SIM_REG16(Address);
+    default: return SIM_REG32(Address);
+  }
+}
+
+static void SIM_DMA_Write(uint32_t Address, uint32_t Size, uint32_t Data)
+{
+  SIM_USART_TypeDef* u = SIM_USART_Find(Address);
+  SIM_SPI_TypeDef* s = SIM_SPI_Find(Address);
+
+  if (u != NULL)
+  {
+    u->USARTx->TDR = (uint16_t)Data;
+    SIM_USART_Transmit(u, (uint16_t)Data);
+    return;
+  }
+  if (s != NULL)
+  {
+    SIM_SPI_Shift(s, (uint8_t)Data);
+    return;
+  }
+  switch (Size)
+  {
+    case 1:  SIM_REG8(Address) = (uint8_t)Data;   break;
+    case 2:  SIM_REG16(Address) = (uint16_t)Data; break;
+    default: SIM_REG32(Address) = Data;           break;
+  }
+}
+
+/**
+  * @brief  Runs every enabled channel as far as its peripheral allows. A
+  *         circular channel runs at most one lap per call.
+  */
+static void SIM_DMA_Service(void)
+{
+  uint32_t progress, i;
+
+  if (SIM_DMABusy != 0)
+  {
+    return;
+  }
+  SIM_DMABusy = 1;
+
+  do
+  {
+    progress = 0;
+    for (i = 0; i < SIM_COUNT(SIM_DMA); i++)
+    {
+      SIM_DMA_TypeDef* d = &SIM_DMA[i];
+      DMA_Channel_TypeDef* ch = d->Channel;
+      uint32_t ccr = ch->CCR;
+      uint32_t psize = 1U << ((ccr & DMA_CCR_PSIZE) >> 8);
+      uint32_t msize = 1U << ((ccr & DMA_CCR_MSIZE) >> 10);
+      uint32_t flags = 0;
+      uint32_t moved = 0;
+
+      if (((ccr & DMA_CCR_EN) == 0) || (d->Reload == 0))
+      {
+        continue;
+      }
+      while ((ch->CNDTR & 0xFFFF) != 0)
+      {
+        uint32_t idx = d->Reload - (ch->CNDTR & 0xFFFF);
+        uint32_t paddr = ch->CPAR + (((ccr & DMA_CCR_PINC) != 0) ? idx * psize : 0);
+        uint32_t maddr = ch->CMAR + (((ccr & DMA_CCR_MINC) != 0) ? idx * msize : 0);
+
+        if ((ccr & DMA_CCR_MEM2MEM) != 0)
+        {
+          if ((ccr & DMA_CCR_DIR) != 0)
+          {
+            SIM_DMA_Write(paddr, psize, SIM_DMA_Read(maddr, msize));
+          }
+          else
+          {
+            SIM_DMA_Write(maddr, msize, SIM_DMA_Read(paddr, psize));
+          }
+        }
+        else if ((ccr & DMA_CCR_DIR) != 0)
+        {
+          if (SIM_DMA_Ready(paddr, 0) == 0)
+          {
+            break;
+          }
+          SIM_DMA_Write(paddr, psize, SIM_DMA_Read(maddr, msize));
+        }
+        else
+        {
+          if (SIM_DMA_Ready(paddr, 1) == 0)
+          {
+            break;
+          }
+          SIM_DMA_Write(maddr, msize, SIM_DMA_Read(paddr, psize));
+        }
+
+        ch->CNDTR = ch->CNDTR - 1;
+        moved++;
+        SIM_Statistics.DMAItems++;
+
+        if ((d->Reload - ch->CNDTR) == (d->Reload / 2))
+        {
+          flags |= DMA_ISR_HTIF1;
+        }
+        if (ch->CNDTR == 0)
+        {
+          flags |= DMA_ISR_TCIF1;
+          if ((ccr & DMA_CCR_CIRC) != 0)
+          {
+            ch->CNDTR = d->Reload;
+          }
+        }
+        if (moved >= d->Reload)
+        {
+          break;
+        }
+      }
+
+      if (flags != 0)
+      {
+        d->DMAx->ISR |= (flags | DMA_ISR_GIF1) << (d->Index * 4);
+      }
+      if (moved != 0)
+      {
+        progress = 1;
+      }
+    }
+  } while (progress != 0);
+
+  SIM_DMABusy = 0;
+}
+
+static void SIM_DMA_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t i, address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if ((address == (uint32_t)(uintptr_t)&DMA1->ISR) || (address == (uint32_t)(uintptr_t)&DMA2->ISR))
+  {
+    SIM_WORD(address) = Access->Old;
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&DMA1->IFCR)
+  {
+    DMA1->ISR &= ~DMA1->IFCR;
+    DMA1->IFCR = 0;
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&DMA2->IFCR)
+  {
+    DMA2->ISR &= ~DMA2->IFCR;
+    DMA2->IFCR = 0;
+    return;
+  }
+  for (i = 0; i < SIM_COUNT(SIM_DMA); i++)
+  {
+    if (address == (uint32_t)(uintptr_t)&SIM_DMA[i].Channel->CCR)
+    {
+      if (((Access->Old & DMA_CCR_EN) == 0) && ((SIM_DMA[i].Channel->CCR & DMA_CCR_EN) != 0))
+      {
+        SIM_DMA[i].Reload = SIM_DMA[i].Channel->CNDTR & 0xFFFF;
+      }
+      return;
+    }
+    if (address == (uint32_t)(uintptr_t)&SIM_DMA[i].Channel->CNDTR)
+    {
+      /* CNDTR is read-only while the channel is enabled */
+      if ((SIM_DMA[i].Channel->CCR & DMA_CCR_EN) != 0)
+      {
+        SIM_WORD(address) = Access->Old;
+      }
+      return;
+    }
+  }
+}
+
+/* SDADC **********************************************************************/
+
+static int16_t SIM_SDADC_Sample(SIM_SDADC_TypeDef* a, uint32_t Channel)
+{
+  if (a->Source != NULL)
+  {
+    return a->Source(Channel);
+  }
+  a->Ramp = (int16_t)(a->Ramp + 64);
+  return a->Ramp;
+}
+
+static void SIM_SDADC_PostAccess(SIM_Access_TypeDef* Access)
+{
+  SIM_SDADC_TypeDef* a = &SIM_SDADC[((Access->Address - SDADC1_BASE) >> 10) % SIM_COUNT(SIM_SDADC)];
+  SDADC_TypeDef* r = a->SDADCx;
+  uint32_t offset = (Access->Address & ~(uint32_t)3) - (uint32_t)(uintptr_t)r;
+
+  if (Access->Write == 0)
+  {
+    if (offset == SIM_OFFSET(r, JDATAR))
+    {
+      r->ISR &= ~SDADC_ISR_JEOCF;
+    }
+    else if (offset == SIM_OFFSET(r, RDATAR))
+    {
+      r->ISR &= ~SDADC_ISR_REOCF;
+    }
+    return;
+  }
+
+  if (offset == SIM_OFFSET(r, CR1))
+  {
+    if ((r->CR1 & SDADC_CR1_INIT) != 0)
+    {
+      r->ISR |= SDADC_ISR_INITRDY;
+    }
+    else
+    {
+      r->ISR &= ~SDADC_ISR_INITRDY;
+    }
+  }
+  else if (offset == SIM_OFFSET(r, CR2))
+  {
+    if ((r->CR2 & SDADC_CR2_STARTCALIB) != 0)
+    {
+      r->CR2 &= ~SDADC_CR2_STARTCALIB;
+      r->ISR |= SDADC_ISR_EOCALF;
+    }
+    if ((r->CR2 & SDADC_CR2_JSWSTART) != 0)
+    {
+      uint32_t group = r->JCHGR & 0x1FF;
+      uint32_t n;
+
+      r->CR2 &= ~SDADC_CR2_JSWSTART;
+      for (n = 0; (group != 0) && (n < 9); n++)
+      {
+        a->Injected = (a->Injected + 1) % 9;
+        if ((group & (1U << a->Injected)) != 0)
+        {
+          break;
+        }
+      }
+      r->JDATAR = (a->Injected << 24) | (uint16_t)SIM_SDADC_Sample(a, a->Injected);
+      r->ISR |= SDADC_ISR_JEOCF;
+    }
+    if ((r->CR2 & SDADC_CR2_RSWSTART) != 0)
+    {
+      uint32_t channel = (r->CR2 & SDADC_CR2_RCH) >> 16;
+
+      r->CR2 &= ~SDADC_CR2_RSWSTART;
+      r->RDATAR = (channel << 24) | (uint16_t)SIM_SDADC_Sample(a, channel);
+      r->ISR |= SDADC_ISR_REOCF;
+    }
+  }
+  else if (offset == SIM_OFFSET(r, ISR))
+  {
+    SIM_WORD(Access->Address) = Access->Old;
+  }
+  else if (offset == SIM_OFFSET(r, CLRISR))
+  {
+    r->ISR &= ~(r->CLRISR & SIM_SDADC_ICR_MASK);
+    r->CLRISR = 0;
+  }
+}
+
+/**
+  * @brief  Connects an analog source model to an SDADC.
+  * @param  SDADCx: SDADC1, SDADC2 or SDADC3.
+  * @param  Source: source model, or NULL for the built-in ramp.
+  * @retval None
+  */
+void SIM_SDADC_SetSource(SDADC_TypeDef* SDADCx, SIM_SDADC_SourceTypeDef Source)
+{
+  uint32_t i;
+
+  for (i = 0; i < SIM_COUNT(SIM_SDADC); i++)
+  {
+    if (SIM_SDADC[i].SDADCx == SDADCx)
+    {
+      SIM_SDADC[i].Source = Source;
+    }
+  }
+}
+
+/* RCC ************************************************************************/
+
+static void SIM_RCC_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&RCC->CR)
+  {
+    uint32_t cr = RCC->CR & ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY);
+    if ((cr & RCC_CR_HSION) != 0) cr |= RCC_CR_HSIRDY;
+    if ((cr & RCC_CR_HSEON) != 0) cr |= RCC_CR_HSERDY;
+    if ((cr & RCC_CR_PLLON) != 0) cr |= RCC_CR_PLLRDY;
+    RCC->CR = cr;
+  }
+  else if (address == (uint32_t)(uintptr_t)&RCC->CFGR)
+  {
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SWS) | ((RCC->CFGR & RCC_CFGR_SW) << 2);
+    /* PLLXTPRE is the same bit as PREDIV1[0] */
+    RCC->CFGR2 = (RCC->CFGR2 & ~RCC_CFGR2_PREDIV1_0) | ((RCC->CFGR & RCC_CFGR_PLLXTPRE) >> 17);
+  }
+  else if (address == (uint32_t)(uintptr_t)&RCC->CFGR2)
+  {
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_PLLXTPRE) | ((RCC->CFGR2 & RCC_CFGR2_PREDIV1_0) << 17);
+  }
+  else if (address == (uint32_t)(uintptr_t)&RCC->CIR)
+  {
+    /* Ready flags are read-only, clear bits are write-only */
+    RCC->CIR = (RCC->CIR & 0x00001F00) | (Access->Old & 0x9F & ~(RCC->CIR >> 16));
+  }
+  else if (address == (uint32_t)(uintptr_t)&RCC->BDCR)
+  {
+    RCC->BDCR = (RCC->BDCR & ~(uint32_t)0x2) | ((RCC->BDCR & 0x1) << 1);
+  }
+  else if (address == (uint32_t)(uintptr_t)&RCC->CSR)
+  {
+    uint32_t csr = (RCC->CSR & ~(uint32_t)0x2) | ((RCC->CSR & 0x1) << 1);
+    if ((csr & 0x01000000) != 0)
+    {
+      csr &= 0x00FFFFFF;
+    }
+    RCC->CSR = csr;
+  }
+}
+
+/* FLASH **********************************************************************/
+
+static void SIM_FLASH_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&FLASH->KEYR)
+  {
+    if (FLASH->KEYR == SIM_FLASH_KEY1)
+    {
+      SIM_FlashKeyState = 1;
+    }
+    else if ((SIM_FlashKeyState == 1) && (FLASH->KEYR == SIM_FLASH_KEY2))
+    {
+      FLASH->CR &= ~FLASH_CR_LOCK;
+      SIM_FlashKeyState = 0;
+    }
+    else
+    {
+      SIM_FlashKeyState = 0;
+    }
+    FLASH->KEYR = 0;
+  }
+  else if (address == (uint32_t)(uintptr_t)&FLASH->OPTKEYR)
+  {
+    if (FLASH->OPTKEYR == SIM_FLASH_KEY1)
+    {
+      SIM_FlashOptKeyState = 1;
+    }
+    else if ((SIM_FlashOptKeyState == 1) && (FLASH->OPTKEYR == SIM_FLASH_KEY2))
+    {
+      FLASH->CR |= FLASH_CR_OPTWRE;
+      SIM_FlashOptKeyState = 0;
+    }
+    else
+    {
+      SIM_FlashOptKeyState = 0;
+    }
+    FLASH->OPTKEYR = 0;
+  }
+  else if (address == (uint32_t)(uintptr_t)&FLASH->SR)
+  {
+    FLASH->SR = Access->Old & ~(FLASH->SR & (FLASH_SR_EOP | FLASH_SR_WRPERR | FLASH_SR_PGERR)) & ~FLASH_SR_BSY;
+  }
+  else if (address == (uint32_t)(uintptr_t)&FLASH->CR)
+  {
+    uint32_t cr = FLASH->CR;
+
+    if ((Access->Old & FLASH_CR_LOCK) != 0)
+    {
+      /* Locked: only LOCK itself may be written */
+      FLASH->CR = Access->Old;
+      return;
+    }
+    if ((cr & FLASH_CR_STRT) != 0)
+    {
+      if ((cr & FLASH_CR_MER) != 0)
+      {
+        memset((void*)(uintptr_t)FLASH_BASE, 0xFF, SIM_FLASH_SIZE);
+      }
+      else if (((cr & FLASH_CR_PER) != 0) && (FLASH->AR >= FLASH_BASE) &&
+               (FLASH->AR < FLASH_BASE + SIM_FLASH_SIZE))
+      {
+        memset((void*)(uintptr_t)(FLASH->AR & ~(SIM_FLASH_PAGE_SIZE - 1)), 0xFF, SIM_FLASH_PAGE_SIZE);
+      }
+      FLASH->SR |= FLASH_SR_EOP;
+      cr &= ~FLASH_CR_STRT;
+    }
+    if ((cr & FLASH_CR_OPTWRE) == 0)
+    {
+      cr &= ~FLASH_CR_OPTWRE;
+    }
+    FLASH->CR = cr | ((Access->Old & FLASH_CR_OPTWRE) & cr);
+  }
+  else if (address == (uint32_t)(uintptr_t)&FLASH->ACR)
+  {
+    FLASH->ACR = (FLASH->ACR & ~(uint32_t)0x20) | ((FLASH->ACR & 0x10) << 1);
+  }
+}
+
+/* CRC ************************************************************************/
+
+static uint32_t SIM_Reverse(uint32_t Value, uint32_t Bits)
+{
+  uint32_t result = 0;
+
+  while (Bits-- != 0)
+  {
+    result = (result << 1) | (Value & 1);
+    Value >>= 1;
+  }
+  return result;
+}
+
+static uint32_t SIM_CRC_Output(void)
+{
+  static const uint32_t size[4] = { 32, 16, 8, 7 };
+  uint32_t bits = size[(CRC->CR & CRC_CR_POLSIZE) >> 3];
+
+  return ((CRC->CR & CRC_CR_REV_OUT) != 0) ? SIM_Reverse(SIM_CRCState, bits) : SIM_CRCState;
+}
+
+static void SIM_CRC_Feed(uint32_t Data, uint32_t Width)
+{
+  static const uint32_t size[4] = { 32, 16, 8, 7 };
+  uint32_t bits = size[(CRC->CR & CRC_CR_POLSIZE) >> 3];
+  uint32_t mask = (bits == 32) ? 0xFFFFFFFF : ((1U << bits) - 1);
+  uint32_t dbits = Width * 8;
+  uint32_t crc = SIM_CRCState & mask;
+  uint32_t i;
+
+  /* Input reversal by byte, half-word or word */
+  switch ((CRC->CR & CRC_CR_REV_IN) >> 5)
+  {
+    case 1:
+      for (i = 0; i < dbits; i += 8)
+      {
+        Data = (Data & ~(0xFFU << i)) | (SIM_Reverse(Data >> i, 8) << i);
+      }
+      break;
+    case 2:
+      if (dbits == 8)
+      {
+        Data = SIM_Reverse(Data, 8);
+      }
+      else
+      {
+        for (i = 0; i < dbits; i += 16)
+        {
+          Data = (Data & ~(0xFFFFU << i)) | (SIM_Reverse(Data >> i, 16) << i);
+        }
+      }
+      break;
+    case 3:
+      Data = SIM_Reverse(Data, dbits);
+      break;
+    default:
+      break;
+  }
+
+  for (i = dbits; i-- != 0;)
+  {
+    uint32_t feedback = ((crc >> (bits - 1)) ^ (Data >> i)) & 1;
+    crc = (crc << 1) & mask;
+    if (feedback != 0)
+    {
+      crc ^= CRC->POL & mask;
+    }
+  }
+  SIM_CRCState = crc;
+}
+
+static void SIM_CRC_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&CRC->DR)
+  {
+    uint32_t data;
+
+    switch (Access->Width)
+    {
+      case 1:  data = SIM_REG8(Access->Address);  break;
+      case 2:  data = SIM_REG16(Access->Address); break;
+      default: data = SIM_REG32(Access->Address); break;
+    }
+    SIM_CRC_Feed(data, (Access->Width > 4) ? 4 : Access->Width);
+    CRC->DR = SIM_CRC_Output();
+  }
+  else if (address == (uint32_t)(uintptr_t)&CRC->CR)
+  {
+    if ((CRC->CR & CRC_CR_RESET) != 0)
+    {
+      SIM_CRCState = CRC->INIT;
+      CRC->CR &= ~CRC_CR_RESET;
+    }
+    CRC->DR = SIM_CRC_Output();
+  }
+  else if (address == (uint32_t)(uintptr_t)&CRC->INIT)
+  {
+    /* Writing INIT also reloads the computation state */
+    SIM_CRCState = CRC->INIT;
+    CRC->DR = SIM_CRC_Output();
+  }
+}
+
+/* GPIO ***********************************************************************/
+
+static void SIM_GPIO_PostAccess(SIM_Access_TypeDef* Access)
+{
+  GPIO_TypeDef* port = (GPIO_TypeDef*)(uintptr_t)(Access->Address & ~(uint32_t)0x3FF);
+  uint32_t offset = (Access->Address & 0x3FC);
+  uint32_t i, outputs = 0;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if (offset == SIM_OFFSET(port, BSRR))
+  {
+    uint32_t bsrr = port->BSRR;
+    port->ODR = (uint16_t)((port->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFF));
+    port->BSRR = 0;
+  }
+  else if (offset == SIM_OFFSET(port, BRR))
+  {
+    port->ODR &= (uint16_t)~port->BRR;
+    port->BRR = 0;
+  }
+  else if (offset == SIM_OFFSET(port, IDR))
+  {
+    SIM_WORD(Access->Address) = Access->Old;
+  }
+
+  /* Output pins read back their output level */
+  for (i = 0; i < 16; i++)
+  {
+    if (((port->MODER >> (i * 2)) & 0x3) == 0x1)
+    {
+      outputs |= 1U << i;
+    }
+  }
+  port->IDR = (uint16_t)((port->IDR & ~outputs) | (port->ODR & outputs));
+}
+
+/* EXTI ***********************************************************************/
+
+static void SIM_EXTI_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  if (address == (uint32_t)(uintptr_t)&EXTI->SWIER)
+  {
+    EXTI->PR |= EXTI->SWIER & ~Access->Old & EXTI->IMR;
+  }
+  else if (address == (uint32_t)(uintptr_t)&EXTI->PR)
+  {
+    uint32_t clear = EXTI->PR;
+    EXTI->PR = Access->Old & ~clear;
+    EXTI->SWIER &= ~clear;
+  }
+}
+
+/**
+  * @brief  Signals an edge on EXTI lines.
+  * @param  EXTI_Line: EXTI line mask (EXTI_Line0..EXTI_Line28).
+  * @retval None
+  */
+void SIM_EXTI_Trigger(uint32_t EXTI_Line)
+{
+  SIM_Unlock();
+  EXTI->PR |= EXTI_Line & EXTI->IMR;
+  SIM_ModelsUpdate();
+  SIM_Lock();
+}
+
+/* DWT ************************************************************************/
+
+static void SIM_DWT_PreAccess(SIM_Access_TypeDef* Access)
+{
+  if (((Access->Address & ~(uint32_t)3) == (uint32_t)(uintptr_t)&DWT->CYCCNT) &&
+      ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0))
+  {
+    DWT->CYCCNT = (uint32_t)SIM_GetCycles() + SIM_CycleOffset;
+  }
+}
+
+static void SIM_DWT_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  /* Writing CYCCNT or enabling the counter rebases it on the host clock */
+  if ((address == (uint32_t)(uintptr_t)&DWT->CYCCNT) ||
+      ((address == (uint32_t)(uintptr_t)&DWT->CTRL) &&
+       ((Access->Old & DWT_CTRL_CYCCNTENA_Msk) == 0) && ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0)))
+  {
+    SIM_CycleOffset = DWT->CYCCNT - (uint32_t)SIM_GetCycles();
+  }
+}
+
+/* NVIC, SysTick, SCB *********************************************************/
+
+static void SIM_SCS_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t offset = (Access->Address & ~(uint32_t)3) - SCS_BASE;
+  uint32_t n;
+
+  if (Access->Write == 0)
+  {
+    if (offset == SIM_SYSTICK_OFFSET)
+    {
+      SysTick->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+    }
+    return;
+  }
+
+  if ((offset >= SIM_NVIC_OFFSET) && (offset < SIM_NVIC_OFFSET + 0x300))
+  {
+    n = ((offset - SIM_NVIC_OFFSET) & 0x7F) >> 2;
+    if (n >= 8)
+    {
+      return;
+    }
+    switch ((offset - SIM_NVIC_OFFSET) >> 7)
+    {
+      case 0: /* ISER */
+        NVIC->ISER[n] |= Access->Old;
+        NVIC->ICER[n] = NVIC->ISER[n];
+        break;
+      case 1: /* ICER */
+        NVIC->ISER[n] &= ~NVIC->ICER[n];
+        NVIC->ICER[n] = NVIC->ISER[n];
+        break;
+      case 2: /* ISPR */
+        NVIC->ISPR[n] |= Access->Old;
+        NVIC->ICPR[n] = NVIC->ISPR[n];
+        break;
+      case 3: /* ICPR */
+        NVIC->ISPR[n] &= ~NVIC->ICPR[n];
+        NVIC->ICPR[n] = NVIC->ISPR[n];
+        break;
+      default: /* IABR is read-only */
+        SIM_WORD(Access->Address) = Access->Old;
+        break;
+    }
+  }
+  else if (offset == SIM_NVIC_OFFSET + 0xE00)
+  {
+    SIM_RaiseIRQ((IRQn_Type)(NVIC->STIR & NVIC_STIR_INTID_Msk));
+    NVIC->STIR = 0;
+  }
+  else if (offset == SIM_SCB_OFFSET + 0x04)
+  {
+    uint32_t icsr = SCB->ICSR;
+    uint32_t pend = Access->Old & SCB_ICSR_PENDSTSET_Msk;
+
+    if ((icsr & SCB_ICSR_PENDSTSET_Msk) != 0)
+    {
+      pend = SCB_ICSR_PENDSTSET_Msk;
+    }
+    if ((icsr & SCB_ICSR_PENDSTCLR_Msk) != 0)
+    {
+      pend = 0;
+    }
+    SCB->ICSR = (Access->Old & ~SCB_ICSR_PENDSTSET_Msk) | pend;
+  }
+  else if (offset == SIM_SYSTICK_OFFSET + 0x08)
+  {
+    /* Any write to VAL clears it and COUNTFLAG */
+    SysTick->VAL = 0;
+    SysTick->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+  }
+}
+
+/**
+  * @brief  Lets the SysTick counter run for the given time.
+  * @param  Microseconds: elapsed time.
+  * @retval None
+  */
+void SIM_SysTickAdvance(uint32_t Microseconds)
+{
+  uint64_t ticks;
+  uint32_t clock, reload, val;
+
+  SIM_Unlock();
+  if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) != 0)
+  {
+    clock = ((SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk) != 0) ? SystemCoreClock : SystemCoreClock / 8;
+    ticks = (uint64_t)Microseconds * clock + SIM_SysTickRemainder;
+    SIM_SysTickRemainder = (uint32_t)(ticks % 1000000);
+    ticks /= 1000000;
+    reload = SysTick->LOAD & SysTick_LOAD_RELOAD_Msk;
+    val = SysTick->VAL & SysTick_VAL_CURRENT_Msk;
+
+    while ((ticks != 0) && (reload != 0))
+    {
+      if (ticks <= val)
+      {
+        val -= (uint32_t)ticks;
+        ticks = 0;
+      }
+      else
+      {
+        ticks -= (uint64_t)val + 1;
+        val = reload;
+        SysTick->CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+        if ((SysTick->CTRL & SysTick_CTRL_TICKINT_Msk) != 0)
+        {
+          SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;
+        }
+        if (ticks > (uint64_t)reload + 1)
+        {
+          ticks %= (uint64_t)reload + 1;
+        }
+      }
+    }
+    SysTick->VAL = val;
+  }
+  SIM_Lock();
+}
+
+/**
+  * @brief  Returns whether the SysTick exception is pending.
+  * @note   Called with the model pages open.
+  * @param  None
+  * @retval Non-zero if pending.
+  */
+uint32_t SIM_SysTickPending(void)
+{
+  return SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+}
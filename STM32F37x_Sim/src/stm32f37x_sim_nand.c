@@ -0,0 +1,236 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_nand.c
+  * @brief   Model of a small page NAND flash (NAND128W3A of the STM3210E-EVAL
+  *          board): pages of 512 data and 16 spare bytes, 32 pages per
+  *          erase block, held in a caller supplied image.
+  *
+  *          The STM32F37x has no FSMC, and a byte bus trapped like the other
+  *          peripherals would cost a signal round trip per byte: the model
+  *          is driven at the page level, by the replacement of the FSMC
+  *          NAND driver of the program under test. Programming only clears
+  *          bits, like on the chip: 0xFF bytes leave the cells as they are,
+  *          and a program of another value that would have to set a bit
+  *          back is counted. Erasing sets the whole block to 0xFF and counts
+  *          the erases of each block. A power cut drops the programs
+  *          and erases after a given number of them.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "stm32f37x_sim_int.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t* pImage;
+  uint32_t Blocks;
+  uint32_t PowerCut;         /*!< Programs and erases left before the cut */
+} SIM_NAND_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_NAND_ROW_SIZE   (SIM_NAND_PAGE_SIZE + SIM_NAND_SPARE_SIZE)
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static SIM_NAND_TypeDef SIM_NAND;
+static SIM_NAND_Stats_TypeDef SIM_NAND_Statistics;
+static uint32_t SIM_NAND_Erases[SIM_NAND_MAX_BLOCKS];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t SIM_NAND_Check(uint32_t Row, uint32_t Column, uint32_t Length);
+static uint32_t SIM_NAND_Powered(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Connects a NAND flash, powered, with its erase counts cleared.
+  * @param  pImage: array content, Blocks * SIM_NAND_BLOCK_BYTES bytes, pages
+  *         of 512 data bytes followed by their 16 spare bytes. Read and
+  *         written in place.
+  * @param  Blocks: erase blocks, at most SIM_NAND_MAX_BLOCKS.
+  * @retval None
+  */
+void SIM_NAND_Attach(uint8_t* pImage, uint32_t Blocks)
+{
+  SIM_NAND.pImage = pImage;
+  SIM_NAND.Blocks = (Blocks > SIM_NAND_MAX_BLOCKS) ? SIM_NAND_MAX_BLOCKS : Blocks;
+  SIM_NAND.PowerCut = SIM_NAND_NO_POWER_CUT;
+  memset(SIM_NAND_Erases, 0, sizeof(SIM_NAND_Erases));
+  SIM_NAND_ClearStats();
+}
+
+/**
+  * @brief  Reads bytes of a page: the data area starts at column 0, the
+  *         spare area at column 512.
+  * @param  Row: page number.
+  * @param  Column: first byte in the page.
+  * @param  pData: bytes read.
+  * @param  Length: bytes to read, up to the end of the spare area.
+  * @retval Status register: SIM_NAND_STATUS_READY, with SIM_NAND_STATUS_FAIL
+  *         if the address is out of the array.
+  */
+uint8_t SIM_NAND_Read(uint32_t Row, uint32_t Column, uint8_t* pData, uint32_t Length)
+{
+  if (!SIM_NAND_Check(Row, Column, Length))
+  {
+    return SIM_NAND_STATUS_READY | SIM_NAND_STATUS_FAIL;
+  }
+  memcpy(pData, &SIM_NAND.pImage[(Row * SIM_NAND_ROW_SIZE) + Column], Length);
+  if (Column < SIM_NAND_PAGE_SIZE)
+  {
+    SIM_NAND_Statistics.PagesRead++;
+  }
+  else
+  {
+    SIM_NAND_Statistics.SparesRead++;
+  }
+  return SIM_NAND_STATUS_READY;
+}
+
+/**
+  * @brief  Programs bytes of a page: each bit written as 0 is cleared, the
+  *         others are left as they are. A byte other than 0xFF is expected
+  *         to take its value.
+  * @param  Row: page number.
+  * @param  Column: first byte in the page.
+  * @param  pData: bytes to program.
+  * @param  Length: bytes to program, up to the end of the spare area.
+  * @retval Status register: SIM_NAND_STATUS_READY, with SIM_NAND_STATUS_FAIL
+  *         if the address is out of the array.
+  */
+uint8_t SIM_NAND_Program(uint32_t Row, uint32_t Column, const uint8_t* pData, uint32_t Length)
+{
+  uint8_t* pCell;
+  uint32_t i, Overwrite = 0;
+
+  if (!SIM_NAND_Check(Row, Column, Length))
+  {
+    return SIM_NAND_STATUS_READY | SIM_NAND_STATUS_FAIL;
+  }
+  if (!SIM_NAND_Powered())
+  {
+    return SIM_NAND_STATUS_READY;
+  }
+
+  pCell = &SIM_NAND.pImage[(Row * SIM_NAND_ROW_SIZE) + Column];
+  for (i = 0; i < Length; i++)
+  {
+    if (pData[i] != 0xFF)
+    {
+      Overwrite |= pData[i] & ~pCell[i];
+    }
+    pCell[i] &= pData[i];
+  }
+  SIM_NAND_Statistics.Overwrites += (Overwrite != 0);
+  if (Column < SIM_NAND_PAGE_SIZE)
+  {
+    SIM_NAND_Statistics.PagesProgrammed++;
+  }
+  else
+  {
+    SIM_NAND_Statistics.SparesProgrammed++;
+  }
+  return SIM_NAND_STATUS_READY;
+}
+
+/**
+  * @brief  Erases the block of a page.
+  * @param  Row: any page of the block.
+  * @retval Status register: SIM_NAND_STATUS_READY, with SIM_NAND_STATUS_FAIL
+  *         if the address is out of the array.
+  */
+uint8_t SIM_NAND_Erase(uint32_t Row)
+{
+  uint32_t Block = Row / SIM_NAND_BLOCK_PAGES;
+
+  if (!SIM_NAND_Check(Row, 0, 0))
+  {
+    return SIM_NAND_STATUS_READY | SIM_NAND_STATUS_FAIL;
+  }
+  if (!SIM_NAND_Powered())
+  {
+    return SIM_NAND_STATUS_READY;
+  }
+
+  memset(&SIM_NAND.pImage[Block * SIM_NAND_BLOCK_BYTES], 0xFF, SIM_NAND_BLOCK_BYTES);
+  SIM_NAND_Erases[Block]++;
+  SIM_NAND_Statistics.BlocksErased++;
+  return SIM_NAND_STATUS_READY;
+}
+
+/**
+  * @brief  Cuts the power after a number of programs and erases: the later
+  *         ones leave the array untouched until the power is restored.
+  * @param  Operations: programs and erases still done, SIM_NAND_NO_POWER_CUT
+  *         to restore the power.
+  * @retval None
+  */
+void SIM_NAND_PowerCut(uint32_t Operations)
+{
+  SIM_NAND.PowerCut = Operations;
+}
+
+/**
+  * @brief  Returns the erases of a block since SIM_NAND_Attach().
+  * @param  Block: erase block.
+  * @retval Erase count.
+  */
+uint32_t SIM_NAND_GetEraseCount(uint32_t Block)
+{
+  return (Block < SIM_NAND.Blocks) ? SIM_NAND_Erases[Block] : 0;
+}
+
+/**
+  * @brief  Returns the statistics accumulated since SIM_NAND_ClearStats().
+  * @param  pStats: statistics.
+  * @retval None
+  */
+void SIM_NAND_GetStats(SIM_NAND_Stats_TypeDef* pStats)
+{
+  *pStats = SIM_NAND_Statistics;
+}
+
+/**
+  * @brief  Clears the statistics.
+  * @param  None
+  * @retval None
+  */
+void SIM_NAND_ClearStats(void)
+{
+  memset(&SIM_NAND_Statistics, 0, sizeof(SIM_NAND_Statistics));
+}
+
+/**
+  * @brief  Checks that bytes of a page are in the array.
+  * @param  Row: page number.
+  * @param  Column: first byte in the page.
+  * @param  Length: bytes.
+  * @retval 1 if they are, else 0.
+  */
+static uint32_t SIM_NAND_Check(uint32_t Row, uint32_t Column, uint32_t Length)
+{
+  return (SIM_NAND.pImage != NULL) && (Row < (SIM_NAND.Blocks * SIM_NAND_BLOCK_PAGES))
+         && (Column <= SIM_NAND_ROW_SIZE) && (Length <= (SIM_NAND_ROW_SIZE - Column));
+}
+
+/**
+  * @brief  Accounts for a program or an erase against the power cut.
+  * @param  None
+  * @retval 1 if it is done, 0 if the power is cut.
+  */
+static uint32_t SIM_NAND_Powered(void)
+{
+  if (SIM_NAND.PowerCut == SIM_NAND_NO_POWER_CUT)
+  {
+    return 1;
+  }
+  if (SIM_NAND.PowerCut == 0)
+  {
+    SIM_NAND_Statistics.Lost++;
+    return 0;
+  }
+  SIM_NAND.PowerCut--;
+  return 1;
+}
@@ -0,0 +1,527 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_sdcard.c
+  * @brief   Model of a standard capacity SD card on an SPI bus.
+  *
+  *          The card is an SPI slave model (SIM_SPI_AttachSlave()) selected
+  *          by a GPIO output: it answers the SPI mode commands used by the
+  *          eval board SD drivers (CMD0, CMD1, ACMD41, CMD9, CMD10, CMD12,
+  *          CMD13, CMD16, CMD17, CMD18, CMD24, CMD25, CMD55, ACMD23, CMD58)
+  *          with byte addressing and 512-byte blocks held in a caller
+  *          supplied image.
+  *
+  *          The card delays are expressed in bytes on the bus: 0xFF bytes
+  *          before a read data token and 0x00 (busy) bytes after a written
+  *          block, so a driver that polls the card pays for them exactly
+  *          like on hardware. Every byte clocked on the bus, selected or
+  *          not, is accounted in SIM_SD_Stats_TypeDef with its duration at
+  *          the SPI clock programmed at that time.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "stm32f37x_sim_int.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  SIM_SD_IDLE = 0,     /*!< Waiting for a command              */
+  SIM_SD_READ,         /*!< Sending the blocks of CMD17/CMD18  */
+  SIM_SD_WRITE_TOKEN,  /*!< Waiting for a CMD24/CMD25 token    */
+  SIM_SD_WRITE_DATA    /*!< Receiving a block                  */
+} SIM_SD_Mode_TypeDef;
+
+typedef struct
+{
+  SPI_TypeDef*          SPIx;
+  GPIO_TypeDef*         CSPort;
+  uint16_t              CSPin;
+  uint8_t*              pImage;
+  uint32_t              Blocks;
+  SIM_SD_Timing_TypeDef Timing;
+
+  SIM_SD_Mode_TypeDef   Mode;
+  uint8_t               Idle;      /*!< In idle state (R1 bit 0)              */
+  uint8_t               App;       /*!< Last command was CMD55                */
+  uint8_t               Multi;     /*!< CMD25 running                         */
+  uint8_t               Cmd[6];
+  uint32_t              CmdLength;
+  uint32_t              Address;   /*!< Next block of the data transfer       */
+  uint32_t              End;       /*!< Block after the last one to read      */
+  uint32_t              Gap;       /*!< 0xFF bytes before the next read block */
+  uint32_t              EraseCount;/*!< ACMD23 count for the next CMD25       */
+  uint32_t              Erased;    /*!< Pre-erased blocks left in this CMD25  */
+
+  uint32_t              Fill;      /*!< 0xFF bytes before Out                 */
+  uint8_t               Out[520];  /*!< Response bytes                        */
+  uint32_t              OutHead;
+  uint32_t              OutTail;
+  uint32_t              Busy;      /*!< 0x00 bytes after Out                  */
+
+  uint8_t               Block[514];/*!< Received block and CRC                */
+  uint32_t              Received;
+} SIM_SD_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_SD_BLOCK_SIZE         512
+#define SIM_SD_R1_IDLE            0x01
+#define SIM_SD_R1_ILLEGAL         0x04
+#define SIM_SD_R1_ADDRESS         0x20
+#define SIM_SD_R1_PARAMETER       0x40
+#define SIM_SD_TOKEN_SINGLE       0xFE
+#define SIM_SD_TOKEN_MULTI        0xFC
+#define SIM_SD_TOKEN_STOP         0xFD
+#define SIM_SD_DATA_ACCEPTED      0xE5
+#define SIM_SD_DATA_WRITE_ERROR   0xED
+#define SIM_SD_STOP_BUSY          8       /*!< Busy bytes after CMD12 or the stop token */
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static SIM_SD_TypeDef SIM_SD;
+static SIM_SD_Stats_TypeDef SIM_SD_Statistics;
+
+static const SIM_SD_Timing_TypeDef SIM_SD_DefaultTiming =
+{
+  64,   /* ReadAccess      */
+  8,    /* ReadGap         */
+  512,  /* WriteBusy       */
+  128   /* WriteBusyErased */
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t SIM_SD_Slave(uint8_t Data);
+static void SIM_SD_Account(void);
+static void SIM_SD_Command(void);
+static void SIM_SD_Receive(uint8_t Data);
+static void SIM_SD_Respond(uint8_t R1);
+static void SIM_SD_QueueBlock(uint32_t Gap);
+static void SIM_SD_QueueRegister(const uint8_t* pRegister);
+static void SIM_SD_GetCSD(uint8_t* pCSD);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Connects an SD card to an SPI bus.
+  * @param  SPIx: SPI1, SPI2 or SPI3.
+  * @param  CS_Port: GPIO port of the chip select output (active low).
+  * @param  CS_Pin: GPIO pin of the chip select output.
+  * @param  pImage: card content, Blocks * 512 bytes, read and written in place.
+  * @param  Blocks: card capacity in 512-byte blocks, multiple of 4 and at
+  *         most 4 Gbytes / 512.
+  * @retval None
+  */
+void SIM_SD_Attach(SPI_TypeDef* SPIx, GPIO_TypeDef* CS_Port, uint16_t CS_Pin,
+                   uint8_t* pImage, uint32_t Blocks)
+{
+  memset(&SIM_SD, 0, sizeof(SIM_SD));
+  SIM_SD.SPIx = SPIx;
+  SIM_SD.CSPort = CS_Port;
+  SIM_SD.CSPin = CS_Pin;
+  SIM_SD.pImage = pImage;
+  SIM_SD.Blocks = Blocks;
+  SIM_SD.Timing = SIM_SD_DefaultTiming;
+  SIM_SD.Idle = 1;
+  SIM_SD_ClearStats();
+
+  SIM_SPI_AttachSlave(SPIx, SIM_SD_Slave);
+}
+
+/**
+  * @brief  Sets the card delays, in bytes on the bus.
+  * @param  pTiming: delays, or NULL to restore the defaults.
+  * @retval None
+  */
+void SIM_SD_SetTiming(const SIM_SD_Timing_TypeDef* pTiming)
+{
+  SIM_SD.Timing = (pTiming != NULL) ? *pTiming : SIM_SD_DefaultTiming;
+}
+
+/**
+  * @brief  Returns the bus statistics accumulated since SIM_SD_ClearStats().
+  * @param  pStats: statistics.
+  * @retval None
+  */
+void SIM_SD_GetStats(SIM_SD_Stats_TypeDef* pStats)
+{
+  *pStats = SIM_SD_Statistics;
+}
+
+/**
+  * @brief  Clears the bus statistics.
+  * @param  None
+  * @retval None
+  */
+void SIM_SD_ClearStats(void)
+{
+  memset(&SIM_SD_Statistics, 0, sizeof(SIM_SD_Statistics));
+}
+
+/**
+  * @brief  SPI slave model: shifts one byte in and out of the card.
+  * @param  Data: byte on MOSI.
+  * @retval Byte on MISO.
+  */
+static uint8_t SIM_SD_Slave(uint8_t Data)
+{
+  uint8_t miso = 0xFF;
+
+  SIM_SD_Account();
+
+  /* Deselected: MISO floats high, only the programming goes on */
+  if ((SIM_SD.CSPort->ODR & SIM_SD.CSPin) != 0)
+  {
+    if ((SIM_SD.Fill == 0) && (SIM_SD.OutHead == SIM_SD.OutTail) && (SIM_SD.Busy != 0))
+    {
+      SIM_SD.Busy--;
+    }
+    SIM_SD.CmdLength = 0;
+    return 0xFF;
+  }
+
+  /* Output: filler bytes, response bytes then busy bytes */
+  if (SIM_SD.Fill != 0)
+  {
+    SIM_SD.Fill--;
+  }
+  else if (SIM_SD.OutHead != SIM_SD.OutTail)
+  {
+    miso = SIM_SD.Out[SIM_SD.OutHead++];
+  }
+  else if (SIM_SD.Busy != 0)
+  {
+    SIM_SD.Busy--;
+    miso = 0x00;
+  }
+  if ((SIM_SD.Mode == SIM_SD_READ) && (SIM_SD.Fill == 0) &&
+      (SIM_SD.OutHead == SIM_SD.OutTail))
+  {
+    /* Response sent: next block, CMD18 streams them until CMD12 */
+    if (SIM_SD.Address < SIM_SD.End)
+    {
+      SIM_SD_QueueBlock(SIM_SD.Gap);
+      SIM_SD.Gap = SIM_SD.Timing.ReadGap;
+    }
+    else
+    {
+      SIM_SD.Mode = SIM_SD_IDLE;
+    }
+  }
+
+  /* Input: block data, or command bytes (CMD12 is accepted during a read) */
+  if ((SIM_SD.Mode == SIM_SD_WRITE_TOKEN) || (SIM_SD.Mode == SIM_SD_WRITE_DATA))
+  {
+    SIM_SD_Receive(Data);
+  }
+  else if ((SIM_SD.CmdLength != 0) || ((Data & 0xC0) == 0x40))
+  {
+    SIM_SD.Cmd[SIM_SD.CmdLength++] = Data;
+    if (SIM_SD.CmdLength == sizeof(SIM_SD.Cmd))
+    {
+      SIM_SD.CmdLength = 0;
+      SIM_SD_Command();
+    }
+  }
+  return miso;
+}
+
+/**
+  * @brief  Accounts one byte on the bus at the current SPI clock.
+  * @param  None
+  * @retval None
+  */
+static void SIM_SD_Account(void)
+{
+  uint32_t pclk = SystemCoreClock;
+  uint32_t ppre;
+
+  /* SPI1 is on APB2, SPI2 and SPI3 on APB1 */
+  if (SIM_SD.SPIx == SPI1)
+  {
+    ppre = (RCC->CFGR & RCC_CFGR_PPRE2) >> 11;
+  }
+  else
+  {
+    ppre = (RCC->CFGR & RCC_CFGR_PPRE1) >> 8;
+  }
+  if ((ppre & 0x4) != 0)
+  {
+    pclk >>= (ppre & 0x3) + 1;
+  }
+  /* 8 bit times of PCLK / 2^(BR + 1) */
+  SIM_SD_Statistics.Bytes++;
+  SIM_SD_Statistics.BusTime += (8000000000ULL << (((SIM_SD.SPIx->CR1 & SPI_CR1_BR) >> 3) + 1)) / pclk;
+}
+
+/**
+  * @brief  Executes the command held in SIM_SD.Cmd.
+  * @param  None
+  * @retval None
+  */
+static void SIM_SD_Command(void)
+{
+  static const uint8_t CID[16] =
+  {
+    0x00, 'S', 'M', 'S', 'I', 'M', 'S', 'D', 0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0xD1, 0x01
+  };
+  uint8_t csd[16];
+  uint8_t index = SIM_SD.Cmd[0] & 0x3F;
+  uint8_t app = SIM_SD.App;
+  uint32_t arg = ((uint32_t)SIM_SD.Cmd[1] << 24) | ((uint32_t)SIM_SD.Cmd[2] << 16) |
+                 ((uint32_t)SIM_SD.Cmd[3] << 8) | SIM_SD.Cmd[4];
+
+  SIM_SD_Statistics.Commands++;
+  SIM_SD.App = 0;
+
+  /* A new command ends the pending response, CMD12 ends the read stream */
+  SIM_SD.Fill = 0;
+  SIM_SD.OutHead = SIM_SD.OutTail = 0;
+  SIM_SD.Mode = SIM_SD_IDLE;
+  SIM_SD.Multi = 0;
+
+  if (app != 0)
+  {
+    switch (index)
+    {
+      case 23: /* ACMD23: SET_WR_BLK_ERASE_COUNT */
+        SIM_SD.EraseCount = arg & 0x007FFFFF;
+        SIM_SD_Respond(0x00);
+        return;
+      case 41: /* ACMD41: SD_SEND_OP_COND */
+        SIM_SD.Idle = 0;
+        SIM_SD_Respond(0x00);
+        return;
+      default: /* Same as the standard command */
+        break;
+    }
+  }
+
+  if ((SIM_SD.Idle != 0) && (index != 0) && (index != 1) && (index != 55) && (index != 58))
+  {
+    SIM_SD_Respond(SIM_SD_R1_ILLEGAL);
+    return;
+  }
+
+  switch (index)
+  {
+    case 0:  /* GO_IDLE_STATE */
+      SIM_SD.Idle = 1;
+      SIM_SD.EraseCount = 0;
+      SIM_SD.Busy = 0;
+      SIM_SD_Respond(0x00);
+      break;
+
+    case 1:  /* SEND_OP_COND */
+      SIM_SD.Idle = 0;
+      SIM_SD_Respond(0x00);
+      break;
+
+    case 9:  /* SEND_CSD */
+      SIM_SD_Respond(0x00);
+      SIM_SD_GetCSD(csd);
+      SIM_SD_QueueRegister(csd);
+      break;
+
+    case 10: /* SEND_CID */
+      SIM_SD_Respond(0x00);
+      SIM_SD_QueueRegister(CID);
+      break;
+
+    case 12: /* STOP_TRANSMISSION: stuff byte, R1b */
+      SIM_SD_Respond(0x00);
+      SIM_SD.Fill++;
+      SIM_SD.Busy = SIM_SD_STOP_BUSY;
+      break;
+
+    case 13: /* SEND_STATUS: R2 */
+      SIM_SD_Respond(0x00);
+      SIM_SD.Out[SIM_SD.OutTail++] = 0x00;
+      break;
+
+    case 16: /* SET_BLOCKLEN */
+      SIM_SD_Respond((arg == SIM_SD_BLOCK_SIZE) ? 0x00 : SIM_SD_R1_PARAMETER);
+      break;
+
+    case 17: /* READ_SINGLE_BLOCK */
+    case 18: /* READ_MULTIPLE_BLOCK */
+      if (((arg % SIM_SD_BLOCK_SIZE) != 0) || ((arg / SIM_SD_BLOCK_SIZE) >= SIM_SD.Blocks))
+      {
+        SIM_SD_Respond(SIM_SD_R1_ADDRESS);
+        break;
+      }
+      SIM_SD_Respond(0x00);
+      SIM_SD.Address = arg / SIM_SD_BLOCK_SIZE;
+      SIM_SD.End = (index == 18) ? SIM_SD.Blocks : (SIM_SD.Address + 1);
+      SIM_SD.Gap = SIM_SD.Timing.ReadAccess;
+      SIM_SD.Mode = SIM_SD_READ;
+      break;
+
+    case 24: /* WRITE_BLOCK */
+    case 25: /* WRITE_MULTIPLE_BLOCK */
+      if (((arg % SIM_SD_BLOCK_SIZE) != 0) || ((arg / SIM_SD_BLOCK_SIZE) >= SIM_SD.Blocks))
+      {
+        SIM_SD_Respond(SIM_SD_R1_ADDRESS);
+        break;
+      }
+      SIM_SD_Respond(0x00);
+      SIM_SD.Address = arg / SIM_SD_BLOCK_SIZE;
+      SIM_SD.Multi = (index == 25);
+      SIM_SD.Erased = (index == 25) ? SIM_SD.EraseCount : 0;
+      SIM_SD.EraseCount = 0;
+      SIM_SD.Mode = SIM_SD_WRITE_TOKEN;
+      break;
+
+    case 55: /* APP_CMD */
+      SIM_SD.App = 1;
+      SIM_SD_Respond(0x00);
+      break;
+
+    case 58: /* READ_OCR: R3, 2.7-3.6 V, powered up */
+      SIM_SD_Respond(0x00);
+      SIM_SD.Out[SIM_SD.OutTail++] = (SIM_SD.Idle != 0) ? 0x00 : 0x80;
+      SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;
+      SIM_SD.Out[SIM_SD.OutTail++] = 0x80;
+      SIM_SD.Out[SIM_SD.OutTail++] = 0x00;
+      break;
+
+    default:
+      SIM_SD_Respond(SIM_SD_R1_ILLEGAL);
+      break;
+  }
+}
+
+/**
+  * @brief  Receives one byte of a CMD24/CMD25 data phase.
+  * @param  Data: byte on MOSI.
+  * @retval None
+  */
+static void SIM_SD_Receive(uint8_t Data)
+{
+  uint8_t* pBlock;
+
+  if (SIM_SD.Mode == SIM_SD_WRITE_TOKEN)
+  {
+    if ((Data == SIM_SD_TOKEN_SINGLE) || ((Data == SIM_SD_TOKEN_MULTI) && (SIM_SD.Multi != 0)))
+    {
+      SIM_SD.Mode = SIM_SD_WRITE_DATA;
+      SIM_SD.Received = 0;
+    }
+    else if ((Data == SIM_SD_TOKEN_STOP) && (SIM_SD.Multi != 0))
+    {
+      SIM_SD.Mode = SIM_SD_IDLE;
+      SIM_SD.Fill = 1;
+      SIM_SD.Busy = SIM_SD_STOP_BUSY;
+    }
+    return;
+  }
+
+  SIM_SD.Block[SIM_SD.Received++] = Data;
+  if (SIM_SD.Received < sizeof(SIM_SD.Block))
+  {
+    return;
+  }
+
+  /* Block and CRC received: data response, then busy while programming */
+  SIM_SD.OutHead = SIM_SD.OutTail = 0;
+  if (SIM_SD.Address >= SIM_SD.Blocks)
+  {
+    SIM_SD.Out[SIM_SD.OutTail++] = SIM_SD_DATA_WRITE_ERROR;
+    SIM_SD.Mode = SIM_SD_WRITE_TOKEN;
+    return;
+  }
+  pBlock = SIM_SD.pImage + (SIM_SD.Address * SIM_SD_BLOCK_SIZE);
+  memcpy(pBlock, SIM_SD.Block, SIM_SD_BLOCK_SIZE);
+  SIM_SD.Address++;
+  SIM_SD_Statistics.BlocksWritten++;
+
+  SIM_SD.Out[SIM_SD.OutTail++] = SIM_SD_DATA_ACCEPTED;
+  if (SIM_SD.Erased != 0)
+  {
+    SIM_SD.Erased--;
+    SIM_SD.Busy = SIM_SD.Timing.WriteBusyErased;
+  }
+  else
+  {
+    SIM_SD.Busy = SIM_SD.Timing.WriteBusy;
+  }
+  SIM_SD.Mode = (SIM_SD.Multi != 0) ? SIM_SD_WRITE_TOKEN : SIM_SD_IDLE;
+}
+
+/**
+  * @brief  Queues an R1 response after the one byte command response time.
+  * @param  R1: response, the idle state bit is added.
+  * @retval None
+  */
+static void SIM_SD_Respond(uint8_t R1)
+{
+  SIM_SD.Fill = 1;
+  SIM_SD.OutHead = SIM_SD.OutTail = 0;
+  SIM_SD.Out[SIM_SD.OutTail++] = R1 | ((SIM_SD.Idle != 0) ? SIM_SD_R1_IDLE : 0);
+}
+
+/**
+  * @brief  Queues the data packet of the next block to read.
+  * @param  Gap: 0xFF bytes before the data token.
+  * @retval None
+  */
+static void SIM_SD_QueueBlock(uint32_t Gap)
+{
+  SIM_SD.Fill = Gap;
+  SIM_SD.OutHead = SIM_SD.OutTail = 0;
+  SIM_SD.Out[SIM_SD.OutTail++] = SIM_SD_TOKEN_SINGLE;
+  memcpy(&SIM_SD.Out[SIM_SD.OutTail], SIM_SD.pImage + (SIM_SD.Address * SIM_SD_BLOCK_SIZE),
+         SIM_SD_BLOCK_SIZE);
+  SIM_SD.OutTail += SIM_SD_BLOCK_SIZE;
+  SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;   /* CRC, not checked in SPI mode */
+  SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;
+  SIM_SD.Address++;
+  SIM_SD_Statistics.BlocksRead++;
+}
+
+/**
+  * @brief  Queues the data packet of a 16-byte register (CSD, CID).
+  * @param  pRegister: register content.
+  * @retval None
+  */
+static void SIM_SD_QueueRegister(const uint8_t* pRegister)
+{
+  SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;
+  SIM_SD.Out[SIM_SD.OutTail++] = SIM_SD_TOKEN_SINGLE;
+  memcpy(&SIM_SD.Out[SIM_SD.OutTail], pRegister, 16);
+  SIM_SD.OutTail += 16;
+  SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;
+  SIM_SD.Out[SIM_SD.OutTail++] = 0xFF;
+}
+
+/**
+  * @brief  Builds the version 1.0 CSD of the card: 512-byte blocks and the
+  *         smallest C_SIZE_MULT that encodes the capacity.
+  * @param  pCSD: 16-byte register.
+  * @retval None
+  */
+static void SIM_SD_GetCSD(uint8_t* pCSD)
+{
+  uint32_t mult = 0;
+  uint32_t size;
+
+  while ((mult < 7) && ((SIM_SD.Blocks >> (mult + 2)) > 4096))
+  {
+    mult++;
+  }
+  size = (SIM_SD.Blocks >> (mult + 2)) - 1;
+
+  memset(pCSD, 0, 16);
+  pCSD[1] = 0x26;                                  /* TAAC: 1.5 ms */
+  pCSD[3] = 0x32;                                  /* TRAN_SPEED: 25 MHz */
+  pCSD[4] = 0x5F;                                  /* CCC */
+  pCSD[5] = 0x50 | 9;                              /* CCC, READ_BL_LEN: 512 */
+  pCSD[6] = 0x80 | ((size >> 10) & 0x03);          /* READ_BL_PARTIAL, C_SIZE */
+  pCSD[7] = (uint8_t)(size >> 2);
+  pCSD[8] = (uint8_t)((size & 0x03) << 6) | 0x2D;  /* C_SIZE, VDD_R_CURR */
+  pCSD[9] = 0xB4 | ((mult >> 1) & 0x03);           /* VDD_W_CURR, C_SIZE_MULT */
+  pCSD[10] = (uint8_t)((mult & 0x01) << 7) | 0x7F; /* C_SIZE_MULT, ERASE_BLK_EN, SECTOR_SIZE */
+  pCSD[11] = 0x80;                                 /* SECTOR_SIZE */
+  pCSD[12] = 0x0A | (9 >> 2);                      /* R2W_FACTOR, WRITE_BL_LEN: 512 */
+  pCSD[13] = (9 & 0x03) << 6;
+  pCSD[15] = 0x01;
+}
@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_trace.c
+  * @brief   Host side report of the USB-FS driver event trace (usb_trace.c).
+  *
+  *          The simulation build enables USB_TRACE. The records are stamped
+  *          with DWT->CYCCNT, which the simulator derives from the host
+  *          monotonic clock scaled to SystemCoreClock: durations include
+  *          the cost of the trapped register accesses, so only compare
+  *          reports taken on the same host.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f37x_sim_int.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static USB_Trace_Stats_TypeDef SIM_TraceStats;
+
+static const char* const SIM_TraceEventNames[USB_TRACE_EVENT_NUM] =
+{
+  "none", "isr-enter", "isr-exit", "sof", "reset", "suspend", "wakeup",
+  "setup", "ctr-in", "ctr-out", "service-done", "tx-valid", "rx-valid"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_TracePrintHist(FILE* pFile, const char* pName,
+                               const USB_Trace_Hist_TypeDef* pHist);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Drains the trace ring and prints the decoded histograms. The
+  *         histograms accumulate over calls until SIM_USB_TraceClear().
+  * @param  pFile: output stream.
+  * @retval None
+  */
+void SIM_USB_TraceReport(FILE* pFile)
+{
+  static const char* const Dir[2] = { "in", "out" };
+  char Name[32];
+  uint32_t Records, ep, dir, ev;
+
+  Records = USB_Trace_Drain(&SIM_TraceStats);
+
+  fprintf(pFile, "usb trace: %u records drained, %u lost\n",
+          (unsigned)Records, (unsigned)USB_Trace_GetLost());
+  for (ev = 1; ev < USB_TRACE_EVENT_NUM; ev++)
+  {
+    if (SIM_TraceStats.wEvents[ev] != 0)
+    {
+      fprintf(pFile, "  %-12s %u\n", SIM_TraceEventNames[ev],
+              (unsigned)SIM_TraceStats.wEvents[ev]);
+    }
+  }
+  SIM_TracePrintHist(pFile, "isr", &SIM_TraceStats.Isr);
+  for (ep = 0; ep < USB_TRACE_EP_NUM; ep++)
+  {
+    for (dir = 0; dir < 2; dir++)
+    {
+      snprintf(Name, sizeof(Name), "ep%u-%s service", (unsigned)ep, Dir[dir]);
+      SIM_TracePrintHist(pFile, Name, &SIM_TraceStats.Service[ep][dir]);
+      snprintf(Name, sizeof(Name), "ep%u-%s latency", (unsigned)ep, Dir[dir]);
+      SIM_TracePrintHist(pFile, Name, &SIM_TraceStats.Latency[ep][dir]);
+    }
+  }
+}
+
+/**
+  * @brief  Clears the histograms accumulated by SIM_USB_TraceReport().
+  * @param  None
+  * @retval None
+  */
+void SIM_USB_TraceClear(void)
+{
+  USB_Trace_DecodeInit(&SIM_TraceStats);
+}
+
+/**
+  * @brief  Prints one histogram: count, min, max in cycles then the non
+  *         empty log2 bins as <upper bound>:<count>.
+  * @param  pFile: output stream.
+  * @param  pName: histogram name.
+  * @param  pHist: histogram.
+  * @retval None
+  */
+static void SIM_TracePrintHist(FILE* pFile, const char* pName,
+                               const USB_Trace_Hist_TypeDef* pHist)
+{
+  uint32_t bin;
+
+  if (pHist->wCount == 0)
+  {
+    return;
+  }
+  fprintf(pFile, "  %-18s n=%u min=%u max=%u |", pName, (unsigned)pHist->wCount,
+          (unsigned)pHist->wMin, (unsigned)pHist->wMax);
+  for (bin = 0; bin < USB_TRACE_HIST_BINS; bin++)
+  {
+    if (pHist->wBin[bin] != 0)
+    {
+      fprintf(pFile, " <%lu:%u", 1UL << bin, (unsigned)pHist->wBin[bin]);
+    }
+  }
+  fprintf(pFile, "\n");
+}
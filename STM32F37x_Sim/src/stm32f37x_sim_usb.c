@@ -0,0 +1,428 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_usb.c
+  * @brief   Model of the USB full speed device peripheral and of the host
+  *          at the other end of the cable.
+  *
+  *          The device side reproduces the endpoint register write semantics
+  *          (CTR bits cleared by writing 0, DTOG and STAT bits toggled by
+  *          writing 1), the interrupt status register and the buffer
+  *          descriptor table. The host side runs one transaction per call:
+  *          it moves the data between the caller and the packet memory,
+  *          updates the endpoint register like the hardware does, and lets
+  *          the device interrupt handler run before returning.
+  *
+  *          Double-buffered bulk endpoints follow the DTOG/SW_BUF protocol:
+  *          the USB transfers the buffer selected by its DTOG bit (0: the
+  *          TX descriptor, 1: the RX descriptor) and NAKs while DTOG equals
+  *          SW_BUF, the DTOG bit of the other direction.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "stm32f37x_sim_int.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_USB_EP_COUNT     8
+
+#define SIM_USB_CNTR         (SIM_USB_BASE + 0x40)
+#define SIM_USB_ISTR         (SIM_USB_BASE + 0x44)
+#define SIM_USB_FNR          (SIM_USB_BASE + 0x48)
+#define SIM_USB_DADDR        (SIM_USB_BASE + 0x4C)
+#define SIM_USB_BTABLE       (SIM_USB_BASE + 0x50)
+
+/* EPnR bits */
+#define SIM_EP_CTR_RX        ((uint32_t)0x8000)
+#define SIM_EP_DTOG_RX       ((uint32_t)0x4000)
+#define SIM_EP_STAT_RX       ((uint32_t)0x3000)
+#define SIM_EP_SETUP         ((uint32_t)0x0800)
+#define SIM_EP_RW            ((uint32_t)0x070F)  /* EP_TYPE, EP_KIND, EA */
+#define SIM_EP_CTR_TX        ((uint32_t)0x0080)
+#define SIM_EP_DTOG_TX       ((uint32_t)0x0040)
+#define SIM_EP_STAT_TX       ((uint32_t)0x0030)
+#define SIM_EP_EA            ((uint32_t)0x000F)
+#define SIM_EP_TYPE          ((uint32_t)0x0600)
+#define SIM_EP_KIND          ((uint32_t)0x0100)
+#define SIM_EP_CTR           (SIM_EP_CTR_RX | SIM_EP_CTR_TX)
+#define SIM_EP_TOGGLE        (SIM_EP_DTOG_RX | SIM_EP_STAT_RX | SIM_EP_DTOG_TX | SIM_EP_STAT_TX)
+
+#define SIM_EP_STAT_DISABLED ((uint32_t)0x0)
+#define SIM_EP_STAT_STALL    ((uint32_t)0x1)
+#define SIM_EP_STAT_NAK      ((uint32_t)0x2)
+#define SIM_EP_STAT_VALID    ((uint32_t)0x3)
+
+/* ISTR and CNTR bits */
+#define SIM_ISTR_CTR         ((uint32_t)0x8000)
+#define SIM_ISTR_RESET       ((uint32_t)0x0400)
+#define SIM_ISTR_SOF         ((uint32_t)0x0200)
+#define SIM_ISTR_EVENTS      ((uint32_t)0x7F00)  /* rc_w0 event flags */
+#define SIM_ISTR_DIR         ((uint32_t)0x0010)
+#define SIM_CNTR_FRES        ((uint32_t)0x0001)
+#define SIM_CNTR_PDWN        ((uint32_t)0x0002)
+#define SIM_FNR_FN           ((uint32_t)0x07FF)
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_EPR(n)           SIM_REG32(SIM_USB_BASE + (n) * 4)
+#define SIM_STAT_RX(r)       (((r) & SIM_EP_STAT_RX) >> 12)
+#define SIM_STAT_TX(r)       (((r) & SIM_EP_STAT_TX) >> 4)
+/* Double-buffered bulk endpoint: EP_TYPE bulk (00) with EP_KIND set */
+#define SIM_DBL_BULK(r)      (((r) & (SIM_EP_TYPE | SIM_EP_KIND)) == SIM_EP_KIND)
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Returns the address of a packet memory byte (the packet memory is
+  *         seen by the CPU as 16-bit half-words on a 32-bit stride).
+  */
+static volatile uint8_t* SIM_PMA(uint32_t Offset)
+{
+  return (volatile uint8_t*)(uintptr_t)(SIM_USB_PMA_BASE + ((Offset >> 1) * 4) + (Offset & 1));
+}
+
+/**
+  * @brief  Returns one half-word of the buffer descriptor table.
+  * @param  n: endpoint register number.
+  * @param  Index: 0 ADDR_TX, 1 COUNT_TX, 2 ADDR_RX, 3 COUNT_RX.
+  */
+static volatile uint16_t* SIM_BDT(uint32_t n, uint32_t Index)
+{
+  uint32_t offset = (SIM_REG32(SIM_USB_BTABLE) & 0xFFF8) + n * 8 + Index * 2;
+  return (volatile uint16_t*)SIM_PMA(offset);
+}
+
+/**
+  * @brief  Returns the size of the RX buffer described by a COUNT_RX entry.
+  */
+static uint32_t SIM_RxCapacity(uint16_t CountRx)
+{
+  uint32_t blocks = (CountRx >> 10) & 0x1F;
+
+  return ((CountRx & 0x8000) != 0) ? (blocks + 1) * 32 : blocks * 2;
+}
+
+/**
+  * @brief  Finds the endpoint register that answers to an endpoint address.
+  * @retval Register number, or SIM_USB_EP_COUNT if none.
+  */
+static uint32_t SIM_FindEndpoint(uint8_t bEpNum)
+{
+  uint32_t n;
+
+  for (n = 0; n < SIM_USB_EP_COUNT; n++)
+  {
+    if ((SIM_EPR(n) & SIM_EP_EA) == (bEpNum & 0x0F))
+    {
+      return n;
+    }
+  }
+  return SIM_USB_EP_COUNT;
+}
+
+/**
+  * @brief  Returns whether the device answers on the bus at all.
+  */
+static uint32_t SIM_Attached(void)
+{
+  return ((SIM_REG32(SIM_USB_CNTR) & (SIM_CNTR_FRES | SIM_CNTR_PDWN)) == 0);
+}
+
+/**
+  * @brief  Completes a host transaction: raises the interrupt, closes the
+  *         model pages and lets the device handle the event.
+  */
+static void SIM_USB_Complete(void)
+{
+  SIM_ModelsUpdate();
+  SIM_Lock();
+  SIM_ServiceIRQs();
+}
+
+/**
+  * @brief  Loads the reset values of the USB registers.
+  * @note   Called with the model pages open.
+  * @param  None
+  * @retval None
+  */
+void SIM_USB_Reset(void)
+{
+  uint32_t n;
+
+  for (n = 0; n < SIM_USB_EP_COUNT; n++)
+  {
+    SIM_EPR(n) = 0;
+  }
+  SIM_REG32(SIM_USB_CNTR) = SIM_CNTR_FRES | SIM_CNTR_PDWN;
+  SIM_REG32(SIM_USB_ISTR) = 0;
+  SIM_REG32(SIM_USB_FNR) = 0;
+  SIM_REG32(SIM_USB_DADDR) = 0;
+  SIM_REG32(SIM_USB_BTABLE) = 0;
+}
+
+/**
+  * @brief  Recomputes the CTR, DIR and EP_ID fields of ISTR and the
+  *         low priority interrupt request.
+  * @note   Called with the model pages open.
+  * @param  None
+  * @retval None
+  */
+void SIM_USB_Update(void)
+{
+  uint32_t istr = SIM_REG32(SIM_USB_ISTR) & SIM_ISTR_EVENTS;
+  uint32_t n, epr;
+
+  for (n = 0; n < SIM_USB_EP_COUNT; n++)
+  {
+    epr = SIM_EPR(n);
+    if ((epr & SIM_EP_CTR) != 0)
+    {
+      istr |= SIM_ISTR_CTR | n | (((epr & SIM_EP_CTR_RX) != 0) ? SIM_ISTR_DIR : 0);
+      break;
+    }
+  }
+  SIM_REG32(SIM_USB_ISTR) = istr;
+
+  if ((istr & SIM_REG32(SIM_USB_CNTR) & 0xFF00) != 0)
+  {
+    SIM_RaiseIRQ(USB_LP_IRQn);
+  }
+}
+
+/**
+  * @brief  Applies the hardware write semantics of the USB registers.
+  * @note   Called with the model pages open.
+  * @param  Access: trapped access.
+  * @retval None
+  */
+void SIM_USB_PostAccess(SIM_Access_TypeDef* Access)
+{
+  uint32_t address = Access->Address & ~(uint32_t)3;
+  uint32_t w, old = Access->Old & 0xFFFF;
+
+  if (Access->Write == 0)
+  {
+    return;
+  }
+  w = SIM_REG32(address) & 0xFFFF;
+
+  if (address < SIM_USB_BASE + SIM_USB_EP_COUNT * 4)
+  {
+    SIM_REG32(address) = (w & SIM_EP_RW) | (old & SIM_EP_SETUP) |
+                         (old & w & SIM_EP_CTR) | ((old ^ w) & SIM_EP_TOGGLE);
+  }
+  else if (address == SIM_USB_ISTR)
+  {
+    SIM_REG32(address) = old & w & SIM_ISTR_EVENTS;
+  }
+  else if (address == SIM_USB_FNR)
+  {
+    SIM_REG32(address) = old;
+  }
+  else if (address == SIM_USB_BTABLE)
+  {
+    SIM_REG32(address) = w & 0xFFF8;
+  }
+  else
+  {
+    SIM_REG32(address) = w;
+  }
+}
+
+/**
+  * @brief  Signals a reset on the bus: the device address and all endpoint
+  *         registers are cleared and the RESET interrupt is raised.
+  * @param  None
+  * @retval None
+  */
+void SIM_USB_BusReset(void)
+{
+  uint32_t n;
+
+  SIM_Unlock();
+  for (n = 0; n < SIM_USB_EP_COUNT; n++)
+  {
+    SIM_EPR(n) = 0;
+  }
+  SIM_REG32(SIM_USB_DADDR) = 0;
+  SIM_REG32(SIM_USB_ISTR) |= SIM_ISTR_RESET;
+  SIM_USB_Complete();
+}
+
+/**
+  * @brief  Generates a start of frame. Called every millisecond by
+  *         SIM_AdvanceTime().
+  * @param  None
+  * @retval None
+  */
+void SIM_USB_Frame(void)
+{
+  uint32_t fnr;
+
+  SIM_Unlock();
+  if (SIM_Attached() == 0)
+  {
+    SIM_Lock();
+    return;
+  }
+  fnr = SIM_REG32(SIM_USB_FNR);
+  SIM_REG32(SIM_USB_FNR) = (fnr & ~SIM_FNR_FN) | ((fnr + 1) & SIM_FNR_FN);
+  SIM_REG32(SIM_USB_ISTR) |= SIM_ISTR_SOF;
+  SIM_Statistics.USBFrames++;
+  SIM_USB_Complete();
+}
+
+/**
+  * @brief  Sends a SETUP packet to endpoint 0. A SETUP is acknowledged
+  *         whatever the state of the endpoint, as long as it is enabled.
+  * @param  pSetup: the 8 bytes of the setup packet.
+  * @retval 8, or SIM_USB_DISABLED.
+  */
+int32_t SIM_USB_HostSetup(const uint8_t* pSetup)
+{
+  uint32_t n, epr, i, addr;
+
+  SIM_Unlock();
+  n = SIM_FindEndpoint(0);
+  if ((SIM_Attached() == 0) || (n == SIM_USB_EP_COUNT) || (SIM_STAT_RX(SIM_EPR(n)) == SIM_EP_STAT_DISABLED))
+  {
+    SIM_Lock();
+    return SIM_USB_DISABLED;
+  }
+  addr = *SIM_BDT(n, 2);
+  for (i = 0; i < 8; i++)
+  {
+    *SIM_PMA(addr + i) = pSetup[i];
+  }
+  *SIM_BDT(n, 3) = (uint16_t)((*SIM_BDT(n, 3) & 0xFC00) | 8);
+
+  /* Both directions NAK and the next data stage uses DATA1 */
+  epr = SIM_EPR(n) & ~(SIM_EP_STAT_RX | SIM_EP_STAT_TX);
+  epr |= (SIM_EP_STAT_NAK << 12) | (SIM_EP_STAT_NAK << 4);
+  epr |= SIM_EP_CTR_RX | SIM_EP_SETUP | SIM_EP_DTOG_RX | SIM_EP_DTOG_TX;
+  SIM_EPR(n) = epr;
+
+  SIM_USB_Complete();
+  return 8;
+}
+
+/**
+  * @brief  Sends an OUT data packet.
+  * @param  bEpNum: endpoint number.
+  * @param  pData: packet data.
+  * @param  wLength: packet length, at most the endpoint buffer size.
+  * @retval wLength, SIM_USB_NAK, SIM_USB_STALL or SIM_USB_DISABLED.
+  */
+int32_t SIM_USB_HostOut(uint8_t bEpNum, const uint8_t* pData, uint16_t wLength)
+{
+  uint32_t n, epr, i, addr, buf, dbl;
+
+  SIM_Unlock();
+  n = SIM_FindEndpoint(bEpNum);
+  epr = (n < SIM_USB_EP_COUNT) ? SIM_EPR(n) : 0;
+  if ((SIM_Attached() == 0) || (SIM_STAT_RX(epr) != SIM_EP_STAT_VALID))
+  {
+    SIM_Lock();
+    switch (SIM_STAT_RX(epr))
+    {
+      case SIM_EP_STAT_NAK:   return SIM_USB_NAK;
+      case SIM_EP_STAT_STALL: return SIM_USB_STALL;
+      default:                return SIM_USB_DISABLED;
+    }
+  }
+  dbl = SIM_DBL_BULK(epr);
+  if (dbl != 0)
+  {
+    if (((epr & SIM_EP_DTOG_RX) != 0) == ((epr & SIM_EP_DTOG_TX) != 0))
+    {
+      /* Both buffers are held by the application */
+      SIM_Lock();
+      return SIM_USB_NAK;
+    }
+    buf = ((epr & SIM_EP_DTOG_RX) != 0) ? 2 : 0;
+  }
+  else
+  {
+    buf = 2;
+  }
+  if (wLength > SIM_RxCapacity(*SIM_BDT(n, buf + 1)))
+  {
+    /* Babble: the hardware would drop the packet without handshake */
+    SIM_Lock();
+    return SIM_USB_NAK;
+  }
+  addr = *SIM_BDT(n, buf);
+  for (i = 0; i < wLength; i++)
+  {
+    *SIM_PMA(addr + i) = pData[i];
+  }
+  *SIM_BDT(n, buf + 1) = (uint16_t)((*SIM_BDT(n, buf + 1) & 0xFC00) | wLength);
+
+  epr &= ~SIM_EP_SETUP;
+  epr ^= SIM_EP_DTOG_RX;
+  epr |= SIM_EP_CTR_RX;
+  if (dbl == 0)
+  {
+    epr = (epr & ~SIM_EP_STAT_RX) | (SIM_EP_STAT_NAK << 12);
+  }
+  SIM_EPR(n) = epr;
+
+  SIM_USB_Complete();
+  return wLength;
+}
+
+/**
+  * @brief  Polls an IN endpoint.
+  * @param  bEpNum: endpoint number.
+  * @param  pData: receives the packet, must hold the endpoint buffer size.
+  * @retval Packet length, SIM_USB_NAK, SIM_USB_STALL or SIM_USB_DISABLED.
+  */
+int32_t SIM_USB_HostIn(uint8_t bEpNum, uint8_t* pData)
+{
+  uint32_t n, epr, i, addr, count, buf, dbl;
+
+  SIM_Unlock();
+  n = SIM_FindEndpoint(bEpNum);
+  epr = (n < SIM_USB_EP_COUNT) ? SIM_EPR(n) : 0;
+  if ((SIM_Attached() == 0) || (SIM_STAT_TX(epr) != SIM_EP_STAT_VALID))
+  {
+    SIM_Lock();
+    switch (SIM_STAT_TX(epr))
+    {
+      case SIM_EP_STAT_NAK:   return SIM_USB_NAK;
+      case SIM_EP_STAT_STALL: return SIM_USB_STALL;
+      default:                return SIM_USB_DISABLED;
+    }
+  }
+  dbl = SIM_DBL_BULK(epr);
+  if (dbl != 0)
+  {
+    if (((epr & SIM_EP_DTOG_TX) != 0) == ((epr & SIM_EP_DTOG_RX) != 0))
+    {
+      /* No buffer released by the application */
+      SIM_Lock();
+      return SIM_USB_NAK;
+    }
+    buf = ((epr & SIM_EP_DTOG_TX) != 0) ? 2 : 0;
+  }
+  else
+  {
+    buf = 0;
+  }
+  addr = *SIM_BDT(n, buf);
+  count = *SIM_BDT(n, buf + 1) & 0x3FF;
+  for (i = 0; i < count; i++)
+  {
+    pData[i] = *SIM_PMA(addr + i);
+  }
+
+  epr ^= SIM_EP_DTOG_TX;
+  epr |= SIM_EP_CTR_TX;
+  if (dbl == 0)
+  {
+    epr = (epr & ~SIM_EP_STAT_TX) | (SIM_EP_STAT_NAK << 4);
+  }
+  SIM_EPR(n) = epr;
+
+  SIM_USB_Complete();
+  return (int32_t)count;
+}
@@ -0,0 +1,186 @@
+/**
+  ******************************************************************************
+  * @file    stm32f37x_sim_vectors.c
+  * @brief   Interrupt vector table of the simulation build.
+  *
+  *          Mirrors the vector table of startup_stm32f37x.s: every handler is
+  *          a weak alias of SIM_DefaultHandler, so that the handlers defined
+  *          by the application (stm32f37x_it.c) take over by name.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f37x_sim_int.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_WEAK    __attribute__((weak, alias("SIM_DefaultHandler")))
+
+/* Private function prototypes -----------------------------------------------*/
+void SIM_DefaultHandler(void);
+
+void SysTick_Handler(void)          SIM_WEAK;
+void WWDG_IRQHandler(void)          SIM_WEAK;
+void PVD_IRQHandler(void)           SIM_WEAK;
+void TAMPER_STAMP_IRQHandler(void)  SIM_WEAK;
+void RTC_WKUP_IRQHandler(void)      SIM_WEAK;
+void FLASH_IRQHandler(void)         SIM_WEAK;
+void RCC_IRQHandler(void)           SIM_WEAK;
+void EXTI0_IRQHandler(void)         SIM_WEAK;
+void EXTI1_IRQHandler(void)         SIM_WEAK;
+void EXTI2_TS_IRQHandler(void)      SIM_WEAK;
+void EXTI3_IRQHandler(void)         SIM_WEAK;
+void EXTI4_IRQHandler(void)         SIM_WEAK;
+void DMA1_Channel1_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel2_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel3_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel4_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel5_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel6_IRQHandler(void) SIM_WEAK;
+void DMA1_Channel7_IRQHandler(void) SIM_WEAK;
+void ADC1_IRQHandler(void)          SIM_WEAK;
+void CAN1_TX_IRQHandler(void)       SIM_WEAK;
+void CAN1_RX0_IRQHandler(void)      SIM_WEAK;
+void CAN1_RX1_IRQHandler(void)      SIM_WEAK;
+void CAN1_SCE_IRQHandler(void)      SIM_WEAK;
+void EXTI9_5_IRQHandler(void)       SIM_WEAK;
+void TIM15_IRQHandler(void)         SIM_WEAK;
+void TIM16_IRQHandler(void)         SIM_WEAK;
+void TIM17_IRQHandler(void)         SIM_WEAK;
+void TIM18_DAC2_IRQHandler(void)    SIM_WEAK;
+void TIM2_IRQHandler(void)          SIM_WEAK;
+void TIM3_IRQHandler(void)          SIM_WEAK;
+void TIM4_IRQHandler(void)          SIM_WEAK;
+void I2C1_EV_IRQHandler(void)       SIM_WEAK;
+void I2C1_ER_IRQHandler(void)       SIM_WEAK;
+void I2C2_EV_IRQHandler(void)       SIM_WEAK;
+void I2C2_ER_IRQHandler(void)       SIM_WEAK;
+void SPI1_IRQHandler(void)          SIM_WEAK;
+void SPI2_IRQHandler(void)          SIM_WEAK;
+void USART1_IRQHandler(void)        SIM_WEAK;
+void USART2_IRQHandler(void)        SIM_WEAK;
+void USART3_IRQHandler(void)        SIM_WEAK;
+void EXTI15_10_IRQHandler(void)     SIM_WEAK;
+void RTC_Alarm_IRQHandler(void)     SIM_WEAK;
+void CEC_IRQHandler(void)           SIM_WEAK;
+void TIM12_IRQHandler(void)         SIM_WEAK;
+void TIM13_IRQHandler(void)         SIM_WEAK;
+void TIM14_IRQHandler(void)         SIM_WEAK;
+void TIM5_IRQHandler(void)          SIM_WEAK;
+void SPI3_IRQHandler(void)          SIM_WEAK;
+void TIM6_DAC1_IRQHandler(void)     SIM_WEAK;
+void TIM7_IRQHandler(void)          SIM_WEAK;
+void DMA2_Channel1_IRQHandler(void) SIM_WEAK;
+void DMA2_Channel2_IRQHandler(void) SIM_WEAK;
+void DMA2_Channel3_IRQHandler(void) SIM_WEAK;
+void DMA2_Channel4_IRQHandler(void) SIM_WEAK;
+void DMA2_Channel5_IRQHandler(void) SIM_WEAK;
+void SDADC1_IRQHandler(void)        SIM_WEAK;
+void SDADC2_IRQHandler(void)        SIM_WEAK;
+void SDADC3_IRQHandler(void)        SIM_WEAK;
+void COMP_IRQHandler(void)          SIM_WEAK;
+void USB_HP_IRQHandler(void)        SIM_WEAK;
+void USB_LP_IRQHandler(void)        SIM_WEAK;
+void USBWakeUp_IRQHandler(void)     SIM_WEAK;
+void TIM19_IRQHandler(void)         SIM_WEAK;
+void FPU_IRQHandler(void)           SIM_WEAK;
+
+/* Exported variables --------------------------------------------------------*/
+void (* const SIM_Vectors[])(void) =
+{
+  WWDG_IRQHandler,                /*  0 */
+  PVD_IRQHandler,                 /*  1 */
+  TAMPER_STAMP_IRQHandler,        /*  2 */
+  RTC_WKUP_IRQHandler,            /*  3 */
+  FLASH_IRQHandler,               /*  4 */
+  RCC_IRQHandler,                 /*  5 */
+  EXTI0_IRQHandler,               /*  6 */
+  EXTI1_IRQHandler,               /*  7 */
+  EXTI2_TS_IRQHandler,            /*  8 */
+  EXTI3_IRQHandler,               /*  9 */
+  EXTI4_IRQHandler,               /* 10 */
+  DMA1_Channel1_IRQHandler,       /* 11 */
+  DMA1_Channel2_IRQHandler,       /* 12 */
+  DMA1_Channel3_IRQHandler,       /* 13 */
+  DMA1_Channel4_IRQHandler,       /* 14 */
+  DMA1_Channel5_IRQHandler,       /* 15 */
+  DMA1_Channel6_IRQHandler,       /* 16 */
+  DMA1_Channel7_IRQHandler,       /* 17 */
+  ADC1_IRQHandler,                /* 18 */
+  CAN1_TX_IRQHandler,             /* 19 */
+  CAN1_RX0_IRQHandler,            /* 20 */
+  CAN1_RX1_IRQHandler,            /* 21 */
+  CAN1_SCE_IRQHandler,            /* 22 */
+  EXTI9_5_IRQHandler,             /* 23 */
+  TIM15_IRQHandler,               /* 24 */
+  TIM16_IRQHandler,               /* 25 */
+  TIM17_IRQHandler,               /* 26 */
+  TIM18_DAC2_IRQHandler,          /* 27 */
+  TIM2_IRQHandler,                /* 28 */
+  TIM3_IRQHandler,                /* 29 */
+  TIM4_IRQHandler,                /* 30 */
+  I2C1_EV_IRQHandler,             /* 31 */
+  I2C1_ER_IRQHandler,             /* 32 */
+  I2C2_EV_IRQHandler,             /* 33 */
+  I2C2_ER_IRQHandler,             /* 34 */
+  SPI1_IRQHandler,                /* 35 */
+  SPI2_IRQHandler,                /* 36 */
+  USART1_IRQHandler,              /* 37 */
+  USART2_IRQHandler,              /* 38 */
+  USART3_IRQHandler,              /* 39 */
+  EXTI15_10_IRQHandler,           /* 40 */
+  RTC_Alarm_IRQHandler,           /* 41 */
+  CEC_IRQHandler,                 /* 42 */
+  TIM12_IRQHandler,               /* 43 */
+  TIM13_IRQHandler,               /* 44 */
+  TIM14_IRQHandler,               /* 45 */
+  SIM_DefaultHandler,             /* 46 */
+  SIM_DefaultHandler,             /* 47 */
+  SIM_DefaultHandler,             /* 48 */
+  SIM_DefaultHandler,             /* 49 */
+  TIM5_IRQHandler,                /* 50 */
+  SPI3_IRQHandler,                /* 51 */
+  SIM_DefaultHandler,             /* 52 */
+  SIM_DefaultHandler,             /* 53 */
+  TIM6_DAC1_IRQHandler,           /* 54 */
+  TIM7_IRQHandler,                /* 55 */
+  DMA2_Channel1_IRQHandler,       /* 56 */
+  DMA2_Channel2_IRQHandler,       /* 57 */
+  DMA2_Channel3_IRQHandler,       /* 58 */
+  DMA2_Channel4_IRQHandler,       /* 59 */
+  DMA2_Channel5_IRQHandler,       /* 60 */
+  SDADC1_IRQHandler,              /* 61 */
+  SDADC2_IRQHandler,              /* 62 */
+  SDADC3_IRQHandler,              /* 63 */
+  COMP_IRQHandler,                /* 64 */
+  SIM_DefaultHandler,             /* 65 */
+  SIM_DefaultHandler,             /* 66 */
+  SIM_DefaultHandler,             /* 67 */
+  SIM_DefaultHandler,             /* 68 */
+  SIM_DefaultHandler,             /* 69 */
+  SIM_DefaultHandler,             /* 70 */
+  SIM_DefaultHandler,             /* 71 */
+  SIM_DefaultHandler,             /* 72 */
+  SIM_DefaultHandler,             /* 73 */
+  USB_HP_IRQHandler,              /* 74 */
+  USB_LP_IRQHandler,              /* 75 */
+  USBWakeUp_IRQHandler,           /* 76 */
+  SIM_DefaultHandler,             /* 77 */
+  TIM19_IRQHandler,               /* 78 */
+  SIM_DefaultHandler,             /* 79 */
+  FPU_IRQHandler,                 /* 80 */
+};
+const uint32_t SIM_VectorCount = sizeof(SIM_Vectors) / sizeof(SIM_Vectors[0]);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Handler of the interrupts the application does not handle.
+  * @note   On the target such an interrupt ends up in an infinite loop; the
+  *         simulation only counts it (SIM_Stats_TypeDef.UnhandledIRQs).
+  * @param  None
+  * @retval None
+  */
+void SIM_DefaultHandler(void)
+{
+  SIM_Statistics.UnhandledIRQs++;
+}
@@ -0,0 +1,140 @@
+/**
+  ******************************************************************************
+  * @file    sim_bench_sd.c
+  * @brief   Bus time of the STM32373C-EVAL SPI SD driver on the SD card
+  *          model: blocks read then written with SD_ReadBlock() and
+  *          SD_WriteBlock(), the CMD17/CMD24 baseline where the CPU clocks
+  *          each data byte, then with SD_ReadMultiBlocks() and
+  *          SD_WriteMultiBlocks(), one block per call against 8 blocks per
+  *          CMD18/CMD25 stream. The card image is checked against a
+  *          reference after each pass. The baseline moves fewer blocks: each
+  *          of its data bytes costs several trapped register accesses.
+  *
+  *          The bus time is the duration of the bytes clocked at the
+  *          programmed SPI clock, with the default card delays of the model;
+  *          the register accesses per block are those trapped by the
+  *          simulator, the CPU work the DMA saves.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "stm32373c_eval_spi_sd.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_CARD_BLOCKS   2048    /* card capacity */
+#define SIM_BENCH_BLOCKS  256     /* blocks read and written per pass */
+#define SIM_BASE_BLOCKS   64      /* blocks of the SD_ReadBlock() pass */
+#define SIM_READ_BLOCK    100     /* first block read */
+#define SIM_WRITE_BLOCK   500     /* first block written */
+#define SIM_MAX_BLOCKS    8       /* longest transfer */
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static uint8_t SIM_Card[SIM_CARD_BLOCKS * 512];   /* image of the card model */
+static uint8_t SIM_Ref[SIM_CARD_BLOCKS * 512];    /* expected image */
+static uint8_t SIM_Buffer[SIM_MAX_BLOCKS * 512];
+
+static const uint32_t SIM_Blocks[] = { 1, SIM_MAX_BLOCKS };
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Prints the bus statistics of a pass and clears them.
+  * @param  pName: pass name.
+  * @param  Blocks: blocks per call.
+  * @param  Total: blocks of the pass.
+  * @retval None.
+  */
+static void SIM_Report(const char* pName, uint32_t Blocks, uint32_t Total)
+{
+  SIM_SD_Stats_TypeDef SD_Stats;
+  SIM_Stats_TypeDef Stats;
+  double Time;
+
+  SIM_SD_GetStats(&SD_Stats);
+  SIM_GetStats(&Stats);
+  Time = (double)SD_Stats.BusTime / 1e6;
+  printf("%-11s %6u %6u %8u %10u %10.2f %10.0f %10u\n", pName, (unsigned)Blocks,
+         (unsigned)Total, (unsigned)SD_Stats.Commands, (unsigned)SD_Stats.Bytes, Time,
+         (Time != 0) ? (Total * 512 / 1024.0) / (Time / 1e3) : 0,
+         (unsigned)((Stats.Reads + Stats.Writes) / Total));
+  SIM_SD_ClearStats();
+  SIM_ClearStats();
+}
+
+int main(void)
+{
+  uint32_t i, k, Blocks, failures = 0;
+
+  srand(1);
+  for (i = 0; i < sizeof(SIM_Card); i++)
+  {
+    SIM_Ref[i] = SIM_Card[i] = (uint8_t)rand();
+  }
+
+  SIM_Init();
+  SystemInit();
+  SystemCoreClockUpdate();
+  SIM_SD_Attach(SPI3, GPIOE, GPIO_Pin_2, SIM_Card, SIM_CARD_BLOCKS);
+  if (SD_Init() != SD_RESPONSE_NO_ERROR)
+  {
+    printf("sim_bench_sd: SD_Init failed\n");
+    return 1;
+  }
+  SIM_SD_ClearStats();
+  SIM_ClearStats();
+
+  printf("SPI SD, core at %u MHz\n", (unsigned)(SystemCoreClock / 1000000));
+  printf("%-11s %6s %6s %8s %10s %10s %10s %10s\n",
+         "pass", "call", "blocks", "commands", "bytes", "bus ms", "KB/s", "acc/block");
+
+  /* Baseline: one CMD17 or CMD24 per block, bytes clocked by the CPU */
+  for (i = 0; i < SIM_BASE_BLOCKS; i++)
+  {
+    failures += (SD_ReadBlock(SIM_Buffer, (SIM_READ_BLOCK + i) * 512, 512) != SD_RESPONSE_NO_ERROR);
+    failures += (memcmp(SIM_Buffer, &SIM_Ref[(SIM_READ_BLOCK + i) * 512], 512) != 0);
+  }
+  SIM_Report("ReadBlock", 1, SIM_BASE_BLOCKS);
+
+  for (i = 0; i < SIM_BASE_BLOCKS; i++)
+  {
+    memset(SIM_Buffer, (int)(i + 0x80), 512);
+    memset(&SIM_Ref[(SIM_WRITE_BLOCK + i) * 512], (int)(i + 0x80), 512);
+    failures += (SD_WriteBlock(SIM_Buffer, (SIM_WRITE_BLOCK + i) * 512, 512) != SD_RESPONSE_NO_ERROR);
+  }
+  SIM_Report("WriteBlock", 1, SIM_BASE_BLOCKS);
+  failures += (memcmp(SIM_Card, SIM_Ref, sizeof(SIM_Card)) != 0);
+
+  for (k = 0; k < sizeof(SIM_Blocks) / sizeof(SIM_Blocks[0]); k++)
+  {
+    Blocks = SIM_Blocks[k];
+
+    for (i = 0; i < SIM_BENCH_BLOCKS; i += Blocks)
+    {
+      failures += (SD_ReadMultiBlocks(SIM_Buffer, (SIM_READ_BLOCK + i) * 512, 512, Blocks)
+                   != SD_RESPONSE_NO_ERROR);
+      failures += (memcmp(SIM_Buffer, &SIM_Ref[(SIM_READ_BLOCK + i) * 512], Blocks * 512) != 0);
+    }
+    SIM_Report("ReadMulti", Blocks, SIM_BENCH_BLOCKS);
+
+    for (i = 0; i < SIM_BENCH_BLOCKS; i += Blocks)
+    {
+      memset(SIM_Buffer, (int)(i + k), Blocks * 512);
+      memset(&SIM_Ref[(SIM_WRITE_BLOCK + i) * 512], (int)(i + k), Blocks * 512);
+      failures += (SD_WriteMultiBlocks(SIM_Buffer, (SIM_WRITE_BLOCK + i) * 512, 512, Blocks)
+                   != SD_RESPONSE_NO_ERROR);
+    }
+    SIM_Report("WriteMulti", Blocks, SIM_BENCH_BLOCKS);
+    failures += (memcmp(SIM_Card, SIM_Ref, sizeof(SIM_Card)) != 0);
+  }
+
+  printf("sim_bench_sd: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
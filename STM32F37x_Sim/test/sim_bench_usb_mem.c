@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file    sim_bench_usb_mem.c
+  * @brief   Throughput of the PMA copy routines of usb_mem.c, word path
+  *          against byte path, for 8, 64 and 512 byte transfers.
+  *
+  *          The bytes per cycle use DWT->CYCCNT, derived by the simulator
+  *          from the host clock scaled to SystemCoreClock: they rank the
+  *          two paths on this host, they are not the cycle counts of the
+  *          target.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef void (*SIM_Copy_TypeDef)(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_BENCH_BYTES   (4 * 1024 * 1024)   /* copied per measurement */
+#define SIM_BENCH_PMA     0x0000              /* PMA offset of the buffer */
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static uint32_t SIM_Buffer[512 / 4];
+
+static const uint16_t SIM_Sizes[] = { 8, 64, 512 };
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Times SIM_BENCH_BYTES bytes of copies of one size.
+  * @param  Copy: copy routine.
+  * @param  Size: bytes per copy.
+  * @retval Bytes per cycle.
+  */
+static double SIM_Bench(SIM_Copy_TypeDef Copy, uint16_t Size)
+{
+  uint32_t i, count = SIM_BENCH_BYTES / Size;
+  uint32_t start, cycles;
+
+  Copy((uint8_t*)SIM_Buffer, SIM_BENCH_PMA, Size);
+  start = DWT->CYCCNT;
+  for (i = 0; i < count; i++)
+  {
+    Copy((uint8_t*)SIM_Buffer, SIM_BENCH_PMA, Size);
+  }
+  cycles = DWT->CYCCNT - start;
+  return (double)count * Size / (double)((cycles != 0) ? cycles : 1);
+}
+
+int main(void)
+{
+  uint32_t i;
+
+  SIM_Init();
+  SystemInit();
+  SystemCoreClockUpdate();
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  for (i = 0; i < sizeof(SIM_Buffer) / sizeof(SIM_Buffer[0]); i++)
+  {
+    SIM_Buffer[i] = i * 0x01010101;
+  }
+
+  printf("PMA copy, bytes/cycle at %u MHz (host clock)\n",
+         (unsigned)(SystemCoreClock / 1000000));
+  printf("%6s %10s %10s %10s %10s\n", "bytes", "to PMA", "to PMA/b", "from PMA", "from PMA/b");
+  for (i = 0; i < sizeof(SIM_Sizes) / sizeof(SIM_Sizes[0]); i++)
+  {
+    printf("%6u %10.3f %10.3f %10.3f %10.3f\n", (unsigned)SIM_Sizes[i],
+           SIM_Bench(UserToPMABufferCopy, SIM_Sizes[i]),
+           SIM_Bench(UserToPMABufferCopy_Byte, SIM_Sizes[i]),
+           SIM_Bench(PMAToUserBufferCopy, SIM_Sizes[i]),
+           SIM_Bench(PMAToUserBufferCopy_Byte, SIM_Sizes[i]));
+  }
+  return 0;
+}
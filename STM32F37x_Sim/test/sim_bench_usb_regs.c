@@ -0,0 +1,159 @@
+/**
+  ******************************************************************************
+  * @file    sim_bench_usb_regs.c
+  * @brief   Host instructions per packet of the USB interrupt: CTR_LP, the
+  *          endpoint callbacks of a bulk class and their SIL and usb_regs
+  *          calls. Built twice by "make simbench", with the usb_regs.c
+  *          functions and with their USB_REGS_INLINE variant.
+  *
+  *          The counts are x86-64 instructions of the host build, trace
+  *          (USB_TRACE) included: compare the two variants, not the target.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_PACKETS       64    /* packets measured per direction */
+#define SIM_PACKET_SIZE   64
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+__IO uint16_t wIstr;
+
+static uint8_t  SIM_Data[SIM_PACKET_SIZE];
+static uint64_t SIM_IsrInsn;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_Nop(void);
+static void SIM_EP1_IN_Callback(void);
+static void SIM_EP2_OUT_Callback(void);
+static void SIM_Init_Device(void);
+static RESULT SIM_Unsupported(uint8_t RequestNo);
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting);
+static uint8_t* SIM_NoDescriptor(uint16_t Length);
+
+/* Bulk IN endpoint 1 and bulk OUT endpoint 2, serviced like a class would */
+DEVICE Device_Table = { EP_NUM, 1 };
+DEVICE_PROP Device_Property =
+{
+  SIM_Init_Device, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Unsupported, SIM_Unsupported,
+  SIM_Interface, SIM_NoDescriptor, SIM_NoDescriptor, SIM_NoDescriptor, 0, 64
+};
+USER_STANDARD_REQUESTS User_Standard_Requests =
+{
+  SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+void (*pEpInt_IN[7])(void) =
+{
+  SIM_EP1_IN_Callback, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+void (*pEpInt_OUT[7])(void) =
+{
+  SIM_Nop, SIM_EP2_OUT_Callback, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static void SIM_Nop(void)
+{
+}
+
+static void SIM_EP1_IN_Callback(void)
+{
+  USB_SIL_Write(EP1_IN, SIM_Data, SIM_PACKET_SIZE);
+  SetEPTxValid(ENDP1);
+}
+
+static void SIM_EP2_OUT_Callback(void)
+{
+  USB_SIL_Read(EP2_OUT, SIM_Data);
+  SetEPRxValid(ENDP2);
+}
+
+static void SIM_Init_Device(void)
+{
+  USB_PMA_Init(0, EP_NUM);
+  USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  SetEPTxAddr(ENDP1, USB_PMA_Alloc(SIM_PACKET_SIZE));
+  SetEPRxAddr(ENDP2, USB_PMA_Alloc(SIM_PACKET_SIZE));
+  SetEPType(ENDP1, EP_BULK);
+  SetEPAddress(ENDP1, ENDP1);
+  SetEPRxStatus(ENDP1, EP_RX_DIS);
+  SetEPType(ENDP2, EP_BULK);
+  SetEPAddress(ENDP2, ENDP2);
+  SetEPRxCount(ENDP2, SIM_PACKET_SIZE);
+  SetEPTxStatus(ENDP2, EP_TX_DIS);
+  SetEPRxValid(ENDP2);
+  USB_SIL_Write(EP1_IN, SIM_Data, SIM_PACKET_SIZE);
+  SetEPTxValid(ENDP1);
+  _SetCNTR(CNTR_CTRM);
+  _SetISTR(0);
+}
+
+static RESULT SIM_Unsupported(uint8_t RequestNo)
+{
+  return USB_UNSUPPORT;
+}
+
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting)
+{
+  return USB_SUCCESS;
+}
+
+static uint8_t* SIM_NoDescriptor(uint16_t Length)
+{
+  return 0;
+}
+
+void USB_LP_IRQHandler(void)
+{
+  SIM_InsnCountStart();
+  wIstr = _GetISTR();
+  if ((wIstr & ISTR_CTR) != 0)
+  {
+    CTR_LP();
+  }
+  SIM_IsrInsn += SIM_InsnCountStop();
+}
+
+int main(void)
+{
+  uint8_t Packet[SIM_PACKET_SIZE];
+  uint64_t InInsn = 0, OutInsn = 0;
+  uint32_t i, Errors = 0;
+
+  SIM_Init();
+  SystemInit();
+  USB_Trace_Init();
+  USB_Init();
+  NVIC_EnableIRQ(USB_LP_IRQn);
+
+  for (i = 0; i < SIM_PACKET_SIZE; i++)
+  {
+    Packet[i] = (uint8_t)i;
+  }
+  for (i = 0; i < SIM_PACKETS; i++)
+  {
+    SIM_IsrInsn = 0;
+    Errors += (SIM_USB_HostOut(ENDP2, Packet, SIM_PACKET_SIZE) != SIM_PACKET_SIZE);
+    OutInsn += SIM_IsrInsn;
+    SIM_IsrInsn = 0;
+    Errors += (SIM_USB_HostIn(ENDP1, Packet) != SIM_PACKET_SIZE);
+    InInsn += SIM_IsrInsn;
+  }
+
+#ifdef USB_REGS_INLINE
+  printf("USB interrupt, usb_regs inline:   ");
+#else
+  printf("USB interrupt, usb_regs calls:    ");
+#endif /* USB_REGS_INLINE */
+  printf("%5u instructions per OUT packet, %5u per IN packet\n",
+         (unsigned)(OutInsn / SIM_PACKETS), (unsigned)(InInsn / SIM_PACKETS));
+  return (Errors == 0) ? 0 : 1;
+}
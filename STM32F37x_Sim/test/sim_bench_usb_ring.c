@@ -0,0 +1,179 @@
+/**
+  ******************************************************************************
+  * @file    sim_bench_usb_ring.c
+  * @brief   Stress and throughput of the single producer, single consumer
+  *          byte ring of usb_ring.c. A producer thread and a consumer
+  *          thread run the zero copy peek/commit calls concurrently on the
+  *          host cores with random span lengths, the consumer checks that
+  *          the byte stream comes out complete and in order. A thread
+  *          finding the ring full or empty yields, for single core hosts.
+  *
+  *          The bytes per cycle use DWT->CYCCNT, derived by the simulator
+  *          from the host clock scaled to SystemCoreClock: they compare the
+  *          ring sizes on this host, they are not the cycle counts of the
+  *          target.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  USB_Ring_TypeDef Ring;
+  uint32_t Seed;
+  uint32_t Errors;
+} SIM_Stress_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_BENCH_BYTES   (16 * 1024 * 1024)   /* streamed per measurement */
+#define SIM_SPAN_MAX      64                   /* longest span per commit */
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static uint8_t SIM_Storage[4096];
+
+static const uint32_t SIM_Sizes[] = { 64, 256, 4096 };
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Pseudo random span length, 1 to SIM_SPAN_MAX bytes.
+  * @param  pSeed: generator state of the calling thread.
+  * @retval Length.
+  */
+static uint32_t SIM_Span(uint32_t *pSeed)
+{
+  *pSeed = *pSeed * 1664525 + 1013904223;
+  return ((*pSeed >> 16) % SIM_SPAN_MAX) + 1;
+}
+
+/**
+  * @brief  Producer: writes the byte stream 0, 1, 2... in random spans.
+  * @param  pArg: stress state.
+  * @retval None.
+  */
+static void *SIM_Producer(void *pArg)
+{
+  SIM_Stress_TypeDef *pStress = (SIM_Stress_TypeDef *)pArg;
+  uint32_t Seed = pStress->Seed, Written = 0, Length, Span, i;
+  uint8_t *pSpan;
+
+  while (Written < SIM_BENCH_BYTES)
+  {
+    Length = SIM_Span(&Seed);
+    Span = USB_Ring_WritePeek(&pStress->Ring, &pSpan);
+    if (Span == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    if (Length > Span)
+    {
+      Length = Span;
+    }
+    if (Length > (SIM_BENCH_BYTES - Written))
+    {
+      Length = SIM_BENCH_BYTES - Written;
+    }
+    for (i = 0; i < Length; i++)
+    {
+      pSpan[i] = (uint8_t)(Written + i);
+    }
+    USB_Ring_WriteCommit(&pStress->Ring, Length);
+    Written += Length;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Consumer: reads the byte stream in random spans and counts the
+  *         bytes out of sequence.
+  * @param  pArg: stress state.
+  * @retval None.
+  */
+static void *SIM_Consumer(void *pArg)
+{
+  SIM_Stress_TypeDef *pStress = (SIM_Stress_TypeDef *)pArg;
+  uint32_t Seed = ~pStress->Seed, Read = 0, Length, Span, i;
+  uint8_t *pSpan;
+
+  while (Read < SIM_BENCH_BYTES)
+  {
+    Length = SIM_Span(&Seed);
+    Span = USB_Ring_ReadPeek(&pStress->Ring, &pSpan);
+    if (Span == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    if (Length > Span)
+    {
+      Length = Span;
+    }
+    for (i = 0; i < Length; i++)
+    {
+      pStress->Errors += (pSpan[i] != (uint8_t)(Read + i));
+    }
+    USB_Ring_ReadCommit(&pStress->Ring, Length);
+    Read += Length;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Streams SIM_BENCH_BYTES bytes through a ring of one size.
+  * @param  Size: ring size in bytes.
+  * @param  pErrors: bytes out of sequence.
+  * @retval Bytes per cycle.
+  */
+static double SIM_Bench(uint32_t Size, uint32_t *pErrors)
+{
+  SIM_Stress_TypeDef Stress;
+  pthread_t Producer, Consumer;
+  uint32_t start, cycles;
+
+  USB_Ring_Init(&Stress.Ring, SIM_Storage, Size);
+  Stress.Seed = Size;
+  Stress.Errors = 0;
+
+  start = DWT->CYCCNT;
+  pthread_create(&Consumer, 0, SIM_Consumer, &Stress);
+  pthread_create(&Producer, 0, SIM_Producer, &Stress);
+  pthread_join(Producer, 0);
+  pthread_join(Consumer, 0);
+  cycles = DWT->CYCCNT - start;
+
+  *pErrors = Stress.Errors + (USB_Ring_Count(&Stress.Ring) != 0);
+  return (double)SIM_BENCH_BYTES / (double)((cycles != 0) ? cycles : 1);
+}
+
+int main(void)
+{
+  uint32_t i, Errors, failures = 0;
+  double Rate;
+
+  SIM_Init();
+  SystemInit();
+  SystemCoreClockUpdate();
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  printf("SPSC ring, %u MB by two threads, bytes/cycle at %u MHz (host clock)\n",
+         (unsigned)(SIM_BENCH_BYTES >> 20), (unsigned)(SystemCoreClock / 1000000));
+  printf("%6s %10s %10s\n", "size", "rate", "errors");
+  for (i = 0; i < sizeof(SIM_Sizes) / sizeof(SIM_Sizes[0]); i++)
+  {
+    Rate = SIM_Bench(SIM_Sizes[i], &Errors);
+    printf("%6u %10.3f %10u\n", (unsigned)SIM_Sizes[i], Rate, (unsigned)Errors);
+    failures += Errors;
+  }
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,488 @@
+/**
+  ******************************************************************************
+  * @file    sim_msc_nand.c
+  * @brief   Test of the NAND flash interface of the Mass_Storage example
+  *          (nand_if.c) on the NAND flash model: blocks written and
+  *          rewritten in two zones, made durable with NAND_Sync(), then
+  *          read back after a new mount, which must load the look up tables
+  *          from the checkpoint instead of scanning the spare areas. The
+  *          power is then cut at each program or erase of a checkpoint in
+  *          turn: every mount after the cut must still find the data.
+  *          Last, the wear levelling: a block merged in background keeps
+  *          its data at each step and its new mapping across mounts, and a
+  *          page rewritten again and again spreads the erases, counted in
+  *          word 3 of the spare areas, evenly over the free blocks.
+  *
+  *          The FSMC NAND driver (fsmc_nand.c) is replaced by the functions
+  *          below, that drive the model at the page level. Built by
+  *          "make simmsc" with USE_STM3210E_EVAL, stm32f10x.h standing for
+  *          stm32f37x.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "fsmc_nand.h"
+#include "nand_if.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_NAND_BLOCKS   (NAND_ZONE_SIZE * NAND_MAX_ZONE)
+#define SIM_RANGE_PAGES   (4 * NAND_BLOCK_SIZE)   /* pages of each range tested */
+#define SIM_RANGES        2
+#define SIM_MAX_CUTS      64      /* programs and erases of a checkpoint, at most */
+#define SIM_REWRITES      240     /* rewrites of one page, about 10 per free block */
+#define SIM_BLOCK_MASK    (MAX_PHY_BLOCKS_PER_ZONE - 1)
+#define SIM_POOL_SIZE     (MAX_PHY_BLOCKS_PER_ZONE - MAX_LOG_BLOCKS_PER_ZONE)
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+#define SIM_ROW(Address) ((Address).Page + ((Address).Block + ((Address).Zone * NAND_ZONE_SIZE)) * NAND_BLOCK_SIZE)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t SIM_Flash[SIM_NAND_BLOCKS * SIM_NAND_BLOCK_BYTES];
+static uint32_t SIM_Page[NAND_PAGE_SIZE / 4];
+
+/* First page of each range: blocks of zone 0, then of zone 1 */
+static const uint32_t SIM_Range[SIM_RANGES] =
+  { 0, (MAX_LOG_BLOCKS_PER_ZONE + 2) * NAND_BLOCK_SIZE };
+/* Data version of each page, 0 if never written */
+static uint8_t SIM_Version[SIM_RANGES][SIM_RANGE_PAGES];
+static uint32_t SIM_Overwrites;
+
+/* Look up table of the selected zone (nand_if.c) */
+extern uint16_t *LUT;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_msc_nand.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+/**
+  * @brief  FSMC NAND driver of the model: nothing to configure.
+  * @param  None.
+  * @retval None.
+  */
+void FSMC_NAND_Init(void)
+{
+}
+
+/**
+  * @brief  FSMC NAND driver of the model: identifiers of the NAND128W3A.
+  * @param  NAND_ID: identifiers.
+  * @retval None.
+  */
+void FSMC_NAND_ReadID(NAND_IDTypeDef* NAND_ID)
+{
+  NAND_ID->Maker_ID = 0x20;
+  NAND_ID->Device_ID = 0x73;
+  NAND_ID->Third_ID = 0x00;
+  NAND_ID->Fourth_ID = 0x00;
+}
+
+/**
+  * @brief  Status of fsmc_nand.c for a status register of the model.
+  * @param  Status: status register.
+  * @retval NAND_READY or NAND_ERROR.
+  */
+static uint32_t SIM_NAND_Status(uint8_t Status)
+{
+  return (Status & SIM_NAND_STATUS_FAIL) ? NAND_ERROR : NAND_READY;
+}
+
+/**
+  * @brief  FSMC NAND driver of the model: programs Count areas of Size bytes
+  *         at Column of consecutive pages, as fsmc_nand.c does.
+  * @param  pBuffer: data.
+  * @param  Address: first page.
+  * @param  Count: pages.
+  * @param  Column: 0 for the data area, NAND_PAGE_SIZE for the spare area.
+  * @param  Size: NAND_PAGE_SIZE or NAND_SPARE_AREA_SIZE.
+  * @retval Status and address status.
+  */
+static uint32_t SIM_NAND_Write(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t Count,
+                               uint32_t Column, uint32_t Size)
+{
+  uint32_t addressstatus = NAND_VALID_ADDRESS, status = NAND_READY;
+
+  while ((Count != 0) && (addressstatus == NAND_VALID_ADDRESS) && (status == NAND_READY))
+  {
+    status = SIM_NAND_Status(SIM_NAND_Program(SIM_ROW(Address), Column, pBuffer, Size));
+    if (status == NAND_READY)
+    {
+      pBuffer += Size;
+      Count--;
+      addressstatus = FSMC_NAND_AddressIncrement(&Address);
+    }
+  }
+  return (status | addressstatus);
+}
+
+/**
+  * @brief  FSMC NAND driver of the model: reads Count areas of Size bytes at
+  *         Column of consecutive pages, as fsmc_nand.c does.
+  * @param  pBuffer: data.
+  * @param  Address: first page.
+  * @param  Count: pages.
+  * @param  Column: 0 for the data area, NAND_PAGE_SIZE for the spare area.
+  * @param  Size: NAND_PAGE_SIZE or NAND_SPARE_AREA_SIZE.
+  * @retval Status and address status.
+  */
+static uint32_t SIM_NAND_ReadArea(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t Count,
+                                  uint32_t Column, uint32_t Size)
+{
+  uint32_t addressstatus = NAND_VALID_ADDRESS, status = NAND_READY;
+
+  while ((Count != 0) && (addressstatus == NAND_VALID_ADDRESS))
+  {
+    if (SIM_NAND_Status(SIM_NAND_Read(SIM_ROW(Address), Column, pBuffer, Size)) != NAND_READY)
+    {
+      status = NAND_ERROR;
+    }
+    pBuffer += Size;
+    Count--;
+    addressstatus = FSMC_NAND_AddressIncrement(&Address);
+  }
+  return (status | addressstatus);
+}
+
+uint32_t FSMC_NAND_WriteSmallPage(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumPageToWrite)
+{
+  return SIM_NAND_Write(pBuffer, Address, NumPageToWrite, 0, NAND_PAGE_SIZE);
+}
+
+uint32_t FSMC_NAND_ReadSmallPage(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumPageToRead)
+{
+  return SIM_NAND_ReadArea(pBuffer, Address, NumPageToRead, 0, NAND_PAGE_SIZE);
+}
+
+uint32_t FSMC_NAND_WriteSpareArea(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumSpareAreaTowrite)
+{
+  return SIM_NAND_Write(pBuffer, Address, NumSpareAreaTowrite, NAND_PAGE_SIZE, NAND_SPARE_AREA_SIZE);
+}
+
+uint32_t FSMC_NAND_ReadSpareArea(uint8_t *pBuffer, NAND_ADDRESS Address, uint32_t NumSpareAreaToRead)
+{
+  return SIM_NAND_ReadArea(pBuffer, Address, NumSpareAreaToRead, NAND_PAGE_SIZE, NAND_SPARE_AREA_SIZE);
+}
+
+uint32_t FSMC_NAND_EraseBlock(NAND_ADDRESS Address)
+{
+  return SIM_NAND_Status(SIM_NAND_Erase(SIM_ROW(Address)));
+}
+
+uint32_t FSMC_NAND_Reset(void)
+{
+  return NAND_READY;
+}
+
+uint32_t FSMC_NAND_GetStatus(void)
+{
+  return NAND_READY;
+}
+
+uint32_t FSMC_NAND_ReadStatus(void)
+{
+  return NAND_READY;
+}
+
+uint32_t FSMC_NAND_AddressIncrement(NAND_ADDRESS* Address)
+{
+  uint32_t status = NAND_VALID_ADDRESS;
+
+  Address->Page++;
+  if (Address->Page == NAND_BLOCK_SIZE)
+  {
+    Address->Page = 0;
+    Address->Block++;
+    if (Address->Block == NAND_ZONE_SIZE)
+    {
+      Address->Block = 0;
+      Address->Zone++;
+      if (Address->Zone == NAND_MAX_ZONE)
+      {
+        status = NAND_INVALID_ADDRESS;
+      }
+    }
+  }
+  return (status);
+}
+
+/**
+  * @brief  Returns the statistics of the model and clears them.
+  * @param  pStats: statistics.
+  * @retval None.
+  */
+static void SIM_TakeStats(SIM_NAND_Stats_TypeDef* pStats)
+{
+  SIM_NAND_GetStats(pStats);
+  SIM_NAND_ClearStats();
+  SIM_Overwrites += pStats->Overwrites;
+}
+
+/**
+  * @brief  Fills a page with the data of a version, erased for version 0.
+  * @param  Page: logical page.
+  * @param  Version: data version.
+  * @retval None.
+  */
+static void SIM_Fill(uint32_t Page, uint8_t Version)
+{
+  uint32_t i;
+
+  for (i = 0; i < (NAND_PAGE_SIZE / 4); i++)
+  {
+    SIM_Page[i] = (Version == 0) ? 0xFFFFFFFF : ((Page << 16) ^ (Version << 8) ^ i);
+  }
+}
+
+/**
+  * @brief  Writes pages of a range with a new version.
+  * @param  Range: range index.
+  * @param  First: first page in the range.
+  * @param  Count: pages.
+  * @param  Version: data version.
+  * @retval Number of failed NAND_Write() calls.
+  */
+static uint32_t SIM_Write(uint32_t Range, uint32_t First, uint32_t Count, uint8_t Version)
+{
+  uint32_t Page, Failed = 0;
+
+  for (Page = First; Page < (First + Count); Page++)
+  {
+    SIM_Fill(SIM_Range[Range] + Page, Version);
+    Failed += (NAND_Write((SIM_Range[Range] + Page) * NAND_PAGE_SIZE, SIM_Page, NAND_PAGE_SIZE) != NAND_OK);
+    SIM_Version[Range][Page] = Version;
+  }
+  return Failed;
+}
+
+/**
+  * @brief  Reads every page of the ranges back.
+  * @param  None.
+  * @retval Number of pages that differ from their last version.
+  */
+static uint32_t SIM_Verify(void)
+{
+  static uint32_t Data[NAND_PAGE_SIZE / 4];
+  uint32_t Range, Page, Mismatch = 0;
+
+  for (Range = 0; Range < SIM_RANGES; Range++)
+  {
+    for (Page = 0; Page < SIM_RANGE_PAGES; Page++)
+    {
+      SIM_Fill(SIM_Range[Range] + Page, SIM_Version[Range][Page]);
+      if ((NAND_Read((SIM_Range[Range] + Page) * NAND_PAGE_SIZE, Data, NAND_PAGE_SIZE) != NAND_OK)
+          || (memcmp(Data, SIM_Page, NAND_PAGE_SIZE) != 0))
+      {
+        Mismatch++;
+      }
+    }
+  }
+  return Mismatch;
+}
+
+/**
+  * @brief  Mounts the NAND, then reads the ranges back.
+  * @param  pScanned: set to 1 if a zone table was built from the spare
+  *         areas instead of being loaded from the checkpoint.
+  * @retval Number of pages that differ from their last version.
+  */
+static uint32_t SIM_Mount(uint32_t* pScanned)
+{
+  SIM_NAND_Stats_TypeDef Stats;
+  uint32_t Mismatch;
+
+  SIM_TakeStats(&Stats);
+  NAND_Init();
+  Mismatch = SIM_Verify();
+  SIM_TakeStats(&Stats);
+  *pScanned = (Stats.SparesRead >= MAX_PHY_BLOCKS_PER_ZONE);
+  return Mismatch;
+}
+
+/**
+  * @brief  Physical block of a logical block of zone 0.
+  * @param  Block: logical block.
+  * @retval Physical block.
+  */
+static uint16_t SIM_Map(uint16_t Block)
+{
+  /* Select the table of zone 0 */
+  NAND_Read(0, SIM_Page, NAND_PAGE_SIZE);
+  return LUT[Block] & SIM_BLOCK_MASK;
+}
+
+/**
+  * @brief  Tells whether a physical block of zone 0 is among the free ones.
+  * @param  Block: physical block.
+  * @retval 1 if it is, else 0.
+  */
+static uint32_t SIM_IsFree(uint16_t Block)
+{
+  uint32_t i;
+
+  SIM_Map(0);
+  for (i = MAX_LOG_BLOCKS_PER_ZONE; i < MAX_PHY_BLOCKS_PER_ZONE; i++)
+  {
+    if (!(LUT[i] & (BAD_BLOCK | USED_BLOCK)) && ((LUT[i] & SIM_BLOCK_MASK) == Block))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Erase count of a physical block of zone 0, from its spare area.
+  * @param  Block: physical block.
+  * @retval Erase count.
+  */
+static uint32_t SIM_EraseCount(uint16_t Block)
+{
+  SPARE_AREA SpareArea = ReadSpareArea(Block * NAND_BLOCK_SIZE);
+
+  return (SpareArea.EraseCount == 0xFFFF) ? 0 : SpareArea.EraseCount;
+}
+
+int main(void)
+{
+  SIM_NAND_Stats_TypeDef Stats;
+  uint32_t Cut, Scanned, Written = 0, failures = 0;
+  uint32_t i, Steps, Work, Mismatch, Count, Min, Max, Wrong;
+  uint16_t Old, New, Block;
+
+  memset(SIM_Flash, 0xFF, sizeof(SIM_Flash));
+  SIM_NAND_Attach(SIM_Flash, SIM_NAND_BLOCKS);
+
+  /* Blank NAND: the tables are built from the spare areas */
+  SIM_CHECK(SIM_Mount(&Scanned) == 0);
+  SIM_CHECK(Scanned);
+
+  /* Whole blocks of both zones, then pages rewritten in the middle of a
+     block and across two blocks */
+  SIM_CHECK(SIM_Write(0, 0, SIM_RANGE_PAGES, 1) == 0);
+  SIM_CHECK(SIM_Write(1, 0, SIM_RANGE_PAGES, 1) == 0);
+  SIM_CHECK(SIM_Write(0, NAND_BLOCK_SIZE + 5, 7, 2) == 0);
+  SIM_CHECK(SIM_Write(1, (2 * NAND_BLOCK_SIZE) - 3, 6, 2) == 0);
+  SIM_CHECK(SIM_Verify() == 0);
+
+  /* Checkpoint, then mount from it */
+  SIM_CHECK(NAND_Sync() == NAND_OK);
+  SIM_CHECK(SIM_Verify() == 0);
+  SIM_CHECK(SIM_Mount(&Scanned) == 0);
+  SIM_CHECK(!Scanned);
+
+  /* Written after the checkpoint and merged: zone 0 no longer matches it */
+  SIM_CHECK(SIM_Write(0, 3, 40, 3) == 0);
+  while (NAND_GC())
+  {
+  }
+  SIM_CHECK(SIM_Mount(&Scanned) == 0);
+  SIM_CHECK(Scanned);
+
+  /* Power cut at each program or erase of the checkpoint in turn: the next
+     mount uses the previous checkpoint, or none, and finds the data */
+  for (Cut = 0; Cut < SIM_MAX_CUTS; Cut++)
+  {
+    SIM_TakeStats(&Stats);
+    SIM_NAND_PowerCut(Cut);
+    NAND_Sync();
+    SIM_NAND_PowerCut(SIM_NAND_NO_POWER_CUT);
+    SIM_TakeStats(&Stats);
+    SIM_CHECK(SIM_Mount(&Scanned) == 0);
+    if (Stats.Lost == 0)
+    {
+      /* Not cut: this checkpoint is used */
+      SIM_CHECK(!Scanned);
+      break;
+    }
+    SIM_CHECK(Scanned);
+    Written++;
+  }
+  SIM_CHECK((Written > 0) && (Cut < SIM_MAX_CUTS));
+
+  /* Background merge of a rewritten block: the reads see each page copied,
+     then the logical block moves to the new block and the old one, erased
+     once more, joins the free blocks */
+  Old = SIM_Map(2);
+  Count = SIM_NAND_GetEraseCount(Old);
+  SIM_CHECK(SIM_Write(0, (2 * NAND_BLOCK_SIZE) + 10, 4, 4) == 0);
+  Steps = 0;
+  Mismatch = 0;
+  do
+  {
+    Work = NAND_GC();
+    Steps++;
+    Mismatch += SIM_Verify();
+  }
+  while (Work && (Steps < NAND_BLOCK_SIZE));
+  SIM_CHECK(Mismatch == 0);
+  SIM_CHECK(Steps == (((NAND_BLOCK_SIZE - 4) + NAND_GC_PAGES - 1) / NAND_GC_PAGES));
+  New = SIM_Map(2);
+  SIM_CHECK(New != Old);
+  SIM_CHECK(SIM_IsFree(Old));
+  SIM_CHECK(SIM_NAND_GetEraseCount(Old) == (Count + 1));
+  SIM_CHECK(SIM_EraseCount(Old) == SIM_NAND_GetEraseCount(Old));
+
+  /* The mapping is found again by scanning, then from a checkpoint */
+  SIM_CHECK(SIM_Mount(&Scanned) == 0);
+  SIM_CHECK(Scanned && (SIM_Map(2) == New));
+  SIM_CHECK(NAND_Sync() == NAND_OK);
+  SIM_CHECK(SIM_Mount(&Scanned) == 0);
+  SIM_CHECK(!Scanned && (SIM_Map(2) == New));
+
+  /* One page rewritten again and again, with a mount half way: each rewrite
+     takes the least worn free block, so the erases spread evenly over the
+     free blocks and the block in use */
+  for (i = 0; i < SIM_REWRITES; i++)
+  {
+    SIM_CHECK(SIM_Write(0, (3 * NAND_BLOCK_SIZE) + 7, 1, (uint8_t)(5 + (i % 200))) == 0);
+    while (NAND_GC())
+    {
+    }
+    if (i == (SIM_REWRITES / 2))
+    {
+      SIM_CHECK(NAND_Sync() == NAND_OK);
+      SIM_CHECK(SIM_Mount(&Scanned) == 0);
+    }
+  }
+  SIM_CHECK(SIM_Verify() == 0);
+
+  /* Erase counts of the block in use, then of the free blocks */
+  Block = SIM_Map(3);
+  Min = Max = SIM_EraseCount(Block);
+  Wrong = (Min != SIM_NAND_GetEraseCount(Block));
+  for (i = MAX_LOG_BLOCKS_PER_ZONE; i < MAX_PHY_BLOCKS_PER_ZONE; i++)
+  {
+    if (LUT[i] & (BAD_BLOCK | USED_BLOCK))
+    {
+      continue;
+    }
+    Block = LUT[i] & SIM_BLOCK_MASK;
+    Count = SIM_EraseCount(Block);
+    Wrong += (Count != SIM_NAND_GetEraseCount(Block));
+    Min = (Count < Min) ? Count : Min;
+    Max = (Count > Max) ? Count : Max;
+  }
+  SIM_CHECK(Wrong == 0);
+  SIM_CHECK(Min >= (SIM_REWRITES / (SIM_POOL_SIZE + 1)) - 1);
+  SIM_CHECK((Max - Min) <= 1);
+
+  /* No byte was programmed over cells that could not take its value */
+  SIM_TakeStats(&Stats);
+  SIM_CHECK(SIM_Overwrites == 0);
+
+  printf("sim_msc_nand: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
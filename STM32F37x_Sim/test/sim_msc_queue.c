@@ -0,0 +1,247 @@
+/**
+  ******************************************************************************
+  * @file    sim_msc_queue.c
+  * @brief   Test of the asynchronous MAL requests of the Mass_Storage example
+  *          on the simulator. Requests queued on a RAM virtual disk of lun 1,
+  *          with media latencies, complete in submission order from
+  *          MAL_Poll() with their status, then their callback runs; one
+  *          callback queues a further request. The requests flagged
+  *          MAL_FLAG_USB_MASKED mask the USB interrupt from their start to
+  *          their completion, nested in the masking of the caller.
+  *
+  *          Built with the Mass_Storage sources by "make simmsc".
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "hw_config.h"
+#include "mass_mal.h"
+#include "mass_vdisk.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_LUN           1
+#define SIM_BLOCKS        32      /* RAM disk size */
+#define SIM_DATA_LBA      4       /* first block written and read back */
+#define SIM_DATA_BLOCKS   4
+#define SIM_REQUESTS      5       /* the last one is queued by a callback */
+#define SIM_STEPS         100000  /* 20 us steps before the queue times out */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+#define SIM_USB_ENABLED() \
+  ((NVIC->ISER[(uint32_t)USB_LP_IRQn >> 5] & (1UL << ((uint32_t)USB_LP_IRQn & 0x1F))) != 0)
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t SIM_Media[SIM_BLOCKS * VDISK_BLOCK_SIZE / 4];
+static uint32_t SIM_Data[SIM_DATA_BLOCKS * VDISK_BLOCK_SIZE / 4];
+static uint32_t SIM_Buffer[SIM_REQUESTS][SIM_DATA_BLOCKS * VDISK_BLOCK_SIZE / 4];
+static MAL_Request_TypeDef SIM_Request[SIM_REQUESTS];
+static uint8_t SIM_Log[SIM_REQUESTS];
+static uint32_t SIM_Logged;
+static uint32_t SIM_LateCalls;        /* callbacks of requests not idle, or masked */
+static uint32_t SIM_Asserts;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_msc_queue.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+/**
+  * @brief  assert_param() failure of the Mass_Storage sources.
+  * @param  file: source file.
+  * @param  line: source line.
+  * @retval None.
+  */
+void assert_failed(uint8_t* file, uint32_t line)
+{
+  fprintf(stderr, "%s:%u: assert_param failed\n", (const char*)file, (unsigned)line);
+  SIM_Asserts++;
+}
+
+/**
+  * @brief  Completion callback: logs the request, the first one queues the
+  *         last request.
+  * @param  Request: completed request.
+  * @retval None.
+  */
+static void SIM_Complete(MAL_Request_TypeDef* Request)
+{
+  uint32_t Index = (uint32_t)(Request - SIM_Request);
+
+  if (SIM_Logged < SIM_REQUESTS)
+  {
+    SIM_Log[SIM_Logged] = (uint8_t)Index;
+  }
+  SIM_Logged++;
+  SIM_LateCalls += (Request->State != MAL_IO_IDLE) || !SIM_USB_ENABLED();
+  if (Index == 0)
+  {
+    MAL_Submit(&SIM_Request[SIM_REQUESTS - 1]);
+  }
+}
+
+/**
+  * @brief  Fills in a request of lun 1.
+  * @param  Index: request.
+  * @param  Dir: MAL_DIR_READ or MAL_DIR_WRITE.
+  * @param  Flags: MAL_FLAG_xxx.
+  * @param  Lba: first block.
+  * @param  Blocks: blocks.
+  * @retval None.
+  */
+static void SIM_Prepare(uint32_t Index, uint8_t Dir, uint8_t Flags, uint32_t Lba, uint32_t Blocks)
+{
+  MAL_Request_TypeDef* Request = &SIM_Request[Index];
+
+  Request->Lun = SIM_LUN;
+  Request->Dir = Dir;
+  Request->Flags = Flags;
+  Request->State = MAL_IO_IDLE;
+  Request->Memory_Offset = Lba * VDISK_BLOCK_SIZE;
+  Request->Buffer = (Dir == MAL_DIR_WRITE) ? SIM_Data : SIM_Buffer[Index];
+  Request->Transfer_Length = (uint16_t)(Blocks * VDISK_BLOCK_SIZE);
+  Request->Complete = SIM_Complete;
+  memset(SIM_Buffer[Index], 0xA5, sizeof(SIM_Buffer[Index]));
+}
+
+/**
+  * @brief  Polls the queue until a number of requests completed. While a
+  *         masked request is in progress the USB interrupt must stay masked.
+  * @param  Count: completion callbacks to wait for.
+  * @param  pUnmasked: incremented for each poll finding a masked request in
+  *         progress with the USB interrupt enabled.
+  * @retval 1 if the requests completed, 0 on timeout.
+  */
+static uint32_t SIM_Wait(uint32_t Count, uint32_t* pUnmasked)
+{
+  uint32_t Step, i;
+
+  for (Step = 0; (Step < SIM_STEPS) && (SIM_Logged < Count); Step++)
+  {
+    MAL_Poll();
+    for (i = 0; i < SIM_REQUESTS; i++)
+    {
+      if (((SIM_Request[i].State == MAL_IO_DATA) || (SIM_Request[i].State == MAL_IO_BUSY))
+          && ((SIM_Request[i].Flags & MAL_FLAG_USB_MASKED) != 0) && SIM_USB_ENABLED())
+      {
+        (*pUnmasked)++;
+      }
+    }
+    SIM_AdvanceTime(20);
+  }
+  return SIM_Logged >= Count;
+}
+
+int main(void)
+{
+  static const uint8_t Order[SIM_REQUESTS] = { 0, 1, 2, 3, 4 };
+  VDisk_Config_TypeDef Config;
+  VDisk_Stats_TypeDef Stats;
+  uint32_t i, Unmasked = 0, failures = 0;
+
+  SIM_Init();
+  Set_System();
+  USB_Interrupts_Config();
+  SIM_CHECK(SIM_USB_ENABLED());
+
+  /* Lun 1: RAM disk, every request busy for its latency */
+  memset(&Config, 0, sizeof(Config));
+  Config.Type = VDISK_RAM;
+  Config.Buffer = SIM_Media;
+  Config.Block_Count = SIM_BLOCKS;
+  Config.Read_Latency = 300;
+  Config.Write_Latency = 500;
+  SIM_CHECK(VDisk_Attach(SIM_LUN, &Config) == MAL_OK);
+  for (i = 0; i < (sizeof(SIM_Data) / 4); i++)
+  {
+    SIM_Data[i] = (i * 0x9E3779B9) ^ 0x5A5A5A5A;
+  }
+
+  /* A write, its read back masked, a write past the end of the disk, a
+     masked read of blocks never written; the callback of the first request
+     queues a read of the first block written */
+  SIM_Prepare(0, MAL_DIR_WRITE, 0, SIM_DATA_LBA, SIM_DATA_BLOCKS);
+  SIM_Prepare(1, MAL_DIR_READ, MAL_FLAG_USB_MASKED, SIM_DATA_LBA, SIM_DATA_BLOCKS);
+  SIM_Prepare(2, MAL_DIR_WRITE, 0, SIM_BLOCKS - 2, SIM_DATA_BLOCKS);
+  SIM_Prepare(3, MAL_DIR_READ, MAL_FLAG_USB_MASKED, 0, 2);
+  SIM_Prepare(4, MAL_DIR_READ, 0, SIM_DATA_LBA, 1);
+  for (i = 0; i < (SIM_REQUESTS - 1); i++)
+  {
+    SIM_CHECK(MAL_Submit(&SIM_Request[i]) == MAL_OK);
+    SIM_CHECK(SIM_Request[i].State == MAL_IO_QUEUED);
+  }
+  SIM_CHECK(MAL_Submit(&SIM_Request[0]) == MAL_FAIL);
+
+  /* The head request waits for the media, the others stay queued */
+  MAL_Poll();
+  SIM_CHECK(SIM_Request[0].State == MAL_IO_BUSY);
+  SIM_CHECK(SIM_Request[1].State == MAL_IO_QUEUED);
+  SIM_CHECK(SIM_USB_ENABLED());
+  SIM_CHECK(SIM_Logged == 0);
+
+  /* Completion in submission order, the queued read last */
+  SIM_CHECK(SIM_Wait(SIM_REQUESTS, &Unmasked));
+  SIM_CHECK(SIM_Logged == SIM_REQUESTS);
+  SIM_CHECK(memcmp(SIM_Log, Order, sizeof(Order)) == 0);
+  SIM_CHECK(SIM_LateCalls == 0);
+  SIM_CHECK(Unmasked == 0);
+  SIM_CHECK(SIM_USB_ENABLED());
+
+  SIM_CHECK(SIM_Request[0].Status == MAL_OK);
+  SIM_CHECK(SIM_Request[1].Status == MAL_OK);
+  SIM_CHECK(memcmp(SIM_Buffer[1], SIM_Data, sizeof(SIM_Data)) == 0);
+  SIM_CHECK(SIM_Request[2].Status == MAL_FAIL);
+  SIM_CHECK(memcmp(&SIM_Media[(SIM_BLOCKS - 2) * VDISK_BLOCK_SIZE / 4], SIM_Data,
+                   2 * VDISK_BLOCK_SIZE) != 0);
+  SIM_CHECK(SIM_Request[3].Status == MAL_OK);
+  SIM_CHECK((SIM_Buffer[3][0] == 0) && (SIM_Buffer[3][(2 * VDISK_BLOCK_SIZE / 4) - 1] == 0));
+  SIM_CHECK(SIM_Request[4].Status == MAL_OK);
+  SIM_CHECK(memcmp(SIM_Buffer[4], SIM_Data, VDISK_BLOCK_SIZE) == 0);
+
+  VDisk_GetStats(SIM_LUN, &Stats);
+  SIM_CHECK((Stats.Writes == 1) && (Stats.Written_Blocks == SIM_DATA_BLOCKS));
+  SIM_CHECK((Stats.Reads == 3) && (Stats.Read_Blocks == (SIM_DATA_BLOCKS + 2 + 1)));
+  SIM_CHECK(Stats.Errors == 1);
+
+  /* A masked request inside a masked section of the caller: its completion
+     leaves the USB interrupt masked until the caller unmasks it */
+  SIM_Logged = 0;
+  SIM_Prepare(1, MAL_DIR_READ, MAL_FLAG_USB_MASKED, SIM_DATA_LBA, SIM_DATA_BLOCKS);
+  USB_Interrupts_Cmd(DISABLE);
+  SIM_CHECK(MAL_Submit(&SIM_Request[1]) == MAL_OK);
+  SIM_CHECK(SIM_Wait(1, &Unmasked));
+  SIM_CHECK((SIM_Request[1].Status == MAL_OK) && (SIM_Log[0] == 1));
+  SIM_CHECK(!SIM_USB_ENABLED());
+  USB_Interrupts_Cmd(ENABLE);
+  SIM_CHECK(SIM_USB_ENABLED());
+
+  /* Its callback ran with the masking of the caller still in place */
+  SIM_CHECK(SIM_LateCalls == 1);
+  SIM_CHECK(Unmasked == 0);
+
+  /* The blocking wrappers go through the same queue */
+  memset(SIM_Buffer[0], 0, sizeof(SIM_Buffer[0]));
+  SIM_CHECK(MAL_Read(SIM_LUN, SIM_DATA_LBA * VDISK_BLOCK_SIZE, SIM_Buffer[0],
+                     SIM_DATA_BLOCKS * VDISK_BLOCK_SIZE) == MAL_OK);
+  SIM_CHECK(memcmp(SIM_Buffer[0], SIM_Data, sizeof(SIM_Data)) == 0);
+  SIM_CHECK(MAL_Write(SIM_LUN, SIM_BLOCKS * VDISK_BLOCK_SIZE, SIM_Data, VDISK_BLOCK_SIZE)
+            == MAL_FAIL);
+
+  SIM_CHECK(SIM_Asserts == 0);
+  VDisk_Detach(SIM_LUN);
+
+  printf("sim_msc_queue: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+/**
+  ******************************************************************************
+  * @file    sim_msc_vdisk.c
+  * @brief   End to end test of the Mass_Storage example on the simulator. The
+  *          host side of the Bulk-Only Transport writes more blocks than the
+  *          cache holds to the file backed virtual disk of lun 0 with
+  *          WRITE(10), makes them durable with SYNCHRONIZE CACHE, checks the
+  *          disk image file, then reads them back with READ(10). The loop of
+  *          main.c runs between the USB transactions, with a media latency
+  *          so that the cache flushes complete from there. A sequential
+  *          stream of READ(10) with command gaps then checks the read ahead
+  *          statistics: the depth grows and each command starts on the
+  *          blocks read ahead during the previous gap. A WRITE(10) over
+  *          these blocks discards them, the next READ(10) gets the new data.
+  *
+  *          Built with the Mass_Storage sources by "make simmsc", with
+  *          VDISK_LUN=0, VDISK_TYPE=VDISK_FILE and USE_FULL_ASSERT.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+#include "usb_pwr.h"
+#include "hw_config.h"
+#include "mass_vdisk.h"
+#include "mass_cache.h"
+#include "memory.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_BLOCKS        256     /* disk image size */
+#define SIM_WRITE_LBA     10      /* first block written */
+#define SIM_WRITE_BLOCKS  48      /* blocks written, 6 times the cache */
+#define SIM_CMD_BLOCKS    16      /* blocks per WRITE(10) or READ(10) */
+#define SIM_STEPS         100000  /* 20 us steps before a command times out */
+#define SIM_STREAM_LBA    128     /* first block of the sequential stream */
+#define SIM_STREAM_CMDS   4       /* READ(10) of the sequential stream */
+#define SIM_GAP_STEPS     50      /* 20 us steps between two commands */
+
+#define SIM_READ_CAPACITY 0x25
+#define SIM_READ10        0x28
+#define SIM_WRITE10       0x2A
+#define SIM_SYNC_CACHE    0x35
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+/* Private variables ---------------------------------------------------------*/
+static uint8_t SIM_Image[SIM_BLOCKS * VDISK_BLOCK_SIZE];   /* expected disk */
+static uint8_t SIM_Disk[SIM_BLOCKS * VDISK_BLOCK_SIZE];    /* image file read */
+static uint8_t SIM_Data[SIM_CMD_BLOCKS * VDISK_BLOCK_SIZE];
+static uint32_t SIM_Tag;
+static uint32_t SIM_Asserts;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_msc_vdisk.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+/**
+  * @brief  assert_param() failure of the Mass_Storage sources.
+  * @param  file: source file.
+  * @param  line: source line.
+  * @retval None.
+  */
+void assert_failed(uint8_t* file, uint32_t line)
+{
+  fprintf(stderr, "%s:%u: assert_param failed\n", (const char*)file, (unsigned)line);
+  SIM_Asserts++;
+}
+
+/**
+  * @brief  One pass of the main.c loop, then 20 us of simulated time.
+  * @param  None.
+  * @retval None.
+  */
+static void SIM_Poll(void)
+{
+  Read_Memory_Fetch();
+  MAL_Poll();
+  Cache_Poll();
+  SIM_AdvanceTime(20);
+}
+
+/**
+  * @brief  Command gap of the host: the main loop runs alone.
+  * @param  None.
+  * @retval None.
+  */
+static void SIM_Gap(void)
+{
+  uint32_t Step;
+
+  for (Step = 0; Step < SIM_GAP_STEPS; Step++)
+  {
+    SIM_Poll();
+  }
+}
+
+/**
+  * @brief  Sends a packet to the bulk OUT endpoint, polling while it NAKs.
+  * @param  pData: packet.
+  * @param  wLength: packet length.
+  * @retval 1 if sent, 0 on STALL or timeout.
+  */
+static uint32_t SIM_Out(const uint8_t* pData, uint16_t wLength)
+{
+  uint32_t Step;
+  int32_t Result;
+
+  for (Step = 0; Step < SIM_STEPS; Step++)
+  {
+    Result = SIM_USB_HostOut(2, pData, wLength);
+    if (Result >= 0)
+    {
+      return 1;
+    }
+    if (Result != SIM_USB_NAK)
+    {
+      return 0;
+    }
+    SIM_Poll();
+  }
+  return 0;
+}
+
+/**
+  * @brief  Receives a packet from the bulk IN endpoint, polling while it NAKs.
+  * @param  pData: 64 byte buffer.
+  * @retval Packet length, or -1 on STALL or timeout.
+  */
+static int32_t SIM_In(uint8_t* pData)
+{
+  uint32_t Step;
+  int32_t Result;
+
+  for (Step = 0; Step < SIM_STEPS; Step++)
+  {
+    Result = SIM_USB_HostIn(1, pData);
+    if (Result >= 0)
+    {
+      return Result;
+    }
+    if (Result != SIM_USB_NAK)
+    {
+      return -1;
+    }
+    SIM_Poll();
+  }
+  return -1;
+}
+
+/**
+  * @brief  Runs one SCSI command of lun 0: CBW, data stage, CSW.
+  * @param  Opcode: SIM_READ_CAPACITY, SIM_READ10, SIM_WRITE10 or
+  *         SIM_SYNC_CACHE.
+  * @param  Lba: first block.
+  * @param  Blocks: blocks of the data stage, none for SIM_READ_CAPACITY and
+  *         SIM_SYNC_CACHE.
+  * @param  pData: data written or read.
+  * @retval CSW status, or -1 if the transport failed.
+  */
+static int32_t SIM_Command(uint8_t Opcode, uint32_t Lba, uint16_t Blocks, uint8_t* pData)
+{
+  uint8_t Cbw[31], Packet[64];
+  uint32_t Length = Blocks * VDISK_BLOCK_SIZE, Done;
+  int32_t Count;
+
+  if (Opcode == SIM_READ_CAPACITY)
+  {
+    Length = 8;
+  }
+
+  memset(Cbw, 0, sizeof(Cbw));
+  memcpy(Cbw, "USBC", 4);
+  SIM_Tag++;
+  memcpy(&Cbw[4], &SIM_Tag, 4);
+  memcpy(&Cbw[8], &Length, 4);
+  Cbw[12] = (Opcode == SIM_WRITE10) ? 0x00 : 0x80;
+  Cbw[14] = 10;
+  Cbw[15] = Opcode;
+  Cbw[17] = (uint8_t)(Lba >> 24);
+  Cbw[18] = (uint8_t)(Lba >> 16);
+  Cbw[19] = (uint8_t)(Lba >> 8);
+  Cbw[20] = (uint8_t)Lba;
+  Cbw[22] = (uint8_t)(Blocks >> 8);
+  Cbw[23] = (uint8_t)Blocks;
+  if (!SIM_Out(Cbw, sizeof(Cbw)))
+  {
+    return -1;
+  }
+
+  for (Done = 0; Done < Length; Done += Count)
+  {
+    Count = ((Length - Done) < 64) ? (Length - Done) : 64;
+    if (Opcode == SIM_WRITE10)
+    {
+      if (!SIM_Out(&pData[Done], Count))
+      {
+        return -1;
+      }
+    }
+    else if (SIM_In(Packet) != Count)
+    {
+      return -1;
+    }
+    else
+    {
+      memcpy(&pData[Done], Packet, Count);
+    }
+  }
+
+  Count = SIM_In(Packet);
+  if ((Count != 13) || (memcmp(Packet, "USBS", 4) != 0)
+      || (memcmp(&Packet[4], &SIM_Tag, 4) != 0)
+      || (Packet[8] | Packet[9] | Packet[10] | Packet[11]))
+  {
+    return -1;
+  }
+  return Packet[12];
+}
+
+int main(void)
+{
+  static const uint8_t SetAddress[8] = { 0x00, 0x05, 0x05, 0, 0, 0, 0, 0 };
+  static const uint8_t SetConfiguration[8] = { 0x00, 0x09, 0x01, 0, 0, 0, 0, 0 };
+  Cache_Stats_TypeDef Stats;
+  Read_Stats_TypeDef Read_Stats;
+  uint8_t Packet[64];
+  uint32_t Lba, i, Mismatch, Depth, failures = 0;
+  FILE* pFile;
+
+  /* Disk image of random blocks, its size sets the block count */
+  srand(1);
+  for (i = 0; i < sizeof(SIM_Image); i++)
+  {
+    SIM_Image[i] = (uint8_t)rand();
+  }
+  pFile = fopen(VDISK_FILE_NAME, "wb");
+  SIM_CHECK(pFile != 0);
+  if (pFile == 0)
+  {
+    return 1;
+  }
+  fwrite(SIM_Image, 1, sizeof(SIM_Image), pFile);
+  fclose(pFile);
+
+  /* Start up as main.c, then enumerate */
+  SIM_Init();
+  Set_System();
+  Set_USBClock();
+  Cache_Init();
+  Read_Memory_Init();
+  USB_Interrupts_Config();
+  USB_Init();
+  SIM_USB_BusReset();
+  SIM_USB_HostSetup(SetAddress);
+  SIM_USB_HostIn(0, Packet);
+  SIM_USB_HostSetup(SetConfiguration);
+  SIM_USB_HostIn(0, Packet);
+  SIM_CHECK(bDeviceState == CONFIGURED);
+
+  /* READ CAPACITY(10): last block and block size */
+  SIM_CHECK(SIM_Command(SIM_READ_CAPACITY, 0, 0, SIM_Data) == 0);
+  SIM_CHECK(((SIM_Data[0] << 24) | (SIM_Data[1] << 16) | (SIM_Data[2] << 8) | SIM_Data[3])
+            == (SIM_BLOCKS - 1));
+  SIM_CHECK(((SIM_Data[6] << 8) | SIM_Data[7]) == VDISK_BLOCK_SIZE);
+
+  /* WRITE(10): the cache fills up and is flushed from the main loop while
+     the OUT endpoint waits */
+  for (i = 0; i < (SIM_WRITE_BLOCKS * VDISK_BLOCK_SIZE); i++)
+  {
+    SIM_Image[(SIM_WRITE_LBA * VDISK_BLOCK_SIZE) + i] ^= 0x5A;
+  }
+  for (Lba = SIM_WRITE_LBA; Lba < (SIM_WRITE_LBA + SIM_WRITE_BLOCKS); Lba += SIM_CMD_BLOCKS)
+  {
+    memcpy(SIM_Data, &SIM_Image[Lba * VDISK_BLOCK_SIZE], sizeof(SIM_Data));
+    SIM_CHECK(SIM_Command(SIM_WRITE10, Lba, SIM_CMD_BLOCKS, SIM_Data) == 0);
+  }
+  Cache_GetStats(&Stats);
+  SIM_CHECK(Stats.Flushed_Blocks >= (SIM_WRITE_BLOCKS - MASS_CACHE_BLOCKS));
+  SIM_CHECK(Stats.Write_Errors == 0);
+
+  /* SYNCHRONIZE CACHE: the image file holds every block once it passed */
+  SIM_CHECK(SIM_Command(SIM_SYNC_CACHE, 0, 0, 0) == 0);
+  pFile = fopen(VDISK_FILE_NAME, "rb");
+  SIM_CHECK((pFile != 0) && (fread(SIM_Disk, 1, sizeof(SIM_Disk), pFile) == sizeof(SIM_Disk)));
+  if (pFile != 0)
+  {
+    fclose(pFile);
+  }
+  SIM_CHECK(memcmp(SIM_Disk, SIM_Image, sizeof(SIM_Image)) == 0);
+
+  /* READ(10) around the written blocks */
+  Mismatch = 0;
+  for (Lba = 0; Lba < (SIM_WRITE_LBA + SIM_WRITE_BLOCKS + SIM_CMD_BLOCKS); Lba += SIM_CMD_BLOCKS)
+  {
+    memset(SIM_Data, 0, sizeof(SIM_Data));
+    SIM_CHECK(SIM_Command(SIM_READ10, Lba, SIM_CMD_BLOCKS, SIM_Data) == 0);
+    Mismatch += (memcmp(SIM_Data, &SIM_Image[Lba * VDISK_BLOCK_SIZE], sizeof(SIM_Data)) != 0);
+  }
+  SIM_CHECK(Mismatch == 0);
+
+  /* Sequential stream: the first command starts cold, then each gap reads
+     ahead the blocks of the next command, up to a depth doubling from 1 */
+  SIM_Gap();
+  Read_Memory_GetStats(0);
+  Depth = 0;
+  Mismatch = 0;
+  for (i = 0; i < SIM_STREAM_CMDS; i++)
+  {
+    Lba = SIM_STREAM_LBA + (i * SIM_CMD_BLOCKS);
+    memset(SIM_Data, 0, sizeof(SIM_Data));
+    SIM_CHECK(SIM_Command(SIM_READ10, Lba, SIM_CMD_BLOCKS, SIM_Data) == 0);
+    Mismatch += (memcmp(SIM_Data, &SIM_Image[Lba * VDISK_BLOCK_SIZE], sizeof(SIM_Data)) != 0);
+    SIM_Gap();
+
+    Read_Memory_GetStats(&Read_Stats);
+    SIM_CHECK(Read_Stats.Commands == 1);
+    SIM_CHECK(Read_Stats.Sequential == (i != 0));
+    SIM_CHECK(Read_Stats.Hit_Commands == (Depth != 0));
+    SIM_CHECK(Read_Stats.Hits == Depth);
+    SIM_CHECK(Read_Stats.Ready == Depth);
+    Depth = (i == 0) ? 0 : ((Depth == 0) ? 1 : (Depth * 2));
+    Depth = (Depth > MASS_READ_PREFETCH) ? MASS_READ_PREFETCH : Depth;
+    SIM_CHECK(Read_Stats.Depth == Depth);
+    SIM_CHECK(Read_Stats.Prefetched == Depth);
+    SIM_CHECK((i == 0) || (Read_Stats.Discarded == 0));
+  }
+  SIM_CHECK(Mismatch == 0);
+  SIM_CHECK(Depth == MASS_READ_PREFETCH);
+
+  /* WRITE(10) over the first block read ahead: the blocks read ahead are
+     discarded and the READ(10) of them gets the new data */
+  Lba = SIM_STREAM_LBA + (SIM_STREAM_CMDS * SIM_CMD_BLOCKS);
+  for (i = 0; i < VDISK_BLOCK_SIZE; i++)
+  {
+    SIM_Image[(Lba * VDISK_BLOCK_SIZE) + i] ^= 0xA5;
+  }
+  memcpy(SIM_Data, &SIM_Image[Lba * VDISK_BLOCK_SIZE], VDISK_BLOCK_SIZE);
+  SIM_CHECK(SIM_Command(SIM_WRITE10, Lba, 1, SIM_Data) == 0);
+  Read_Memory_GetStats(&Read_Stats);
+  SIM_CHECK(Read_Stats.Discarded == Depth);
+
+  memset(SIM_Data, 0, sizeof(SIM_Data));
+  SIM_CHECK(SIM_Command(SIM_READ10, Lba, 2, SIM_Data) == 0);
+  SIM_CHECK(memcmp(SIM_Data, &SIM_Image[Lba * VDISK_BLOCK_SIZE], 2 * VDISK_BLOCK_SIZE) == 0);
+  Read_Memory_GetStats(&Read_Stats);
+  SIM_CHECK((Read_Stats.Commands == 1) && (Read_Stats.Hits == 0));
+
+  /* The media was only accessed from the main loop */
+  SIM_CHECK(SIM_Asserts == 0);
+
+  remove(VDISK_FILE_NAME);
+  printf("sim_msc_vdisk: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_rcc.c
+  * @brief   Checks the RCC model against the clock tree set up by
+  *          SystemInit(): HSE / 2 x 9 gives the 72 MHz core clock with the
+  *          16 MHz crystal of the simulation build.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  SIM_Check((expr), #expr, __LINE__)
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t SIM_Failures;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static void SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_rcc.c:%d: check failed: %s\n", Line, pText);
+    SIM_Failures++;
+  }
+}
+
+int main(void)
+{
+  SIM_Init();
+  SystemInit();
+  SystemCoreClockUpdate();
+
+  SIM_CHECK(SystemCoreClock == 72000000);
+  SIM_CHECK((RCC->CFGR & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL);
+
+  /* PLLXTPRE and PREDIV1[0] are the same bit, whichever register is written */
+  SIM_CHECK((RCC->CFGR2 & RCC_CFGR2_PREDIV1) == RCC_CFGR2_PREDIV1_DIV2);
+  RCC->CFGR2 = RCC_CFGR2_PREDIV1_DIV3;
+  SIM_CHECK((RCC->CFGR & RCC_CFGR_PLLXTPRE) == 0);
+  RCC->CFGR |= RCC_CFGR_PLLXTPRE;
+  SIM_CHECK((RCC->CFGR2 & RCC_CFGR2_PREDIV1) == (RCC_CFGR2_PREDIV1_DIV3 | RCC_CFGR2_PREDIV1_0));
+  SystemCoreClockUpdate();
+  SIM_CHECK(SystemCoreClock == (HSE_VALUE / 4) * 9);
+
+  printf("sim_test_rcc: %s\n", (SIM_Failures == 0) ? "passed" : "FAILED");
+  return (SIM_Failures == 0) ? 0 : 1;
+}
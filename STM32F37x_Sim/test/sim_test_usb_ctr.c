@@ -0,0 +1,249 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_usb_ctr.c
+  * @brief   Checks the deferred endpoint service routines (CTR_DEFERRED):
+  *          CTR_LP only posts the OUT and IN transfers of endpoints 1 to 7,
+  *          which NAK until USB_Poll() has run their routine, in the order
+  *          the transfers completed. With every endpoint pending in both
+  *          directions, retries of the host post nothing more, so the queue
+  *          holds at most one event per endpoint and direction. The control
+  *          endpoint is still serviced in the interrupt.
+  *
+  *          Built with the USB driver sources and CTR_DEFERRED by
+  *          "make simtest".
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_ENDPOINTS   7     /* endpoints 1 to 7, OUT and IN */
+#define SIM_PACKET      16    /* buffer size of each direction */
+#define SIM_ROUNDS      24    /* rounds of 14 events, wrap the queue indexes */
+#define SIM_EVENT_IN    0x80  /* logged event: IN transfer */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+
+/* Service routines of an endpoint: log the event and re-arm the endpoint */
+#define SIM_EP_ROUTINES(n) \
+  static void SIM_EP##n##_OUT(void) { SIM_Serviced(n); } \
+  static void SIM_EP##n##_IN(void)  { SIM_Serviced((n) | SIM_EVENT_IN); }
+
+/* Private variables ---------------------------------------------------------*/
+__IO uint16_t wIstr;
+
+static uint8_t SIM_Log[2 * SIM_ENDPOINTS];
+static uint32_t SIM_Logged;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_Nop(void);
+static void SIM_Serviced(uint8_t bEvent);
+static void SIM_Init_Device(void);
+static RESULT SIM_Unsupported(uint8_t RequestNo);
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting);
+static uint8_t* SIM_NoDescriptor(uint16_t Length);
+
+SIM_EP_ROUTINES(1)
+SIM_EP_ROUTINES(2)
+SIM_EP_ROUTINES(3)
+SIM_EP_ROUTINES(4)
+SIM_EP_ROUTINES(5)
+SIM_EP_ROUTINES(6)
+SIM_EP_ROUTINES(7)
+
+/* Minimal device: endpoint 0 with the standard requests of the core, and
+   endpoints 1 to 7 configured by SIM_Init_Device() */
+DEVICE Device_Table = { 1 + SIM_ENDPOINTS, 1 };
+DEVICE_PROP Device_Property =
+{
+  SIM_Init_Device, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Unsupported, SIM_Unsupported,
+  SIM_Interface, SIM_NoDescriptor, SIM_NoDescriptor, SIM_NoDescriptor, 0, 64
+};
+USER_STANDARD_REQUESTS User_Standard_Requests =
+{
+  SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+void (*pEpInt_IN[7])(void) =
+{
+  SIM_EP1_IN, SIM_EP2_IN, SIM_EP3_IN, SIM_EP4_IN, SIM_EP5_IN, SIM_EP6_IN, SIM_EP7_IN
+};
+void (*pEpInt_OUT[7])(void) =
+{
+  SIM_EP1_OUT, SIM_EP2_OUT, SIM_EP3_OUT, SIM_EP4_OUT, SIM_EP5_OUT, SIM_EP6_OUT, SIM_EP7_OUT
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_usb_ctr.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+static void SIM_Nop(void)
+{
+}
+
+/**
+  * @brief  Logs a serviced transfer and lets the endpoint take the next one.
+  * @param  bEvent: endpoint number, with SIM_EVENT_IN for an IN transfer.
+  * @retval None.
+  */
+static void SIM_Serviced(uint8_t bEvent)
+{
+  uint8_t bEpNum = bEvent & ~SIM_EVENT_IN;
+
+  if (SIM_Logged < sizeof(SIM_Log))
+  {
+    SIM_Log[SIM_Logged] = bEvent;
+  }
+  SIM_Logged++;
+  if ((bEvent & SIM_EVENT_IN) != 0)
+  {
+    SetEPTxCount(bEpNum, 1);
+    SetEPTxValid(bEpNum);
+  }
+  else
+  {
+    SetEPRxValid(bEpNum);
+  }
+}
+
+static void SIM_Init_Device(void)
+{
+  uint8_t n;
+
+  pInformation->Current_Configuration = 0;
+  USB_PMA_Init(0, 1 + SIM_ENDPOINTS);
+  USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  SetEPType(ENDP0, EP_CONTROL);
+  SetEPTxStatus(ENDP0, EP_TX_NAK);
+  SetEPRxValid(ENDP0);
+
+  /* Endpoints 1 to 7: bulk, OUT armed, one byte ready for IN */
+  for (n = 1; n <= SIM_ENDPOINTS; n++)
+  {
+    SetEPType(n, EP_BULK);
+    SetEPAddress(n, n);
+    SetEPRxAddr(n, USB_PMA_Alloc(SIM_PACKET));
+    SetEPRxCount(n, SIM_PACKET);
+    SetEPTxAddr(n, USB_PMA_Alloc(SIM_PACKET));
+    SetEPTxCount(n, 1);
+    SetEPRxValid(n);
+    SetEPTxValid(n);
+  }
+  SetDeviceAddress(0);
+  _SetCNTR(CNTR_CTRM);
+  _SetISTR(0);
+}
+
+static RESULT SIM_Unsupported(uint8_t RequestNo)
+{
+  return USB_UNSUPPORT;
+}
+
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting)
+{
+  return USB_SUCCESS;
+}
+
+static uint8_t* SIM_NoDescriptor(uint16_t Length)
+{
+  return 0;
+}
+
+void USB_LP_IRQHandler(void)
+{
+  wIstr = _GetISTR();
+  if ((wIstr & ISTR_CTR) != 0)
+  {
+    CTR_LP();
+  }
+}
+
+/**
+  * @brief  Runs one host transaction on an endpoint.
+  * @param  bEvent: endpoint number, with SIM_EVENT_IN for an IN transaction.
+  * @retval Transaction result of SIM_USB_HostOut() or SIM_USB_HostIn().
+  */
+static int32_t SIM_Transfer(uint8_t bEvent)
+{
+  uint8_t Packet[SIM_PACKET];
+
+  memset(Packet, bEvent, sizeof(Packet));
+  if ((bEvent & SIM_EVENT_IN) != 0)
+  {
+    return SIM_USB_HostIn(bEvent & ~SIM_EVENT_IN, Packet);
+  }
+  return SIM_USB_HostOut(bEvent, Packet, 1);
+}
+
+int main(void)
+{
+  static const uint8_t GetStatus[8] = { 0x80, GET_STATUS, 0, 0, 0, 0, 2, 0 };
+  uint8_t Order[2 * SIM_ENDPOINTS], Status[64];
+  uint32_t Round, i, Accepted, Naks, failures = 0;
+
+  SIM_Init();
+  SystemInit();
+  USB_Trace_Init();
+  USB_Init();
+  NVIC_EnableIRQ(USB_LP_IRQn);
+
+  /* Every endpoint may have two transfers of each direction outstanding */
+  SIM_CHECK(CTR_QUEUE_SIZE >= (4 * SIM_ENDPOINTS));
+
+  for (Round = 0; Round < SIM_ROUNDS; Round++)
+  {
+    /* Each round completes the 14 transfers in another order: one direction
+       of every endpoint, then the other one */
+    for (i = 0; i < SIM_ENDPOINTS; i++)
+    {
+      Order[i] = (uint8_t)(((i * 3 + Round) % SIM_ENDPOINTS) + 1);
+      Order[i] |= ((Order[i] + Round) & 1) ? SIM_EVENT_IN : 0;
+      Order[SIM_ENDPOINTS + i] = (uint8_t)(((i * 5 + Round) % SIM_ENDPOINTS) + 1);
+      Order[SIM_ENDPOINTS + i] |= ((Order[SIM_ENDPOINTS + i] + Round) & 1) ? 0 : SIM_EVENT_IN;
+    }
+
+    Accepted = 0;
+    for (i = 0; i < sizeof(Order); i++)
+    {
+      Accepted += (SIM_Transfer(Order[i]) >= 0);
+    }
+    SIM_CHECK(Accepted == sizeof(Order));
+    SIM_CHECK(SIM_Logged == 0);
+
+    /* Held endpoints NAK and post nothing, the control endpoint answers */
+    Naks = 0;
+    for (i = 0; i < sizeof(Order); i++)
+    {
+      Naks += (SIM_Transfer(Order[i]) == SIM_USB_NAK);
+    }
+    SIM_CHECK(Naks == sizeof(Order));
+    SIM_CHECK(SIM_USB_HostSetup(GetStatus) >= 0);
+    SIM_CHECK(SIM_USB_HostIn(ENDP0, Status) == 2);
+    SIM_CHECK(SIM_USB_HostOut(ENDP0, 0, 0) == 0);
+    SIM_CHECK(SIM_Logged == 0);
+
+    /* USB_Poll() runs the routines in the completion order, once each */
+    USB_Poll();
+    SIM_CHECK(SIM_Logged == sizeof(Order));
+    SIM_CHECK(memcmp(SIM_Log, Order, sizeof(Order)) == 0);
+    SIM_Logged = 0;
+    USB_Poll();
+    SIM_CHECK(SIM_Logged == 0);
+  }
+
+  printf("sim_test_usb_ctr: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_usb_dblbuf.c
+  * @brief   Checks the double-buffered bulk endpoints of usb_sil.c through
+  *          the USB model. IN: a buffer committed while the other one is
+  *          in transmission stays pending until the IN callback hands it
+  *          over with USB_SIL_DblBufInComplete(), a third reservation is
+  *          refused, and the endpoint NAKs once both buffers are sent.
+  *          OUT: the endpoint NAKs while the application holds the received
+  *          buffer, until USB_SIL_DblBufReadAcquire() releases the other
+  *          one. Zero length packets go through in both directions.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_PACKET      64    /* size of each buffer */
+#define SIM_EP_IN       0x81  /* double-buffered bulk IN */
+#define SIM_EP_OUT      0x02  /* double-buffered bulk OUT */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+
+/* Private variables ---------------------------------------------------------*/
+__IO uint16_t wIstr;
+
+static uint32_t SIM_InCalls;          /* IN callbacks */
+static uint32_t SIM_InBusy;           /* last USB_SIL_DblBufInComplete() result */
+static uint32_t SIM_OutCalls;         /* OUT callbacks */
+static uint32_t SIM_OutHold;          /* OUT callback leaves the buffer held */
+static uint32_t SIM_OutLength;        /* bytes read by the last OUT callback */
+static uint8_t SIM_OutData[SIM_PACKET];
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_Nop(void);
+static void SIM_EP1_IN(void);
+static void SIM_EP2_OUT(void);
+static void SIM_Init_Device(void);
+static RESULT SIM_Unsupported(uint8_t RequestNo);
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting);
+static uint8_t* SIM_NoDescriptor(uint16_t Length);
+
+/* Minimal device: endpoint 0 with the standard requests of the core, bulk IN
+   on endpoint 1 and bulk OUT on endpoint 2 */
+DEVICE Device_Table = { 3, 1 };
+DEVICE_PROP Device_Property =
+{
+  SIM_Init_Device, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Unsupported, SIM_Unsupported,
+  SIM_Interface, SIM_NoDescriptor, SIM_NoDescriptor, SIM_NoDescriptor, 0, 64
+};
+USER_STANDARD_REQUESTS User_Standard_Requests =
+{
+  SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+void (*pEpInt_IN[7])(void) = { SIM_EP1_IN, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop };
+void (*pEpInt_OUT[7])(void) = { SIM_Nop, SIM_EP2_OUT, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop };
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_usb_dblbuf.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+static void SIM_Nop(void)
+{
+}
+
+static void SIM_EP1_IN(void)
+{
+  SIM_InCalls++;
+  SIM_InBusy = USB_SIL_DblBufInComplete(SIM_EP_IN);
+}
+
+static void SIM_EP2_OUT(void)
+{
+  USB_SIL_PMABuf_TypeDef Reader;
+
+  SIM_OutCalls++;
+  if (SIM_OutHold == 0)
+  {
+    SIM_OutLength = USB_SIL_DblBufReadAcquire(SIM_EP_OUT, &Reader);
+    USB_SIL_ReadData(&Reader, SIM_OutData, SIM_OutLength);
+  }
+}
+
+static void SIM_Init_Device(void)
+{
+  pInformation->Current_Configuration = 0;
+  USB_PMA_Init(0, 3);
+  USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  SetEPType(ENDP0, EP_CONTROL);
+  SetEPTxStatus(ENDP0, EP_TX_NAK);
+  SetEPRxValid(ENDP0);
+
+  SetEPAddress(ENDP1, ENDP1);
+  USB_SIL_DblBufInit(SIM_EP_IN, USB_PMA_Alloc(SIM_PACKET), USB_PMA_Alloc(SIM_PACKET), SIM_PACKET);
+  SetEPAddress(ENDP2, ENDP2);
+  USB_SIL_DblBufInit(SIM_EP_OUT, USB_PMA_Alloc(SIM_PACKET), USB_PMA_Alloc(SIM_PACKET), SIM_PACKET);
+  SetDeviceAddress(0);
+  _SetCNTR(CNTR_CTRM);
+  _SetISTR(0);
+}
+
+static RESULT SIM_Unsupported(uint8_t RequestNo)
+{
+  return USB_UNSUPPORT;
+}
+
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting)
+{
+  return USB_SUCCESS;
+}
+
+static uint8_t* SIM_NoDescriptor(uint16_t Length)
+{
+  return 0;
+}
+
+void USB_LP_IRQHandler(void)
+{
+  wIstr = _GetISTR();
+  if ((wIstr & ISTR_CTR) != 0)
+  {
+    CTR_LP();
+  }
+}
+
+int main(void)
+{
+  USB_SIL_PMABuf_TypeDef First, Second, Third, Reader;
+  uint8_t A[SIM_PACKET], B[SIM_PACKET], Packet[SIM_PACKET];
+  uint32_t i, failures = 0;
+
+  SIM_Init();
+  SystemInit();
+  USB_Init();
+  NVIC_EnableIRQ(USB_LP_IRQn);
+
+  for (i = 0; i < SIM_PACKET; i++)
+  {
+    A[i] = (uint8_t)(i * 3 + 1);
+    B[i] = (uint8_t)(0xFF - i);
+  }
+
+  /* IN: nothing committed yet */
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == SIM_USB_NAK);
+
+  /* The first buffer goes to the idle USB at once, the second one waits
+     for it and the application gets no third one */
+  SIM_CHECK(USB_SIL_DblBufWriteReserve(SIM_EP_IN, &First, SIM_PACKET) == 0);
+  SIM_CHECK(USB_SIL_WriteData(&First, A, SIM_PACKET) == SIM_PACKET);
+  SIM_CHECK(USB_SIL_DblBufWriteCommit(&First) == SIM_PACKET);
+  SIM_CHECK(USB_SIL_DblBufWriteReserve(SIM_EP_IN, &Second, SIM_PACKET) == 0);
+  SIM_CHECK(Second.wPMABufAddr != First.wPMABufAddr);
+  SIM_CHECK(USB_SIL_WriteData(&Second, B, 17) == 17);
+  SIM_CHECK(USB_SIL_DblBufWriteCommit(&Second) == 17);
+  SIM_CHECK(USB_SIL_DblBufWriteReserve(SIM_EP_IN, &Third, SIM_PACKET) == 1);
+
+  /* Each IN callback hands the pending buffer over, then the USB idles */
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == SIM_PACKET);
+  SIM_CHECK(memcmp(Packet, A, SIM_PACKET) == 0);
+  SIM_CHECK((SIM_InCalls == 1) && (SIM_InBusy == 1));
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == 17);
+  SIM_CHECK(memcmp(Packet, B, 17) == 0);
+  SIM_CHECK((SIM_InCalls == 2) && (SIM_InBusy == 0));
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == SIM_USB_NAK);
+
+  /* A buffer committed empty is a zero length packet */
+  SIM_CHECK(USB_SIL_DblBufWriteReserve(SIM_EP_IN, &Third, SIM_PACKET) == 0);
+  SIM_CHECK(USB_SIL_DblBufWriteCommit(&Third) == 0);
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == 0);
+  SIM_CHECK((SIM_InCalls == 3) && (SIM_InBusy == 0));
+  SIM_CHECK(SIM_USB_HostIn(ENDP1, Packet) == SIM_USB_NAK);
+
+  /* OUT: while the application holds the received buffer the USB NAKs */
+  SIM_OutHold = 1;
+  SIM_CHECK(SIM_USB_HostOut(ENDP2, A, SIM_PACKET) == SIM_PACKET);
+  SIM_CHECK(SIM_OutCalls == 1);
+  SIM_CHECK(SIM_USB_HostOut(ENDP2, B, 31) == SIM_USB_NAK);
+  SIM_CHECK(SIM_OutCalls == 1);
+
+  /* Acquiring it releases the other buffer to the USB */
+  SIM_CHECK(USB_SIL_DblBufReadAcquire(SIM_EP_OUT, &Reader) == SIM_PACKET);
+  memset(Packet, 0, sizeof(Packet));
+  SIM_CHECK(USB_SIL_ReadData(&Reader, Packet, SIM_PACKET) == SIM_PACKET);
+  SIM_CHECK(memcmp(Packet, A, SIM_PACKET) == 0);
+  SIM_OutHold = 0;
+  SIM_CHECK(SIM_USB_HostOut(ENDP2, B, 31) == 31);
+  SIM_CHECK((SIM_OutCalls == 2) && (SIM_OutLength == 31));
+  SIM_CHECK(memcmp(SIM_OutData, B, 31) == 0);
+
+  /* A callback that drains each buffer keeps the endpoint open, a zero
+     length packet included */
+  SIM_CHECK(SIM_USB_HostOut(ENDP2, 0, 0) == 0);
+  SIM_CHECK((SIM_OutCalls == 3) && (SIM_OutLength == 0));
+  SIM_CHECK(SIM_USB_HostOut(ENDP2, A, 5) == 5);
+  SIM_CHECK((SIM_OutCalls == 4) && (SIM_OutLength == 5));
+  SIM_CHECK(memcmp(SIM_OutData, A, 5) == 0);
+
+  printf("sim_test_usb_dblbuf: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
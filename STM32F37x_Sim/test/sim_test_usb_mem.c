@@ -0,0 +1,202 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_usb_mem.c
+  * @brief   Checks the word path of the PMA copy routines of usb_mem.c
+  *          against the byte path, for every user buffer alignment and the
+  *          lengths up to a full PMA. Unlike the byte path, which stores a
+  *          whole half-word for an odd length, the word path taken by the
+  *          half-word aligned buffers must leave the bytes around the user
+  *          buffer untouched. Then checks the USB_SIL_WriteData() and
+  *          USB_SIL_ReadData() cursors of usb_sil.c: odd lengths split at
+  *          odd and even points, for every user buffer alignment, clipped
+  *          at the end of the reservation or of the received data. Also
+  *          checks the PMA allocation from a configuration descriptor, up
+  *          to its USB_ERROR on exhaustion.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_GUARD   8   /* bytes checked on each side of the user buffer */
+#define SIM_SIL_BUF 64  /* PMA buffer of the USB_SIL cursors, after the */
+#define SIM_SIL_PMA 64  /* buffer table at PMA 0 */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+/* Private variables ---------------------------------------------------------*/
+/* Configuration descriptor: bulk IN 1 and bulk OUT 2 of 64 bytes, isochronous
+   OUT 3 of 192 bytes */
+static const uint8_t SIM_ConfigDescriptor[] =
+{
+  0x09, 0x02, 9 + 3 * 7, 0x00, 0x01, 0x01, 0x00, 0x80, 0x32,
+  0x07, 0x05, 0x81, 0x02, 0x40, 0x00, 0x00,
+  0x07, 0x05, 0x02, 0x02, 0x40, 0x00, 0x00,
+  0x07, 0x05, 0x03, 0x01, 0xC0, 0x00, 0x01
+};
+
+static uint8_t SIM_Source[PMA_SIZE + 2 * SIM_GUARD];
+static uint8_t SIM_Word[PMA_SIZE + 2 * SIM_GUARD];
+static uint8_t SIM_Byte[PMA_SIZE + 2 * SIM_GUARD];
+
+/* Reservations of the USB_SIL writer, the odd one ends inside a half-word */
+static const uint16_t SIM_SilSizes[] = { SIM_SIL_BUF, SIM_SIL_BUF - 1 };
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_usb_mem.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+/**
+  * @brief  Writes then reads back one endpoint buffer in two pieces through
+  *         the USB_SIL cursors, asking for more than fits.
+  * @param  wSize: reservation of the writer.
+  * @param  Length: bytes written, then asked for, in total.
+  * @param  Split: bytes of the first piece.
+  * @param  Align: user buffer offset from a word boundary.
+  * @retval 0 if the bytes and the returned counts are right, else 1.
+  */
+static uint32_t SIM_SilCheck(uint16_t wSize, uint32_t Length, uint32_t Split, uint32_t Align)
+{
+  USB_SIL_PMABuf_TypeDef Writer, Reader;
+  uint32_t Expected = (Length < wSize) ? Length : wSize;
+  uint32_t First = (Split < Expected) ? Split : Expected;
+  uint32_t failures = 0;
+  uint8_t bData;
+
+  /* Writer: the second piece is clipped at the end of the reservation, the
+     half-word after the buffer is left untouched */
+  UserToPMABufferCopy_Byte(&SIM_Source[1], SIM_SIL_PMA + SIM_SIL_BUF, 2);
+  USB_SIL_WriteReserve(ENDP1, &Writer, wSize);
+  failures += (USB_SIL_WriteData(&Writer, &SIM_Source[Align], Split) != First);
+  failures += (USB_SIL_WriteData(&Writer, &SIM_Source[Align + Split], Length - Split)
+               != (Expected - First));
+  failures += (USB_SIL_WriteByte(&Writer, 0) != (Expected < wSize));
+  failures += (USB_SIL_WriteCommit(&Writer) != ((Expected < wSize) ? Expected + 1 : wSize));
+  memset(SIM_Byte, 0xA5, sizeof(SIM_Byte));
+  PMAToUserBufferCopy_Byte(SIM_Byte, SIM_SIL_PMA, SIM_SIL_BUF + 2);
+  failures += (memcmp(SIM_Byte, &SIM_Source[Align], Expected) != 0);
+  failures += (memcmp(&SIM_Byte[SIM_SIL_BUF], &SIM_Source[1], 2) != 0);
+
+  /* Reader: the received count, as set by the USB, bounds the pieces */
+  SetEPRxAddr(ENDP1, SIM_SIL_PMA);
+  *_pEPRxCount(ENDP1) = Expected;
+  memset(SIM_Word, 0xA5, sizeof(SIM_Word));
+  failures += (USB_SIL_ReadAcquire(ENDP1, &Reader) != Expected);
+  failures += (USB_SIL_ReadData(&Reader, &SIM_Word[SIM_GUARD + Align], Split) != First);
+  failures += (USB_SIL_ReadData(&Reader, &SIM_Word[SIM_GUARD + Align + First], Length + 1)
+               != (Expected - First));
+  failures += (USB_SIL_ReadData(&Reader, &SIM_Word[SIM_GUARD + Align + Expected], 1) != 0);
+  failures += (USB_SIL_ReadByte(&Reader, &bData) != 0);
+  failures += (memcmp(&SIM_Word[SIM_GUARD + Align], &SIM_Source[Align], Expected) != 0);
+  failures += (SIM_Word[SIM_GUARD + Align - 1] != 0xA5);
+  failures += (SIM_Word[SIM_GUARD + Align + Expected] != 0xA5);
+
+  if (failures != 0)
+  {
+    fprintf(stderr, "USB_SIL: size %u, align %u, %u bytes split at %u\n",
+            (unsigned)wSize, (unsigned)Align, (unsigned)Length, (unsigned)Split);
+  }
+  return (failures != 0);
+}
+
+int main(void)
+{
+  static const uint32_t Splits[] = { 0, 1, 2, 3, 30, 31 };
+  uint32_t align, pma, length, end, i, k, size, failures = 0;
+
+  SIM_Init();
+
+  for (i = 0; i < sizeof(SIM_Source); i++)
+  {
+    SIM_Source[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  for (align = 0; align < 4; align++)
+  {
+    for (pma = 0; pma < 4; pma += 2)
+    {
+      for (length = 0; length + pma <= PMA_SIZE - SIM_GUARD; length++)
+      {
+        /* To the PMA: the word path writes what the byte path reads back */
+        UserToPMABufferCopy(&SIM_Source[SIM_GUARD / 2 + align], pma, length);
+        memset(SIM_Byte, 0xA5, sizeof(SIM_Byte));
+        PMAToUserBufferCopy_Byte(&SIM_Byte[SIM_GUARD], pma, length);
+        if (memcmp(&SIM_Byte[SIM_GUARD], &SIM_Source[SIM_GUARD / 2 + align], length) != 0)
+        {
+          fprintf(stderr, "to PMA: align %u, PMA 0x%X, %u bytes\n",
+                  (unsigned)align, (unsigned)pma, (unsigned)length);
+          failures++;
+        }
+
+        /* From the PMA: same bytes as the byte path, nothing around them */
+        UserToPMABufferCopy_Byte(SIM_Source, pma, length + SIM_GUARD);
+        memset(SIM_Word, 0xA5, sizeof(SIM_Word));
+        PMAToUserBufferCopy(&SIM_Word[SIM_GUARD + align], pma, length);
+        PMAToUserBufferCopy_Byte(&SIM_Byte[SIM_GUARD + align], pma, length);
+        end = SIM_GUARD + align + length + ((align & 1) ? (length & 1) : 0);
+        for (i = 0; i < sizeof(SIM_Word); i++)
+        {
+          if ((i < SIM_GUARD + align) || (i >= end))
+          {
+            SIM_Byte[i] = 0xA5;
+          }
+        }
+        if (memcmp(SIM_Word, SIM_Byte, sizeof(SIM_Word)) != 0)
+        {
+          fprintf(stderr, "from PMA: align %u, PMA 0x%X, %u bytes\n",
+                  (unsigned)align, (unsigned)pma, (unsigned)length);
+          failures++;
+        }
+      }
+    }
+  }
+
+  /* USB_SIL cursors over a TX buffer, read back as received data */
+  SetEPTxAddr(ENDP1, SIM_SIL_PMA);
+  for (size = 0; size < sizeof(SIM_SilSizes) / sizeof(SIM_SilSizes[0]); size++)
+  {
+    for (align = 0; align < 4; align++)
+    {
+      for (length = 0; length <= SIM_SIL_BUF + 2; length++)
+      {
+        for (k = 0; k < sizeof(Splits) / sizeof(Splits[0]); k++)
+        {
+          failures += SIM_SilCheck(SIM_SilSizes[size], length,
+                                   (Splits[k] < length) ? Splits[k] : length, align);
+        }
+        failures += SIM_SilCheck(SIM_SilSizes[size], length, length - (length / 2), align);
+      }
+    }
+  }
+
+  /* Buffer table of 4 endpoints, then EP0 RX and TX and the bulk endpoints */
+  USB_PMA_Init(0, 4);
+  SIM_CHECK(USB_PMA_ConfigEP0(64) == USB_SUCCESS);
+  SIM_CHECK(USB_PMA_GetFree() == PMA_SIZE - 4 * 8 - 2 * 64);
+  SIM_CHECK(USB_PMA_ConfigEndpoints(SIM_ConfigDescriptor, 0) == USB_ERROR);
+  USB_PMA_Init(0, 4);
+  SIM_CHECK(USB_PMA_ConfigEP0(64) == USB_SUCCESS);
+  SIM_CHECK(USB_PMA_Alloc(64) != PMA_ADDR_NONE);
+  SIM_CHECK(USB_PMA_Alloc(64) != PMA_ADDR_NONE);
+  SIM_CHECK(USB_PMA_GetFree() == PMA_SIZE - 4 * 8 - 4 * 64);
+  SIM_CHECK(USB_PMA_Alloc(USB_PMA_GetFree() + 2) == PMA_ADDR_NONE);
+  SIM_CHECK(USB_PMA_Alloc(USB_PMA_GetFree()) != PMA_ADDR_NONE);
+  SIM_CHECK(USB_PMA_GetFree() == 0);
+
+  printf("sim_test_usb_mem: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
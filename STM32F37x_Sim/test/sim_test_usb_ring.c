@@ -0,0 +1,161 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_usb_ring.c
+  * @brief   Checks the single producer, single consumer byte ring of
+  *          usb_ring.c: counts and spans around the storage end and the
+  *          free running index wrap, the bytes at an offset from the read
+  *          index, partial writes and reads on a full or empty ring, a random sequence of copies against a reference
+  *          stream, and the write index following a circular DMA counter.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_RING_SIZE   64
+#define SIM_STEPS       200000   /* random write/read steps */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+/* Private variables ---------------------------------------------------------*/
+static uint8_t SIM_Storage[SIM_RING_SIZE];
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_usb_ring.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+int main(void)
+{
+  USB_Ring_TypeDef Ring;
+  uint8_t Data[SIM_RING_SIZE * 2], *pSpan;
+  uint32_t Written, Read, Length, Done, Step, Mismatch, i, failures = 0;
+  __IO uint32_t DmaCount;
+
+  SIM_Init();
+
+  for (i = 0; i < sizeof(Data); i++)
+  {
+    Data[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  /* Empty ring */
+  USB_Ring_Init(&Ring, SIM_Storage, SIM_RING_SIZE);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 0);
+  SIM_CHECK(USB_Ring_Space(&Ring) == SIM_RING_SIZE);
+  SIM_CHECK(USB_Ring_ReadPeek(&Ring, &pSpan) == 0);
+  SIM_CHECK(USB_Ring_Read(&Ring, Data, 1) == 0);
+  SIM_CHECK(USB_Ring_WritePeek(&Ring, &pSpan) == SIM_RING_SIZE);
+  SIM_CHECK(pSpan == SIM_Storage);
+
+  /* Full ring: the write stops at the free space */
+  SIM_CHECK(USB_Ring_Write(&Ring, Data, SIM_RING_SIZE + 8) == SIM_RING_SIZE);
+  SIM_CHECK(USB_Ring_Count(&Ring) == SIM_RING_SIZE);
+  SIM_CHECK(USB_Ring_Space(&Ring) == 0);
+  SIM_CHECK(USB_Ring_WritePeek(&Ring, &pSpan) == 0);
+  SIM_CHECK(USB_Ring_Write(&Ring, Data, 1) == 0);
+
+  /* Spans stop at the storage end */
+  USB_Ring_ReadCommit(&Ring, 40);
+  SIM_CHECK(USB_Ring_WritePeek(&Ring, &pSpan) == 40);
+  SIM_CHECK(pSpan == SIM_Storage);
+  USB_Ring_WriteCommit(&Ring, 10);
+  SIM_CHECK(USB_Ring_ReadPeek(&Ring, &pSpan) == SIM_RING_SIZE - 40);
+  SIM_CHECK(pSpan == &SIM_Storage[40]);
+  SIM_CHECK(memcmp(pSpan, &Data[40], SIM_RING_SIZE - 40) == 0);
+  USB_Ring_ReadCommit(&Ring, SIM_RING_SIZE - 40);
+  SIM_CHECK(USB_Ring_ReadPeek(&Ring, &pSpan) == 10);
+  SIM_CHECK(pSpan == SIM_Storage);
+  SIM_CHECK(USB_Ring_WritePeek(&Ring, &pSpan) == SIM_RING_SIZE - 10);
+  SIM_CHECK(pSpan == &SIM_Storage[10]);
+
+  /* Bytes past the read index, across the storage end, left in the ring */
+  USB_Ring_ReadCommit(&Ring, 2);
+  USB_Ring_WriteCommit(&Ring, SIM_RING_SIZE - 10);
+  SIM_CHECK(USB_Ring_PeekAt(&Ring, 0) == Data[2]);
+  SIM_CHECK(USB_Ring_PeekAt(&Ring, 7) == Data[9]);
+  USB_Ring_ReadCommit(&Ring, SIM_RING_SIZE - 4);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 2);
+  USB_Ring_WriteCommit(&Ring, 3);
+  SIM_CHECK(USB_Ring_PeekAt(&Ring, 1) == SIM_Storage[SIM_RING_SIZE - 1]);
+  SIM_CHECK(USB_Ring_PeekAt(&Ring, 2) == SIM_Storage[0]);
+  SIM_CHECK(USB_Ring_PeekAt(&Ring, 4) == SIM_Storage[2]);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 5);
+
+  /* Free running indexes wrapping around 2^32 */
+  USB_Ring_Init(&Ring, SIM_Storage, SIM_RING_SIZE);
+  Ring.wHead = 0xFFFFFFF0;
+  Ring.wTail = 0xFFFFFFF0;
+  SIM_CHECK(USB_Ring_Write(&Ring, Data, 40) == 40);
+  SIM_CHECK(Ring.wHead == 24);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 40);
+  SIM_CHECK(USB_Ring_Space(&Ring) == SIM_RING_SIZE - 40);
+  memset(&Data[SIM_RING_SIZE], 0, SIM_RING_SIZE);
+  SIM_CHECK(USB_Ring_Read(&Ring, &Data[SIM_RING_SIZE], SIM_RING_SIZE) == 40);
+  SIM_CHECK(memcmp(&Data[SIM_RING_SIZE], Data, 40) == 0);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 0);
+
+  /* Random copies in and out: the bytes come out in order, none lost */
+  USB_Ring_Init(&Ring, SIM_Storage, SIM_RING_SIZE);
+  srand(1);
+  Written = 0;
+  Read = 0;
+  Mismatch = 0;
+  for (Step = 0; Step < SIM_STEPS; Step++)
+  {
+    Length = rand() % 40;
+    for (i = 0; i < Length; i++)
+    {
+      Data[i] = (uint8_t)(Written + i);
+    }
+    Done = USB_Ring_Write(&Ring, Data, Length);
+    Mismatch += (Done != ((Length < (SIM_RING_SIZE - (Written - Read))) ?
+                          Length : (SIM_RING_SIZE - (Written - Read))));
+    Written += Done;
+
+    Done = USB_Ring_Read(&Ring, Data, rand() % 40);
+    for (i = 0; i < Done; i++)
+    {
+      Mismatch += (Data[i] != (uint8_t)(Read + i));
+    }
+    Read += Done;
+    Mismatch += (USB_Ring_Count(&Ring) != (Written - Read));
+  }
+  SIM_CHECK(Mismatch == 0);
+  SIM_CHECK(Written > SIM_STEPS);
+
+  /* Circular DMA into the storage: the write index follows the down counter
+     across the storage end, and a second sync does not move it */
+  USB_Ring_Init(&Ring, SIM_Storage, SIM_RING_SIZE);
+  DmaCount = SIM_RING_SIZE;
+  USB_Ring_WriteSync(&Ring, &DmaCount);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 0);
+  DmaCount = SIM_RING_SIZE - 48;
+  USB_Ring_WriteSync(&Ring, &DmaCount);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 48);
+  USB_Ring_ReadCommit(&Ring, 48);
+  DmaCount = SIM_RING_SIZE - 16;
+  USB_Ring_WriteSync(&Ring, &DmaCount);
+  USB_Ring_WriteSync(&Ring, &DmaCount);
+  SIM_CHECK(USB_Ring_Count(&Ring) == 32);
+  SIM_CHECK(Ring.wHead == SIM_RING_SIZE + 16);
+  SIM_CHECK(USB_Ring_ReadPeek(&Ring, &pSpan) == 16);
+  SIM_CHECK(pSpan == &SIM_Storage[48]);
+
+  printf("sim_test_usb_ring: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/**
+  ******************************************************************************
+  * @file    sim_test_usb_trace.c
+  * @brief   Checks the USB event trace of the control endpoint: each SETUP,
+  *          IN and OUT transaction of a control transfer must close its NAK
+  *          window, which CTR_LP reopens when it restores the endpoint 0
+  *          status saved on entry.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define SIM_TRANSFERS   8   /* GET_STATUS control transfers */
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+
+/* Private variables ---------------------------------------------------------*/
+__IO uint16_t wIstr;
+
+/* Private function prototypes -----------------------------------------------*/
+static void SIM_Nop(void);
+static void SIM_Init_Device(void);
+static RESULT SIM_Unsupported(uint8_t RequestNo);
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting);
+static uint8_t* SIM_NoDescriptor(uint16_t Length);
+
+/* Minimal device: endpoint 0 only, standard requests handled by the core */
+DEVICE Device_Table = { 1, 1 };
+DEVICE_PROP Device_Property =
+{
+  SIM_Init_Device, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Unsupported, SIM_Unsupported,
+  SIM_Interface, SIM_NoDescriptor, SIM_NoDescriptor, SIM_NoDescriptor, 0, 64
+};
+USER_STANDARD_REQUESTS User_Standard_Requests =
+{
+  SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop
+};
+void (*pEpInt_IN[7])(void) = { SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop };
+void (*pEpInt_OUT[7])(void) = { SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop, SIM_Nop };
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_test_usb_trace.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+static void SIM_Nop(void)
+{
+}
+
+static void SIM_Init_Device(void)
+{
+  pInformation->Current_Configuration = 0;
+  USB_PMA_Init(0, EP_NUM);
+  USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  SetEPType(ENDP0, EP_CONTROL);
+  SetEPTxStatus(ENDP0, EP_TX_NAK);
+  SetEPRxValid(ENDP0);
+  SetDeviceAddress(0);
+  _SetCNTR(CNTR_CTRM);
+  _SetISTR(0);
+}
+
+static RESULT SIM_Unsupported(uint8_t RequestNo)
+{
+  return USB_UNSUPPORT;
+}
+
+static RESULT SIM_Interface(uint8_t Interface, uint8_t AlternateSetting)
+{
+  return USB_SUCCESS;
+}
+
+static uint8_t* SIM_NoDescriptor(uint16_t Length)
+{
+  return 0;
+}
+
+void USB_LP_IRQHandler(void)
+{
+  wIstr = _GetISTR();
+  USB_TRACE_EVENT(USB_TRACE_ISR_ENTER, 0, wIstr);
+  if ((wIstr & ISTR_CTR) != 0)
+  {
+    CTR_LP();
+  }
+  USB_TRACE_EVENT(USB_TRACE_ISR_EXIT, 0, 0);
+}
+
+int main(void)
+{
+  static const uint8_t GetStatus[8] = { 0x80, GET_STATUS, 0, 0, 0, 0, 2, 0 };
+  USB_Trace_Stats_TypeDef Stats;
+  uint8_t Status[64];
+  uint32_t i, failures = 0;
+
+  SIM_Init();
+  SystemInit();
+  USB_Trace_Init();
+  USB_Init();
+  NVIC_EnableIRQ(USB_LP_IRQn);
+
+  for (i = 0; i < SIM_TRANSFERS; i++)
+  {
+    SIM_CHECK(SIM_USB_HostSetup(GetStatus) >= 0);
+    SIM_CHECK(SIM_USB_HostIn(ENDP0, Status) == 2);
+    SIM_CHECK(SIM_USB_HostOut(ENDP0, 0, 0) == 0);
+  }
+
+  USB_Trace_DecodeInit(&Stats);
+  USB_Trace_Drain(&Stats);
+  SIM_CHECK(USB_Trace_GetLost() == 0);
+  SIM_CHECK(Stats.wEvents[USB_TRACE_SETUP] == SIM_TRANSFERS);
+  SIM_CHECK(Stats.wEvents[USB_TRACE_CTR_IN] == SIM_TRANSFERS);
+  /* SETUP and status OUT on the OUT side, data IN on the IN side */
+  SIM_CHECK(Stats.Latency[ENDP0][1].wCount == 2 * SIM_TRANSFERS);
+  SIM_CHECK(Stats.Latency[ENDP0][0].wCount == SIM_TRANSFERS);
+  SIM_CHECK((Stats.wNakPending & 0x0101) == 0);
+
+  printf("sim_test_usb_trace: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+/**
+  ******************************************************************************
+  * @file    sim_vcp_ports.c
+  * @brief   End to end test of the Virtual_COM_Port example on the simulator,
+  *          with three ports and frame aware IN packing. The host enumerates
+  *          the composite device, sets the line coding of each port while
+  *          the receiver holds stale bytes, which must be dropped with the
+  *          receive DMA restarted, then moves data both ways on the three
+  *          ports at once. The USART to host direction carries MAVLink v1
+  *          style frames: whole frames are sent after the frame deadline, an
+  *          incomplete one waits for its end or for the frame timeout.
+  *
+  *          Built with the Virtual_COM_Port sources by "make simvcp", with
+  *          VCP_PORT_NUM=3, VCOMPORT_FRAMING and USE_FULL_ASSERT.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32f37x.h"
+#include "stm32f37x_sim.h"
+#include "usb_lib.h"
+#include "usb_pwr.h"
+#include "usb_desc.h"
+#include "hw_config.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  USART_TypeDef*        USARTx;
+  DMA_Channel_TypeDef*  Rx_DMA_Channel;
+  uint8_t               bInEp;
+  uint8_t               bOutEp;
+} SIM_Port_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_PORTS         3
+#define SIM_PACKET        VIRTUAL_COM_PORT_DATA_SIZE
+#define SIM_EP0_SIZE      VIRTUAL_COM_PORT_EP0_SIZE
+#define SIM_BAUD_RATE     115200
+#define SIM_STEPS         1000    /* 20 us steps before the USART output times out */
+
+#define SIM_SET_LINE_CODING   0x20
+#define SIM_GET_LINE_CODING   0x21
+
+/* Private macro -------------------------------------------------------------*/
+#define SIM_CHECK(expr)  failures += SIM_Check((expr), #expr, __LINE__)
+
+/* Private variables ---------------------------------------------------------*/
+/* USART, receive DMA channel and bulk endpoints of each port on the
+   STM32373C-EVAL board, see platform_config.h and usb_desc.h */
+static const SIM_Port_TypeDef SIM_Port[SIM_PORTS] =
+{
+  { USART2, DMA1_Channel6, VCP0_DATA_IN_EP & 0x7F, VCP0_DATA_OUT_EP },
+  { USART1, DMA1_Channel5, VCP1_DATA_IN_EP & 0x7F, VCP1_DATA_OUT_EP },
+  { USART3, DMA1_Channel3, VCP2_DATA_IN_EP & 0x7F, VCP2_DATA_OUT_EP },
+};
+static uint32_t SIM_Asserts;
+
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t SIM_Check(int Passed, const char* pText, int Line)
+{
+  if (!Passed)
+  {
+    fprintf(stderr, "sim_vcp_ports.c:%d: check failed: %s\n", Line, pText);
+  }
+  return !Passed;
+}
+
+/**
+  * @brief  assert_param() failure of the Virtual_COM_Port sources.
+  * @param  file: source file.
+  * @param  line: source line.
+  * @retval None.
+  */
+void assert_failed(uint8_t* file, uint32_t line)
+{
+  fprintf(stderr, "%s:%u: assert_param failed\n", (const char*)file, (unsigned)line);
+  SIM_Asserts++;
+}
+
+/**
+  * @brief  Runs USB frames of 1 ms: the SOF interrupt checks the deadlines
+  *         of the frame aware packing.
+  * @param  Count: number of frames.
+  * @retval None.
+  */
+static void SIM_Frames(uint32_t Count)
+{
+  SIM_AdvanceTime(Count * 1000);
+}
+
+/**
+  * @brief  Runs a control transfer with a data stage of at most one packet.
+  * @param  pSetup: setup packet, bit 7 of bmRequestType gives the direction.
+  * @param  pData: data sent or received.
+  * @retval Bytes of the data stage, or -1 if the transfer failed.
+  */
+static int32_t SIM_Control(const uint8_t* pSetup, uint8_t* pData)
+{
+  uint16_t wLength = pSetup[6] | (pSetup[7] << 8);
+  uint8_t Packet[SIM_EP0_SIZE];
+  int32_t Count = 0;
+
+  if (SIM_USB_HostSetup(pSetup) < 0)
+  {
+    return -1;
+  }
+  if ((pSetup[0] & 0x80) != 0)
+  {
+    Count = SIM_USB_HostIn(ENDP0, Packet);
+    if ((Count < 0) || (Count > wLength))
+    {
+      return -1;
+    }
+    memcpy(pData, Packet, Count);
+    return (SIM_USB_HostOut(ENDP0, 0, 0) == 0) ? Count : -1;
+  }
+  if (wLength != 0)
+  {
+    Count = SIM_USB_HostOut(ENDP0, pData, wLength);
+    if (Count != wLength)
+    {
+      return -1;
+    }
+  }
+  return (SIM_USB_HostIn(ENDP0, Packet) == 0) ? Count : -1;
+}
+
+/**
+  * @brief  Sets the line coding of a port: SET_LINE_CODING, then reads it
+  *         back with GET_LINE_CODING.
+  * @param  bPort: virtual COM port.
+  * @param  wBaudRate: requested rate, 8 data bits, no parity, 1 stop bit.
+  * @retval Rate reported by GET_LINE_CODING, 0 if a transfer failed.
+  */
+static uint32_t SIM_SetLineCoding(uint8_t bPort, uint32_t wBaudRate)
+{
+  uint8_t Set[8] = { 0x21, SIM_SET_LINE_CODING, 0, 0, 0, 0, 7, 0 };
+  uint8_t Get[8] = { 0xA1, SIM_GET_LINE_CODING, 0, 0, 0, 0, 7, 0 };
+  uint8_t Coding[7];
+
+  Set[4] = Get[4] = (uint8_t)(2 * bPort);
+  memcpy(Coding, &wBaudRate, 4);
+  Coding[4] = 0;
+  Coding[5] = 0;
+  Coding[6] = 8;
+  if ((SIM_Control(Set, Coding) != 7) || (SIM_Control(Get, Coding) != 7))
+  {
+    return 0;
+  }
+  return Coding[0] | (Coding[1] << 8) | (Coding[2] << 16) | ((uint32_t)Coding[3] << 24);
+}
+
+/**
+  * @brief  Builds a frame: start byte, payload length, then the payload and
+  *         the rest of the overhead filled with a pattern.
+  * @param  pFrame: frame, VCOMPORT_FRAME_OVERHEAD + Payload bytes.
+  * @param  Payload: payload length.
+  * @param  Seed: first byte of the pattern.
+  * @retval Frame length.
+  */
+static uint32_t SIM_Frame(uint8_t* pFrame, uint8_t Payload, uint8_t Seed)
+{
+  uint32_t i, Length = VCOMPORT_FRAME_OVERHEAD + Payload;
+
+  pFrame[0] = VCOMPORT_FRAME_START;
+  pFrame[VCOMPORT_FRAME_LENGTH_OFFSET] = Payload;
+  for (i = VCOMPORT_FRAME_LENGTH_OFFSET + 1; i < Length; i++)
+  {
+    pFrame[i] = (uint8_t)(Seed + i);
+  }
+  return Length;
+}
+
+/**
+  * @brief  Puts bytes on the RX wire of a USART, then runs the interrupts
+  *         they raise: the receive DMA takes them and the line goes idle.
+  * @param  USARTx: USART.
+  * @param  pData: bytes received.
+  * @param  Length: number of bytes.
+  * @retval Bytes accepted by the wire.
+  */
+static uint32_t SIM_Receive(USART_TypeDef* USARTx, const uint8_t* pData, uint32_t Length)
+{
+  Length = SIM_USART_Inject(USARTx, pData, Length);
+  SIM_ServiceIRQs();
+  return Length;
+}
+
+/**
+  * @brief  Collects the bytes a USART transmitted, waiting for a count.
+  * @param  USARTx: USART.
+  * @param  pData: bytes transmitted.
+  * @param  Length: expected count.
+  * @retval Bytes collected.
+  */
+static uint32_t SIM_Collect(USART_TypeDef* USARTx, uint8_t* pData, uint32_t Length)
+{
+  uint32_t Step, Count = 0;
+
+  for (Step = 0; (Step < SIM_STEPS) && (Count < Length); Step++)
+  {
+    Count += SIM_USART_Collect(USARTx, &pData[Count], Length - Count);
+    SIM_AdvanceTime(20);
+  }
+  return Count;
+}
+
+int main(void)
+{
+  static const uint8_t SetAddress[8] = { 0x00, 0x05, 0x05, 0, 0, 0, 0, 0 };
+  static const uint8_t SetConfiguration[8] = { 0x00, 0x09, 0x01, 0, 0, 0, 0, 0 };
+  static const uint8_t GetConfig[8] = { 0x80, 0x06, 0, 0x02, 0, 0, 9, 0 };
+  uint8_t Data[SIM_PORTS][SIM_PACKET], Frame[SIM_PORTS][2][SIM_PACKET];
+  uint8_t Packet[SIM_PACKET], Wire[SIM_PACKET];
+  uint32_t Length[SIM_PORTS][2], wBaudRate, p, i, failures = 0;
+  const SIM_Port_TypeDef* pPort;
+
+  /* Start up as main.c, then enumerate */
+  SIM_Init();
+  Set_System();
+  Set_USBClock();
+  USB_Interrupts_Config();
+  USB_Init();
+  SIM_USB_BusReset();
+  SIM_CHECK(SIM_Control(SetAddress, 0) == 0);
+  SIM_CHECK(SIM_Control(SetConfiguration, 0) == 0);
+  SIM_CHECK(bDeviceState == CONFIGURED);
+
+  /* One function of two interfaces per port */
+  SIM_CHECK(SIM_Control(GetConfig, Packet) == 9);
+  SIM_CHECK((Packet[2] | (Packet[3] << 8)) == VIRTUAL_COM_PORT_SIZ_CONFIG_DESC);
+  SIM_CHECK(Packet[4] == (2 * SIM_PORTS));
+
+  /* SET_LINE_CODING while the start of a frame waits in the receiver: the
+     stale bytes are dropped and the receive DMA restarts at the beginning
+     of its circular buffer */
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    pPort = &SIM_Port[p];
+    SIM_Frame(Packet, 16, 0x40);
+    SIM_CHECK(SIM_Receive(pPort->USARTx, Packet, 5) == 5);
+    SIM_Frames(1);
+    SIM_CHECK(pPort->Rx_DMA_Channel->CNDTR == (USART_RX_DATA_SIZE - 5));
+    SIM_CHECK(SIM_USB_HostIn(pPort->bInEp, Packet) == SIM_USB_NAK);
+
+    wBaudRate = SIM_SetLineCoding(p, SIM_BAUD_RATE);
+    wBaudRate = (wBaudRate > SIM_BAUD_RATE) ? (wBaudRate - SIM_BAUD_RATE) : (SIM_BAUD_RATE - wBaudRate);
+    SIM_CHECK((wBaudRate * 1000) <= (SIM_BAUD_RATE * VCOMPORT_BAUD_TOLERANCE));
+    SIM_CHECK((pPort->USARTx->CR1 & (USART_CR1_UE | USART_CR1_RE | USART_CR1_PCE)) ==
+              (USART_CR1_UE | USART_CR1_RE));
+    SIM_CHECK((pPort->USARTx->CR3 & USART_CR3_DMAR) != 0);
+    SIM_CHECK((pPort->Rx_DMA_Channel->CCR & (DMA_CCR_EN | DMA_CCR_CIRC)) ==
+              (DMA_CCR_EN | DMA_CCR_CIRC));
+    SIM_CHECK(pPort->Rx_DMA_Channel->CNDTR == USART_RX_DATA_SIZE);
+  }
+
+  /* Host to USART: one packet on each port, then the USARTs send them with
+     the 8 data bits of the new line coding */
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    for (i = 0; i < SIM_PACKET; i++)
+    {
+      Data[p][i] = (uint8_t)(0x80 + (p * 37) + (i * 5));
+    }
+    SIM_CHECK(SIM_USB_HostOut(SIM_Port[p].bOutEp, Data[p], SIM_PACKET) == SIM_PACKET);
+  }
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    memset(Wire, 0, sizeof(Wire));
+    SIM_CHECK(SIM_Collect(SIM_Port[p].USARTx, Wire, SIM_PACKET) == SIM_PACKET);
+    SIM_CHECK(memcmp(Wire, Data[p], SIM_PACKET) == 0);
+    SIM_CHECK(SIM_USART_Collect(SIM_Port[p].USARTx, Wire, 1) == 0);
+  }
+
+  /* USART to host: a whole frame and the start of the next one on each
+     port. The whole frame waits for the deadline and goes alone */
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    Length[p][0] = SIM_Frame(Frame[p][0], (uint8_t)(4 + (p * 9)), (uint8_t)(0x90 + p));
+    Length[p][1] = SIM_Frame(Frame[p][1], (uint8_t)(30 - (p * 7)), (uint8_t)(0xC0 + p));
+    SIM_CHECK(SIM_Receive(SIM_Port[p].USARTx, Frame[p][0], Length[p][0]) == Length[p][0]);
+    SIM_CHECK(SIM_Receive(SIM_Port[p].USARTx, Frame[p][1], 6) == 6);
+  }
+  SIM_Frames(VCOMPORT_FRAME_DEADLINE - 1);
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == SIM_USB_NAK);
+  }
+  SIM_Frames(1);
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    memset(Packet, 0, sizeof(Packet));
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == (int32_t)Length[p][0]);
+    SIM_CHECK(memcmp(Packet, Frame[p][0], Length[p][0]) == 0);
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == SIM_USB_NAK);
+  }
+
+  /* The end of the incomplete frame completes it */
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    SIM_CHECK(SIM_Receive(SIM_Port[p].USARTx, &Frame[p][1][6], Length[p][1] - 6)
+              == (Length[p][1] - 6));
+  }
+  SIM_Frames(VCOMPORT_FRAME_DEADLINE);
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    memset(Packet, 0, sizeof(Packet));
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == (int32_t)Length[p][1]);
+    SIM_CHECK(memcmp(Packet, Frame[p][1], Length[p][1]) == 0);
+  }
+
+  /* A frame cut short goes out as it is after the frame timeout */
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    SIM_CHECK(SIM_Receive(SIM_Port[p].USARTx, Frame[p][0], 3) == 3);
+  }
+  SIM_Frames(VCOMPORT_FRAME_TIMEOUT - 1);
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == SIM_USB_NAK);
+  }
+  SIM_Frames(1);
+  for (p = 0; p < SIM_PORTS; p++)
+  {
+    memset(Packet, 0, sizeof(Packet));
+    SIM_CHECK(SIM_USB_HostIn(SIM_Port[p].bInEp, Packet) == 3);
+    SIM_CHECK(memcmp(Packet, Frame[p][0], 3) == 0);
+  }
+
+  SIM_CHECK(SIM_Asserts == 0);
+
+  printf("sim_vcp_ports: %s\n", (failures == 0) ? "passed" : "FAILED");
+  return (failures == 0) ? 0 : 1;
+}
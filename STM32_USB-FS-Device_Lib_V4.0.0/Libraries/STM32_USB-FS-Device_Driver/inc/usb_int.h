@@ -33,10 +33,15 @@
 /* Includes ------------------------------------------------------------------*/
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
+#ifndef CTR_QUEUE_SIZE
+ #define CTR_QUEUE_SIZE     32  /* deferred CTR events, power of two */
+#endif /* CTR_QUEUE_SIZE */
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void CTR_LP(void);
 void CTR_HP(void);
+void USB_Poll(void);
 
 /* External variables --------------------------------------------------------*/
 
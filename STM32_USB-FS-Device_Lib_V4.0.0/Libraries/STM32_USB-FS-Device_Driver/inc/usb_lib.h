@@ -39,6 +39,8 @@
 #include "usb_init.h"
 #include "usb_sil.h"
 #include "usb_mem.h"
+#include "usb_trace.h"
+#include "usb_ring.h"
 #include "usb_int.h"
 
 /* Exported types ------------------------------------------------------------*/
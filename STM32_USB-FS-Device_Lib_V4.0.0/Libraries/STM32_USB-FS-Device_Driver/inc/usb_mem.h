@@ -33,10 +33,23 @@
 /* Includes ------------------------------------------------------------------*/
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
+#ifndef PMA_SIZE
+ #define PMA_SIZE           512     /* Packet memory size in bytes */
+#endif /* PMA_SIZE */
+#define PMA_ADDR_NONE       0xFFFF  /* USB_PMA_Alloc() failure */
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void UserToPMABufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
 void PMAToUserBufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
+void UserToPMABufferCopy_Byte(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
+void PMAToUserBufferCopy_Byte(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
+
+void     USB_PMA_Init(uint16_t wBTableAddr, uint8_t bEpCount);
+uint16_t USB_PMA_Alloc(uint16_t wSize);
+uint16_t USB_PMA_GetFree(void);
+uint32_t USB_PMA_ConfigEP0(uint16_t wMaxPacketSize);
+uint32_t USB_PMA_ConfigEndpoints(const uint8_t *pConfigDescriptor, uint16_t wDblBufMask);
 
 /* External variables --------------------------------------------------------*/
 
@@ -614,6 +614,9 @@ enum EP_BUF_NUM
 extern __IO uint16_t wIstr;  /* ISTR register last read value */
 
 /* Exported functions ------------------------------------------------------- */
+#ifdef USB_REGS_INLINE
+#include "usb_regs_inline.h"
+#else
 void SetCNTR(uint16_t /*wRegValue*/);
 void SetISTR(uint16_t /*wRegValue*/);
 void SetDADDR(uint16_t /*wRegValue*/);
@@ -674,6 +677,7 @@ EP_DBUF_DIR GetEPDblBufDir(uint8_t /*bEpNum*/);
 void FreeUserBuffer(uint8_t bEpNum/*bEpNum*/, uint8_t bDir);
 uint16_t ToWord(uint8_t, uint8_t);
 uint16_t ByteSwap(uint16_t);
+#endif /* USB_REGS_INLINE */
 
 #endif /* __USB_REGS_H */
 
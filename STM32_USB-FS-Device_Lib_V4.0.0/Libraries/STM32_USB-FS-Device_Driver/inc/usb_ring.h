@@ -0,0 +1,46 @@
+/**
+  ******************************************************************************
+  * @file    usb_ring.h
+  * @brief   Lock-free single producer, single consumer byte ring
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_RING_H
+#define __USB_RING_H
+
+/* Includes ------------------------------------------------------------------*/
+/* Exported types ------------------------------------------------------------*/
+/* Byte ring shared by one producer and one consumer, which may run at
+   different interrupt priorities. The indexes are free running: only the
+   producer writes wHead, only the consumer writes wTail. */
+typedef struct _USB_RING
+{
+  uint8_t *pBuffer;         /* storage, wSize bytes                    */
+  uint32_t wSize;           /* power of two                            */
+  __IO uint32_t wHead;      /* bytes written so far, producer owned    */
+  __IO uint32_t wTail;      /* bytes read so far, consumer owned       */
+} USB_Ring_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+void     USB_Ring_Init(USB_Ring_TypeDef *pRing, uint8_t *pBuffer, uint32_t wSize);
+uint32_t USB_Ring_Count(USB_Ring_TypeDef *pRing);
+uint32_t USB_Ring_Space(USB_Ring_TypeDef *pRing);
+
+/* Producer side */
+uint32_t USB_Ring_WritePeek(USB_Ring_TypeDef *pRing, uint8_t **ppData);
+void     USB_Ring_WriteCommit(USB_Ring_TypeDef *pRing, uint32_t wLength);
+uint32_t USB_Ring_Write(USB_Ring_TypeDef *pRing, const uint8_t *pData, uint32_t wLength);
+void     USB_Ring_WriteSync(USB_Ring_TypeDef *pRing, __IO uint32_t *pwDmaCount);
+
+/* Consumer side */
+uint32_t USB_Ring_ReadPeek(USB_Ring_TypeDef *pRing, uint8_t **ppData);
+uint8_t  USB_Ring_PeekAt(USB_Ring_TypeDef *pRing, uint32_t wOffset);
+void     USB_Ring_ReadCommit(USB_Ring_TypeDef *pRing, uint32_t wLength);
+uint32_t USB_Ring_Read(USB_Ring_TypeDef *pRing, uint8_t *pData, uint32_t wLength);
+
+/* External variables --------------------------------------------------------*/
+
+#endif  /*__USB_RING_H*/
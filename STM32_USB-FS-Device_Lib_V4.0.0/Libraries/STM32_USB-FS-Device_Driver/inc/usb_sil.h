@@ -32,6 +32,17 @@
 
 /* Includes ------------------------------------------------------------------*/
 /* Exported types ------------------------------------------------------------*/
+/* Cursor over an endpoint buffer in packet memory, used by the
+   USB_SIL_WriteReserve()/USB_SIL_ReadAcquire() zero-copy interface */
+typedef struct
+{
+  uint16_t wPMABufAddr;   /* buffer address into PMA                        */
+  uint16_t wSize;         /* TX: room in the buffer, RX: bytes received     */
+  uint16_t wCount;        /* bytes written or read so far                   */
+  uint8_t  bEpNum;        /* endpoint number                                */
+  uint8_t  bPending;      /* TX: low byte of the half-word being completed  */
+} USB_SIL_PMABuf_TypeDef;
+
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
@@ -40,6 +51,22 @@ uint32_t USB_SIL_Init(void);
 uint32_t USB_SIL_Write(uint8_t bEpAddr, uint8_t* pBufferPointer, uint32_t wBufferSize);
 uint32_t USB_SIL_Read(uint8_t bEpAddr, uint8_t* pBufferPointer);
 
+uint32_t USB_SIL_WriteReserve(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf, uint16_t wSize);
+uint32_t USB_SIL_WriteData(USB_SIL_PMABuf_TypeDef* pBuf, const uint8_t* pData, uint32_t wLength);
+uint32_t USB_SIL_WriteByte(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t bData);
+uint32_t USB_SIL_WriteCommit(USB_SIL_PMABuf_TypeDef* pBuf);
+uint32_t USB_SIL_ReadAcquire(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf);
+uint32_t USB_SIL_ReadData(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t* pData, uint32_t wLength);
+uint32_t USB_SIL_ReadByte(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t* pbData);
+
+void     USB_SIL_DblBufInit(uint8_t bEpAddr, uint16_t wBuf0Addr, uint16_t wBuf1Addr, uint16_t wMaxPacketSize);
+uint32_t USB_SIL_DblBufWrite(uint8_t bEpAddr, uint8_t* pBufferPointer, uint32_t wBufferSize);
+uint32_t USB_SIL_DblBufWriteReserve(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf, uint16_t wSize);
+uint32_t USB_SIL_DblBufWriteCommit(USB_SIL_PMABuf_TypeDef* pBuf);
+uint32_t USB_SIL_DblBufInComplete(uint8_t bEpAddr);
+uint32_t USB_SIL_DblBufRead(uint8_t bEpAddr, uint8_t* pBufferPointer);
+uint32_t USB_SIL_DblBufReadAcquire(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf);
+
 /* External variables --------------------------------------------------------*/
 
 #endif /* __USB_SIL_H */
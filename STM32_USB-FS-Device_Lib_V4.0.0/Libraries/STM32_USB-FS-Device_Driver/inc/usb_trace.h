@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    usb_trace.h
+  * @brief   USB event trace: cycle stamped event ring and histogram decoder
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_TRACE_H
+#define __USB_TRACE_H
+
+/* Includes ------------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+#ifndef USB_TRACE_SIZE
+ #define USB_TRACE_SIZE       256  /* ring records, power of two */
+#endif /* USB_TRACE_SIZE */
+#define USB_TRACE_EP_NUM      8
+#define USB_TRACE_HIST_BINS   24
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum _USB_TRACE_ID
+{
+  USB_TRACE_NONE = 0,   /* free ring slot */
+  USB_TRACE_ISR_ENTER,  /* USB_Istr() entry, info = ISTR */
+  USB_TRACE_ISR_EXIT,   /* USB_Istr() exit */
+  USB_TRACE_SOF,        /* start of frame, info = frame number */
+  USB_TRACE_RESET,      /* bus reset */
+  USB_TRACE_SUSP,       /* suspend */
+  USB_TRACE_WKUP,       /* wakeup */
+  USB_TRACE_SETUP,      /* SETUP received on a control endpoint */
+  USB_TRACE_CTR_IN,     /* IN transfer completed, endpoint now NAKs */
+  USB_TRACE_CTR_OUT,    /* OUT transfer completed, endpoint now NAKs */
+  USB_TRACE_CB_DONE,    /* endpoint service routine returned, info = dir */
+  USB_TRACE_TX_VALID,   /* IN endpoint re-armed, NAK window closed */
+  USB_TRACE_RX_VALID,   /* OUT endpoint re-armed, NAK window closed */
+  USB_TRACE_EVENT_NUM
+} USB_TRACE_ID;
+
+/* One trace record, 8 bytes */
+typedef struct _USB_TRACE_RECORD
+{
+  uint32_t wCycles;     /* DWT->CYCCNT at the event */
+  uint8_t  bEvent;      /* USB_TRACE_ID */
+  uint8_t  bEpNum;      /* endpoint number */
+  uint16_t wInfo;       /* event specific */
+} USB_Trace_Record_TypeDef;
+
+/* Log2 histogram of cycle counts: bin n holds durations in [2^(n-1), 2^n) */
+typedef struct _USB_TRACE_HIST
+{
+  uint32_t wCount;
+  uint32_t wMin;
+  uint32_t wMax;
+  uint32_t wBin[USB_TRACE_HIST_BINS];
+} USB_Trace_Hist_TypeDef;
+
+/* Decoder output and state; directions are indexed 0 = IN, 1 = OUT */
+typedef struct _USB_TRACE_STATS
+{
+  USB_Trace_Hist_TypeDef Isr;                              /* USB_Istr() duration       */
+  USB_Trace_Hist_TypeDef Service[USB_TRACE_EP_NUM][2];     /* CTR to service return     */
+  USB_Trace_Hist_TypeDef Latency[USB_TRACE_EP_NUM][2];     /* CTR to endpoint re-armed  */
+  uint32_t wEvents[USB_TRACE_EVENT_NUM];                   /* decoded records per event */
+  uint32_t wIsrStart;
+  uint32_t wCtrStart[USB_TRACE_EP_NUM][2];
+  uint16_t wNakPending;                                    /* bit ep + 8 * dir          */
+  uint8_t  bInIsr;
+} USB_Trace_Stats_TypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#ifdef USB_TRACE
+ #define USB_TRACE_EVENT(bEvent, bEpNum, wInfo)  USB_Trace_Event((bEvent), (bEpNum), (wInfo))
+#else
+ #define USB_TRACE_EVENT(bEvent, bEpNum, wInfo)
+#endif /* USB_TRACE */
+
+/* Exported functions ------------------------------------------------------- */
+void     USB_Trace_Init(void);
+void     USB_Trace_Event(uint8_t bEvent, uint8_t bEpNum, uint16_t wInfo);
+uint32_t USB_Trace_Read(USB_Trace_Record_TypeDef *pRecord);
+uint32_t USB_Trace_GetLost(void);
+
+void     USB_Trace_DecodeInit(USB_Trace_Stats_TypeDef *pStats);
+void     USB_Trace_Decode(USB_Trace_Stats_TypeDef *pStats, const USB_Trace_Record_TypeDef *pRecord);
+uint32_t USB_Trace_Drain(USB_Trace_Stats_TypeDef *pStats);
+
+/* External variables --------------------------------------------------------*/
+
+#endif  /*__USB_TRACE_H*/
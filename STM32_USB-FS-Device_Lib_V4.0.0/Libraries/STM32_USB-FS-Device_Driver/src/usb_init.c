@@ -69,6 +69,9 @@ void USB_Init(void)
   pInformation->ControlState = 2;
   pProperty = &Device_Property;
   pUser_Standard_Requests = &User_Standard_Requests;
+#ifdef USB_TRACE
+  USB_Trace_Init();
+#endif /* USB_TRACE */
   /* Initialize devices one by one */
   pProperty->Init();
 }
@@ -30,11 +30,40 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define CTR_EVENT_IN        0x80  /* deferred event: IN transfer */
+
 /* Private macro -------------------------------------------------------------*/
+/* Restore the endpoint 0 status saved on entry of CTR_LP. In the trace, the
+   directions the service routine left VALID, or STALL at the end of the
+   transfer (the next SETUP is accepted), close their NAK window */
+#ifdef USB_TRACE
+#define RestoreEP0Status() {\
+    _SetEPRxTxStatus(ENDP0, SaveRState, SaveTState);\
+    if ((SaveRState == EP_RX_VALID) || (SaveRState == EP_RX_STALL))\
+    {\
+      USB_Trace_Event(USB_TRACE_RX_VALID, ENDP0, 0);\
+    }\
+    if ((SaveTState == EP_TX_VALID) || (SaveTState == EP_TX_STALL))\
+    {\
+      USB_Trace_Event(USB_TRACE_TX_VALID, ENDP0, 0);\
+    }\
+  }
+#else
+#define RestoreEP0Status()  _SetEPRxTxStatus(ENDP0, SaveRState, SaveTState)
+#endif /* USB_TRACE */
 /* Private variables ---------------------------------------------------------*/
 __IO uint16_t SaveRState;
 __IO uint16_t SaveTState;
 
+#ifdef CTR_DEFERRED
+/* Endpoint events posted by CTR_LP and run by USB_Poll: an endpoint NAKs
+   from CTR until its service routine re-arms it, so at most two events per
+   direction (double buffering) are outstanding per endpoint */
+static __IO uint8_t CtrQueue[CTR_QUEUE_SIZE];
+static __IO uint8_t bCtrHead;  /* written by CTR_LP only   */
+static __IO uint8_t bCtrTail;  /* written by USB_Poll only */
+#endif /* CTR_DEFERRED */
+
 /* Extern variables ----------------------------------------------------------*/
 extern void (*pEpInt_IN[7])(void);    /*  Handles IN  interrupts   */
 extern void (*pEpInt_OUT[7])(void);   /*  Handles OUT interrupts   */
@@ -83,11 +112,13 @@ void CTR_LP(void)
         /* DIR = 0 implies that (EP_CTR_TX = 1) always  */
 
         _ClearEP_CTR_TX(ENDP0);
+        USB_TRACE_EVENT(USB_TRACE_CTR_IN, ENDP0, 0);
         In0_Process();
+        USB_TRACE_EVENT(USB_TRACE_CB_DONE, ENDP0, 0);
 
            /* before terminate set Tx & Rx status */
 
-            _SetEPRxTxStatus(ENDP0,SaveRState,SaveTState);
+            RestoreEP0Status();
 		  return;
       }
       else
@@ -102,20 +133,24 @@ void CTR_LP(void)
         if ((wEPVal &EP_SETUP) != 0)
         {
           _ClearEP_CTR_RX(ENDP0); /* SETUP bit kept frozen while CTR_RX = 1 */
+          USB_TRACE_EVENT(USB_TRACE_SETUP, ENDP0, 0);
           Setup0_Process();
+          USB_TRACE_EVENT(USB_TRACE_CB_DONE, ENDP0, 1);
           /* before terminate set Tx & Rx status */
 
-		      _SetEPRxTxStatus(ENDP0,SaveRState,SaveTState);
+		      RestoreEP0Status();
           return;
         }
 
         else if ((wEPVal & EP_CTR_RX) != 0)
         {
           _ClearEP_CTR_RX(ENDP0);
+          USB_TRACE_EVENT(USB_TRACE_CTR_OUT, ENDP0, 0);
           Out0_Process();
+          USB_TRACE_EVENT(USB_TRACE_CB_DONE, ENDP0, 1);
           /* before terminate set Tx & Rx status */
      
-		     _SetEPRxTxStatus(ENDP0,SaveRState,SaveTState);
+		     RestoreEP0Status();
           return;
         }
       }
@@ -130,9 +165,16 @@ void CTR_LP(void)
       {
         /* clear int flag */
         _ClearEP_CTR_RX(EPindex);
+        USB_TRACE_EVENT(USB_TRACE_CTR_OUT, EPindex, 0);
 
         /* call OUT service function */
+#ifdef CTR_DEFERRED
+        CtrQueue[bCtrHead & (CTR_QUEUE_SIZE - 1)] = EPindex;
+        bCtrHead++;
+#else
         (*pEpInt_OUT[EPindex-1])();
+        USB_TRACE_EVENT(USB_TRACE_CB_DONE, EPindex, 1);
+#endif /* CTR_DEFERRED */
 
       } /* if((wEPVal & EP_CTR_RX) */
 
@@ -140,9 +182,16 @@ void CTR_LP(void)
       {
         /* clear int flag */
         _ClearEP_CTR_TX(EPindex);
+        USB_TRACE_EVENT(USB_TRACE_CTR_IN, EPindex, 0);
 
         /* call IN service function */
+#ifdef CTR_DEFERRED
+        CtrQueue[bCtrHead & (CTR_QUEUE_SIZE - 1)] = EPindex | CTR_EVENT_IN;
+        bCtrHead++;
+#else
         (*pEpInt_IN[EPindex-1])();
+        USB_TRACE_EVENT(USB_TRACE_CB_DONE, EPindex, 0);
+#endif /* CTR_DEFERRED */
       } /* if((wEPVal & EP_CTR_TX) != 0) */
 
     }/* if(EPindex == 0) else */
@@ -173,18 +222,22 @@ void CTR_HP(void)
     {
       /* clear int flag */
       _ClearEP_CTR_RX(EPindex);
+      USB_TRACE_EVENT(USB_TRACE_CTR_OUT, EPindex, 0);
 
       /* call OUT service function */
       (*pEpInt_OUT[EPindex-1])();
+      USB_TRACE_EVENT(USB_TRACE_CB_DONE, EPindex, 1);
 
     } /* if((wEPVal & EP_CTR_RX) */
     else if ((wEPVal & EP_CTR_TX) != 0)
     {
       /* clear int flag */
       _ClearEP_CTR_TX(EPindex);
+      USB_TRACE_EVENT(USB_TRACE_CTR_IN, EPindex, 0);
 
       /* call IN service function */
       (*pEpInt_IN[EPindex-1])();
+      USB_TRACE_EVENT(USB_TRACE_CB_DONE, EPindex, 0);
 
 
     } /* if((wEPVal & EP_CTR_TX) != 0) */
@@ -192,4 +245,42 @@ void CTR_HP(void)
   }/* while(...) */
 }
 
+/*******************************************************************************
+* Function Name  : USB_Poll.
+* Description    : Run the endpoint service routines deferred by CTR_LP, in
+*                  the order the transfers completed. With CTR_DEFERRED
+*                  defined, to be called from the application main loop or
+*                  task; the control endpoint is still serviced in CTR_LP.
+*                  Isochronous endpoints must not be deferred: they do not
+*                  NAK while their service routine is pending. None of the
+*                  example projects defines CTR_DEFERRED.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Poll(void)
+{
+#ifdef CTR_DEFERRED
+  uint8_t bEvent, bEpNum;
+
+  while (bCtrTail != bCtrHead)
+  {
+    bEvent = CtrQueue[bCtrTail & (CTR_QUEUE_SIZE - 1)];
+    bCtrTail++;
+    bEpNum = bEvent & ~CTR_EVENT_IN;
+
+    if ((bEvent & CTR_EVENT_IN) != 0)
+    {
+      (*pEpInt_IN[bEpNum-1])();
+      USB_TRACE_EVENT(USB_TRACE_CB_DONE, bEpNum, 0);
+    }
+    else
+    {
+      (*pEpInt_OUT[bEpNum-1])();
+      USB_TRACE_EVENT(USB_TRACE_CB_DONE, bEpNum, 1);
+    }
+  }
+#endif /* CTR_DEFERRED */
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -30,8 +30,16 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define PMA_EP_TYPE_ISOC   0x01
+#define PMA_EP_TYPE_BULK   0x02
+
 /* Private macro -------------------------------------------------------------*/
+/* RX buffers above 62 bytes are counted in 32-byte blocks (BL_SIZE = 1) */
+#define PMA_RX_SIZE(wSize)  (((wSize) > 62) ? (((wSize) + 31) & ~31) : (wSize))
+
 /* Private variables ---------------------------------------------------------*/
+static uint16_t wPMANext = PMA_SIZE;
+
 /* Extern variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
@@ -39,6 +47,9 @@
 /*******************************************************************************
 * Function Name  : UserToPMABufferCopy
 * Description    : Copy a buffer from user memory area to packet memory area (PMA)
+*                  Half-word aligned buffers are moved one 32-bit word (two PMA
+*                  half-words) per load, four words per loop iteration; odd
+*                  aligned buffers go through the byte path.
 * Input          : - pbUsrBuf: pointer to user memory area.
 *                  - wPMABufAddr: address into PMA.
 *                  - wNBytes: no. of bytes to be copied.
@@ -46,6 +57,79 @@
 * Return         : None	.
 *******************************************************************************/
 void UserToPMABufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
+{
+  uint32_t n, temp;
+  uint32_t *pwUsrBuf;
+  __IO uint16_t *pdwVal;
+
+  if (((uint32_t)pbUsrBuf & 1) != 0)
+  {
+    UserToPMABufferCopy_Byte(pbUsrBuf, wPMABufAddr, wNBytes);
+    return;
+  }
+  pdwVal = (__IO uint16_t *)(wPMABufAddr * 2 + PMAAddr);
+
+  /* head: one half-word up to the next word boundary */
+  if ((((uint32_t)pbUsrBuf & 2) != 0) && (wNBytes >= 2))
+  {
+    *pdwVal = *(uint16_t *)pbUsrBuf;
+    pdwVal += 2;
+    pbUsrBuf += 2;
+    wNBytes -= 2;
+  }
+
+  /* body: each word fills two PMA half-words (PMA words are 32-bit spaced) */
+  pwUsrBuf = (uint32_t *)pbUsrBuf;
+  for (n = wNBytes >> 4; n != 0; n--)
+  {
+    temp = pwUsrBuf[0];
+    pdwVal[0] = (uint16_t)temp;
+    pdwVal[2] = (uint16_t)(temp >> 16);
+    temp = pwUsrBuf[1];
+    pdwVal[4] = (uint16_t)temp;
+    pdwVal[6] = (uint16_t)(temp >> 16);
+    temp = pwUsrBuf[2];
+    pdwVal[8] = (uint16_t)temp;
+    pdwVal[10] = (uint16_t)(temp >> 16);
+    temp = pwUsrBuf[3];
+    pdwVal[12] = (uint16_t)temp;
+    pdwVal[14] = (uint16_t)(temp >> 16);
+    pdwVal += 16;
+    pwUsrBuf += 4;
+  }
+  for (n = (wNBytes >> 2) & 3; n != 0; n--)
+  {
+    temp = *pwUsrBuf++;
+    pdwVal[0] = (uint16_t)temp;
+    pdwVal[2] = (uint16_t)(temp >> 16);
+    pdwVal += 4;
+  }
+
+  /* tail: 0 to 3 bytes, never read past the end of the user buffer */
+  pbUsrBuf = (uint8_t *)pwUsrBuf;
+  if ((wNBytes & 2) != 0)
+  {
+    *pdwVal = *(uint16_t *)pbUsrBuf;
+    pdwVal += 2;
+    pbUsrBuf += 2;
+  }
+  if ((wNBytes & 1) != 0)
+  {
+    *pdwVal = *pbUsrBuf;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : UserToPMABufferCopy_Byte
+* Description    : Copy a buffer from user memory area to packet memory area (PMA)
+*                  byte by byte. Works with any user buffer alignment.
+* Input          : - pbUsrBuf: pointer to user memory area.
+*                  - wPMABufAddr: address into PMA.
+*                  - wNBytes: no. of bytes to be copied.
+* Output         : None.
+* Return         : None	.
+*******************************************************************************/
+void UserToPMABufferCopy_Byte(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
 {
   uint32_t n = (wNBytes + 1) >> 1;   /* n = (wNBytes + 1) / 2 */
   uint32_t i, temp1, temp2;
@@ -64,7 +148,11 @@ void UserToPMABufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNByt
 
 /*******************************************************************************
 * Function Name  : PMAToUserBufferCopy
-* Description    : Copy a buffer from user memory area to packet memory area (PMA)
+* Description    : Copy a buffer from packet memory area (PMA) to user memory area
+*                  Half-word aligned buffers receive one PMA half-word per
+*                  16-bit store, eight stores per loop iteration, and no byte
+*                  past their end; odd aligned buffers go through the byte
+*                  path.
 * Input          : - pbUsrBuf    = pointer to user memory area.
 *                  - wPMABufAddr = address into PMA.
 *                  - wNBytes     = no. of bytes to be copied.
@@ -72,6 +160,56 @@ void UserToPMABufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNByt
 * Return         : None.
 *******************************************************************************/
 void PMAToUserBufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
+{
+  uint32_t n;
+  uint16_t *phUsrBuf;
+  uint32_t *pdwVal;
+
+  if (((uint32_t)pbUsrBuf & 1) != 0)
+  {
+    PMAToUserBufferCopy_Byte(pbUsrBuf, wPMABufAddr, wNBytes);
+    return;
+  }
+  pdwVal = (uint32_t *)(wPMABufAddr * 2 + PMAAddr);
+  phUsrBuf = (uint16_t *)pbUsrBuf;
+
+  /* body: the low half of each 32-bit spaced PMA word is one user half-word */
+  for (n = wNBytes >> 4; n != 0; n--)
+  {
+    phUsrBuf[0] = (uint16_t)pdwVal[0];
+    phUsrBuf[1] = (uint16_t)pdwVal[1];
+    phUsrBuf[2] = (uint16_t)pdwVal[2];
+    phUsrBuf[3] = (uint16_t)pdwVal[3];
+    phUsrBuf[4] = (uint16_t)pdwVal[4];
+    phUsrBuf[5] = (uint16_t)pdwVal[5];
+    phUsrBuf[6] = (uint16_t)pdwVal[6];
+    phUsrBuf[7] = (uint16_t)pdwVal[7];
+    pdwVal += 8;
+    phUsrBuf += 8;
+  }
+  for (n = (wNBytes >> 1) & 7; n != 0; n--)
+  {
+    *phUsrBuf++ = (uint16_t)*pdwVal++;
+  }
+
+  /* tail: the last byte of an odd length, never write past the end */
+  if ((wNBytes & 1) != 0)
+  {
+    *(uint8_t *)phUsrBuf = (uint8_t)*pdwVal;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : PMAToUserBufferCopy_Byte
+* Description    : Copy a buffer from packet memory area (PMA) to user memory area
+*                  one half-word at a time. Works with any user buffer alignment.
+* Input          : - pbUsrBuf    = pointer to user memory area.
+*                  - wPMABufAddr = address into PMA.
+*                  - wNBytes     = no. of bytes to be copied.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void PMAToUserBufferCopy_Byte(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
 {
   uint32_t n = (wNBytes + 1) >> 1;/* /2*/
   uint32_t i;
@@ -84,4 +222,146 @@ void PMAToUserBufferCopy(uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNByt
   }
 }
 
+/*******************************************************************************
+* Function Name  : USB_PMA_Init
+* Description    : Reset the packet memory allocator: place the buffer
+*                  descriptor table at wBTableAddr and reserve its bEpCount
+*                  entries. To be called from the Device_Property Reset
+*                  routine, before any endpoint buffer is allocated.
+* Input          : - wBTableAddr: buffer descriptor table address into PMA.
+*                  - bEpCount: number of endpoints used by the device.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_PMA_Init(uint16_t wBTableAddr, uint8_t bEpCount)
+{
+  SetBTABLE(wBTableAddr);
+  wPMANext = (wBTableAddr & ~7) + ((uint16_t)bEpCount << 3);
+}
+
+/*******************************************************************************
+* Function Name  : USB_PMA_Alloc
+* Description    : Reserve a half-word aligned buffer into PMA.
+* Input          : - wSize: buffer size in bytes.
+* Output         : None.
+* Return         : Buffer address into PMA, or PMA_ADDR_NONE when the packet
+*                  memory is exhausted.
+*******************************************************************************/
+uint16_t USB_PMA_Alloc(uint16_t wSize)
+{
+  uint16_t wAddr = wPMANext;
+
+  wSize = (wSize + 1) & ~1;
+  if (wSize > (uint16_t)(PMA_SIZE - wAddr))
+  {
+    return PMA_ADDR_NONE;
+  }
+  wPMANext = wAddr + wSize;
+  return wAddr;
+}
+
+/*******************************************************************************
+* Function Name  : USB_PMA_GetFree
+* Description    : Return the packet memory still available for allocation.
+* Input          : None.
+* Output         : None.
+* Return         : Free PMA space in bytes.
+*******************************************************************************/
+uint16_t USB_PMA_GetFree(void)
+{
+  return (uint16_t)(PMA_SIZE - wPMANext);
+}
+
+/*******************************************************************************
+* Function Name  : USB_PMA_ConfigEP0
+* Description    : Allocate the control endpoint buffers and set the RX count.
+* Input          : - wMaxPacketSize: control endpoint max packet size.
+* Output         : None.
+* Return         : USB_SUCCESS or USB_ERROR when the PMA is exhausted.
+*******************************************************************************/
+uint32_t USB_PMA_ConfigEP0(uint16_t wMaxPacketSize)
+{
+  uint16_t wRxAddr, wTxAddr;
+
+  wRxAddr = USB_PMA_Alloc(PMA_RX_SIZE(wMaxPacketSize));
+  wTxAddr = USB_PMA_Alloc(wMaxPacketSize);
+  if ((wRxAddr == PMA_ADDR_NONE) || (wTxAddr == PMA_ADDR_NONE))
+  {
+    return USB_ERROR;
+  }
+  SetEPRxAddr(ENDP0, wRxAddr);
+  SetEPTxAddr(ENDP0, wTxAddr);
+  SetEPRxCount(ENDP0, wMaxPacketSize);
+  return USB_SUCCESS;
+}
+
+/*******************************************************************************
+* Function Name  : USB_PMA_ConfigEndpoints
+* Description    : Walk the endpoint descriptors of a configuration descriptor
+*                  and allocate wMaxPacketSize bytes per endpoint into PMA.
+*                  Isochronous endpoints and the bulk endpoints whose number
+*                  is set in wDblBufMask get two buffers, programmed through
+*                  SetEPDblBuffAddr(); the RX count of OUT endpoints is set.
+*                  Endpoint type, kind and status are left to the caller.
+* Input          : - pConfigDescriptor: configuration descriptor.
+*                  - wDblBufMask: bit n set = bulk endpoint n double buffered.
+* Output         : None.
+* Return         : USB_SUCCESS or USB_ERROR when the PMA is exhausted.
+*******************************************************************************/
+uint32_t USB_PMA_ConfigEndpoints(const uint8_t *pConfigDescriptor, uint16_t wDblBufMask)
+{
+  const uint8_t *pDesc = pConfigDescriptor;
+  const uint8_t *pEnd;
+  uint16_t wMaxPacketSize, wSize, wAddr0, wAddr1;
+  uint8_t bEpNum, bType, bOut;
+
+  pEnd = pConfigDescriptor + (pConfigDescriptor[2] | (pConfigDescriptor[3] << 8));
+  for (; (pDesc + 1 < pEnd) && (pDesc[0] != 0); pDesc += pDesc[0])
+  {
+    if ((pDesc[1] != ENDPOINT_DESCRIPTOR) || (pDesc[0] < 7))
+    {
+      continue;
+    }
+    bEpNum = pDesc[2] & 0x0F;
+    bOut = ((pDesc[2] & 0x80) == 0);
+    bType = pDesc[3] & 0x03;
+    wMaxPacketSize = (pDesc[4] | (pDesc[5] << 8)) & 0x03FF;
+    wSize = bOut ? PMA_RX_SIZE(wMaxPacketSize) : wMaxPacketSize;
+
+    if ((bType == PMA_EP_TYPE_ISOC) ||
+        ((bType == PMA_EP_TYPE_BULK) && ((wDblBufMask >> bEpNum) & 1)))
+    {
+      wAddr0 = USB_PMA_Alloc(wSize);
+      wAddr1 = USB_PMA_Alloc(wSize);
+      if ((wAddr0 == PMA_ADDR_NONE) || (wAddr1 == PMA_ADDR_NONE))
+      {
+        return USB_ERROR;
+      }
+      SetEPDblBuffAddr(bEpNum, wAddr0, wAddr1);
+      if (bOut)
+      {
+        SetEPDblBuffCount(bEpNum, EP_DBUF_OUT, wMaxPacketSize);
+      }
+    }
+    else
+    {
+      wAddr0 = USB_PMA_Alloc(wSize);
+      if (wAddr0 == PMA_ADDR_NONE)
+      {
+        return USB_ERROR;
+      }
+      if (bOut)
+      {
+        SetEPRxAddr(bEpNum, wAddr0);
+        SetEPRxCount(bEpNum, wMaxPacketSize);
+      }
+      else
+      {
+        SetEPTxAddr(bEpNum, wAddr0);
+      }
+    }
+  }
+  return USB_SUCCESS;
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
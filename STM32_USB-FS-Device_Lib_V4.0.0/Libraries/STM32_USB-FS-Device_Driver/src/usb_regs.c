@@ -35,6 +35,7 @@
 /* Extern variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
+#ifndef USB_REGS_INLINE
 
 /*******************************************************************************
 * Function Name  : SetCNTR.
@@ -205,6 +206,12 @@ uint16_t GetEPType(uint8_t bEpNum)
 void SetEPTxStatus(uint8_t bEpNum, uint16_t wState)
 {
   _SetEPTxStatus(bEpNum, wState);
+#ifdef USB_TRACE
+  if (wState == EP_TX_VALID)
+  {
+    USB_Trace_Event(USB_TRACE_TX_VALID, bEpNum, 0);
+  }
+#endif /* USB_TRACE */
 }
 
 /*******************************************************************************
@@ -218,6 +225,12 @@ void SetEPTxStatus(uint8_t bEpNum, uint16_t wState)
 void SetEPRxStatus(uint8_t bEpNum, uint16_t wState)
 {
   _SetEPRxStatus(bEpNum, wState);
+#ifdef USB_TRACE
+  if (wState == EP_RX_VALID)
+  {
+    USB_Trace_Event(USB_TRACE_RX_VALID, bEpNum, 0);
+  }
+#endif /* USB_TRACE */
 }
 
 /*******************************************************************************
@@ -276,6 +289,7 @@ uint16_t GetEPRxStatus(uint8_t bEpNum)
 void SetEPTxValid(uint8_t bEpNum)
 {
   _SetEPTxStatus(bEpNum, EP_TX_VALID);
+  USB_TRACE_EVENT(USB_TRACE_TX_VALID, bEpNum, 0);
 }
 
 /*******************************************************************************
@@ -288,6 +302,7 @@ void SetEPTxValid(uint8_t bEpNum)
 void SetEPRxValid(uint8_t bEpNum)
 {
   _SetEPRxStatus(bEpNum, EP_RX_VALID);
+  USB_TRACE_EVENT(USB_TRACE_RX_VALID, bEpNum, 0);
 }
 
 /*******************************************************************************
@@ -721,10 +736,12 @@ void FreeUserBuffer(uint8_t bEpNum, uint8_t bDir)
   if (bDir == EP_DBUF_OUT)
   { /* OUT double buffered endpoint */
     _ToggleDTOG_TX(bEpNum);
+    USB_TRACE_EVENT(USB_TRACE_RX_VALID, bEpNum, 0);
   }
   else if (bDir == EP_DBUF_IN)
   { /* IN double buffered endpoint */
     _ToggleDTOG_RX(bEpNum);
+    USB_TRACE_EVENT(USB_TRACE_TX_VALID, bEpNum, 0);
   }
 }
 
@@ -757,4 +774,6 @@ uint16_t ByteSwap(uint16_t wSwW)
   return(wRet);
 }
 
+#endif /* USB_REGS_INLINE */
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,254 @@
+/**
+  ******************************************************************************
+  * @file    usb_ring.c
+  * @brief   Lock-free single producer, single consumer byte ring
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+#define RING_INDEX(pRing, wCount)   ((wCount) & ((pRing)->wSize - 1))
+
+/* Private variables ---------------------------------------------------------*/
+/* Extern variables ----------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+/*******************************************************************************
+* Function Name  : USB_Ring_Init
+* Description    : Initialize an empty ring. Neither side may use the ring
+*                  meanwhile.
+* Input          : - pRing: ring to initialize.
+*                  - pBuffer: storage.
+*                  - wSize: storage size in bytes, a power of two.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Ring_Init(USB_Ring_TypeDef *pRing, uint8_t *pBuffer, uint32_t wSize)
+{
+  pRing->pBuffer = pBuffer;
+  pRing->wSize = wSize;
+  pRing->wHead = 0;
+  pRing->wTail = 0;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_Count
+* Description    : Return the number of bytes the consumer can read. Exact for
+*                  the consumer, a lower bound for the producer.
+* Input          : - pRing: ring.
+* Output         : None.
+* Return         : Number of bytes in the ring.
+*******************************************************************************/
+uint32_t USB_Ring_Count(USB_Ring_TypeDef *pRing)
+{
+  return pRing->wHead - pRing->wTail;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_Space
+* Description    : Return the number of bytes the producer can write. Exact for
+*                  the producer, a lower bound for the consumer.
+* Input          : - pRing: ring.
+* Output         : None.
+* Return         : Number of free bytes in the ring.
+*******************************************************************************/
+uint32_t USB_Ring_Space(USB_Ring_TypeDef *pRing)
+{
+  return pRing->wSize - (pRing->wHead - pRing->wTail);
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_WritePeek
+* Description    : Producer: get the contiguous free span at the write index,
+*                  to be filled in place then published by
+*                  USB_Ring_WriteCommit().
+* Input          : - pRing: ring.
+* Output         : - ppData: start of the span.
+* Return         : Length of the span (in bytes), 0 if the ring is full.
+*******************************************************************************/
+uint32_t USB_Ring_WritePeek(USB_Ring_TypeDef *pRing, uint8_t **ppData)
+{
+  uint32_t wHead = pRing->wHead;
+  uint32_t wIndex = RING_INDEX(pRing, wHead);
+  uint32_t wLength = pRing->wSize - (wHead - pRing->wTail);
+
+  if (wLength > (pRing->wSize - wIndex))
+  {
+    wLength = pRing->wSize - wIndex;
+  }
+  *ppData = &pRing->pBuffer[wIndex];
+  return wLength;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_WriteCommit
+* Description    : Producer: publish wLength bytes written at the write index.
+*                  The barrier makes the data visible before the index.
+* Input          : - pRing: ring.
+*                  - wLength: number of bytes written, at most the free space.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Ring_WriteCommit(USB_Ring_TypeDef *pRing, uint32_t wLength)
+{
+  __DMB();
+  pRing->wHead += wLength;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_Write
+* Description    : Producer: copy data into the ring, wrapping at its end.
+* Input          : - pRing: ring.
+*                  - pData: data to write.
+*                  - wLength: number of bytes to write.
+* Output         : None.
+* Return         : Number of bytes written, less than wLength if the ring
+*                  became full.
+*******************************************************************************/
+uint32_t USB_Ring_Write(USB_Ring_TypeDef *pRing, const uint8_t *pData, uint32_t wLength)
+{
+  uint8_t *pSpan;
+  uint32_t wSpan, wDone = 0, i;
+
+  while (wDone < wLength)
+  {
+    wSpan = USB_Ring_WritePeek(pRing, &pSpan);
+    if (wSpan == 0)
+    {
+      break;
+    }
+    if (wSpan > (wLength - wDone))
+    {
+      wSpan = wLength - wDone;
+    }
+    for (i = 0; i < wSpan; i++)
+    {
+      pSpan[i] = pData[wDone + i];
+    }
+    USB_Ring_WriteCommit(pRing, wSpan);
+    wDone += wSpan;
+  }
+  return wDone;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_WriteSync
+* Description    : Producer: publish the bytes stored by a circular DMA channel
+*                  whose buffer is the ring storage. Unlike the other producer
+*                  calls, it may be called from several contexts: the write
+*                  index follows the channel counter under LDREX/STREX, so it
+*                  only ever moves forward. The consumer has to keep up, an
+*                  overrun loses data as the channel overwrites it.
+* Input          : - pRing: ring.
+*                  - pwDmaCount: down counter of the channel (CNDTR).
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Ring_WriteSync(USB_Ring_TypeDef *pRing, __IO uint32_t *pwDmaCount)
+{
+  uint32_t wHead, wIndex;
+
+  do
+  {
+    wHead = __LDREXW((uint32_t *)&pRing->wHead);
+
+    /* Sampled after the exclusive load: never older than wHead */
+    wIndex = RING_INDEX(pRing, pRing->wSize - *pwDmaCount);
+    wHead += RING_INDEX(pRing, wIndex - wHead);
+  } while (__STREXW(wHead, (uint32_t *)&pRing->wHead) != 0);
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_ReadPeek
+* Description    : Consumer: get the contiguous span of data at the read index,
+*                  to be used in place then released by USB_Ring_ReadCommit().
+* Input          : - pRing: ring.
+* Output         : - ppData: start of the span.
+* Return         : Length of the span (in bytes), 0 if the ring is empty.
+*******************************************************************************/
+uint32_t USB_Ring_ReadPeek(USB_Ring_TypeDef *pRing, uint8_t **ppData)
+{
+  uint32_t wTail = pRing->wTail;
+  uint32_t wIndex = RING_INDEX(pRing, wTail);
+  uint32_t wLength = pRing->wHead - wTail;
+
+  __DMB();
+  if (wLength > (pRing->wSize - wIndex))
+  {
+    wLength = pRing->wSize - wIndex;
+  }
+  *ppData = &pRing->pBuffer[wIndex];
+  return wLength;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_PeekAt
+* Description    : Consumer: get the byte wOffset bytes past the read index,
+*                  wrapping at the storage end, without consuming it. The
+*                  barrier orders the read after the count the offset was
+*                  checked against.
+* Input          : - pRing: ring.
+*                  - wOffset: offset from the read index, below the count.
+* Output         : None.
+* Return         : The byte.
+*******************************************************************************/
+uint8_t USB_Ring_PeekAt(USB_Ring_TypeDef *pRing, uint32_t wOffset)
+{
+  __DMB();
+  return pRing->pBuffer[RING_INDEX(pRing, pRing->wTail + wOffset)];
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_ReadCommit
+* Description    : Consumer: release wLength bytes at the read index. The
+*                  barrier completes the reads before the producer may reuse
+*                  the space.
+* Input          : - pRing: ring.
+*                  - wLength: number of bytes consumed, at most the count.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Ring_ReadCommit(USB_Ring_TypeDef *pRing, uint32_t wLength)
+{
+  __DMB();
+  pRing->wTail += wLength;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Ring_Read
+* Description    : Consumer: copy data out of the ring, wrapping at its end.
+* Input          : - pRing: ring.
+*                  - wLength: maximum number of bytes to read.
+* Output         : - pData: destination.
+* Return         : Number of bytes read.
+*******************************************************************************/
+uint32_t USB_Ring_Read(USB_Ring_TypeDef *pRing, uint8_t *pData, uint32_t wLength)
+{
+  uint8_t *pSpan;
+  uint32_t wSpan, wDone = 0, i;
+
+  while (wDone < wLength)
+  {
+    wSpan = USB_Ring_ReadPeek(pRing, &pSpan);
+    if (wSpan == 0)
+    {
+      break;
+    }
+    if (wSpan > (wLength - wDone))
+    {
+      wSpan = wLength - wDone;
+    }
+    for (i = 0; i < wSpan; i++)
+    {
+      pData[wDone + i] = pSpan[i];
+    }
+    USB_Ring_ReadCommit(pRing, wSpan);
+    wDone += wSpan;
+  }
+  return wDone;
+}
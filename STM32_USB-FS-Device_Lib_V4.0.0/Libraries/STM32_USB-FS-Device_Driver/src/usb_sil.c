@@ -33,7 +33,18 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
+/* Double-buffered endpoints: the USB uses the buffer selected by its DTOG bit,
+   the application the one selected by SW_BUF (DTOG of the other direction) */
+#define DBL_IN_DTOG(bEpNum)     ((GetENDPOINT(bEpNum) & EP_DTOG_TX) != 0)
+#define DBL_IN_SW_BUF(bEpNum)   ((GetENDPOINT(bEpNum) & EP_DTOG_RX) != 0)
+#define DBL_OUT_SW_BUF(bEpNum)  ((GetENDPOINT(bEpNum) & EP_DTOG_TX) != 0)
+
+/* PMA half-word holding the byte at PMA address addr */
+#define PMA_HALFWORD(addr)  (*(__IO uint16_t *)((uint32_t)((addr) & ~1) * 2 + PMAAddr))
 /* Private variables ---------------------------------------------------------*/
+/* Double-buffered IN endpoints whose application buffer is filled but not yet
+   handed to the USB (one bit per endpoint number) */
+static uint16_t wDblBufInPending;
 /* Extern variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
@@ -100,4 +111,416 @@ uint32_t USB_SIL_Read(uint8_t bEpAddr, uint8_t* pBufferPointer)
   return DataLength;
 }
 
+/*******************************************************************************
+* Function Name  : USB_SIL_WriteReserve
+* Description    : Open a writer over the PMA TX buffer of an endpoint, so that
+*                  class code can serialize its data straight into packet
+*                  memory instead of staging it in RAM for USB_SIL_Write.
+* Input          : - bEpAddr: The address of the non control endpoint.
+*                  - pBuf: writer to initialize.
+*                  - wSize: size of the endpoint TX buffer (in bytes).
+* Output         : None.
+* Return         : Status.
+*******************************************************************************/
+uint32_t USB_SIL_WriteReserve(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf, uint16_t wSize)
+{
+  pBuf->bEpNum = bEpAddr & 0x7F;
+  pBuf->wPMABufAddr = GetEPTxAddr(pBuf->bEpNum);
+  pBuf->wSize = wSize;
+  pBuf->wCount = 0;
+  pBuf->bPending = 0;
+
+  return 0;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_WriteData
+* Description    : Append a buffer of data to a reserved endpoint buffer.
+* Input          : - pBuf: writer opened by USB_SIL_WriteReserve.
+*                  - pData: The pointer to the data to be written.
+*                  - wLength: Number of data to be written (in bytes).
+* Output         : None.
+* Return         : Number of data written (in bytes), less than wLength when
+*                  the buffer is full.
+*******************************************************************************/
+uint32_t USB_SIL_WriteData(USB_SIL_PMABuf_TypeDef* pBuf, const uint8_t* pData, uint32_t wLength)
+{
+  uint32_t room = pBuf->wSize - pBuf->wCount;
+  uint32_t n, written;
+
+  if (wLength > room)
+  {
+    wLength = room;
+  }
+  written = wLength;
+
+  /* Complete the half-word started by the previous write */
+  if (((pBuf->wCount & 1) != 0) && (wLength != 0))
+  {
+    USB_SIL_WriteByte(pBuf, *pData++);
+    wLength--;
+  }
+
+  n = wLength & ~1;
+  if (n != 0)
+  {
+    UserToPMABufferCopy((uint8_t *)pData, pBuf->wPMABufAddr + pBuf->wCount, n);
+    pBuf->wCount += n;
+  }
+  if ((wLength & 1) != 0)
+  {
+    USB_SIL_WriteByte(pBuf, pData[n]);
+  }
+
+  return written;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_WriteByte
+* Description    : Append one byte to a reserved endpoint buffer.
+* Input          : - pBuf: writer opened by USB_SIL_WriteReserve.
+*                  - bData: byte to be written.
+* Output         : None.
+* Return         : 1 if written, 0 if the buffer is full.
+*******************************************************************************/
+uint32_t USB_SIL_WriteByte(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t bData)
+{
+  uint16_t wAddr = pBuf->wPMABufAddr + pBuf->wCount;
+
+  if (pBuf->wCount >= pBuf->wSize)
+  {
+    return 0;
+  }
+
+  /* The PMA is half-word wide: an odd byte is merged with its even
+     neighbour, written alone first so that the buffer is always valid */
+  if ((pBuf->wCount & 1) == 0)
+  {
+    pBuf->bPending = bData;
+    PMA_HALFWORD(wAddr) = bData;
+  }
+  else
+  {
+    PMA_HALFWORD(wAddr) = pBuf->bPending | ((uint16_t)bData << 8);
+  }
+  pBuf->wCount++;
+
+  return 1;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_WriteCommit
+* Description    : Close a writer: update the data length of the endpoint.
+*                  The endpoint is then made valid by the caller, as after
+*                  USB_SIL_Write.
+* Input          : - pBuf: writer opened by USB_SIL_WriteReserve.
+* Output         : None.
+* Return         : Number of data written (in bytes).
+*******************************************************************************/
+uint32_t USB_SIL_WriteCommit(USB_SIL_PMABuf_TypeDef* pBuf)
+{
+  SetEPTxCount(pBuf->bEpNum, pBuf->wCount);
+
+  return pBuf->wCount;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_ReadAcquire
+* Description    : Open a reader over the received data of an endpoint, so that
+*                  class code can parse it straight from packet memory.
+* Input          : - bEpAddr: The address of the non control endpoint.
+*                  - pBuf: reader to initialize.
+* Output         : None.
+* Return         : Number of received data (in Bytes).
+*******************************************************************************/
+uint32_t USB_SIL_ReadAcquire(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf)
+{
+  pBuf->bEpNum = bEpAddr & 0x7F;
+  pBuf->wPMABufAddr = GetEPRxAddr(pBuf->bEpNum);
+  pBuf->wSize = GetEPRxCount(pBuf->bEpNum);
+  pBuf->wCount = 0;
+  pBuf->bPending = 0;
+
+  return pBuf->wSize;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_ReadData
+* Description    : Read the next received data of an acquired endpoint buffer.
+* Input          : - pBuf: reader opened by USB_SIL_ReadAcquire.
+*                  - pData: The pointer to which will be saved the data.
+*                  - wLength: Number of data wanted (in bytes).
+* Output         : None.
+* Return         : Number of data read (in bytes).
+*******************************************************************************/
+uint32_t USB_SIL_ReadData(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t* pData, uint32_t wLength)
+{
+  uint32_t left = pBuf->wSize - pBuf->wCount;
+  uint32_t n, read;
+
+  if (wLength > left)
+  {
+    wLength = left;
+  }
+  read = wLength;
+
+  if (((pBuf->wCount & 1) != 0) && (wLength != 0))
+  {
+    USB_SIL_ReadByte(pBuf, pData++);
+    wLength--;
+  }
+
+  n = wLength & ~1;
+  if (n != 0)
+  {
+    PMAToUserBufferCopy(pData, pBuf->wPMABufAddr + pBuf->wCount, n);
+    pBuf->wCount += n;
+  }
+  if ((wLength & 1) != 0)
+  {
+    USB_SIL_ReadByte(pBuf, pData + n);
+  }
+
+  return read;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_ReadByte
+* Description    : Read the next received byte of an acquired endpoint buffer.
+* Input          : - pBuf: reader opened by USB_SIL_ReadAcquire.
+*                  - pbData: The pointer to which will be saved the byte.
+* Output         : None.
+* Return         : 1 if read, 0 if all received data has been read.
+*******************************************************************************/
+uint32_t USB_SIL_ReadByte(USB_SIL_PMABuf_TypeDef* pBuf, uint8_t* pbData)
+{
+  uint16_t wAddr = pBuf->wPMABufAddr + pBuf->wCount;
+
+  if (pBuf->wCount >= pBuf->wSize)
+  {
+    return 0;
+  }
+  *pbData = (uint8_t)(PMA_HALFWORD(wAddr) >> ((wAddr & 1) * 8));
+  pBuf->wCount++;
+
+  return 1;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufInit
+* Description    : Configure a bulk endpoint in double-buffered mode. The
+*                  application fills (IN) or drains (OUT) one buffer while the
+*                  USB transfers the other one.
+* Input          : - bEpAddr: The address of the bulk endpoint (bit 7 set: IN).
+*                  - wBuf0Addr, wBuf1Addr: addresses of the two buffers into PMA.
+*                  - wMaxPacketSize: size of each buffer (in bytes).
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_SIL_DblBufInit(uint8_t bEpAddr, uint16_t wBuf0Addr, uint16_t wBuf1Addr, uint16_t wMaxPacketSize)
+{
+  uint8_t bEpNum = bEpAddr & 0x7F;
+
+  SetEPType(bEpNum, EP_BULK);
+  SetEPDoubleBuff(bEpNum);
+  SetEPDblBuffAddr(bEpNum, wBuf0Addr, wBuf1Addr);
+  ClearDTOG_RX(bEpNum);
+  ClearDTOG_TX(bEpNum);
+
+  if ((bEpAddr & 0x80) != 0)
+  {
+    /* DTOG_TX = SW_BUF: nothing to transmit, the application owns buffer 0 */
+    SetEPDblBuffCount(bEpNum, EP_DBUF_IN, 0);
+    wDblBufInPending &= ~(1 << bEpNum);
+    SetEPRxStatus(bEpNum, EP_RX_DIS);
+    SetEPTxStatus(bEpNum, EP_TX_VALID);
+  }
+  else
+  {
+    /* SW_BUF = 1: both buffers are free for reception, starting with 0 */
+    SetEPDblBuffCount(bEpNum, EP_DBUF_OUT, wMaxPacketSize);
+    ToggleDTOG_TX(bEpNum);
+    SetEPTxStatus(bEpNum, EP_TX_DIS);
+    SetEPRxStatus(bEpNum, EP_RX_VALID);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufWrite
+* Description    : Write a buffer of data to a double-buffered IN endpoint.
+* Input          : - bEpAddr: The address of the IN endpoint.
+*                  - pBufferPointer: The pointer to the buffer of data to be
+*                    written to the endpoint.
+*                  - wBufferSize: Number of data to be written (in bytes).
+* Output         : None.
+* Return         : Status: 0 if queued, 1 if both buffers are busy.
+*******************************************************************************/
+uint32_t USB_SIL_DblBufWrite(uint8_t bEpAddr, uint8_t* pBufferPointer, uint32_t wBufferSize)
+{
+  USB_SIL_PMABuf_TypeDef Writer;
+
+  if (USB_SIL_DblBufWriteReserve(bEpAddr, &Writer, wBufferSize) != 0)
+  {
+    return 1;
+  }
+  USB_SIL_WriteData(&Writer, pBufferPointer, wBufferSize);
+  USB_SIL_DblBufWriteCommit(&Writer);
+
+  return 0;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufWriteReserve
+* Description    : Open a writer over the application buffer of a
+*                  double-buffered IN endpoint.
+* Input          : - bEpAddr: The address of the IN endpoint.
+*                  - pBuf: writer to initialize.
+*                  - wSize: size of the endpoint buffers (in bytes).
+* Output         : None.
+* Return         : Status: 0 if reserved, 1 if both buffers are busy.
+*******************************************************************************/
+uint32_t USB_SIL_DblBufWriteReserve(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf, uint16_t wSize)
+{
+  uint8_t bEpNum = bEpAddr & 0x7F;
+
+  if ((wDblBufInPending & (1 << bEpNum)) != 0)
+  {
+    return 1;
+  }
+  pBuf->bEpNum = bEpNum;
+  pBuf->wPMABufAddr = DBL_IN_SW_BUF(bEpNum) ? GetEPDblBuf1Addr(bEpNum) : GetEPDblBuf0Addr(bEpNum);
+  pBuf->wSize = wSize;
+  pBuf->wCount = 0;
+  pBuf->bPending = 0;
+
+  return 0;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufWriteCommit
+* Description    : Close a writer opened by USB_SIL_DblBufWriteReserve. The
+*                  buffer goes to the USB at once if it is idle, otherwise as
+*                  soon as the buffer in transmission has been sent. May be
+*                  called from the main loop: the interrupts are masked while
+*                  the idle test and the hand over race with the IN callback.
+* Input          : - pBuf: writer opened by USB_SIL_DblBufWriteReserve.
+* Output         : None.
+* Return         : Number of data written (in bytes).
+*******************************************************************************/
+uint32_t USB_SIL_DblBufWriteCommit(USB_SIL_PMABuf_TypeDef* pBuf)
+{
+  uint8_t bEpNum = pBuf->bEpNum;
+  uint32_t wPriMask;
+
+  if (DBL_IN_SW_BUF(bEpNum))
+  {
+    SetEPDblBuf1Count(bEpNum, EP_DBUF_IN, pBuf->wCount);
+  }
+  else
+  {
+    SetEPDblBuf0Count(bEpNum, EP_DBUF_IN, pBuf->wCount);
+  }
+
+  /* An IN transaction completing between the test and the update would
+     leave the buffer pending with no callback to send it */
+  wPriMask = __get_PRIMASK();
+  __disable_irq();
+  if (DBL_IN_DTOG(bEpNum) == DBL_IN_SW_BUF(bEpNum))
+  {
+    /* USB idle: hand the buffer over, the application gets the other one */
+    FreeUserBuffer(bEpNum, EP_DBUF_IN);
+  }
+  else
+  {
+    wDblBufInPending |= (1 << bEpNum);
+  }
+  __set_PRIMASK(wPriMask);
+
+  return pBuf->wCount;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufInComplete
+* Description    : To be called from the IN callback of a double-buffered
+*                  endpoint: hands the next filled buffer, if any, to the USB.
+*                  Masks the interrupts like USB_SIL_DblBufWriteCommit, the
+*                  callback may run from the main loop (CTR_DEFERRED).
+* Input          : - bEpAddr: The address of the IN endpoint.
+* Output         : None.
+* Return         : 1 if a buffer is being transmitted, 0 if the endpoint is idle.
+*******************************************************************************/
+uint32_t USB_SIL_DblBufInComplete(uint8_t bEpAddr)
+{
+  uint8_t bEpNum = bEpAddr & 0x7F;
+  uint32_t wPriMask, wBusy;
+
+  wPriMask = __get_PRIMASK();
+  __disable_irq();
+  if ((wDblBufInPending & (1 << bEpNum)) != 0)
+  {
+    wDblBufInPending &= ~(1 << bEpNum);
+    FreeUserBuffer(bEpNum, EP_DBUF_IN);
+  }
+  wBusy = (DBL_IN_DTOG(bEpNum) != DBL_IN_SW_BUF(bEpNum));
+  __set_PRIMASK(wPriMask);
+
+  return wBusy;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufRead
+* Description    : To be called from the OUT callback of a double-buffered
+*                  endpoint: copies the received buffer while the USB already
+*                  receives into the other one.
+* Input          : - bEpAddr: The address of the OUT endpoint.
+*                  - pBufferPointer: The pointer to which will be saved the
+*                     received data buffer.
+* Output         : None.
+* Return         : Number of received data (in Bytes).
+*******************************************************************************/
+uint32_t USB_SIL_DblBufRead(uint8_t bEpAddr, uint8_t* pBufferPointer)
+{
+  USB_SIL_PMABuf_TypeDef Reader;
+  uint32_t DataLength;
+
+  DataLength = USB_SIL_DblBufReadAcquire(bEpAddr, &Reader);
+  USB_SIL_ReadData(&Reader, pBufferPointer, DataLength);
+
+  return DataLength;
+}
+
+/*******************************************************************************
+* Function Name  : USB_SIL_DblBufReadAcquire
+* Description    : To be called from the OUT callback of a double-buffered
+*                  endpoint: takes the received buffer and releases the other
+*                  one to the USB. The reader stays valid until the next OUT
+*                  callback of the endpoint.
+* Input          : - bEpAddr: The address of the OUT endpoint.
+*                  - pBuf: reader to initialize.
+* Output         : None.
+* Return         : Number of received data (in Bytes).
+*******************************************************************************/
+uint32_t USB_SIL_DblBufReadAcquire(uint8_t bEpAddr, USB_SIL_PMABuf_TypeDef* pBuf)
+{
+  uint8_t bEpNum = bEpAddr & 0x7F;
+
+  FreeUserBuffer(bEpNum, EP_DBUF_OUT);
+
+  pBuf->bEpNum = bEpNum;
+  if (DBL_OUT_SW_BUF(bEpNum))
+  {
+    pBuf->wPMABufAddr = GetEPDblBuf1Addr(bEpNum);
+    pBuf->wSize = GetEPDblBuf1Count(bEpNum);
+  }
+  else
+  {
+    pBuf->wPMABufAddr = GetEPDblBuf0Addr(bEpNum);
+    pBuf->wSize = GetEPDblBuf0Count(bEpNum);
+  }
+  pBuf->wCount = 0;
+  pBuf->bPending = 0;
+
+  return pBuf->wSize;
+}
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,264 @@
+/**
+  ******************************************************************************
+  * @file    usb_trace.c
+  * @brief   USB event trace: cycle stamped event ring and histogram decoder
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_lib.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define TRACE_MASK          (USB_TRACE_SIZE - 1)
+
+/* Private macro -------------------------------------------------------------*/
+#define TRACE_EP(bEpNum)    ((bEpNum) & (USB_TRACE_EP_NUM - 1))
+#define TRACE_NAK_BIT(bEpNum, bDir)  ((uint16_t)1 << (TRACE_EP(bEpNum) + ((bDir) << 3)))
+
+/* Private variables ---------------------------------------------------------*/
+static USB_Trace_Record_TypeDef TraceRing[USB_TRACE_SIZE];
+static __IO uint32_t wTraceHead;  /* records reserved by the producers */
+static __IO uint32_t wTraceTail;  /* records released by the consumer  */
+static __IO uint32_t wTraceLost;  /* records dropped on a full ring    */
+
+/* Extern variables ----------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void USB_Trace_HistAdd(USB_Trace_Hist_TypeDef *pHist, uint32_t wCycles);
+
+/* Private functions ---------------------------------------------------------*/
+
+/*******************************************************************************
+* Function Name  : USB_Trace_Init
+* Description    : Empty the trace ring and start the DWT cycle counter.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Trace_Init(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < USB_TRACE_SIZE; i++)
+  {
+    TraceRing[i].bEvent = USB_TRACE_NONE;
+  }
+  wTraceHead = 0;
+  wTraceTail = 0;
+  wTraceLost = 0;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_Event
+* Description    : Record one event. Callable from any interrupt priority:
+*                  the slot is reserved with LDREX/STREX, so a producer that
+*                  preempts another one simply takes the next slot. The event
+*                  code is written last and marks the record as complete.
+* Input          : - bEvent: USB_TRACE_ID.
+*                  - bEpNum: endpoint number.
+*                  - wInfo: event specific information.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Trace_Event(uint8_t bEvent, uint8_t bEpNum, uint16_t wInfo)
+{
+  uint32_t wCycles = DWT->CYCCNT;
+  uint32_t wHead, wLost;
+  USB_Trace_Record_TypeDef *pRecord;
+
+  do
+  {
+    wHead = __LDREXW((uint32_t *)&wTraceHead);
+    if ((wHead - wTraceTail) >= USB_TRACE_SIZE)
+    {
+      __CLREX();
+      do
+      {
+        wLost = __LDREXW((uint32_t *)&wTraceLost);
+      } while (__STREXW(wLost + 1, (uint32_t *)&wTraceLost) != 0);
+      return;
+    }
+  } while (__STREXW(wHead + 1, (uint32_t *)&wTraceHead) != 0);
+
+  pRecord = &TraceRing[wHead & TRACE_MASK];
+  pRecord->wCycles = wCycles;
+  pRecord->bEpNum = bEpNum;
+  pRecord->wInfo = wInfo;
+  __DMB();
+  pRecord->bEvent = bEvent;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_Read
+* Description    : Take the oldest complete record out of the ring. Single
+*                  consumer only.
+* Input          : None.
+* Output         : - pRecord: copy of the record.
+* Return         : 1 if a record was read, 0 if the ring is empty or the
+*                  oldest record is still being written.
+*******************************************************************************/
+uint32_t USB_Trace_Read(USB_Trace_Record_TypeDef *pRecord)
+{
+  USB_Trace_Record_TypeDef *pSlot = &TraceRing[wTraceTail & TRACE_MASK];
+
+  if (pSlot->bEvent == USB_TRACE_NONE)
+  {
+    return 0;
+  }
+  __DMB();
+  *pRecord = *pSlot;
+  pSlot->bEvent = USB_TRACE_NONE;
+  __DMB();
+  wTraceTail++;
+  return 1;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_GetLost
+* Description    : Return the number of events dropped because the ring was
+*                  full.
+* Input          : None.
+* Output         : None.
+* Return         : Dropped events since USB_Trace_Init().
+*******************************************************************************/
+uint32_t USB_Trace_GetLost(void)
+{
+  return wTraceLost;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_DecodeInit
+* Description    : Clear the histograms and the decoder state.
+* Input          : - pStats: decoder context.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Trace_DecodeInit(USB_Trace_Stats_TypeDef *pStats)
+{
+  uint8_t *pByte = (uint8_t *)pStats;
+  uint32_t i;
+
+  for (i = 0; i < sizeof(*pStats); i++)
+  {
+    pByte[i] = 0;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_Decode
+* Description    : Account one record. Pairs ISR entry/exit into the ISR
+*                  duration histogram, CTR/service return into the per
+*                  endpoint service histograms and CTR/endpoint re-armed
+*                  into the per endpoint latency (NAK window) histograms.
+* Input          : - pStats: decoder context.
+*                  - pRecord: record to account.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void USB_Trace_Decode(USB_Trace_Stats_TypeDef *pStats, const USB_Trace_Record_TypeDef *pRecord)
+{
+  uint8_t bEp = TRACE_EP(pRecord->bEpNum);
+  uint8_t bDir;
+
+  if (pRecord->bEvent >= USB_TRACE_EVENT_NUM)
+  {
+    return;
+  }
+  pStats->wEvents[pRecord->bEvent]++;
+
+  switch (pRecord->bEvent)
+  {
+    case USB_TRACE_ISR_ENTER:
+      pStats->wIsrStart = pRecord->wCycles;
+      pStats->bInIsr = 1;
+      break;
+
+    case USB_TRACE_ISR_EXIT:
+      if (pStats->bInIsr)
+      {
+        USB_Trace_HistAdd(&pStats->Isr, pRecord->wCycles - pStats->wIsrStart);
+        pStats->bInIsr = 0;
+      }
+      break;
+
+    case USB_TRACE_CTR_IN:
+    case USB_TRACE_CTR_OUT:
+    case USB_TRACE_SETUP:
+      bDir = (pRecord->bEvent != USB_TRACE_CTR_IN);
+      pStats->wCtrStart[bEp][bDir] = pRecord->wCycles;
+      pStats->wNakPending |= TRACE_NAK_BIT(bEp, bDir);
+      break;
+
+    case USB_TRACE_CB_DONE:
+      bDir = pRecord->wInfo & 1;
+      USB_Trace_HistAdd(&pStats->Service[bEp][bDir],
+                        pRecord->wCycles - pStats->wCtrStart[bEp][bDir]);
+      break;
+
+    case USB_TRACE_TX_VALID:
+    case USB_TRACE_RX_VALID:
+      bDir = (pRecord->bEvent == USB_TRACE_RX_VALID);
+      if (pStats->wNakPending & TRACE_NAK_BIT(bEp, bDir))
+      {
+        USB_Trace_HistAdd(&pStats->Latency[bEp][bDir],
+                          pRecord->wCycles - pStats->wCtrStart[bEp][bDir]);
+        pStats->wNakPending &= ~TRACE_NAK_BIT(bEp, bDir);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_Drain
+* Description    : Read and decode all the complete records of the ring.
+* Input          : - pStats: decoder context.
+* Output         : None.
+* Return         : Number of records decoded.
+*******************************************************************************/
+uint32_t USB_Trace_Drain(USB_Trace_Stats_TypeDef *pStats)
+{
+  USB_Trace_Record_TypeDef Record;
+  uint32_t n = 0;
+
+  while (USB_Trace_Read(&Record))
+  {
+    USB_Trace_Decode(pStats, &Record);
+    n++;
+  }
+  return n;
+}
+
+/*******************************************************************************
+* Function Name  : USB_Trace_HistAdd
+* Description    : Add one duration to a log2 histogram.
+* Input          : - pHist: histogram.
+*                  - wCycles: duration in CPU cycles.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void USB_Trace_HistAdd(USB_Trace_Hist_TypeDef *pHist, uint32_t wCycles)
+{
+  uint32_t wBin = 32 - __CLZ(wCycles);
+
+  if (wBin >= USB_TRACE_HIST_BINS)
+  {
+    wBin = USB_TRACE_HIST_BINS - 1;
+  }
+  if ((pHist->wCount == 0) || (wCycles < pHist->wMin))
+  {
+    pHist->wMin = wCycles;
+  }
+  if (wCycles > pHist->wMax)
+  {
+    pHist->wMax = wCycles;
+  }
+  pHist->wCount++;
+  pHist->wBin[wBin]++;
+}
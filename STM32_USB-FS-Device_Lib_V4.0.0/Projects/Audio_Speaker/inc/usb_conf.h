@@ -44,15 +44,8 @@
 /* buffer table base address */
 #define BTABLE_ADDRESS      (0x00)
 
-/* EP0  */
-/* rx/tx buffer base address */
-#define ENDP0_RXADDR        (0x10)
-#define ENDP0_TXADDR        (0x50)
-
-/* EP1  */
-/* buffer base address */
-#define ENDP1_BUF0Addr      (0x90)
-#define ENDP1_BUF1Addr      (0xC0)
+/* endpoint buffers are allocated into PMA by the Reset routine, */
+/* see USB_PMA_Init() and USB_PMA_ConfigEndpoints() */
 
 /*-------------------------------------------------------------*/
 /* -------------------   ISTR events  -------------------------*/
@@ -74,6 +67,12 @@
 
 
 
+/* USB event trace, add usb_trace.c to the project when enabled */
+/*#define USB_TRACE*/
+
+/* usb_regs.c functions expanded inline (usb_regs_inline.h) */
+/*#define USB_REGS_INLINE*/
+
 /* CTR service routines */
 /* associated to defined endpoints */
 #define  EP1_IN_Callback   NOP_Process
@@ -53,15 +53,15 @@ void EP1_OUT_Callback(void)
   
   if (GetENDPOINT(ENDP1) & EP_DTOG_TX)
   {
-    /*read from ENDP1_BUF0Addr buffer*/
+    /*read from buffer 0*/
     Data_Len = GetEPDblBuf0Count(ENDP1);
-    PMAToUserBufferCopy(Stream_Buff, ENDP1_BUF0Addr, Data_Len);
+    PMAToUserBufferCopy(Stream_Buff, GetEPDblBuf0Addr(ENDP1), Data_Len);
   }
   else
   {
-    /*read from ENDP1_BUF1Addr buffer*/
+    /*read from buffer 1*/
     Data_Len = GetEPDblBuf1Count(ENDP1);
-    PMAToUserBufferCopy(Stream_Buff, ENDP1_BUF1Addr, Data_Len);
+    PMAToUserBufferCopy(Stream_Buff, GetEPDblBuf1Addr(ENDP1), Data_Len);
   }
   FreeUserBuffer(ENDP1, EP_DBUF_OUT);
   In_Data_Offset += Data_Len;
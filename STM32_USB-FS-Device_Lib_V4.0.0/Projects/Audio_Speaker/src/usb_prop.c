@@ -138,27 +138,37 @@ void Speaker_init()
 *******************************************************************************/
 void Speaker_Reset()
 {
+  uint32_t Status;
+
   /* Set Speaker device as not configured state */
   pInformation->Current_Configuration = 0;
 
   /* Current Feature initialization */
   pInformation->Current_Feature = Speaker_ConfigDescriptor[7];
 
-  SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  if (Status == USB_SUCCESS)
+  {
+    Status = USB_PMA_ConfigEndpoints(Speaker_ConfigDescriptor, 0);
+  }
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
 
   /* Initialize Endpoint 0 */
   SetEPType(ENDP0, EP_CONTROL);
   SetEPTxStatus(ENDP0, EP_TX_NAK);
-  SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
-  SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   Clear_Status_Out(ENDP0);
   SetEPRxValid(ENDP0);
 
   /* Initialize Endpoint 1 */
   SetEPType(ENDP1, EP_ISOCHRONOUS);
-  SetEPDblBuffAddr(ENDP1, ENDP1_BUF0Addr, ENDP1_BUF1Addr);
-  SetEPDblBuffCount(ENDP1, EP_DBUF_OUT, 0x40);
   ClearDTOG_RX(ENDP1);
   ClearDTOG_TX(ENDP1);
   ToggleDTOG_TX(ENDP1);
@@ -49,22 +49,8 @@
 /* buffer table base address */
 #define BTABLE_ADDRESS      (0x00)
 
-/* EP0  */
-/* rx/tx buffer base address */
-#define ENDP0_RXADDR        (0x18)
-#define ENDP0_TXADDR        (0x58)
-
-/* EP2  */
-/* tx buffer base address */
-#define ENDP2_TXADDR        (0x98)
-
-/* EP2  */
-/* Rx buffer base address */
-#define ENDP2_RXADDR        (0xD8)
-/* EP1  */
-/* tx buffer base address */
-#define ENDP1_TXADDR        (0x118)
-#define ENDP1_RXADDR        (0x11C)
+/* endpoint buffers are allocated into PMA by the Reset routine, */
+/* see USB_PMA_Init() and USB_PMA_ConfigEndpoints() */
 
 /*-------------------------------------------------------------*/
 /* -------------------   ISTR events  -------------------------*/
@@ -75,6 +61,12 @@
 #define IMR_MSK (CNTR_CTRM  | CNTR_WKUPM | CNTR_SUSPM | CNTR_ERRM  | CNTR_SOFM \
                  | CNTR_ESOFM | CNTR_RESETM )
 
+/* USB event trace, add usb_trace.c to the project when enabled */
+/*#define USB_TRACE*/
+
+/* usb_regs.c functions expanded inline (usb_regs_inline.h) */
+/*#define USB_REGS_INLINE*/
+
 /* CTR service routines */
 /* associated to defined endpoints */
 /* #define  EP1_IN_Callback   NOP_Process */
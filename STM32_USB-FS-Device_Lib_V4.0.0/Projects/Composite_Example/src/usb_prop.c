@@ -180,6 +180,8 @@ void CustomHID_init(void)
 *******************************************************************************/
 void CustomHID_Reset(void)
 {
+  uint32_t Status;
+
   /* Set Composite_DEVICE as not configured */
   pInformation->Current_Configuration = 0;
   pInformation->Current_Interface = 0;/*the default Interface*/
@@ -187,21 +189,29 @@ void CustomHID_Reset(void)
   /* Current Feature initialization */
   pInformation->Current_Feature = Composite_ConfigDescriptor[7];
  
-  SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  if (Status == USB_SUCCESS)
+  {
+    Status = USB_PMA_ConfigEndpoints(Composite_ConfigDescriptor, 0);
+  }
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
 
   /* Initialize Endpoint 0 */
   SetEPType(ENDP0, EP_CONTROL);
   SetEPTxStatus(ENDP0, EP_TX_STALL);
-  SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   Clear_Status_Out(ENDP0);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
   SetEPRxValid(ENDP0);
 
   /* Initialize Endpoint 1 */
   SetEPType(ENDP1, EP_INTERRUPT);
-  SetEPTxAddr(ENDP1, ENDP1_TXADDR);
-  SetEPRxAddr(ENDP1, ENDP1_RXADDR);
   SetEPTxCount(ENDP1, 2);
   SetEPRxCount(ENDP1, 2);
   SetEPRxStatus(ENDP1, EP_RX_VALID);
@@ -209,13 +219,11 @@ void CustomHID_Reset(void)
   /* Initialize Endpoint 2 IN */
   SetEPType(ENDP2, EP_BULK);
   SetEPTxCount(ENDP1, 64);
-  SetEPTxAddr(ENDP2, ENDP1_TXADDR);
   SetEPTxStatus(ENDP2, EP_TX_NAK);
   
 
   /* Initialize Endpoint 2 OUT */
   SetEPType(ENDP2, EP_BULK);
-  SetEPRxAddr(ENDP2, ENDP2_RXADDR);
   SetEPRxCount(ENDP2, 64);
   SetEPRxStatus(ENDP2, EP_RX_VALID);
 
@@ -157,20 +157,28 @@ void DFU_init(void)
 *******************************************************************************/
 void DFU_Reset(void)
 {
+  uint32_t Status;
+
   /* Set DFU_DEVICE as not configured */
   Device_Info.Current_Configuration = 0;
 
   /* Current Feature initialization */
   pInformation->Current_Feature = DFU_ConfigDescriptor[7];
 
-  _SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
 
   /* Initialize Endpoint 0 */
   _SetEPType(ENDP0, EP_CONTROL);
   _SetEPTxStatus(ENDP0, EP_TX_NAK);
-  _SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
-  _SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   SetEPTxCount(ENDP0, Device_Property.MaxPacketSize);
   Clear_Status_Out(ENDP0);
   SetEPRxValid(ENDP0);
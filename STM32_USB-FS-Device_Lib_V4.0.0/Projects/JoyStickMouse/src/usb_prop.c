@@ -148,25 +148,36 @@ void Joystick_init(void)
 *******************************************************************************/
 void Joystick_Reset(void)
 {
+  uint32_t Status;
+
   /* Set Joystick_DEVICE as not configured */
   pInformation->Current_Configuration = 0;
   pInformation->Current_Interface = 0;/*the default Interface*/
 
   /* Current Feature initialization */
   pInformation->Current_Feature = Joystick_ConfigDescriptor[7];
-  SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  if (Status == USB_SUCCESS)
+  {
+    Status = USB_PMA_ConfigEndpoints(Joystick_ConfigDescriptor, 0);
+  }
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
   /* Initialize Endpoint 0 */
   SetEPType(ENDP0, EP_CONTROL);
   SetEPTxStatus(ENDP0, EP_TX_STALL);
-  SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   Clear_Status_Out(ENDP0);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
   SetEPRxValid(ENDP0);
 
   /* Initialize Endpoint 1 */
   SetEPType(ENDP1, EP_INTERRUPT);
-  SetEPTxAddr(ENDP1, ENDP1_TXADDR);
   SetEPTxCount(ENDP1, 4);
   SetEPRxStatus(ENDP1, EP_RX_DIS);
   SetEPTxStatus(ENDP1, EP_TX_NAK);
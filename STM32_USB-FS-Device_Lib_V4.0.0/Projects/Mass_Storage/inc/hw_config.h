@@ -46,6 +46,7 @@ void Set_USBClock(void);
 void Enter_LowPowerMode(void);
 void Leave_LowPowerMode(void);
 void USB_Interrupts_Config(void);
+void USB_Interrupts_Cmd(FunctionalState NewState);
 void Led_Config(void);
 void Led_RW_ON(void);
 void Led_RW_OFF(void);
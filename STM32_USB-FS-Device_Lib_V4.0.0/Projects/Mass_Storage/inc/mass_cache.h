@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    mass_cache.h
+  * @brief   Header for mass_cache.c file.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MASS_CACHE_H
+#define __MASS_CACHE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "hw_config.h"
+#include "mass_mal.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Read_Hits;       /* blocks read from the cache */
+  uint32_t Read_Misses;     /* blocks read from the media */
+  uint32_t Write_Hits;      /* blocks written over a cached block */
+  uint32_t Write_Misses;    /* blocks written into a new cache block */
+  uint32_t Flushes;         /* flushes that wrote at least one block */
+  uint32_t Flushed_Blocks;  /* dirty blocks written to the media */
+  uint32_t Media_Writes;    /* MAL_Write() calls of the flushes */
+  uint32_t Write_Errors;    /* MAL_Write() calls that failed */
+} Cache_Stats_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+/* Cache blocks, 512 bytes of RAM each */
+#ifndef MASS_CACHE_BLOCKS
+ #define MASS_CACHE_BLOCKS        8
+#endif /* MASS_CACHE_BLOCKS */
+
+/* Flush the dirty blocks after this many ms (USB frames) without write */
+#ifndef MASS_CACHE_IDLE_TIMEOUT
+ #define MASS_CACHE_IDLE_TIMEOUT  200
+#endif /* MASS_CACHE_IDLE_TIMEOUT */
+
+#define MASS_CACHE_BLOCK_SIZE     512
+
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+void Cache_Init(void);
+uint16_t Cache_Read(uint8_t lun, uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length);
+uint16_t Cache_Write(uint8_t lun, uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length);
+uint16_t Cache_Submit(MAL_Request_TypeDef *Request);
+uint16_t Cache_SubmitFlush(MAL_Request_TypeDef *Request);
+uint16_t Cache_Flush(void);
+void Cache_Invalidate(uint8_t lun);
+void Cache_Poll(void);
+void Cache_GetStats(Cache_Stats_TypeDef *Stats);
+
+#endif /* __MASS_CACHE_H */
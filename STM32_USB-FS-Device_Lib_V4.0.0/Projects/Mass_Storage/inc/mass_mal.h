@@ -31,12 +31,48 @@
 #define __MASS_MAL_H
 
 /* Includes ------------------------------------------------------------------*/
+#include "platform_config.h"
+
 /* Exported types ------------------------------------------------------------*/
+/* Asynchronous media request, see MAL_Submit() */
+typedef struct _MAL_Request MAL_Request_TypeDef;
+struct _MAL_Request
+{
+  uint8_t  Lun;                   /* logical unit */
+  uint8_t  Dir;                   /* MAL_DIR_READ or MAL_DIR_WRITE */
+  uint8_t  Flags;                 /* MAL_FLAG_xxx */
+  __IO uint8_t  State;            /* MAL_IO_xxx, MAL_IO_IDLE once completed */
+  __IO uint16_t Status;           /* MAL_OK or MAL_FAIL once completed */
+  uint32_t Memory_Offset;         /* media offset in bytes */
+  uint32_t *Buffer;               /* data */
+  uint16_t Transfer_Length;       /* bytes, multiple of 512 */
+  void (*Complete)(MAL_Request_TypeDef *Request);  /* called once completed, may be null */
+  MAL_Request_TypeDef *Next;      /* queue link, private */
+};
+
 /* Exported constants --------------------------------------------------------*/
 #define MAL_OK   0
 #define MAL_FAIL 1
 #define MAX_LUN  1
 
+#define MAL_DIR_READ   0
+#define MAL_DIR_WRITE  1
+
+#define MAL_IO_IDLE    0          /* not queued, or completed */
+#define MAL_IO_QUEUED  1          /* waiting for the media */
+#define MAL_IO_DATA    2          /* data transfer in progress */
+#define MAL_IO_BUSY    3          /* media busy after the transfer */
+
+/* USB interrupt masked from the start of the request to its completion: for
+   the requests running while the endpoint routines may access the media */
+#define MAL_FLAG_USB_MASKED  0x01
+
+/* Merge the NAND block being rewritten after this many ms (USB frames)
+   without NAND write */
+#ifndef MAL_GC_IDLE_TIMEOUT
+ #define MAL_GC_IDLE_TIMEOUT  20
+#endif /* MAL_GC_IDLE_TIMEOUT */
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 
@@ -44,6 +80,9 @@ uint16_t MAL_Init (uint8_t lun);
 uint16_t MAL_GetStatus (uint8_t lun);
 uint16_t MAL_Read(uint8_t lun, uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length);
 uint16_t MAL_Write(uint8_t lun, uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length);
+uint16_t MAL_Submit(MAL_Request_TypeDef *Request);
+void MAL_Poll(void);
+void MAL_Sync(uint8_t lun);
 #endif /* __MASS_MAL_H */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,113 @@
+/**
+  ******************************************************************************
+  * @file    mass_vdisk.h
+  * @brief   Header for mass_vdisk.c file.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MASS_VDISK_H
+#define __MASS_VDISK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "platform_config.h"
+#include "mass_mal.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Virtual disk of a logical unit, see VDisk_Attach() */
+typedef struct
+{
+  uint8_t  Type;            /* VDISK_RAM or VDISK_FILE */
+  uint32_t *Buffer;         /* VDISK_RAM: Block_Count blocks, null for the
+                               "VDISK_RAM_BLOCKS" buffer of this module */
+  const char *File_Name;    /* VDISK_FILE: disk image, created if missing */
+  uint32_t Block_Count;     /* 512 byte blocks, 0 for the image file size */
+  uint32_t Read_Latency;    /* us from a read request to its data */
+  uint32_t Write_Latency;   /* us to program the blocks of a write request */
+  uint32_t Erase_Latency;   /* us to erase one erase unit */
+  uint32_t Erase_Blocks;    /* blocks per erase unit, 0 for no erase */
+  uint32_t Bandwidth;       /* kB/s (bytes per ms) of the data, 0 for no limit */
+} VDisk_Config_TypeDef;
+
+typedef struct
+{
+  uint32_t Reads;           /* read requests */
+  uint32_t Writes;          /* write requests */
+  uint32_t Read_Blocks;     /* blocks read */
+  uint32_t Written_Blocks;  /* blocks written */
+  uint32_t Erases;          /* erase units erased by the writes */
+  uint32_t Busy_Time;       /* us of modelled media time */
+  uint32_t Errors;          /* requests failed */
+} VDisk_Stats_TypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+#define VDISK_RAM         0   /* disk in RAM */
+#define VDISK_FILE        1   /* disk image file, needs VDISK_FILE_SUPPORT */
+
+#define VDISK_BLOCK_SIZE  512
+
+/* Logical unit given the virtual disk below by MAL_Init(), none if undefined.
+   Other virtual disks may be attached by the application with VDisk_Attach()
+   before MAL_Config() is called. */
+/* #define VDISK_LUN            1 */
+
+/* The VDISK_FILE disks use the C library file I/O: define VDISK_FILE_SUPPORT
+   on the host builds only */
+/* #define VDISK_FILE_SUPPORT */
+
+#ifndef VDISK_TYPE
+ #define VDISK_TYPE           VDISK_RAM
+#endif /* VDISK_TYPE */
+
+#ifndef VDISK_FILE_NAME
+ #define VDISK_FILE_NAME      "vdisk.img"
+#endif /* VDISK_FILE_NAME */
+
+/* Blocks of the RAM disk buffer of this module, 512 bytes of RAM each */
+#ifndef VDISK_RAM_BLOCKS
+ #ifdef VDISK_LUN
+  #define VDISK_RAM_BLOCKS    16
+ #else
+  #define VDISK_RAM_BLOCKS    0
+ #endif /* VDISK_LUN */
+#endif /* VDISK_RAM_BLOCKS */
+
+/* Blocks of the VDISK_LUN disk, 0 for the buffer or image file size */
+#ifndef VDISK_BLOCKS
+ #define VDISK_BLOCKS         0
+#endif /* VDISK_BLOCKS */
+
+/* Timing of the VDISK_LUN disk, see VDisk_Config_TypeDef */
+#ifndef VDISK_READ_LATENCY
+ #define VDISK_READ_LATENCY   0
+#endif /* VDISK_READ_LATENCY */
+
+#ifndef VDISK_WRITE_LATENCY
+ #define VDISK_WRITE_LATENCY  0
+#endif /* VDISK_WRITE_LATENCY */
+
+#ifndef VDISK_ERASE_LATENCY
+ #define VDISK_ERASE_LATENCY  0
+#endif /* VDISK_ERASE_LATENCY */
+
+#ifndef VDISK_ERASE_BLOCKS
+ #define VDISK_ERASE_BLOCKS   0
+#endif /* VDISK_ERASE_BLOCKS */
+
+#ifndef VDISK_BANDWIDTH
+ #define VDISK_BANDWIDTH      0
+#endif /* VDISK_BANDWIDTH */
+
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+uint8_t VDisk_Init(uint8_t lun);
+uint16_t VDisk_Attach(uint8_t lun, const VDisk_Config_TypeDef *Config);
+void VDisk_Detach(uint8_t lun);
+uint8_t VDisk_IsAttached(uint8_t lun);
+uint32_t VDisk_GetBlockCount(uint8_t lun);
+uint8_t VDisk_Start(MAL_Request_TypeDef *Request);
+uint8_t VDisk_Check(MAL_Request_TypeDef *Request);
+void VDisk_Sync(uint8_t lun);
+void VDisk_GetStats(uint8_t lun, VDisk_Stats_TypeDef *Stats);
+
+#endif /* __MASS_VDISK_H */
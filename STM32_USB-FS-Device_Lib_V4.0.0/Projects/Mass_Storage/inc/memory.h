@@ -33,14 +33,45 @@
 /* Includes ------------------------------------------------------------------*/
 #include "hw_config.h"
 /* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Commands;        /* READ(10) commands with data */
+  uint32_t Sequential;      /* commands starting where the previous one ended */
+  uint32_t Hit_Commands;    /* commands starting on a block read ahead */
+  uint32_t Prefetched;      /* blocks read ahead past the end of a command */
+  uint32_t Hits;            /* blocks read ahead used by the next command */
+  uint32_t Ready;           /* hits already read when the command came */
+  uint32_t Discarded;       /* blocks read ahead not used */
+  uint32_t Cold_Wait;       /* us from command to first packet, no hit */
+  uint32_t Hit_Wait;        /* us from command to first packet, hit commands */
+  uint32_t Saved_Time;      /* us saved by the hit commands */
+  uint32_t Depth;           /* current read ahead depth, blocks */
+} Read_Stats_TypeDef;
+
 /* Exported constants --------------------------------------------------------*/
 #define TXFR_IDLE     0
 #define TXFR_ONGOING  1
 
+/* Block buffers of the read pipeline (512 bytes each, at least 2) */
+#ifndef MASS_READ_BUFFERS
+ #define MASS_READ_BUFFERS  2
+#endif /* MASS_READ_BUFFERS */
+
+/* Blocks read ahead past the end of a sequential READ(10) at most, 0 to
+   disable; the depth starts at 1 and doubles while the stream goes on */
+#ifndef MASS_READ_PREFETCH
+ #define MASS_READ_PREFETCH  MASS_READ_BUFFERS
+#endif /* MASS_READ_PREFETCH */
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void Write_Memory (uint8_t lun, uint32_t Memory_Offset, uint32_t Transfer_Length);
+void Write_Memory_Out (void);
 void Read_Memory (uint8_t lun, uint32_t Memory_Offset, uint32_t Transfer_Length);
+void Read_Memory_In (void);
+void Read_Memory_Fetch (void);
+void Read_Memory_Init (void);
+void Read_Memory_GetStats (Read_Stats_TypeDef *Stats);
 #endif /* __memory_H */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -44,29 +44,29 @@
 
 #define MAX_PHY_BLOCKS_PER_ZONE  1024
 #define MAX_LOG_BLOCKS_PER_ZONE  1000
+
+/* Zone look up tables kept in RAM (2 KB each), least recently used replaced */
+#ifndef NAND_LUT_ZONES
+ #define NAND_LUT_ZONES          2
+#endif /* NAND_LUT_ZONES */
+
+/* Blocks at the end of the last zone reserved for the look up tables
+   checkpoint, written alternately */
+#define NAND_CKPT_BLOCKS         2
+
+/* Pages merged by each NAND_GC() call */
+#ifndef NAND_GC_PAGES
+ #define NAND_GC_PAGES           1
+#endif /* NAND_GC_PAGES */
 /* Private Structures---------------------------------------------------------*/
 typedef struct __SPARE_AREA {
 	uint16_t LogicalIndex;
 	uint16_t DataStatus;
 	uint16_t BlockStatus;
+	uint16_t EraseCount;	/* 0xFFFF if unknown */
 } SPARE_AREA;	
 
-typedef enum {
-  WRITE_IDLE = 0,
-  POST_WRITE,
-  PRE_WRITE,
-  WRITE_CLEANUP,
-  WRITE_ONGOING  
-}WRITE_STATE;  
-
-typedef enum {
-  OLD_BLOCK = 0,
-  UNUSED_BLOCK
-}BLOCK_STATE; 
-
 /* Private macro --------------------------------------------------------------*/
-//#define WEAR_LEVELLING_SUPPORT
-#define WEAR_DEPTH         10
 #define PAGE_TO_WRITE      (Transfer_Length/512)
 /* Private variables ----------------------------------------------------------*/
 /* Private function prototypes ------------------------------------------------*/
@@ -75,6 +75,8 @@ uint16_t NAND_Init (void);
 uint16_t NAND_Write (uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length);
 uint16_t NAND_Read  (uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length);
 uint16_t NAND_Format (void);
+uint16_t NAND_Sync (void);
+uint8_t NAND_GC (void);
 SPARE_AREA ReadSpareArea (uint32_t address);
 #endif
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -42,19 +42,8 @@
 
 #define BTABLE_ADDRESS      (0x00)
 
-/* EP0  */
-/* rx/tx buffer base address */
-#define ENDP0_RXADDR        (0x18)
-#define ENDP0_TXADDR        (0x58)
-
-/* EP1  */
-/* tx buffer base address */
-#define ENDP1_TXADDR        (0x98)
-
-/* EP2  */
-/* Rx buffer base address */
-#define ENDP2_RXADDR        (0xD8)
-
+/* endpoint buffers are allocated into PMA by the Reset routine, */
+/* see USB_PMA_Init() and USB_PMA_ConfigEndpoints() */
 
 /* ISTR events */
 /* IMR_MSK */
@@ -63,6 +52,22 @@
 #define IMR_MSK (CNTR_CTRM  | CNTR_WKUPM | CNTR_SUSPM | CNTR_ERRM  | CNTR_SOFM \
                  | CNTR_ESOFM | CNTR_RESETM )
 
+/* USB event trace, add usb_trace.c to the project when enabled */
+/*#define USB_TRACE*/
+
+/* usb_regs.c functions expanded inline (usb_regs_inline.h) */
+/*#define USB_REGS_INLINE*/
+
+/* run the endpoint service routines from USB_Poll() instead of CTR_LP */
+/*#define CTR_DEFERRED*/
+
+/* Not supported by this project: the read ahead, the block cache and the MAL
+   queue exclude the BOT endpoint routines from the main loop by masking the
+   USB interrupt, which assumes these run in that interrupt */
+#ifdef CTR_DEFERRED
+ #error "CTR_DEFERRED: the Mass Storage endpoint routines must run in the USB interrupt"
+#endif /* CTR_DEFERRED */
+
 /* CTR service routines */
 /* associated to defined endpoints */
 //#define  EP1_IN_Callback   NOP_Process
@@ -66,6 +66,7 @@
 #define SCSI_VERIFY16                               0x8F
 
 #define SCSI_SEND_DIAGNOSTIC                        0x1D
+#define SCSI_SYNCHRONIZE_CACHE10                    0x35
 #define SCSI_READ_FORMAT_CAPACITIES                 0x23
 
 #define NO_SENSE		                    0
@@ -91,6 +92,7 @@
 #define ADDRESS_OUT_OF_RANGE                        0x21
 #define MEDIUM_NOT_PRESENT 			    0x3A
 #define MEDIUM_HAVE_CHANGED			    0x28
+#define WRITE_ERROR                                 0x0C
 
 #define READ_FORMAT_CAPACITY_DATA_LEN               0x0C
 #define READ_CAPACITY10_DATA_LEN                    0x08
@@ -121,6 +123,7 @@ void SCSI_ModeSense10_Cmd (uint8_t lun);
 void SCSI_Write10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr);
 void SCSI_Read10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr);
 void SCSI_Verify10_Cmd(uint8_t lun);
+void SCSI_Synchronize_Cache_Cmd(uint8_t lun);
 
 void SCSI_Invalid_Cmd(uint8_t lun);
 void SCSI_Valid_Cmd(uint8_t lun);
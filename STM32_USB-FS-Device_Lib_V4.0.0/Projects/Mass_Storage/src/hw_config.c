@@ -42,6 +42,7 @@
 /* Private variables ---------------------------------------------------------*/
 ErrorStatus HSEStartUpStatus;
 EXTI_InitTypeDef EXTI_InitStructure;
+static uint8_t USB_Masked;    /* USB_Interrupts_Cmd(DISABLE) calls pending */
 
 /* Extern variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
@@ -256,6 +257,40 @@ void USB_Interrupts_Config(void)
  
 }
 
+/*******************************************************************************
+* Function Name  : USB_Interrupts_Cmd
+* Description    : Mask or unmask the USB low priority interrupt, so that the
+*                  main loop can share data with the endpoint routines. The
+*                  calls nest: the interrupt is unmasked by the ENABLE call
+*                  matching the first DISABLE one. From the main loop only.
+* Input          : NewState: ENABLE or DISABLE.
+* Return         : None.
+*******************************************************************************/
+void USB_Interrupts_Cmd(FunctionalState NewState)
+{
+#if defined(STM32L1XX_MD) || defined(STM32L1XX_HD)|| defined(STM32L1XX_MD_PLUS) || defined(STM32F37X)
+  IRQn_Type IRQn = USB_LP_IRQn;
+#else
+  IRQn_Type IRQn = USB_LP_CAN1_RX0_IRQn;
+#endif /* STM32L1XX_MD || STM32L1XX_HD || STM32L1XX_MD_PLUS || STM32F37X */
+
+  if (NewState != DISABLE)
+  {
+    if (USB_Masked != 0)
+    {
+      USB_Masked--;
+    }
+    if (USB_Masked == 0)
+    {
+      NVIC_EnableIRQ(IRQn);
+    }
+  }
+  else if (USB_Masked++ == 0)
+  {
+    NVIC_DisableIRQ(IRQn);
+  }
+}
+
 /*******************************************************************************
 * Function Name  : Led_Config
 * Description    : configure the Read/Write LEDs.
@@ -417,8 +452,9 @@ void MAL_Config(void)
 #if defined(STM32F10X_HD) || defined(STM32F10X_XL)
   /* Enable the FSMC Clock */
   RCC_AHBPeriphClockCmd(RCC_AHBPeriph_FSMC, ENABLE);
-  MAL_Init(1);
 #endif /* STM32F10X_HD | STM32F10X_XL */
+  /* The NAND Flash, or a virtual disk on the other boards */
+  MAL_Init(1);
 }
 
 #if !defined (USE_STM32L152_EVAL) 
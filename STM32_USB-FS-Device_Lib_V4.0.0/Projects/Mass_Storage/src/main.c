@@ -30,6 +30,8 @@
 #include "hw_config.h" 
 #include "usb_lib.h"
 #include "usb_pwr.h"
+#include "memory.h"
+#include "mass_cache.h"
 
 extern uint16_t MAL_Init (uint8_t lun);
 
@@ -52,6 +54,8 @@ int main(void)
   Set_System();
   Set_USBClock();
   Led_Config();
+  Cache_Init();
+  Read_Memory_Init();
   USB_Interrupts_Config();
   USB_Init();
   while (bDeviceState != CONFIGURED);
@@ -59,7 +63,13 @@ int main(void)
   USB_Configured_LED();
 
   while (1)
-  {}
+  {
+    /* Read ahead the blocks of the ongoing READ(10) */
+    Read_Memory_Fetch();
+    MAL_Poll();
+    /* Write back the cached blocks once the host stops writing */
+    Cache_Poll();
+  }
 }
 
 #ifdef USE_FULL_ASSERT
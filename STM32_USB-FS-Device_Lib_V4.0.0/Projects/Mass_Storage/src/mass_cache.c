@@ -0,0 +1,772 @@
+/**
+  ******************************************************************************
+  * @file    mass_cache.c
+  * @brief   Write-back block cache between the SCSI layer and the MAL
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mass_cache.h"
+#include "mass_mal.h"
+#include "usb_lib.h"
+#include "usb_pwr.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  State;           /* CACHE_FREE, CACHE_CLEAN or CACHE_DIRTY */
+  uint8_t  Lun;
+  uint32_t Block;           /* media offset / MASS_CACHE_BLOCK_SIZE */
+  uint32_t Use;             /* Cache_Clock at the last access */
+} Cache_Tag_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define CACHE_FREE    0
+#define CACHE_CLEAN   1
+#define CACHE_DIRTY   2
+
+#define CACHE_WORDS   (MASS_CACHE_BLOCK_SIZE / 4)
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* The blocks are written by the OUT endpoint routine while a block is free
+   for the data, and flushed from the main loop only, with the USB interrupt
+   masked: the media requests are polled there */
+static uint32_t Cache_Buffer[MASS_CACHE_BLOCKS][CACHE_WORDS];
+static Cache_Tag_TypeDef Cache_Tag[MASS_CACHE_BLOCKS];
+static uint32_t Cache_Clock;
+static __IO uint8_t Cache_Dirty;        /* at least one dirty block */
+static __IO uint16_t Cache_Stamp;       /* frame number of the last write */
+static Cache_Stats_TypeDef Cache_Stats;
+
+/* Request of the endpoint routines waiting for a flush, completed by
+   Cache_Poll(); the flush writes one run of blocks per MAL_Submit() request */
+static MAL_Request_TypeDef * __IO Cache_Waiting;
+static MAL_Request_TypeDef Cache_Flush_Request;
+static __IO uint8_t Cache_Flushing;     /* flush requests queued */
+static uint8_t Cache_Flush_Next;        /* first block not yet submitted */
+static uint16_t Cache_Flush_Status;     /* MAL_FAIL once a run failed */
+static uint8_t Cache_Configured;        /* configured at the last poll */
+
+/* Extern variables ----------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static int32_t Cache_Find(uint8_t lun, uint32_t Block);
+static int32_t Cache_Alloc(void);
+static uint8_t Cache_Fits(MAL_Request_TypeDef *Request);
+static uint16_t Cache_Defer(MAL_Request_TypeDef *Request);
+static uint32_t Cache_Run(uint32_t First);
+static void Cache_Written(uint32_t First, uint32_t Run, uint16_t Status);
+static void Cache_FlushStart(void);
+static void Cache_FlushNext(void);
+static void Cache_FlushDone(MAL_Request_TypeDef *Request);
+static void Cache_Resume(void);
+static void Cache_Sort(void);
+static void Cache_Copy(uint32_t *Dest, const uint32_t *Src);
+
+/* Private functions ---------------------------------------------------------*/
+
+/*******************************************************************************
+* Function Name  : Cache_Init
+* Description    : Empty the cache and clear the statistics.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Cache_Init(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < MASS_CACHE_BLOCKS; i++)
+  {
+    Cache_Tag[i].State = CACHE_FREE;
+  }
+  Cache_Clock = 0;
+  Cache_Dirty = 0;
+  Cache_Waiting = 0;
+  Cache_Flushing = 0;
+  Cache_Flush_Status = MAL_OK;
+  Cache_Configured = 0;
+  Cache_GetStats(0);
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Read
+* Description    : Read sectors: the cached blocks are copied from RAM, each
+*                  run of the other blocks is read by one MAL_Read() call. A
+*                  read not block aligned goes to the media after a flush.
+*                  Blocking: from the main loop only.
+* Input          : - lun: logical unit.
+*                  - Memory_Offset: media offset in bytes.
+*                  - Transfer_Length: bytes to read.
+* Output         : - Readbuff: read data.
+* Return         : MAL_OK or MAL_FAIL.
+*******************************************************************************/
+uint16_t Cache_Read(uint8_t lun, uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length)
+{
+  uint32_t Block = Memory_Offset / MASS_CACHE_BLOCK_SIZE;
+  uint32_t Count = Transfer_Length / MASS_CACHE_BLOCK_SIZE;
+  uint32_t i, Miss = 0;
+  int32_t Slot;
+
+  if ((Memory_Offset % MASS_CACHE_BLOCK_SIZE) || (Transfer_Length % MASS_CACHE_BLOCK_SIZE))
+  {
+    /* Not block aligned: the media must hold the dirty blocks it covers */
+    if (Cache_Flush() != MAL_OK)
+    {
+      return MAL_FAIL;
+    }
+    return MAL_Read(lun, Memory_Offset, Readbuff, Transfer_Length);
+  }
+
+  for (i = 0; i <= Count; i++)
+  {
+    Slot = (i < Count) ? Cache_Find(lun, Block + i) : -1;
+    if ((Slot < 0) && (i < Count))
+    {
+      /* Extend the run of uncached blocks */
+      Miss++;
+      continue;
+    }
+    if (Miss != 0)
+    {
+      if (MAL_Read(lun, (Block + i - Miss) * MASS_CACHE_BLOCK_SIZE,
+                   Readbuff + (i - Miss) * CACHE_WORDS,
+                   Miss * MASS_CACHE_BLOCK_SIZE) != MAL_OK)
+      {
+        return MAL_FAIL;
+      }
+      Cache_Stats.Read_Misses += Miss;
+      Miss = 0;
+    }
+    if (Slot >= 0)
+    {
+      Cache_Copy(Readbuff + i * CACHE_WORDS, Cache_Buffer[Slot]);
+      Cache_Tag[Slot].Use = ++Cache_Clock;
+      Cache_Stats.Read_Hits++;
+    }
+  }
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Write
+* Description    : Write sectors into the cache. The media is only written when
+*                  no block is left for the new data: all the dirty blocks are
+*                  then flushed. A write not block aligned goes to the media
+*                  after a flush. Blocking: from the main loop only, the
+*                  endpoint routines use Cache_Submit().
+* Input          : - lun: logical unit.
+*                  - Memory_Offset: media offset in bytes.
+*                  - Writebuff: data to write.
+*                  - Transfer_Length: bytes to write.
+* Output         : None.
+* Return         : MAL_OK or MAL_FAIL.
+*******************************************************************************/
+uint16_t Cache_Write(uint8_t lun, uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length)
+{
+  uint32_t Block = Memory_Offset / MASS_CACHE_BLOCK_SIZE;
+  uint32_t Count = Transfer_Length / MASS_CACHE_BLOCK_SIZE;
+  uint32_t i;
+  int32_t Slot;
+
+  if ((Memory_Offset % MASS_CACHE_BLOCK_SIZE) || (Transfer_Length % MASS_CACHE_BLOCK_SIZE))
+  {
+    /* Not block aligned: write through, after the dirty blocks so that
+       the write is not overwritten and none is lost by the invalidation */
+    if (Cache_Flush() != MAL_OK)
+    {
+      return MAL_FAIL;
+    }
+    Cache_Invalidate(lun);
+    return MAL_Write(lun, Memory_Offset, Writebuff, Transfer_Length);
+  }
+
+  for (i = 0; i < Count; i++)
+  {
+    Slot = Cache_Find(lun, Block + i);
+    if (Slot >= 0)
+    {
+      Cache_Stats.Write_Hits++;
+    }
+    else
+    {
+      Slot = Cache_Alloc();
+      if (Slot < 0)
+      {
+        if (Cache_Flush() != MAL_OK)
+        {
+          return MAL_FAIL;
+        }
+        Slot = Cache_Alloc();
+      }
+      Cache_Tag[Slot].Lun = lun;
+      Cache_Tag[Slot].Block = Block + i;
+      Cache_Stats.Write_Misses++;
+    }
+    Cache_Copy(Cache_Buffer[Slot], Writebuff + i * CACHE_WORDS);
+    Cache_Tag[Slot].State = CACHE_DIRTY;
+    Cache_Tag[Slot].Use = ++Cache_Clock;
+  }
+  Cache_Stamp = GetFNR() & FNR_FN;
+  Cache_Dirty = 1;
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Submit
+* Description    : Asynchronous Cache_Read() and Cache_Write(): the requests
+*                  served from the cache complete at once, the reads of
+*                  uncached blocks are queued by MAL_Submit(). A write finding
+*                  no block free for its data waits for Cache_Poll() to flush
+*                  the cache, it completes from there.
+* Input          : - Request: see MAL_Submit().
+* Output         : None.
+* Return         : MAL_OK, or MAL_FAIL if the request is still queued.
+*******************************************************************************/
+uint16_t Cache_Submit(MAL_Request_TypeDef *Request)
+{
+  uint32_t Block = Request->Memory_Offset / MASS_CACHE_BLOCK_SIZE;
+  uint32_t Count = Request->Transfer_Length / MASS_CACHE_BLOCK_SIZE;
+  uint32_t i, Cached = 0;
+
+  if (Request->State != MAL_IO_IDLE)
+  {
+    return MAL_FAIL;
+  }
+
+  if (Request->Dir == MAL_DIR_READ)
+  {
+    for (i = 0; i < Count; i++)
+    {
+      if (Cache_Find(Request->Lun, Block + i) >= 0)
+      {
+        Cached++;
+      }
+    }
+    if ((Cached == 0) && !(Request->Memory_Offset % MASS_CACHE_BLOCK_SIZE)
+        && !(Request->Transfer_Length % MASS_CACHE_BLOCK_SIZE))
+    {
+      Cache_Stats.Read_Misses += Count;
+      return MAL_Submit(Request);
+    }
+    Request->Status = Cache_Read(Request->Lun, Request->Memory_Offset,
+                                 Request->Buffer, Request->Transfer_Length);
+  }
+  else if ((Cache_Waiting != 0) || Cache_Flushing || !Cache_Fits(Request))
+  {
+    return Cache_Defer(Request);
+  }
+  else
+  {
+    Request->Status = Cache_Write(Request->Lun, Request->Memory_Offset,
+                                  Request->Buffer, Request->Transfer_Length);
+  }
+
+  if (Request->Complete != 0)
+  {
+    Request->Complete(Request);
+  }
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_SubmitFlush
+* Description    : Asynchronous Cache_Flush(), from the endpoint routines: the
+*                  request completes at once if no block is dirty, else once
+*                  Cache_Poll() wrote them, with MAL_FAIL if a write failed.
+* Input          : - Request: Lun and Complete filled in.
+* Output         : None.
+* Return         : MAL_OK, or MAL_FAIL if a request already waits.
+*******************************************************************************/
+uint16_t Cache_SubmitFlush(MAL_Request_TypeDef *Request)
+{
+  if (Request->State != MAL_IO_IDLE)
+  {
+    return MAL_FAIL;
+  }
+  Request->Dir = MAL_DIR_WRITE;
+  Request->Transfer_Length = 0;
+
+  if (Cache_Dirty || Cache_Flushing || (Cache_Waiting != 0))
+  {
+    return Cache_Defer(Request);
+  }
+  Request->Status = MAL_OK;
+  if (Request->Complete != 0)
+  {
+    Request->Complete(Request);
+  }
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Flush
+* Description    : Write the dirty blocks to the media. The blocks are first
+*                  sorted by address so that each run of adjacent dirty blocks
+*                  goes out in one multi-block MAL_Write() call. Blocking: from
+*                  the main loop only, the endpoint routines use
+*                  Cache_SubmitFlush().
+* Input          : None.
+* Output         : None.
+* Return         : MAL_OK, or MAL_FAIL if a write failed (its blocks are
+*                  dropped).
+*******************************************************************************/
+uint16_t Cache_Flush(void)
+{
+  uint16_t Status = MAL_OK, Written;
+  uint32_t i, Run;
+
+  /* Let the flush of Cache_Poll() finish, its runs are in the MAL queue */
+  while (Cache_Flushing)
+  {
+    MAL_Poll();
+  }
+  if (!Cache_Dirty)
+  {
+    return MAL_OK;
+  }
+  Cache_Dirty = 0;
+  Cache_Sort();
+
+  for (i = 0; i < MASS_CACHE_BLOCKS; i += Run)
+  {
+    Run = 1;
+    if (Cache_Tag[i].State != CACHE_DIRTY)
+    {
+      continue;
+    }
+    Run = Cache_Run(i);
+    Written = MAL_Write(Cache_Tag[i].Lun, Cache_Tag[i].Block * MASS_CACHE_BLOCK_SIZE,
+                        Cache_Buffer[i], Run * MASS_CACHE_BLOCK_SIZE);
+    if (Written != MAL_OK)
+    {
+      Status = MAL_FAIL;
+    }
+    Cache_Written(i, Run, Written);
+  }
+  Cache_Stats.Flushes++;
+  return Status;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Invalidate
+* Description    : Drop the blocks of one logical unit without writing them,
+*                  e.g. before the media is formatted.
+* Input          : - lun: logical unit.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Cache_Invalidate(uint8_t lun)
+{
+  uint32_t i;
+
+  for (i = 0; i < MASS_CACHE_BLOCKS; i++)
+  {
+    if (Cache_Tag[i].Lun == lun)
+    {
+      Cache_Tag[i].State = CACHE_FREE;
+    }
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Poll
+* Description    : Flush the dirty blocks for the request of the endpoint
+*                  routines waiting for it, then complete the request. Else
+*                  flush them once no block has been written for
+*                  MASS_CACHE_IDLE_TIMEOUT ms, or at once when the device is no
+*                  longer configured; in the latter case the media state is
+*                  also checkpointed (MAL_Sync()), once per configuration. To
+*                  be called from the main loop.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Cache_Poll(void)
+{
+  uint16_t Idle = (GetFNR() - Cache_Stamp) & FNR_FN;
+  uint8_t Lun;
+
+  if (Cache_Flushing)
+  {
+    /* Cache_FlushDone() submits the next run from MAL_Poll() */
+    return;
+  }
+  if (Cache_Waiting != 0)
+  {
+    /* The endpoint routines must not read the blocks being sorted, nor see
+       the request half completed */
+    USB_Interrupts_Cmd(DISABLE);
+    if (Cache_Dirty)
+    {
+      Cache_FlushStart();
+    }
+    else
+    {
+      Cache_Resume();
+    }
+    USB_Interrupts_Cmd(ENABLE);
+  }
+  else if (Cache_Dirty && ((Idle >= MASS_CACHE_IDLE_TIMEOUT) || (bDeviceState != CONFIGURED)))
+  {
+    /* The endpoint routines must not write the cache during the flush */
+    USB_Interrupts_Cmd(DISABLE);
+    Cache_Flush();
+    USB_Interrupts_Cmd(ENABLE);
+  }
+  if (bDeviceState == CONFIGURED)
+  {
+    Cache_Configured = 1;
+  }
+  else if (Cache_Configured && !Cache_Flushing)
+  {
+    /* Left the configured state: checkpoint once the blocks are written */
+    Cache_Configured = 0;
+    for (Lun = 0; Lun <= MAX_LUN; Lun++)
+    {
+      MAL_Sync(Lun);
+    }
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Cache_GetStats
+* Description    : Return the statistics since the last call and clear them.
+* Input          : None.
+* Output         : - Stats: statistics, may be null to only clear them.
+* Return         : None.
+*******************************************************************************/
+void Cache_GetStats(Cache_Stats_TypeDef *Stats)
+{
+  if (Stats != 0)
+  {
+    *Stats = Cache_Stats;
+  }
+  Cache_Stats.Read_Hits = 0;
+  Cache_Stats.Read_Misses = 0;
+  Cache_Stats.Write_Hits = 0;
+  Cache_Stats.Write_Misses = 0;
+  Cache_Stats.Flushes = 0;
+  Cache_Stats.Flushed_Blocks = 0;
+  Cache_Stats.Media_Writes = 0;
+  Cache_Stats.Write_Errors = 0;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Find
+* Description    : Look up a block.
+* Input          : - lun: logical unit.
+*                  - Block: block number.
+* Output         : None.
+* Return         : Cache index, or -1 if the block is not cached.
+*******************************************************************************/
+static int32_t Cache_Find(uint8_t lun, uint32_t Block)
+{
+  int32_t i;
+
+  for (i = 0; i < MASS_CACHE_BLOCKS; i++)
+  {
+    if ((Cache_Tag[i].State != CACHE_FREE) && (Cache_Tag[i].Block == Block)
+        && (Cache_Tag[i].Lun == lun))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Alloc
+* Description    : Pick a free block, else the least recently used clean one.
+* Input          : None.
+* Output         : None.
+* Return         : Cache index, or -1 if all the blocks are dirty.
+*******************************************************************************/
+static int32_t Cache_Alloc(void)
+{
+  int32_t i, Slot = -1;
+
+  for (i = 0; i < MASS_CACHE_BLOCKS; i++)
+  {
+    if (Cache_Tag[i].State == CACHE_FREE)
+    {
+      return i;
+    }
+    if ((Cache_Tag[i].State == CACHE_CLEAN)
+        && ((Slot < 0) || ((int32_t)(Cache_Tag[i].Use - Cache_Tag[Slot].Use) < 0)))
+    {
+      Slot = i;
+    }
+  }
+  return Slot;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Fits
+* Description    : Check that a block aligned write finds a cache block for
+*                  each of its uncached blocks without a flush.
+* Input          : - Request: write request.
+* Output         : None.
+* Return         : 1 if Cache_Write() would not flush, else 0.
+*******************************************************************************/
+static uint8_t Cache_Fits(MAL_Request_TypeDef *Request)
+{
+  uint32_t Block = Request->Memory_Offset / MASS_CACHE_BLOCK_SIZE;
+  uint32_t Count = Request->Transfer_Length / MASS_CACHE_BLOCK_SIZE;
+  uint32_t i, Free = 0;
+
+  if ((Request->Memory_Offset % MASS_CACHE_BLOCK_SIZE)
+      || (Request->Transfer_Length % MASS_CACHE_BLOCK_SIZE))
+  {
+    return 0;
+  }
+  for (i = 0; i < MASS_CACHE_BLOCKS; i++)
+  {
+    if (Cache_Tag[i].State != CACHE_DIRTY)
+    {
+      Free++;
+    }
+  }
+  for (i = 0; i < Count; i++)
+  {
+    if (Cache_Find(Request->Lun, Block + i) < 0)
+    {
+      if (Free == 0)
+      {
+        return 0;
+      }
+      Free--;
+    }
+  }
+  return 1;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Defer
+* Description    : Make a request of the endpoint routines wait for the flush
+*                  of Cache_Poll().
+* Input          : - Request: write or flush request.
+* Output         : None.
+* Return         : MAL_OK, or MAL_FAIL if a request already waits.
+*******************************************************************************/
+static uint16_t Cache_Defer(MAL_Request_TypeDef *Request)
+{
+  if (Cache_Waiting != 0)
+  {
+    return MAL_FAIL;
+  }
+  Request->Status = MAL_OK;
+  Request->State = MAL_IO_QUEUED;
+  Cache_Waiting = Request;
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Run
+* Description    : Count the adjacent dirty blocks from a dirty one, sorted, up
+*                  to the size of one media request.
+* Input          : - First: cache index of the first block.
+* Output         : None.
+* Return         : Blocks of the run.
+*******************************************************************************/
+static uint32_t Cache_Run(uint32_t First)
+{
+  uint32_t Run = 1;
+
+  while (((First + Run) < MASS_CACHE_BLOCKS)
+         && (Cache_Tag[First + Run].State == CACHE_DIRTY)
+         && (Cache_Tag[First + Run].Lun == Cache_Tag[First].Lun)
+         && (Cache_Tag[First + Run].Block == (Cache_Tag[First].Block + Run))
+         && (((Run + 1) * MASS_CACHE_BLOCK_SIZE) <= 0xFFFF))
+  {
+    Run++;
+  }
+  return Run;
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Written
+* Description    : Account for the media write of a run: its blocks are clean,
+*                  or dropped if the write failed.
+* Input          : - First: cache index of the first block.
+*                  - Run: blocks.
+*                  - Status: MAL_OK or MAL_FAIL.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_Written(uint32_t First, uint32_t Run, uint16_t Status)
+{
+  uint32_t i;
+
+  if (Status != MAL_OK)
+  {
+    Cache_Stats.Write_Errors++;
+  }
+  Cache_Stats.Media_Writes++;
+  Cache_Stats.Flushed_Blocks += Run;
+  for (i = First; i < (First + Run); i++)
+  {
+    Cache_Tag[i].State = (Status == MAL_OK) ? CACHE_CLEAN : CACHE_FREE;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Cache_FlushStart
+* Description    : Start the flush of Cache_Poll(): sort the blocks, then
+*                  submit the first run.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_FlushStart(void)
+{
+  Cache_Dirty = 0;
+  Cache_Flushing = 1;
+  Cache_Sort();
+  Cache_Flush_Next = 0;
+  Cache_FlushNext();
+}
+
+/*******************************************************************************
+* Function Name  : Cache_FlushNext
+* Description    : Submit the next run of dirty blocks, or end the flush.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_FlushNext(void)
+{
+  MAL_Request_TypeDef *Request = &Cache_Flush_Request;
+  uint32_t i = Cache_Flush_Next;
+
+  while ((i < MASS_CACHE_BLOCKS) && (Cache_Tag[i].State != CACHE_DIRTY))
+  {
+    i++;
+  }
+  if (i == MASS_CACHE_BLOCKS)
+  {
+    Cache_Stats.Flushes++;
+    Cache_Flushing = 0;
+    return;
+  }
+  Cache_Flush_Next = i + Cache_Run(i);
+
+  Request->Lun = Cache_Tag[i].Lun;
+  Request->Dir = MAL_DIR_WRITE;
+  Request->Flags = 0;
+  Request->Memory_Offset = Cache_Tag[i].Block * MASS_CACHE_BLOCK_SIZE;
+  Request->Buffer = Cache_Buffer[i];
+  Request->Transfer_Length = (Cache_Flush_Next - i) * MASS_CACHE_BLOCK_SIZE;
+  Request->Complete = Cache_FlushDone;
+  MAL_Submit(Request);
+}
+
+/*******************************************************************************
+* Function Name  : Cache_FlushDone
+* Description    : Completion of a run written by the flush of Cache_Poll(),
+*                  called by MAL_Poll().
+* Input          : - Request: the flush request.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_FlushDone(MAL_Request_TypeDef *Request)
+{
+  uint32_t Run = Request->Transfer_Length / MASS_CACHE_BLOCK_SIZE;
+
+  if (Request->Status != MAL_OK)
+  {
+    Cache_Flush_Status = MAL_FAIL;
+  }
+  Cache_Written(Cache_Flush_Next - Run, Run, Request->Status);
+  Cache_FlushNext();
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Resume
+* Description    : Complete the request waiting for the flush, now done: a
+*                  write goes into the cache, a flush request gets the status
+*                  of the flush.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_Resume(void)
+{
+  MAL_Request_TypeDef *Request = Cache_Waiting;
+
+  Cache_Waiting = 0;
+  Request->Status = Cache_Flush_Status;
+  Cache_Flush_Status = MAL_OK;
+  if ((Request->Status == MAL_OK) && (Request->Transfer_Length != 0))
+  {
+    Request->Status = Cache_Write(Request->Lun, Request->Memory_Offset,
+                                  Request->Buffer, Request->Transfer_Length);
+  }
+  Request->State = MAL_IO_IDLE;
+  if (Request->Complete != 0)
+  {
+    Request->Complete(Request);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Sort
+* Description    : Order the blocks by logical unit then block number, free
+*                  blocks last, so that adjacent blocks are contiguous in RAM.
+*                  Selection sort: at most MASS_CACHE_BLOCKS - 1 block swaps.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Cache_Sort(void)
+{
+  Cache_Tag_TypeDef Tag;
+  uint32_t i, j, Min, w, Word;
+
+  for (i = 0; i < (MASS_CACHE_BLOCKS - 1); i++)
+  {
+    Min = i;
+    for (j = i + 1; j < MASS_CACHE_BLOCKS; j++)
+    {
+      if (Cache_Tag[j].State == CACHE_FREE)
+      {
+        continue;
+      }
+      if ((Cache_Tag[Min].State == CACHE_FREE)
+          || (Cache_Tag[j].Lun < Cache_Tag[Min].Lun)
+          || ((Cache_Tag[j].Lun == Cache_Tag[Min].Lun) && (Cache_Tag[j].Block < Cache_Tag[Min].Block)))
+      {
+        Min = j;
+      }
+    }
+    if (Min != i)
+    {
+      Tag = Cache_Tag[i];
+      Cache_Tag[i] = Cache_Tag[Min];
+      Cache_Tag[Min] = Tag;
+      for (w = 0; w < CACHE_WORDS; w++)
+      {
+        Word = Cache_Buffer[i][w];
+        Cache_Buffer[i][w] = Cache_Buffer[Min][w];
+        Cache_Buffer[Min][w] = Word;
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Cache_Copy
+* Description    : Copy one block.
+* Input          : - Src: source.
+* Output         : - Dest: destination.
+* Return         : None.
+*******************************************************************************/
+static void Cache_Copy(uint32_t *Dest, const uint32_t *Src)
+{
+  uint32_t w;
+
+  for (w = 0; w < CACHE_WORDS; w++)
+  {
+    Dest[w] = Src[w];
+  }
+}
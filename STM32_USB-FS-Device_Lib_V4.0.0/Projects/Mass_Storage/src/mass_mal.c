@@ -29,9 +29,14 @@
 /* Includes ------------------------------------------------------------------*/
 #include "platform_config.h"
 #include "mass_mal.h"
+#include "mass_vdisk.h"
+#include "hw_config.h"
+#include "usb_lib.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+#define MAL_SECTOR_SIZE  512
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 uint32_t Mass_Memory_Size[2];
@@ -39,15 +44,36 @@ uint32_t Mass_Block_Size[2];
 uint32_t Mass_Block_Count[2];
 __IO uint32_t Status = 0;
 
+/* Queued requests, the head one is in progress */
+static MAL_Request_TypeDef *MAL_Head = 0;
+static MAL_Request_TypeDef *MAL_Tail = 0;
+
+#ifdef USE_STM3210E_EVAL
+/* NAND look up tables checkpoint requested by MAL_Sync() */
+static __IO uint8_t MAL_Sync_Pending = 0;
+/* NAND background merge pending, and frame number of the last NAND write */
+static __IO uint8_t MAL_GC_Pending = 0;
+static __IO uint16_t MAL_GC_Stamp = 0;
+#endif /* USE_STM3210E_EVAL */
+
 #if defined(USE_STM3210E_EVAL) || defined(USE_STM32L152D_EVAL)
 SD_CardInfo mSDCardInfo;
+
+/* Transfer flags of the SDIO driver, set by its interrupt handlers */
+extern __IO uint32_t TransferEnd, DMAEndOfTransfer;
+extern __IO SD_Error TransferError;
 #endif
 
 /* Private function prototypes -----------------------------------------------*/
+static uint16_t MAL_Transfer(uint8_t lun, uint8_t Dir, uint32_t Memory_Offset, uint32_t *Buffer, uint16_t Transfer_Length);
+static uint8_t MAL_Start(MAL_Request_TypeDef *Request);
+static uint8_t MAL_Check(MAL_Request_TypeDef *Request);
+
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
 * Function Name  : MAL_Init
-* Description    : Initializes the Media on the STM32
+* Description    : Initializes the Media on the STM32, or the virtual disk
+*                  of the logical unit (see "mass_vdisk.h" file)
 * Input          : None
 * Output         : None
 * Return         : None
@@ -56,6 +82,11 @@ uint16_t MAL_Init(uint8_t lun)
 {
   uint16_t status = MAL_OK;
 
+  if (VDisk_Init(lun))
+  {
+    return MAL_OK;
+  }
+
   switch (lun)
   {
     case 0:
@@ -73,75 +104,330 @@ uint16_t MAL_Init(uint8_t lun)
 }
 /*******************************************************************************
 * Function Name  : MAL_Write
-* Description    : Write sectors
+* Description    : Write sectors, blocking wrapper of MAL_Submit(): from the
+*                  main loop only.
 * Input          : None
 * Output         : None
-* Return         : None
+* Return         : MAL_OK or MAL_FAIL
 *******************************************************************************/
 uint16_t MAL_Write(uint8_t lun, uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length)
 {
+  return MAL_Transfer(lun, MAL_DIR_WRITE, Memory_Offset, Writebuff, Transfer_Length);
+}
 
-  switch (lun)
+/*******************************************************************************
+* Function Name  : MAL_Read
+* Description    : Read sectors, blocking wrapper of MAL_Submit(): from the
+*                  main loop only.
+* Input          : None
+* Output         : None
+* Return         : MAL_OK or MAL_FAIL
+*******************************************************************************/
+uint16_t MAL_Read(uint8_t lun, uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length)
+{
+  return MAL_Transfer(lun, MAL_DIR_READ, Memory_Offset, Readbuff, Transfer_Length);
+}
+
+/*******************************************************************************
+* Function Name  : MAL_Sync
+* Description    : Request the media state only kept in RAM to be saved: the
+*                  NAND block being rewritten is merged and the look up tables
+*                  checkpoint written by MAL_Poll() once no request is queued.
+*                  The last NAND writes are only safe after that.
+* Input          : - lun: logical unit.
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void MAL_Sync(uint8_t lun)
+{
+  if (VDisk_IsAttached(lun))
   {
-    case 0:
-    Status = SD_WriteMultiBlocks((uint8_t*)Writebuff, Memory_Offset, Transfer_Length,1);
-#if defined(USE_STM3210E_EVAL) || defined(USE_STM32L152D_EVAL)
-    Status = SD_WaitWriteOperation();  
-    while(SD_GetStatus() != SD_TRANSFER_OK);
-      if ( Status != SD_OK )
-      {
-        return MAL_FAIL;
-      }      
-#endif /* USE_STM3210E_EVAL ||USE_STM32L152D_EVAL*/      
-      break;
+    VDisk_Sync(lun);
+    return;
+  }
 #ifdef USE_STM3210E_EVAL
-    case 1:
-      NAND_Write(Memory_Offset, Writebuff, Transfer_Length);
-      break;
-#endif /* USE_STM3210E_EVAL */  
-    default:
-      return MAL_FAIL;
+  if (lun == 1)
+  {
+    MAL_Sync_Pending = 1;
   }
+#endif /* USE_STM3210E_EVAL */
+}
+
+/*******************************************************************************
+* Function Name  : MAL_Submit
+* Description    : Queue a read or write request. The requests are served in
+*                  order by MAL_Poll(): Request->State goes back to MAL_IO_IDLE
+*                  with Request->Status set, then Request->Complete is called
+*                  if not null. The request must stay allocated until then.
+* Input          : - Request: Lun, Dir, Flags, Memory_Offset, Buffer,
+*                    Transfer_Length (multiple of 512 bytes) and Complete
+*                    filled in.
+* Output         : None
+* Return         : MAL_OK, or MAL_FAIL if the request is still queued
+*******************************************************************************/
+uint16_t MAL_Submit(MAL_Request_TypeDef *Request)
+{
+  if (Request->State != MAL_IO_IDLE)
+  {
+    return MAL_FAIL;
+  }
+  Request->Status = MAL_OK;
+  Request->State = MAL_IO_QUEUED;
+  Request->Next = 0;
+
+  __disable_irq();
+  if (MAL_Tail != 0)
+  {
+    MAL_Tail->Next = Request;
+  }
+  else
+  {
+    MAL_Head = Request;
+  }
+  MAL_Tail = Request;
+  __enable_irq();
   return MAL_OK;
 }
 
 /*******************************************************************************
-* Function Name  : MAL_Read
-* Description    : Read sectors
+* Function Name  : MAL_Poll
+* Description    : Start the oldest queued request or check its progress, and
+*                  complete it once done. To be called from the main loop; the
+*                  media without DMA (SPI SD card, NAND) are accessed from
+*                  here. With no request queued, the NAND background merge
+*                  and checkpoint run from here. Not reentrant.
 * Input          : None
 * Output         : None
-* Return         : Buffer pointer
+* Return         : None
 *******************************************************************************/
-uint16_t MAL_Read(uint8_t lun, uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length)
+void MAL_Poll(void)
 {
+  MAL_Request_TypeDef *Request = MAL_Head;
 
-  switch (lun)
+  if (Request == 0)
   {
-    case 0:
+#ifdef USE_STM3210E_EVAL
+    if (MAL_Sync_Pending
+        || (MAL_GC_Pending && (((GetFNR() - MAL_GC_Stamp) & FNR_FN) >= MAL_GC_IDLE_TIMEOUT)))
+    {
+      /* The endpoint routines may write the NAND through the cache */
+      USB_Interrupts_Cmd(DISABLE);
+      if (MAL_Sync_Pending)
+      {
+        MAL_Sync_Pending = 0;
+        MAL_GC_Pending = 0;
+        NAND_Sync();
+      }
+      else
+      {
+        MAL_GC_Pending = NAND_GC();
+      }
+      USB_Interrupts_Cmd(ENABLE);
+    }
+#endif /* USE_STM3210E_EVAL */
+    return;
+  }
+  if (Request->State == MAL_IO_QUEUED)
+  {
+    if (Request->Flags & MAL_FLAG_USB_MASKED)
+    {
+      /* Unmasked once completed, below */
+      USB_Interrupts_Cmd(DISABLE);
+    }
+    if (!MAL_Start(Request))
+    {
+      return;
+    }
+  }
+  else if (!MAL_Check(Request))
+  {
+    return;
+  }
+
+  __disable_irq();
+  MAL_Head = Request->Next;
+  if (MAL_Head == 0)
+  {
+    MAL_Tail = 0;
+  }
+  __enable_irq();
+
+  if (Request->Flags & MAL_FLAG_USB_MASKED)
+  {
+    USB_Interrupts_Cmd(ENABLE);
+  }
+  Request->State = MAL_IO_IDLE;
+  if (Request->Complete != 0)
+  {
+    Request->Complete(Request);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : MAL_Transfer
+* Description    : Submit a request and poll it to completion. MAL_Poll() is
+*                  not reentrant: never from an interrupt handler, whose
+*                  requests must complete through MAL_Submit().
+* Input          : - lun: logical unit.
+*                  - Dir: MAL_DIR_READ or MAL_DIR_WRITE.
+*                  - Memory_Offset: media offset in bytes.
+*                  - Buffer: data.
+*                  - Transfer_Length: bytes to transfer.
+* Output         : None
+* Return         : MAL_OK or MAL_FAIL
+*******************************************************************************/
+static uint16_t MAL_Transfer(uint8_t lun, uint8_t Dir, uint32_t Memory_Offset, uint32_t *Buffer, uint16_t Transfer_Length)
+{
+  MAL_Request_TypeDef Request;
+
+  assert_param(__get_IPSR() == 0);
+
+  Request.Lun = lun;
+  Request.Dir = Dir;
+  Request.Flags = 0;
+  Request.State = MAL_IO_IDLE;
+  Request.Memory_Offset = Memory_Offset;
+  Request.Buffer = Buffer;
+  Request.Transfer_Length = Transfer_Length;
+  Request.Complete = 0;
 
-      SD_ReadMultiBlocks((uint8_t*)Readbuff, Memory_Offset, Transfer_Length, 1);
+  MAL_Submit(&Request);
+  while (Request.State != MAL_IO_IDLE)
+  {
+    MAL_Poll();
+  }
+  return Request.Status;
+}
+
+/*******************************************************************************
+* Function Name  : MAL_Start
+* Description    : Start a request on its media, or its virtual disk.
+* Input          : - Request: request to start.
+* Output         : None
+* Return         : 1 if the request is complete, 0 if it runs in background
+*******************************************************************************/
+static uint8_t MAL_Start(MAL_Request_TypeDef *Request)
+{
+  uint32_t Sectors = Request->Transfer_Length / MAL_SECTOR_SIZE;
+#ifdef USE_STM3210E_EVAL
+  uint32_t i;
+#endif /* USE_STM3210E_EVAL */
+
+  if (VDisk_IsAttached(Request->Lun))
+  {
+    return VDisk_Start(Request);
+  }
+
+  switch (Request->Lun)
+  {
+    case 0:
+      if (Request->Dir == MAL_DIR_READ)
+      {
+        Status = SD_ReadMultiBlocks((uint8_t*)Request->Buffer, Request->Memory_Offset, MAL_SECTOR_SIZE, Sectors);
+      }
+      else
+      {
+        Status = SD_WriteMultiBlocks((uint8_t*)Request->Buffer, Request->Memory_Offset, MAL_SECTOR_SIZE, Sectors);
+      }
 #if defined(USE_STM3210E_EVAL) || defined(USE_STM32L152D_EVAL)
-      Status = SD_WaitReadOperation();
-      while(SD_GetStatus() != SD_TRANSFER_OK)
+      if (Status == SD_OK)
       {
+        /* The DMA moves the data, MAL_Check() follows the transfer */
+        Request->State = MAL_IO_DATA;
+        return 0;
       }
-      
-      if ( Status != SD_OK )
+#endif /* USE_STM3210E_EVAL || USE_STM32L152D_EVAL */
+      if (Status != 0)
       {
-        return MAL_FAIL;
+        Request->Status = MAL_FAIL;
       }
-#endif /* USE_STM3210E_EVAL */      
       break;
 #ifdef USE_STM3210E_EVAL
     case 1:
-      NAND_Read(Memory_Offset, Readbuff, Transfer_Length);
-      ;
+      /* One page at a time: a run of pages may span NAND blocks */
+      for (i = 0; i < Sectors; i++)
+      {
+        if (Request->Dir == MAL_DIR_READ)
+        {
+          Status = NAND_Read(Request->Memory_Offset + (i * MAL_SECTOR_SIZE),
+                             Request->Buffer + (i * MAL_SECTOR_SIZE / 4), MAL_SECTOR_SIZE);
+        }
+        else
+        {
+          Status = NAND_Write(Request->Memory_Offset + (i * MAL_SECTOR_SIZE),
+                              Request->Buffer + (i * MAL_SECTOR_SIZE / 4), MAL_SECTOR_SIZE);
+          MAL_GC_Pending = 1;
+          MAL_GC_Stamp = GetFNR();
+        }
+        if (Status != NAND_OK)
+        {
+          Request->Status = MAL_FAIL;
+        }
+      }
       break;
-#endif
+#endif /* USE_STM3210E_EVAL */
     default:
-      return MAL_FAIL;
+      Request->Status = MAL_FAIL;
+      break;
   }
-  return MAL_OK;
+  return 1;
+}
+
+/*******************************************************************************
+* Function Name  : MAL_Check
+* Description    : Follow a request running in background: the SDIO transfer
+*                  then the card busy state (programming).
+* Input          : - Request: running request.
+* Output         : None
+* Return         : 1 if the request is complete, else 0
+*******************************************************************************/
+static uint8_t MAL_Check(MAL_Request_TypeDef *Request)
+{
+#if defined(USE_STM3210E_EVAL) || defined(USE_STM32L152D_EVAL)
+  SDTransferState Card;
+#endif /* USE_STM3210E_EVAL || USE_STM32L152D_EVAL */
+
+  if (VDisk_IsAttached(Request->Lun))
+  {
+    return VDisk_Check(Request);
+  }
+
+#if defined(USE_STM3210E_EVAL) || defined(USE_STM32L152D_EVAL)
+
+  if (Request->State == MAL_IO_DATA)
+  {
+    if ((DMAEndOfTransfer == 0) && (TransferEnd == 0) && (TransferError == SD_OK))
+    {
+      return 0;
+    }
+    /* Ended: the wait returns at once and stops the multi-block transfer */
+    if (Request->Dir == MAL_DIR_READ)
+    {
+      Status = SD_WaitReadOperation();
+    }
+    else
+    {
+      Status = SD_WaitWriteOperation();
+    }
+    if (Status != SD_OK)
+    {
+      Request->Status = MAL_FAIL;
+      return 1;
+    }
+    Request->State = MAL_IO_BUSY;
+  }
+
+  Card = SD_GetStatus();
+  if (Card == SD_TRANSFER_BUSY)
+  {
+    return 0;
+  }
+  if (Card != SD_TRANSFER_OK)
+  {
+    Request->Status = MAL_FAIL;
+  }
+#endif /* USE_STM3210E_EVAL || USE_STM32L152D_EVAL */
+  return 1;
 }
 
 /*******************************************************************************
@@ -166,6 +452,14 @@ uint16_t MAL_GetStatus (uint8_t lun)
   uint32_t NumberOfBlocks = 0;
 #endif
 
+  if (VDisk_IsAttached(lun))
+  {
+    Mass_Block_Count[lun] = VDisk_GetBlockCount(lun);
+    Mass_Block_Size[lun] = MAL_SECTOR_SIZE;
+    Mass_Memory_Size[lun] = Mass_Block_Count[lun] * Mass_Block_Size[lun];
+    return MAL_OK;
+  }
+
   if (lun == 0)
   {
 #if defined (USE_STM3210E_EVAL)  || defined(USE_STM32L152D_EVAL)
@@ -0,0 +1,444 @@
+/**
+  ******************************************************************************
+  * @file    mass_vdisk.c
+  * @brief   Virtual disks of the Medium Access Layer: a RAM disk, and on the
+  *          host builds a disk image file, with a model of the media timing.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mass_vdisk.h"
+#ifdef VDISK_FILE_SUPPORT
+ #include <stdio.h>
+#endif /* VDISK_FILE_SUPPORT */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  VDisk_Config_TypeDef Config;
+  uint8_t  Attached;
+  uint32_t Erase_Unit;            /* erase unit the last write ended in */
+#ifdef VDISK_FILE_SUPPORT
+  FILE *File;
+#endif /* VDISK_FILE_SUPPORT */
+  VDisk_Stats_TypeDef Stats;
+} VDisk_TypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define VDISK_NO_UNIT   0xFFFFFFFF
+#define VDISK_NO_LUN    0xFF
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+static VDisk_TypeDef VDisk[MAX_LUN + 1];
+
+#if VDISK_RAM_BLOCKS > 0
+static uint32_t VDisk_Ram[VDISK_RAM_BLOCKS * VDISK_BLOCK_SIZE / 4];
+static uint8_t VDisk_Ram_Lun = VDISK_NO_LUN;
+#endif /* VDISK_RAM_BLOCKS */
+
+/* Modelled busy time of the request in progress, in DWT cycles */
+static uint32_t VDisk_Busy_Start = 0;
+static uint32_t VDisk_Busy_Cycles = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t VDisk_Access(VDisk_TypeDef *Disk, MAL_Request_TypeDef *Request);
+static uint32_t VDisk_Time(VDisk_TypeDef *Disk, MAL_Request_TypeDef *Request);
+
+/* Private functions ---------------------------------------------------------*/
+
+/*******************************************************************************
+* Function Name  : VDisk_Init
+* Description    : Attach the disk of the VDISK_xxx settings (see "mass_vdisk.h"
+*                  file) to the "VDISK_LUN" logical unit, if not done yet.
+* Input          : - lun: logical unit.
+* Output         : None.
+* Return         : 1 if the logical unit is a virtual disk, else 0.
+*******************************************************************************/
+uint8_t VDisk_Init(uint8_t lun)
+{
+#ifdef VDISK_LUN
+  VDisk_Config_TypeDef Config;
+
+  if ((lun == VDISK_LUN) && !VDisk_IsAttached(lun))
+  {
+    Config.Type = VDISK_TYPE;
+    Config.Buffer = 0;
+    Config.File_Name = VDISK_FILE_NAME;
+    Config.Block_Count = VDISK_BLOCKS;
+    Config.Read_Latency = VDISK_READ_LATENCY;
+    Config.Write_Latency = VDISK_WRITE_LATENCY;
+    Config.Erase_Latency = VDISK_ERASE_LATENCY;
+    Config.Erase_Blocks = VDISK_ERASE_BLOCKS;
+    Config.Bandwidth = VDISK_BANDWIDTH;
+    VDisk_Attach(lun, &Config);
+  }
+#endif /* VDISK_LUN */
+  return VDisk_IsAttached(lun);
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Attach
+* Description    : Serve a logical unit from a virtual disk instead of its
+*                  media, replacing the disk already attached if any. No request
+*                  of the logical unit may be queued.
+* Input          : - lun: logical unit.
+*                  - Config: disk and timing, copied.
+* Output         : None.
+* Return         : MAL_OK or MAL_FAIL.
+*******************************************************************************/
+uint16_t VDisk_Attach(uint8_t lun, const VDisk_Config_TypeDef *Config)
+{
+  VDisk_TypeDef *Disk;
+#ifdef VDISK_FILE_SUPPORT
+  uint32_t Size;
+#endif /* VDISK_FILE_SUPPORT */
+
+  if (lun > MAX_LUN)
+  {
+    return MAL_FAIL;
+  }
+  VDisk_Detach(lun);
+  Disk = &VDisk[lun];
+  Disk->Config = *Config;
+
+  switch (Config->Type)
+  {
+    case VDISK_RAM:
+      if (Disk->Config.Buffer == 0)
+      {
+#if VDISK_RAM_BLOCKS > 0
+        if (Disk->Config.Block_Count == 0)
+        {
+          Disk->Config.Block_Count = VDISK_RAM_BLOCKS;
+        }
+        if ((VDisk_Ram_Lun != VDISK_NO_LUN) || (Disk->Config.Block_Count > VDISK_RAM_BLOCKS))
+        {
+          return MAL_FAIL;
+        }
+        Disk->Config.Buffer = VDisk_Ram;
+        VDisk_Ram_Lun = lun;
+#else
+        return MAL_FAIL;
+#endif /* VDISK_RAM_BLOCKS */
+      }
+      if (Disk->Config.Block_Count == 0)
+      {
+        return MAL_FAIL;
+      }
+      break;
+#ifdef VDISK_FILE_SUPPORT
+    case VDISK_FILE:
+      Disk->File = fopen(Config->File_Name, "r+b");
+      if (Disk->File == 0)
+      {
+        Disk->File = fopen(Config->File_Name, "w+b");
+      }
+      if (Disk->File == 0)
+      {
+        return MAL_FAIL;
+      }
+      fseek(Disk->File, 0, SEEK_END);
+      Size = (uint32_t)(ftell(Disk->File) / VDISK_BLOCK_SIZE);
+      if (Disk->Config.Block_Count == 0)
+      {
+        Disk->Config.Block_Count = Size;
+      }
+      else if (Size < Disk->Config.Block_Count)
+      {
+        /* Grow the image, the new blocks read as zeros */
+        fseek(Disk->File, (long)Disk->Config.Block_Count * VDISK_BLOCK_SIZE - 1, SEEK_SET);
+        fputc(0, Disk->File);
+        fflush(Disk->File);
+      }
+      if (Disk->Config.Block_Count == 0)
+      {
+        fclose(Disk->File);
+        Disk->File = 0;
+        return MAL_FAIL;
+      }
+      break;
+#endif /* VDISK_FILE_SUPPORT */
+    default:
+      return MAL_FAIL;
+  }
+
+  Disk->Erase_Unit = VDISK_NO_UNIT;
+  VDisk_GetStats(lun, 0);
+  Disk->Attached = 1;
+
+  /* The busy time is counted in core cycles */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Detach
+* Description    : Give a logical unit back to its media. No request of the
+*                  logical unit may be queued.
+* Input          : - lun: logical unit.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void VDisk_Detach(uint8_t lun)
+{
+  VDisk_TypeDef *Disk;
+
+  if (!VDisk_IsAttached(lun))
+  {
+    return;
+  }
+  Disk = &VDisk[lun];
+  Disk->Attached = 0;
+#if VDISK_RAM_BLOCKS > 0
+  if (VDisk_Ram_Lun == lun)
+  {
+    VDisk_Ram_Lun = VDISK_NO_LUN;
+  }
+#endif /* VDISK_RAM_BLOCKS */
+#ifdef VDISK_FILE_SUPPORT
+  if (Disk->File != 0)
+  {
+    fclose(Disk->File);
+    Disk->File = 0;
+  }
+#endif /* VDISK_FILE_SUPPORT */
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_IsAttached
+* Description    : Tell whether a logical unit is a virtual disk.
+* Input          : - lun: logical unit.
+* Output         : None.
+* Return         : 1 if attached, else 0.
+*******************************************************************************/
+uint8_t VDisk_IsAttached(uint8_t lun)
+{
+  return (lun <= MAX_LUN) && VDisk[lun].Attached;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_GetBlockCount
+* Description    : Size of a virtual disk.
+* Input          : - lun: logical unit, attached.
+* Output         : None.
+* Return         : 512 byte blocks.
+*******************************************************************************/
+uint32_t VDisk_GetBlockCount(uint8_t lun)
+{
+  return VDisk[lun].Config.Block_Count;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Start
+* Description    : Move the data of a request at once, then keep the request
+*                  busy for the modelled media time.
+* Input          : - Request: request of an attached logical unit.
+* Output         : None.
+* Return         : 1 if the request is complete, 0 if VDisk_Check() follows it.
+*******************************************************************************/
+uint8_t VDisk_Start(MAL_Request_TypeDef *Request)
+{
+  VDisk_TypeDef *Disk = &VDisk[Request->Lun];
+  uint32_t Time;
+
+  if (VDisk_Access(Disk, Request) != MAL_OK)
+  {
+    Disk->Stats.Errors++;
+    Request->Status = MAL_FAIL;
+    return 1;
+  }
+
+  Time = VDisk_Time(Disk, Request);
+  Disk->Stats.Busy_Time += Time;
+  if (Time == 0)
+  {
+    return 1;
+  }
+  VDisk_Busy_Cycles = Time * (SystemCoreClock / 1000000);
+  VDisk_Busy_Start = DWT->CYCCNT;
+  Request->State = MAL_IO_BUSY;
+  return 0;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Check
+* Description    : Follow the modelled busy time of the request in progress.
+* Input          : - Request: request started by VDisk_Start().
+* Output         : None.
+* Return         : 1 if the request is complete, else 0.
+*******************************************************************************/
+uint8_t VDisk_Check(MAL_Request_TypeDef *Request)
+{
+  return (uint32_t)(DWT->CYCCNT - VDisk_Busy_Start) >= VDisk_Busy_Cycles;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Sync
+* Description    : Write the buffered data of a disk image file to the host.
+* Input          : - lun: logical unit.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void VDisk_Sync(uint8_t lun)
+{
+#ifdef VDISK_FILE_SUPPORT
+  if (VDisk_IsAttached(lun) && (VDisk[lun].File != 0))
+  {
+    fflush(VDisk[lun].File);
+  }
+#endif /* VDISK_FILE_SUPPORT */
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_GetStats
+* Description    : Return the statistics of a virtual disk since the last call
+*                  and clear them.
+* Input          : - lun: logical unit.
+* Output         : - Stats: statistics, may be null to only clear them.
+* Return         : None.
+*******************************************************************************/
+void VDisk_GetStats(uint8_t lun, VDisk_Stats_TypeDef *Stats)
+{
+  VDisk_Stats_TypeDef *Disk_Stats;
+
+  if (lun > MAX_LUN)
+  {
+    return;
+  }
+  Disk_Stats = &VDisk[lun].Stats;
+  if (Stats != 0)
+  {
+    *Stats = *Disk_Stats;
+  }
+  Disk_Stats->Reads = 0;
+  Disk_Stats->Writes = 0;
+  Disk_Stats->Read_Blocks = 0;
+  Disk_Stats->Written_Blocks = 0;
+  Disk_Stats->Erases = 0;
+  Disk_Stats->Busy_Time = 0;
+  Disk_Stats->Errors = 0;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Access
+* Description    : Copy the data of a request from or to the disk.
+* Input          : - Disk: virtual disk.
+*                  - Request: request.
+* Output         : None.
+* Return         : MAL_OK or MAL_FAIL.
+*******************************************************************************/
+static uint16_t VDisk_Access(VDisk_TypeDef *Disk, MAL_Request_TypeDef *Request)
+{
+  uint32_t Words = Request->Transfer_Length / 4;
+  uint32_t i;
+  uint32_t *Media;
+
+  if ((Request->Memory_Offset % VDISK_BLOCK_SIZE) || (Request->Transfer_Length % VDISK_BLOCK_SIZE)
+      || ((Request->Memory_Offset / VDISK_BLOCK_SIZE) + (Request->Transfer_Length / VDISK_BLOCK_SIZE)
+          > Disk->Config.Block_Count))
+  {
+    return MAL_FAIL;
+  }
+
+#ifdef VDISK_FILE_SUPPORT
+  if (Disk->File != 0)
+  {
+    if (fseek(Disk->File, (long)Request->Memory_Offset, SEEK_SET) != 0)
+    {
+      return MAL_FAIL;
+    }
+    if (Request->Dir == MAL_DIR_READ)
+    {
+      /* Past the end of a sparse image the blocks read as zeros */
+      i = (uint32_t)fread(Request->Buffer, 1, Request->Transfer_Length, Disk->File);
+      if (ferror(Disk->File))
+      {
+        clearerr(Disk->File);
+        return MAL_FAIL;
+      }
+      for (i = (i + 3) / 4; i < Words; i++)
+      {
+        Request->Buffer[i] = 0;
+      }
+    }
+    else if (fwrite(Request->Buffer, 1, Request->Transfer_Length, Disk->File) != Request->Transfer_Length)
+    {
+      clearerr(Disk->File);
+      return MAL_FAIL;
+    }
+    return MAL_OK;
+  }
+#endif /* VDISK_FILE_SUPPORT */
+
+  Media = Disk->Config.Buffer + (Request->Memory_Offset / 4);
+  if (Request->Dir == MAL_DIR_READ)
+  {
+    for (i = 0; i < Words; i++)
+    {
+      Request->Buffer[i] = Media[i];
+    }
+  }
+  else
+  {
+    for (i = 0; i < Words; i++)
+    {
+      Media[i] = Request->Buffer[i];
+    }
+  }
+  return MAL_OK;
+}
+
+/*******************************************************************************
+* Function Name  : VDisk_Time
+* Description    : Modelled media time of a request, and its statistics: the
+*                  access latency, the data at the disk bandwidth and, for a
+*                  write, the erase of each erase unit it enters. The unit the
+*                  previous write ended in is still open and not erased again,
+*                  so that a sequential stream pays one erase per unit.
+* Input          : - Disk: virtual disk.
+*                  - Request: request.
+* Output         : None.
+* Return         : us.
+*******************************************************************************/
+static uint32_t VDisk_Time(VDisk_TypeDef *Disk, MAL_Request_TypeDef *Request)
+{
+  uint32_t Block = Request->Memory_Offset / VDISK_BLOCK_SIZE;
+  uint32_t Blocks = Request->Transfer_Length / VDISK_BLOCK_SIZE;
+  uint32_t First, Last, Time;
+
+  if (Request->Dir == MAL_DIR_READ)
+  {
+    Disk->Stats.Reads++;
+    Disk->Stats.Read_Blocks += Blocks;
+    Time = Disk->Config.Read_Latency;
+  }
+  else
+  {
+    Disk->Stats.Writes++;
+    Disk->Stats.Written_Blocks += Blocks;
+    Time = Disk->Config.Write_Latency;
+    if ((Disk->Config.Erase_Blocks != 0) && (Blocks != 0))
+    {
+      First = Block / Disk->Config.Erase_Blocks;
+      Last = (Block + Blocks - 1) / Disk->Config.Erase_Blocks;
+      if (First == Disk->Erase_Unit)
+      {
+        First++;
+      }
+      Disk->Erase_Unit = Last;
+      if (Last >= First)
+      {
+        Disk->Stats.Erases += Last - First + 1;
+        Time += (Last - First + 1) * Disk->Config.Erase_Latency;
+      }
+    }
+  }
+
+  if (Disk->Config.Bandwidth != 0)
+  {
+    Time += (Request->Transfer_Length * 1000) / Disk->Config.Bandwidth;
+  }
+  return Time;
+}
@@ -36,84 +36,412 @@
 #include "usb_conf.h"
 #include "hw_config.h"
 #include "mass_mal.h"
+#include "mass_cache.h"
 #include "usb_lib.h"
 
 /* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  Lun;             /* logical unit */
+  uint16_t Block_Size;      /* bytes per block */
+  uint16_t PMA_Addr;        /* endpoint buffer in packet memory */
+  uint8_t  *Data;           /* current block */
+  uint16_t Offset;          /* bytes of the current block copied */
+  uint32_t Memory_Offset;   /* Write: media offset of the current block */
+  uint32_t Blocks;          /* Write: blocks left, current one included */
+} Memory_Transfer_TypeDef;
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-__IO uint32_t Block_Read_count = 0;
-__IO uint32_t Block_offset;
-__IO uint32_t Counter = 0;
-uint32_t  Idx;
 uint32_t Data_Buffer[BULK_MAX_PACKET_SIZE *2]; /* 512 bytes*/
 uint8_t TransferState = TXFR_IDLE;
+
+/* Data phase of the READ(10) or WRITE(10) command in progress, set up once
+   per command: the endpoint routines only copy the packets of the current
+   block, the block bookkeeping runs once per block */
+static Memory_Transfer_TypeDef Xfer;
+
+/* Cache write of the block received: the OUT endpoint NAKs till it completes,
+   from the main loop when the cache has to be flushed first */
+static MAL_Request_TypeDef Write_Request;
+
+/* Read pipeline: Read_Memory_Fetch() submits the reads of the blocks of the
+   transfer from the main loop while Read_Memory() sends the already read ones
+   from the IN endpoint routine. The block counters run free across
+   transfers: block n is held in buffer n % MASS_READ_BUFFERS, Read_Issued and
+   Read_Fetched are only written by the main loop and Read_Sent only by the
+   IN endpoint routine. Once a sequential stream is seen, the fetch goes on
+   past Read_End by up to Read_Depth blocks, during the CSW and the command
+   gap, for the next READ(10) to find its first blocks read already. */
+uint32_t Read_Buffer[MASS_READ_BUFFERS][BULK_MAX_PACKET_SIZE *2]; /* 512 bytes each */
+static MAL_Request_TypeDef Read_Request[MASS_READ_BUFFERS];
+static uint8_t Read_Ready[MASS_READ_BUFFERS]; /* request completed, block not yet counted */
+static uint8_t Read_Lun;
+static uint32_t Read_Offset;          /* media offset of the next block to read */
+static __IO uint32_t Read_End;        /* block count at the end of the transfer */
+static uint32_t Read_Issued;          /* blocks submitted to the media */
+static __IO uint32_t Read_Fetched;    /* blocks read from the media */
+static __IO uint32_t Read_Sent;       /* blocks sent to the host */
+static __IO uint8_t Read_Starved;     /* IN endpoint waits for a block */
+static __IO uint32_t Read_Discard;    /* blocks below are stale, skipped */
+static __IO uint32_t Read_Depth = 0;  /* blocks fetched past Read_End */
+static uint32_t Read_End_Lba = 0xFFFFFFFF;   /* block at Read_End */
+static uint32_t Read_Next_Lba = 0xFFFFFFFF;  /* block after the last READ(10) */
+static uint32_t Read_Wait_Stamp;      /* cycle count at the READ(10) */
+static uint8_t Read_Wait;             /* first packet awaited: 1 cold, 2 hit */
+static Read_Stats_TypeDef Read_Stats;
 /* Extern variables ----------------------------------------------------------*/
-extern uint8_t Bulk_Data_Buff[BULK_MAX_PACKET_SIZE];  /* data buffer*/
-extern uint16_t Data_Len;
 extern uint8_t Bot_State;
 extern Bulk_Only_CBW CBW;
 extern Bulk_Only_CSW CSW;
 extern uint32_t Mass_Memory_Size[2];
 extern uint32_t Mass_Block_Size[2];
+extern uint32_t Mass_Block_Count[2];
 
 /* Private function prototypes -----------------------------------------------*/
+static void Read_Memory_Send(void);
+static void Read_Memory_Done(MAL_Request_TypeDef *Request);
+static void Read_Memory_Discard(void);
+static void Write_Memory_Done(MAL_Request_TypeDef *Request);
+
 /* Extern function prototypes ------------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
 /*******************************************************************************
 * Function Name  : Read_Memory
-* Description    : Handle the Read operation from the microSD card.
-* Input          : None.
+* Description    : Start the Read operation from the microSD card: set up the
+*                  transfer and send its first packet. Read_Memory_In() sends
+*                  the next ones as the blocks are read by Read_Memory_Fetch().
+*                  A transfer starting at the block following the fetched ones
+*                  goes on with them, the others restart the fetch.
+* Input          : - lun: logical unit.
+*                  - Memory_Offset: first block.
+*                  - Transfer_Length: blocks to read.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void Read_Memory(uint8_t lun, uint32_t Memory_Offset, uint32_t Transfer_Length)
 {
-  static uint32_t Offset, Length;
+  uint32_t Ahead;
+  int32_t Ready;
 
-  if (TransferState == TXFR_IDLE )
+  if (Transfer_Length == 0)
   {
-    Offset = Memory_Offset * Mass_Block_Size[lun];
-    Length = Transfer_Length * Mass_Block_Size[lun];
-    TransferState = TXFR_ONGOING;
+    /* Nothing to read: no data stage */
+    Set_CSW (CSW_CMD_PASSED, SEND_CSW_ENABLE);
+    return;
   }
+  Xfer.Lun = lun;
+  Xfer.Block_Size = Mass_Block_Size[lun];
+  Xfer.PMA_Addr = GetEPTxAddr(ENDP1);
+  Xfer.Offset = 0;
+  Read_Starved = 0;
+  Read_Stats.Commands++;
 
-  if (TransferState == TXFR_ONGOING )
+  /* Sequential stream: read further ahead while it goes on */
+  if ((lun == Read_Lun) && (Memory_Offset == Read_Next_Lba))
   {
-    if (!Block_Read_count)
+    Read_Stats.Sequential++;
+    Read_Depth = (Read_Depth == 0) ? 1 : (Read_Depth * 2);
+    if (Read_Depth > MASS_READ_PREFETCH)
     {
-      MAL_Read(lun ,
-               Offset ,
-               Data_Buffer,
-               Mass_Block_Size[lun]);
+      Read_Depth = MASS_READ_PREFETCH;
+    }
+  }
+  else
+  {
+    Read_Depth = 0;
+  }
+  Read_Next_Lba = Memory_Offset + Transfer_Length;
 
-      USB_SIL_Write(EP1_IN, (uint8_t *)Data_Buffer, BULK_MAX_PACKET_SIZE);
+  /* No transfer ongoing: the blocks from Read_End on are read ahead */
+  Ahead = Read_Issued - Read_End;
+  if ((lun == Read_Lun) && (Memory_Offset == Read_End_Lba))
+  {
+    Ready = (int32_t)(Read_Fetched - Read_End);
+    Ready = (Ready < 0) ? 0 : Ready;
+    Read_Stats.Hits += (Ahead < Transfer_Length) ? Ahead : Transfer_Length;
+    Read_Stats.Ready += ((uint32_t)Ready < Transfer_Length) ? (uint32_t)Ready : Transfer_Length;
+    Read_Wait = (Ahead != 0) ? 2 : 1;
+    Read_Stats.Hit_Commands += (Ahead != 0);
+  }
+  else
+  {
+    /* Restart the fetch at this transfer, past the blocks in progress */
+    Read_Stats.Discarded += Ahead;
+    Read_Discard = Read_Issued;
+    Read_End = Read_Issued;
+    Read_Lun = lun;
+    Read_Offset = Memory_Offset * Mass_Block_Size[lun];
+    Read_Wait = 1;
+  }
+  Read_End_Lba = Memory_Offset + Transfer_Length;
+  Read_Wait_Stamp = DWT->CYCCNT;
+  TransferState = TXFR_ONGOING;
+  /* Written last: starts the fetch in the main loop */
+  Read_End += Transfer_Length;
+
+  /* All the packets are full: the count is kept until the CSW */
+  SetEPTxCount(ENDP1, BULK_MAX_PACKET_SIZE);
+  Led_RW_ON();
+  Read_Memory_Send();
+}
 
-      Block_Read_count = Mass_Block_Size[lun] - BULK_MAX_PACKET_SIZE;
-      Block_offset = BULK_MAX_PACKET_SIZE;
+/*******************************************************************************
+* Function Name  : Read_Memory_In
+* Description    : Send the next packet of the ongoing Read operation, from the
+*                  EP1 IN endpoint routine.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Read_Memory_In(void)
+{
+  if (TransferState == TXFR_ONGOING)
+  {
+    Read_Memory_Send();
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_Fetch
+* Description    : Submit the reads of the next blocks of the ongoing Read
+*                  operation, then of the blocks following it for a sequential
+*                  stream, into the free buffers. To be called from the main
+*                  loop, with MAL_Poll(): the media is read there while the IN
+*                  endpoint sends the previous blocks. The blocks past the
+*                  transfer are read with the USB interrupt masked: the next
+*                  command may reach the cache and the media from the
+*                  endpoint routines meanwhile.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Read_Memory_Fetch(void)
+{
+  MAL_Request_TypeDef *Request;
+  uint32_t Slot, Offset;
+  int32_t Ahead;
+
+  while (1)
+  {
+    /* Claim the next buffer atomically: Read_Memory() may restart the fetch */
+    __disable_irq();
+    Ahead = (int32_t)(Read_Issued - Read_End);
+    if (((Read_Issued - Read_Sent) >= MASS_READ_BUFFERS)
+        || ((Ahead >= 0) && ((Ahead >= (int32_t)Read_Depth)
+            || ((Read_Offset / Mass_Block_Size[Read_Lun]) >= Mass_Block_Count[Read_Lun]))))
+    {
+      __enable_irq();
+      return;
     }
-    else
+    Slot = Read_Issued % MASS_READ_BUFFERS;
+    Offset = Read_Offset;
+    Read_Offset += Mass_Block_Size[Read_Lun];
+    Read_Issued++;
+    __enable_irq();
+
+    if (Ahead >= 0)
     {
-      USB_SIL_Write(EP1_IN, (uint8_t *)Data_Buffer + Block_offset, BULK_MAX_PACKET_SIZE);
+      Read_Stats.Prefetched++;
+    }
 
-      Block_Read_count -= BULK_MAX_PACKET_SIZE;
-      Block_offset += BULK_MAX_PACKET_SIZE;
+    /* The request of this buffer completed before its block was sent */
+    Request = &Read_Request[Slot];
+    Request->Lun = Read_Lun;
+    Request->Dir = MAL_DIR_READ;
+    Request->Flags = 0;
+    Request->Memory_Offset = Offset;
+    Request->Buffer = Read_Buffer[Slot];
+    Request->Transfer_Length = Mass_Block_Size[Read_Lun];
+    Request->Complete = Read_Memory_Done;
+    if (Ahead < 0)
+    {
+      Cache_Submit(Request);
+      continue;
     }
 
-    SetEPTxCount(ENDP1, BULK_MAX_PACKET_SIZE);
-    SetEPTxStatus(ENDP1, EP_TX_VALID);  
-    Offset += BULK_MAX_PACKET_SIZE;
-    Length -= BULK_MAX_PACKET_SIZE;
+    /* Read ahead: the CSW may be sent and the next command decoded */
+    Request->Flags = MAL_FLAG_USB_MASKED;
+    USB_Interrupts_Cmd(DISABLE);
+    Cache_Submit(Request);
+    USB_Interrupts_Cmd(ENABLE);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_Discard
+* Description    : Drop the blocks read ahead, the host wrote over them: the IN
+*                  endpoint skips them and the fetch goes on past them. From
+*                  the endpoint routines only.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Read_Memory_Discard(void)
+{
+  uint32_t Ahead = Read_Issued - Read_End;
+
+  Read_Stats.Discarded += Ahead;
+  Read_End_Lba += Ahead;
+  Read_Discard = Read_Issued;
+  Read_End = Read_Issued;
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_Init
+* Description    : Clear the read ahead statistics and start the cycle counter
+*                  timing the READ(10) commands.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Read_Memory_Init(void)
+{
+  Read_Memory_GetStats(0);
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_GetStats
+* Description    : Return the read ahead statistics since the last call and
+*                  clear them. The latency saved is the number of commands
+*                  starting on a read ahead block times the difference between
+*                  the average wait for the first packet of the other commands
+*                  and theirs.
+* Input          : None.
+* Output         : - Stats: statistics, may be null to only clear them.
+* Return         : None.
+*******************************************************************************/
+void Read_Memory_GetStats(Read_Stats_TypeDef *Stats)
+{
+  uint32_t Cold_Commands, Cold_Wait, Hit_Wait;
 
-    CSW.dDataResidue -= BULK_MAX_PACKET_SIZE;
-    Led_RW_ON();
+  __disable_irq();
+  if (Stats != 0)
+  {
+    *Stats = Read_Stats;
+    Stats->Depth = Read_Depth;
+    Stats->Saved_Time = 0;
+    Cold_Commands = Stats->Commands - Stats->Hit_Commands;
+    if ((Cold_Commands != 0) && (Stats->Hit_Commands != 0))
+    {
+      Cold_Wait = Stats->Cold_Wait / Cold_Commands;
+      Hit_Wait = Stats->Hit_Wait / Stats->Hit_Commands;
+      if (Cold_Wait > Hit_Wait)
+      {
+        Stats->Saved_Time = Stats->Hit_Commands * (Cold_Wait - Hit_Wait);
+      }
+    }
   }
-  if (Length == 0)
+  Read_Stats.Commands = 0;
+  Read_Stats.Sequential = 0;
+  Read_Stats.Hit_Commands = 0;
+  Read_Stats.Prefetched = 0;
+  Read_Stats.Hits = 0;
+  Read_Stats.Ready = 0;
+  Read_Stats.Discarded = 0;
+  Read_Stats.Cold_Wait = 0;
+  Read_Stats.Hit_Wait = 0;
+  __enable_irq();
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_Done
+* Description    : Completion of a block read: hand the completed blocks to
+*                  the IN endpoint in order. The blocks found in the cache
+*                  complete before the media reads queued ahead of them.
+* Input          : - Request: completed request.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Read_Memory_Done(MAL_Request_TypeDef *Request)
+{
+  uint32_t Fetched = Read_Fetched;
+
+  Read_Ready[Request - Read_Request] = 1;
+  while ((Fetched != Read_Issued) && Read_Ready[Fetched % MASS_READ_BUFFERS])
+  {
+    Read_Ready[Fetched % MASS_READ_BUFFERS] = 0;
+    Fetched++;
+  }
+  if (Fetched == Read_Fetched)
+  {
+    return;
+  }
+  Read_Fetched = Fetched;
+
+  /* The IN endpoint ran out of blocks: send the first packet of the next one */
+  if (Read_Starved)
+  {
+    Read_Starved = 0;
+    __disable_irq();
+    Read_Memory_Send();
+    __enable_irq();
+  }
+}
+
+/*******************************************************************************
+* Function Name  : Read_Memory_Send
+* Description    : Copy the next packet of the current block to the endpoint
+*                  buffer, or flag the IN endpoint as starved when the block is
+*                  not read yet. The block is counted once its last packet is
+*                  copied.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Read_Memory_Send(void)
+{
+  uint32_t Wait;
+
+  if (Xfer.Offset == 0)
+  {
+    /* Skip the stale blocks read ahead */
+    while (((int32_t)(Read_Discard - Read_Sent) > 0) && (Read_Sent != Read_Fetched))
+    {
+      Read_Sent++;
+    }
+    if (Read_Sent == Read_Fetched)
+    {
+      Read_Starved = 1;
+      return;
+    }
+    Xfer.Data = (uint8_t *)Read_Buffer[Read_Sent % MASS_READ_BUFFERS];
+
+    if (Read_Wait != 0)
+    {
+      /* First packet of the command */
+      Wait = (DWT->CYCCNT - Read_Wait_Stamp) / (SystemCoreClock / 1000000);
+      if (Read_Wait == 2)
+      {
+        Read_Stats.Hit_Wait += Wait;
+      }
+      else
+      {
+        Read_Stats.Cold_Wait += Wait;
+      }
+      Read_Wait = 0;
+    }
+  }
+
+  UserToPMABufferCopy(Xfer.Data + Xfer.Offset, Xfer.PMA_Addr, BULK_MAX_PACKET_SIZE);
+  SetEPTxStatus(ENDP1, EP_TX_VALID);
+
+  Xfer.Offset += BULK_MAX_PACKET_SIZE;
+  if (Xfer.Offset < Xfer.Block_Size)
+  {
+    return;
+  }
+
+  /* Block sent: its buffer is free for Read_Memory_Fetch() */
+  Xfer.Offset = 0;
+  Read_Sent++;
+  CSW.dDataResidue -= Xfer.Block_Size;
+
+  if (Read_Sent == Read_End)
   {
-    Block_Read_count = 0;
-    Block_offset = 0;
-    Offset = 0;
     Bot_State = BOT_DATA_IN_LAST;
     TransferState = TXFR_IDLE;
     Led_RW_OFF();
@@ -122,57 +450,115 @@ void Read_Memory(uint8_t lun, uint32_t Memory_Offset, uint32_t Transfer_Length)
 
 /*******************************************************************************
 * Function Name  : Write_Memory
-* Description    : Handle the Write operation to the microSD card.
-* Input          : None.
+* Description    : Start the Write operation to the microSD card: set up the
+*                  transfer, Write_Memory_Out() then receives its packets.
+* Input          : - lun: logical unit.
+*                  - Memory_Offset: first block.
+*                  - Transfer_Length: blocks to write.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void Write_Memory (uint8_t lun, uint32_t Memory_Offset, uint32_t Transfer_Length)
 {
+  if (Transfer_Length == 0)
+  {
+    /* Nothing to write: no data stage */
+    Set_CSW (CSW_CMD_PASSED, SEND_CSW_ENABLE);
+    return;
+  }
+  Xfer.Lun = lun;
+  Xfer.Block_Size = Mass_Block_Size[lun];
+  Xfer.PMA_Addr = GetEPRxAddr(ENDP2);
+  Xfer.Data = (uint8_t *)Data_Buffer;
+  Xfer.Offset = 0;
+  Xfer.Memory_Offset = Memory_Offset * Mass_Block_Size[lun];
+  Xfer.Blocks = Transfer_Length;
+  TransferState = TXFR_ONGOING;
+  Led_RW_ON();
+}
 
-  static uint32_t W_Offset, W_Length;
-
-  uint32_t temp =  Counter + 64;
+/*******************************************************************************
+* Function Name  : Write_Memory_Out
+* Description    : Receive the next packet of the ongoing Write operation, from
+*                  the EP2 OUT endpoint routine: the packet is copied straight
+*                  to the block buffer, which is written once complete.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Write_Memory_Out(void)
+{
+  uint32_t Count = GetEPRxCount(ENDP2);
 
-  if (TransferState == TXFR_IDLE )
+  if (TransferState != TXFR_ONGOING)
   {
-    W_Offset = Memory_Offset * Mass_Block_Size[lun];
-    W_Length = Transfer_Length * Mass_Block_Size[lun];
-    TransferState = TXFR_ONGOING;
+    return;
   }
-
-  if (TransferState == TXFR_ONGOING )
+  if (Count > (uint32_t)(Xfer.Block_Size - Xfer.Offset))
   {
+    Count = Xfer.Block_Size - Xfer.Offset;
+  }
+  PMAToUserBufferCopy(Xfer.Data + Xfer.Offset, Xfer.PMA_Addr, Count);
+  Xfer.Offset += Count;
 
-    for (Idx = 0 ; Counter < temp; Counter++)
-    {
-      *((uint8_t *)Data_Buffer + Counter) = Bulk_Data_Buff[Idx++];
-    }
+  if (Xfer.Offset < Xfer.Block_Size)
+  {
+    SetEPRxStatus(ENDP2, EP_RX_VALID); /* enable the next transaction*/
+    return;
+  }
 
-    W_Offset += Data_Len;
-    W_Length -= Data_Len;
+  /* Block received: Write_Memory_Done() takes the next packet */
+  Write_Request.Lun = Xfer.Lun;
+  Write_Request.Dir = MAL_DIR_WRITE;
+  Write_Request.Memory_Offset = Xfer.Memory_Offset;
+  Write_Request.Buffer = Data_Buffer;
+  Write_Request.Transfer_Length = Xfer.Block_Size;
+  Write_Request.Complete = Write_Memory_Done;
+  Cache_Submit(&Write_Request);
+}
 
-    if (!(W_Length % Mass_Block_Size[lun]))
-    {
-      Counter = 0;
-      MAL_Write(lun ,
-                W_Offset - Mass_Block_Size[lun],
-                Data_Buffer,
-                Mass_Block_Size[lun]);
-    }
+/*******************************************************************************
+* Function Name  : Write_Memory_Done
+* Description    : Completion of the cache write of a block, called from the
+*                  OUT endpoint routine or from Cache_Poll() with the USB
+*                  interrupt masked: enable the next packet, or send the CSW
+*                  after the last block.
+* Input          : - Request: the block write request.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Write_Memory_Done(MAL_Request_TypeDef *Request)
+{
+  if (TransferState != TXFR_ONGOING)
+  {
+    return;
+  }
+  Xfer.Offset = 0;
 
-    CSW.dDataResidue -= Data_Len;
-    SetEPRxStatus(ENDP2, EP_RX_VALID); /* enable the next transaction*/   
-    Led_RW_ON();
+  if (Request->Status != MAL_OK)
+  {
+    /* The host gets the error in the CSW, the other blocks are dropped */
+    Set_Scsi_Sense_Data(Xfer.Lun, MEDIUM_ERROR, WRITE_ERROR);
+    Bot_Abort(DIR_OUT);
+    Read_Memory_Discard();
+    Set_CSW (CSW_CMD_FAILED, SEND_CSW_ENABLE);
+    TransferState = TXFR_IDLE;
+    Led_RW_OFF();
+    return;
   }
+  Xfer.Memory_Offset += Xfer.Block_Size;
+  CSW.dDataResidue -= Xfer.Block_Size;
 
-  if ((W_Length == 0) || (Bot_State == BOT_CSW_Send))
+  if (--Xfer.Blocks == 0)
   {
-    Counter = 0;
+    /* The blocks read ahead may be stale now */
+    Read_Memory_Discard();
     Set_CSW (CSW_CMD_PASSED, SEND_CSW_ENABLE);
     TransferState = TXFR_IDLE;
     Led_RW_OFF();
+    return;
   }
+  SetEPRxStatus(ENDP2, EP_RX_VALID); /* enable the next transaction*/
 }
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
 
@@ -34,29 +34,93 @@
 #include "fsmc_nand.h"
 #include "memory.h"
 /* Private typedef -----------------------------------------------------------*/
+/* Checkpoint header, written after the zone tables */
+typedef struct
+{
+  uint32_t Magic;                       /* NAND_CKPT_MAGIC */
+  uint32_t Sequence;                    /* incremented by each checkpoint */
+  uint16_t Zones;                       /* NAND_MAX_ZONE */
+  uint16_t Blocks;                      /* MAX_PHY_BLOCKS_PER_ZONE */
+  uint16_t Sum[NAND_MAX_ZONE];          /* NAND_TableSum() of the zone tables */
+} NAND_CKPT_HEADER;
+
+/* Block being rewritten: the written pages go to New, the others are read
+   from Old until NAND_Merge() copies them */
+typedef struct
+{
+  uint16_t Zone;                        /* NAND_NO_ZONE if no block is open */
+  uint16_t Logical;                     /* logical block */
+  uint16_t Old;                         /* previous physical block or NAND_NO_BLOCK */
+  uint16_t New;                         /* physical block receiving the writes */
+  uint16_t Pool;                        /* LUT index New was taken from */
+  uint32_t Pages;                       /* pages of New programmed, bit per page */
+} NAND_OPEN_BLOCK;
+
 /* Private define ------------------------------------------------------------*/
-/* extern variables-----------------------------------------------------------*/
-extern uint32_t SCSI_LBA;
-extern uint32_t SCSI_BlkLen;
+#define NAND_NO_ZONE             0xFFFF
+#define NAND_NO_BLOCK            0xFFFF
+#define NAND_NO_CKPT             0xFF
+#define NAND_BLOCK_MASK          0x03FF
+#define NAND_ALL_PAGES           0xFFFFFFFF
+
+/* Free blocks at the end of the look up table, erase count in RAM for each */
+#define NAND_POOL_SIZE           (MAX_PHY_BLOCKS_PER_ZONE - MAX_LOG_BLOCKS_PER_ZONE)
+#define NAND_NO_WEAR             0xFFFF   /* pool entry without free block */
+#define NAND_MAX_ERASE_COUNT     0xFFFE
+
+/* Spare area of the last page of a block taken from the pool, programmed
+   until the block is merged: the block must be erased before reuse */
+#define NAND_RECEIVING_PAGE      (NAND_BLOCK_SIZE - 1)
+
+/* Checkpoint block layout: the zone tables (one page per 256 blocks), the
+   header, then one page per zone whose spare area is programmed when the
+   zone is first written after the checkpoint */
+#define NAND_CKPT_MAGIC          0x4C555443
+#define NAND_CKPT_MARK           0x4C54   /* LogicalIndex of the checkpoint blocks */
+#define NAND_CKPT_ZONE           (NAND_MAX_ZONE - 1)
+#define NAND_CKPT_FIRST_BLOCK    (MAX_PHY_BLOCKS_PER_ZONE - NAND_CKPT_BLOCKS)
+#define NAND_CKPT_ZONE_PAGES     ((MAX_PHY_BLOCKS_PER_ZONE * 2) / NAND_PAGE_SIZE)
+#define NAND_CKPT_HEADER_PAGE    (NAND_MAX_ZONE * NAND_CKPT_ZONE_PAGES)
+#define NAND_CKPT_STALE_PAGE(z)  (NAND_BLOCK_SIZE - NAND_MAX_ZONE + (z))
+#define NAND_ALL_ZONES           ((1 << NAND_MAX_ZONE) - 1)
+
 /* Private variables ---------------------------------------------------------*/
-uint16_t LUT[1024]; //Look Up Table Buffer
-WRITE_STATE Write_State;
-BLOCK_STATE Block_State;
-NAND_ADDRESS wAddress, fAddress;
-uint16_t  phBlock, LogAddress, Initial_Page, CurrentZone = 0;
-uint16_t  Written_Pages = 0;
-
-uint16_t LUT[1024]; //Look Up Table Buffer
+uint16_t *LUT; //Look Up Table of CurrentZone
+uint16_t  CurrentZone = 0;
+
+static NAND_OPEN_BLOCK Open_Block = {NAND_NO_ZONE};
+
+static uint16_t LUT_Table[NAND_LUT_ZONES][MAX_PHY_BLOCKS_PER_ZONE];
+static uint16_t LUT_Wear[NAND_LUT_ZONES][NAND_POOL_SIZE]; /* erase counts of the pool */
+static uint16_t LUT_Zone[NAND_LUT_ZONES];   /* zone of each table or NAND_NO_ZONE */
+static uint32_t LUT_Age[NAND_LUT_ZONES];    /* LRU stamps */
+static uint32_t LUT_Clock = 0;
+
+static uint8_t  Ckpt_Block = NAND_NO_CKPT;  /* reserved block of the valid checkpoint */
+static uint8_t  Ckpt_Usable = 0;            /* reserved blocks free for the checkpoint */
+static uint8_t  Ckpt_Stale = NAND_ALL_ZONES;/* zones changed since the checkpoint */
+static uint32_t Ckpt_Sequence = 0;
+static uint16_t Ckpt_Sum[NAND_MAX_ZONE];
+static uint32_t Ckpt_Page[NAND_PAGE_SIZE / 4];
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
-static uint16_t NAND_CleanLUT(uint8_t ZoneNbr);
 static NAND_ADDRESS NAND_GetAddress(uint32_t Address);
-static uint16_t NAND_GetFreeBlock(void);
-static uint16_t NAND_Write_Cleanup(void);
+static int32_t NAND_GetFreeBlock(int32_t Slot);
+static uint16_t NAND_Open(NAND_ADDRESS Address);
+static uint16_t NAND_Merge(uint16_t PageToCopy);
+static uint16_t NAND_Erase(NAND_ADDRESS Address);
+static void NAND_Prepare(NAND_ADDRESS Address);
+static void NAND_LoadWear(int32_t Slot);
 SPARE_AREA ReadSpareArea(uint32_t address);
 static uint16_t NAND_Copy(NAND_ADDRESS Address_Src, NAND_ADDRESS Address_Dest, uint16_t PageToCopy);
 static NAND_ADDRESS NAND_ConvertPhyAddress(uint32_t Address);
 static uint16_t NAND_BuildLUT(uint8_t ZoneNbr);
+static uint16_t NAND_SelectZone(uint16_t ZoneNbr);
+static int32_t NAND_FindZone(uint16_t ZoneNbr);
+static void NAND_Mount(void);
+static void NAND_MarkStale(uint16_t ZoneNbr);
+static uint16_t NAND_TableSum(uint16_t *Table);
+static NAND_ADDRESS NAND_CkptAddress(uint8_t Block, uint16_t Page);
 
 /*******************************************************************************
 * Function Name  : NAND_Init
@@ -70,260 +134,387 @@ uint16_t NAND_Init(void)
   uint16_t Status = NAND_OK;
 
   FSMC_NAND_Init();
-  Status = NAND_BuildLUT(0);
-  Write_State = WRITE_IDLE;
+  NAND_Mount();
+  Status = NAND_SelectZone(0);
   return Status;
 }
 
 /*******************************************************************************
 * Function Name  : NAND_Write
-* Description    : write one sector by once
+* Description    : Write sectors. A rewritten block is opened: a free block
+*                  receives the written pages and the other pages are merged
+*                  into it by NAND_GC() in background, or at once when
+*                  another block or a page already written is written.
 * Input          : None
 * Output         : None
 * Return         : Status
 *******************************************************************************/
 uint16_t NAND_Write(uint32_t Memory_Offset, uint32_t *Writebuff, uint16_t Transfer_Length)
 {
-  /* check block status and calculate start and end addresses */
-  wAddress    = NAND_GetAddress(Memory_Offset / 512);
+  NAND_ADDRESS wAddress;
+  uint16_t Page;
 
-  /*check Zone: if second zone is requested build second LUT*/
-  if (wAddress.Zone != CurrentZone)
+  for (Page = 0; Page < PAGE_TO_WRITE; Page++)
   {
-    CurrentZone = wAddress.Zone;
-    NAND_BuildLUT(CurrentZone);
-  }
-
-  phBlock     = LUT[wAddress.Block]; /* Block Index + flags */
-  LogAddress  = wAddress.Block ; /* save logical block */
-
-  /*  IDLE state  */
-  /****************/
-  if ( Write_State == WRITE_IDLE)
-  {/* Idle state */
-
-    if (phBlock & USED_BLOCK)
-    { /* USED BLOCK */
-
-      Block_State = OLD_BLOCK;
-      /* Get a free Block for swap */
-      fAddress.Block = NAND_GetFreeBlock();
-      fAddress.Zone  = wAddress.Zone;
-      Initial_Page = fAddress.Page  = wAddress.Page;
-
-      /* write the new page */
-      FSMC_NAND_WriteSmallPage((uint8_t *)Writebuff, fAddress, PAGE_TO_WRITE);
-      Written_Pages++;
+    /* check block status and calculate start and end addresses */
+    wAddress = NAND_GetAddress((Memory_Offset / 512) + Page);
 
-      /* get physical block */
-      wAddress.Block = phBlock & 0x3FF;
+    /*check Zone: if second zone is requested select its LUT*/
+    NAND_SelectZone(wAddress.Zone);
+    NAND_MarkStale(wAddress.Zone);
 
-
-      if (Written_Pages == SCSI_BlkLen)
-      {
-        NAND_Write_Cleanup();
-        Written_Pages = 0;
-        return NAND_OK;
-      }
-      else
+    if ((Open_Block.Zone != wAddress.Zone) || (Open_Block.Logical != wAddress.Block)
+        || (Open_Block.Pages & (1 << wAddress.Page)))
+    {
+      NAND_Merge(NAND_BLOCK_SIZE);
+      if (NAND_Open(wAddress) != NAND_OK)
       {
-        if (wAddress.Page == (NAND_BLOCK_SIZE - 1))
-        {
-          NAND_Write_Cleanup();
-          return NAND_OK;
-        }
-        Write_State = WRITE_ONGOING;
-        return NAND_OK;
+        return NAND_FAIL;
       }
     }
-    else
-    {/* UNUSED BLOCK */
 
-      Block_State = UNUSED_BLOCK;
-      /* write the new page */
-      wAddress.Block = phBlock & 0x3FF;
-      FSMC_NAND_WriteSmallPage( (uint8_t *)Writebuff , wAddress, PAGE_TO_WRITE);
-
-      Written_Pages++;
-      if (Written_Pages == SCSI_BlkLen)
-      {
-        Written_Pages = 0;
-        NAND_Write_Cleanup();
-        return NAND_OK;
-      }
-      else
-      {
-        Write_State = WRITE_ONGOING;
-        return NAND_OK;
-      }
-    }
+    wAddress.Block = Open_Block.New;
+    FSMC_NAND_WriteSmallPage((uint8_t *)(Writebuff + (Page * (NAND_PAGE_SIZE / 4))), wAddress, 1);
+    Open_Block.Pages |= 1 << wAddress.Page;
   }
-  /* WRITE state */
-  /***************/
-  if ( Write_State == WRITE_ONGOING)
-  {/* Idle state */
-    if (phBlock & USED_BLOCK)
-    { /* USED BLOCK */
-
-      wAddress.Block = phBlock & 0x3FF;
-      Block_State = OLD_BLOCK;
-      fAddress.Page  = wAddress.Page;
+  return NAND_OK;
+}
 
-      /* check if next pages are in next block */
-      if (wAddress.Page == (NAND_BLOCK_SIZE - 1))
-      {
-        /* write Last page  */
-        FSMC_NAND_WriteSmallPage( (uint8_t *)Writebuff , fAddress, PAGE_TO_WRITE);
-        Written_Pages++;
-        if (Written_Pages == SCSI_BlkLen)
-        {
-          Written_Pages = 0;
-        }
-        /* Clean up and Update the LUT */
-        NAND_Write_Cleanup();
-        Write_State = WRITE_IDLE;
-        return NAND_OK;
-      }
+/*******************************************************************************
+* Function Name  : NAND_Read
+* Description    : Read sectors
+* Input          : None
+* Output         : None
+* Return         : Status
+*******************************************************************************/
+uint16_t NAND_Read(uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length)
+{
+  NAND_ADDRESS phAddress;
+  uint16_t Page;
 
-      /* write next page */
-      FSMC_NAND_WriteSmallPage( (uint8_t *)Writebuff , fAddress, PAGE_TO_WRITE);
-      Written_Pages++;
-      if (Written_Pages == SCSI_BlkLen)
-      {
-        Write_State = WRITE_IDLE;
-        NAND_Write_Cleanup();
-        Written_Pages = 0;
-      }
+  for (Page = 0; Page < (Transfer_Length / 512); Page++)
+  {
+    phAddress = NAND_GetAddress((Memory_Offset / 512) + Page);
+    NAND_SelectZone(phAddress.Zone);
 
+    if (LUT [phAddress.Block] & BAD_BLOCK)
+    {
+      return NAND_FAIL;
+    }
+    if ((Open_Block.Zone == phAddress.Zone) && (Open_Block.Logical == phAddress.Block)
+        && (Open_Block.Pages & (1 << phAddress.Page)))
+    {
+      phAddress.Block = Open_Block.New;
     }
     else
-    {/* UNUSED BLOCK */
-      wAddress.Block = phBlock & 0x3FF;
-      /* check if it is the last page in prev block */
-      if (wAddress.Page == (NAND_BLOCK_SIZE - 1))
-      {
-        /* write Last page  */
-        FSMC_NAND_WriteSmallPage( (uint8_t *)Writebuff , wAddress, PAGE_TO_WRITE);
-        Written_Pages++;
-        if (Written_Pages == SCSI_BlkLen)
-        {
-          Written_Pages = 0;
-        }
+    {
+      phAddress.Block = LUT [phAddress.Block] & NAND_BLOCK_MASK;
+    }
+    FSMC_NAND_ReadSmallPage ((uint8_t *)(Readbuff + (Page * (NAND_PAGE_SIZE / 4))), phAddress, 1);
+  }
+  return NAND_OK;
+}
 
-        /* Clean up and Update the LUT */
-        NAND_Write_Cleanup();
-        Write_State = WRITE_IDLE;
+/*******************************************************************************
+* Function Name  : NAND_GetAddress
+* Description    : Translate logical address into a phy one
+* Input          : None
+* Output         : None
+* Return         : Status
+*******************************************************************************/
+static NAND_ADDRESS NAND_GetAddress (uint32_t Address)
+{
+  NAND_ADDRESS Address_t;
 
+  Address_t.Page  = Address & (NAND_BLOCK_SIZE - 1);
+  Address_t.Block = Address / NAND_BLOCK_SIZE;
+  Address_t.Zone = 0;
 
+  while (Address_t.Block >= MAX_LOG_BLOCKS_PER_ZONE)
+  {
+    Address_t.Block -= MAX_LOG_BLOCKS_PER_ZONE;
+    Address_t.Zone++;
+  }
+  return Address_t;
+}
 
-        return NAND_OK;
-      }
-      /* write next page in same block */
-      FSMC_NAND_WriteSmallPage( (uint8_t *)Writebuff , wAddress, PAGE_TO_WRITE);
-      Written_Pages++;
-      if (Written_Pages == SCSI_BlkLen)
-      {
-        Write_State = WRITE_IDLE;
-        NAND_Write_Cleanup();
-        Written_Pages = 0;
-      }
+/*******************************************************************************
+* Function Name  : NAND_GetFreeBlock
+* Description    : Look for the least worn free block for data exchange
+* Input          : Table index of the current zone
+* Output         : None
+* Return         : LUT index of the free block, or -1 if none
+*******************************************************************************/
+static int32_t NAND_GetFreeBlock (int32_t Slot)
+{
+  int32_t Pool, Best = -1;
+
+  for (Pool = 0; Pool < NAND_POOL_SIZE; Pool++)
+  {
+    if ((LUT_Wear[Slot][Pool] != NAND_NO_WEAR)
+        && ((Best < 0) || (LUT_Wear[Slot][Pool] < LUT_Wear[Slot][Best])))
+    {
+      Best = Pool;
     }
   }
-  return NAND_OK;
+  return (Best < 0) ? -1 : (MAX_LOG_BLOCKS_PER_ZONE + Best);
 }
 
 /*******************************************************************************
-* Function Name  : NAND_Read
-* Description    : Read sectors
-* Input          : None
+* Function Name  : NAND_Open
+* Description    : Open a logical block of the current zone for writing. A
+*                  used block gets the least worn free block; an unused one
+*                  is written in place, in its own free block or a less worn
+*                  one, and assigned at once.
+* Input          : Logical address
 * Output         : None
 * Return         : Status
 *******************************************************************************/
-uint16_t NAND_Read(uint32_t Memory_Offset, uint32_t *Readbuff, uint16_t Transfer_Length)
+static uint16_t NAND_Open (NAND_ADDRESS Address)
 {
+  uint16_t tempSpareArea [8];
+  SPARE_AREA SpareArea;
   NAND_ADDRESS phAddress;
+  uint16_t EraseCount, i;
+  int32_t Slot = NAND_FindZone(Address.Zone);
+  int32_t Pool = NAND_GetFreeBlock(Slot);
 
-  phAddress = NAND_GetAddress(Memory_Offset / 512);
+  phAddress.Zone = Address.Zone;
+  phAddress.Page = 0;
 
-  if (phAddress.Zone != CurrentZone)
+  if (LUT[Address.Block] & USED_BLOCK)
   {
-    CurrentZone = phAddress.Zone;
-    NAND_BuildLUT(CurrentZone);
-  }
+    if (Pool < 0)
+    {
+      return NAND_FAIL;
+    }
+    phAddress.Block = LUT[Pool] & NAND_BLOCK_MASK;
+    NAND_Prepare(phAddress);
 
-  if (LUT [phAddress.Block] & BAD_BLOCK)
-  {
-    return NAND_FAIL;
+    /* flag the block as receiving until it is merged */
+    for (i = 0; i < 8; i++)
+    {
+      tempSpareArea [i] = 0xFFFF;
+    }
+    tempSpareArea [0] = 0;
+    phAddress.Page = NAND_RECEIVING_PAGE;
+    FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, phAddress, 1);
+
+    Open_Block.Old  = LUT[Address.Block] & NAND_BLOCK_MASK;
+    Open_Block.Pool = Pool;
   }
   else
   {
-    phAddress.Block = LUT [phAddress.Block] & ~ (USED_BLOCK | VALID_BLOCK);
-    FSMC_NAND_ReadSmallPage ( (uint8_t *)Readbuff , phAddress, Transfer_Length / 512);
+    phAddress.Block = LUT[Address.Block] & NAND_BLOCK_MASK;
+    if (Pool >= 0)
+    {
+      SpareArea = ReadSpareArea(((phAddress.Zone * MAX_PHY_BLOCKS_PER_ZONE) + phAddress.Block) * NAND_BLOCK_SIZE);
+      EraseCount = (SpareArea.EraseCount == 0xFFFF) ? 0 : SpareArea.EraseCount;
+      if (LUT_Wear[Slot][Pool - MAX_LOG_BLOCKS_PER_ZONE] < EraseCount)
+      {
+        /* exchange with the less worn free block */
+        phAddress.Block = LUT[Pool] & NAND_BLOCK_MASK;
+        LUT[Pool] = LUT[Address.Block] & NAND_BLOCK_MASK;
+        LUT_Wear[Slot][Pool - MAX_LOG_BLOCKS_PER_ZONE] = EraseCount;
+      }
+    }
+    NAND_Prepare(phAddress);
+
+    /* assign logical address to the new used block */
+    for (i = 0; i < 8; i++)
+    {
+      tempSpareArea [i] = 0xFFFF;
+    }
+    tempSpareArea [0] = Address.Block | USED_BLOCK;
+    FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, phAddress, 1);
+    LUT[Address.Block] = phAddress.Block | VALID_BLOCK | USED_BLOCK;
+
+    Open_Block.Old = NAND_NO_BLOCK;
   }
+
+  Open_Block.Zone    = Address.Zone;
+  Open_Block.Logical = Address.Block;
+  Open_Block.New     = phAddress.Block;
+  Open_Block.Pages   = 0;
   return NAND_OK;
 }
 
 /*******************************************************************************
-* Function Name  : NAND_CleanLUT
-* Description    : Erase old blocks & rebuild the look up table
-* Input          : None
+* Function Name  : NAND_Merge
+* Description    : Copy up to PageToCopy pages not written yet from the old
+*                  block of the open block. Once all are there, the logical
+*                  block is assigned to the new block and the old one is
+*                  erased and takes its place among the free blocks.
+* Input          : Pages to copy
 * Output         : None
 * Return         : Status
 *******************************************************************************/
-static uint16_t NAND_CleanLUT (uint8_t ZoneNbr)
+static uint16_t NAND_Merge (uint16_t PageToCopy)
 {
-#ifdef WEAR_LEVELLING_SUPPORT
-  uint16_t BlockIdx, LUT_Item;
-#endif
-  /* Rebuild the LUT for the current zone */
-  NAND_BuildLUT (ZoneNbr);
-
-#ifdef WEAR_LEVELLING_SUPPORT
-  /* Wear Leveling : circular use of free blocks */
-  LUT_Item = LUT [BlockIdx]
-             for (BlockIdx == MAX_LOG_BLOCKS_PER_ZONE ; BlockIdx < MAX_LOG_BLOCKS_PER_ZONE + WEAR_DEPTH ; BlockIdx++)
-             {
-               LUT [BlockIdx] = LUT [BlockIdx + 1];
-             }
-             LUT [ MAX_LOG_BLOCKS_PER_ZONE + WEAR_DEPTH - 1] = LUT_Item ;
-#endif
+  NAND_ADDRESS Address_Src, Address_Dest;
+  uint16_t tempSpareArea [8];
+  uint16_t EraseCount, i;
+  int32_t Slot;
 
+  if (Open_Block.Zone == NAND_NO_ZONE)
+  {
+    return NAND_OK;
+  }
+
+  if (Open_Block.Old != NAND_NO_BLOCK)
+  {
+    Address_Src.Zone  = Address_Dest.Zone = Open_Block.Zone;
+    Address_Src.Block = Open_Block.Old;
+    Address_Dest.Block = Open_Block.New;
+
+    for (i = 0; (i < NAND_BLOCK_SIZE) && (PageToCopy > 0); i++)
+    {
+      if (!(Open_Block.Pages & (1 << i)))
+      {
+        Address_Src.Page = Address_Dest.Page = i;
+        NAND_Copy (Address_Src, Address_Dest, 1);
+        Open_Block.Pages |= 1 << i;
+        PageToCopy--;
+      }
+    }
+    if (Open_Block.Pages != NAND_ALL_PAGES)
+    {
+      return NAND_OK;
+    }
+
+    /* assign logical address to new block */
+    for (i = 0; i < 8; i++)
+    {
+      tempSpareArea [i] = 0xFFFF;
+    }
+    tempSpareArea [0] = Open_Block.Logical | USED_BLOCK;
+    Address_Dest.Page = 0;
+    FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, Address_Dest, 1);
+
+    /* erase old block, it replaces the new one among the free blocks */
+    EraseCount = NAND_Erase(Address_Src);
+    Slot = NAND_FindZone(Open_Block.Zone);
+    if (Slot >= 0)
+    {
+      LUT_Table[Slot][Open_Block.Logical] = Open_Block.New | VALID_BLOCK | USED_BLOCK;
+      LUT_Table[Slot][Open_Block.Pool] = Open_Block.Old;
+      LUT_Wear[Slot][Open_Block.Pool - MAX_LOG_BLOCKS_PER_ZONE] = EraseCount;
+    }
+  }
+  Open_Block.Zone = NAND_NO_ZONE;
   return NAND_OK;
 }
 
 /*******************************************************************************
-* Function Name  : NAND_GetAddress
-* Description    : Translate logical address into a phy one
+* Function Name  : NAND_GC
+* Description    : Background work, to be called while the NAND is idle: merge
+*                  NAND_GC_PAGES pages of the open block, so that its old block
+*                  is erased and back among the free blocks before the next
+*                  write needs one.
 * Input          : None
 * Output         : None
-* Return         : Status
+* Return         : 1 while there is work left, else 0
 *******************************************************************************/
-static NAND_ADDRESS NAND_GetAddress (uint32_t Address)
+uint8_t NAND_GC (void)
 {
-  NAND_ADDRESS Address_t;
+  NAND_Merge(NAND_GC_PAGES);
+  return (Open_Block.Zone != NAND_NO_ZONE);
+}
 
-  Address_t.Page  = Address & (NAND_BLOCK_SIZE - 1);
-  Address_t.Block = Address / NAND_BLOCK_SIZE;
-  Address_t.Zone = 0;
+/*******************************************************************************
+* Function Name  : NAND_Erase
+* Description    : Erase a block and write its erase count, incremented, into
+*                  the spare area of its first page
+* Input          : Block address
+* Output         : None
+* Return         : New erase count
+*******************************************************************************/
+static uint16_t NAND_Erase (NAND_ADDRESS Address)
+{
+  uint16_t tempSpareArea [8];
+  uint16_t EraseCount, i;
 
-  while (Address_t.Block >= MAX_LOG_BLOCKS_PER_ZONE)
+  Address.Page = 0;
+  FSMC_NAND_ReadSpareArea((uint8_t *)tempSpareArea, Address, 1);
+  EraseCount = (tempSpareArea [3] == 0xFFFF) ? 0 : tempSpareArea [3];
+  if (EraseCount < NAND_MAX_ERASE_COUNT)
   {
-    Address_t.Block -= MAX_LOG_BLOCKS_PER_ZONE;
-    Address_t.Zone++;
+    EraseCount++;
   }
-  return Address_t;
+
+  FSMC_NAND_EraseBlock(Address);
+  for (i = 0; i < 8; i++)
+  {
+    tempSpareArea [i] = 0xFFFF;
+  }
+  tempSpareArea [3] = EraseCount;
+  FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, Address, 1);
+  return EraseCount;
 }
 
 /*******************************************************************************
-* Function Name  : NAND_GetFreeBlock
-* Description    : Look for a free block for data exchange
-* Input          : None
+* Function Name  : NAND_Prepare
+* Description    : Erase a free block left receiving by a reset before its
+*                  merge, its pages are not blank
+* Input          : Block address
 * Output         : None
-* Return         : Status
+* Return         : None
+*******************************************************************************/
+static void NAND_Prepare (NAND_ADDRESS Address)
+{
+  uint16_t tempSpareArea [8];
+
+  Address.Page = NAND_RECEIVING_PAGE;
+  FSMC_NAND_ReadSpareArea((uint8_t *)tempSpareArea, Address, 1);
+  if (tempSpareArea [0] != 0xFFFF)
+  {
+    NAND_Erase(Address);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : NAND_LoadWear
+* Description    : Read the erase counts of the free blocks of a zone table
+*                  just built or loaded
+* Input          : Table index
+* Output         : None
+* Return         : None
 *******************************************************************************/
-static uint16_t NAND_GetFreeBlock (void)
+static void NAND_LoadWear (int32_t Slot)
 {
-  return LUT[MAX_LOG_BLOCKS_PER_ZONE]& ~(USED_BLOCK | VALID_BLOCK);
+  uint16_t *Table = LUT_Table[Slot];
+  uint32_t Assigned[MAX_PHY_BLOCKS_PER_ZONE / 32];
+  SPARE_AREA SpareArea;
+  uint16_t pBlock, Pool;
+
+  for (pBlock = 0; pBlock < (MAX_PHY_BLOCKS_PER_ZONE / 32); pBlock++)
+  {
+    Assigned[pBlock] = 0;
+  }
+  for (pBlock = 0; pBlock < MAX_LOG_BLOCKS_PER_ZONE; pBlock++)
+  {
+    Assigned[(Table[pBlock] & NAND_BLOCK_MASK) / 32] |= 1 << (Table[pBlock] & 31);
+  }
+
+  /* The end of the table holds the free blocks left, then the bad blocks */
+  for (Pool = 0; Pool < NAND_POOL_SIZE; Pool++)
+  {
+    LUT_Wear[Slot][Pool] = NAND_NO_WEAR;
+    pBlock = Table[MAX_LOG_BLOCKS_PER_ZONE + Pool] & NAND_BLOCK_MASK;
+    if ((Table[MAX_LOG_BLOCKS_PER_ZONE + Pool] & (BAD_BLOCK | USED_BLOCK))
+        || (Assigned[pBlock / 32] & (1 << (pBlock & 31)))
+        || ((LUT_Zone[Slot] == NAND_CKPT_ZONE) && (pBlock >= NAND_CKPT_FIRST_BLOCK)))
+    {
+      continue;
+    }
+    Assigned[pBlock / 32] |= 1 << (pBlock & 31);
+
+    SpareArea = ReadSpareArea(((LUT_Zone[Slot] * MAX_PHY_BLOCKS_PER_ZONE) + pBlock) * NAND_BLOCK_SIZE);
+    if ((SpareArea.LogicalIndex == 0xFFFF) && (SpareArea.DataStatus != 0) && (SpareArea.BlockStatus != 0))
+    {
+      LUT_Wear[Slot][Pool] = (SpareArea.EraseCount == 0xFFFF) ? 0 : SpareArea.EraseCount;
+    }
+  }
 }
 
 /*******************************************************************************
@@ -386,68 +577,346 @@ uint16_t NAND_Format (void)
     SpareArea = ReadSpareArea(BlockIndex * NAND_BLOCK_SIZE);
    
     if((SpareArea.DataStatus != 0)||(SpareArea.BlockStatus != 0)){
-        FSMC_NAND_EraseBlock (phAddress);
+        NAND_Erase (phAddress);
     }  
   }
-  NAND_BuildLUT(0);
+  NAND_Mount();
+  return NAND_SelectZone(0);
+}
+
+/*******************************************************************************
+* Function Name  : NAND_Sync
+* Description    : Merge the open block, then write a checkpoint of the look
+*                  up tables of all zones into the reserved block that does
+*                  not hold the valid one, so that the next mount loads them
+*                  instead of scanning the spare areas. No checkpoint is
+*                  written if no zone changed.
+* Input          : None
+* Output         : None
+* Return         : Status
+*******************************************************************************/
+uint16_t NAND_Sync (void)
+{
+  NAND_CKPT_HEADER *Header = (NAND_CKPT_HEADER *)Ckpt_Page;
+  uint16_t tempSpareArea [8];
+  uint16_t Sum[NAND_MAX_ZONE];
+  uint16_t Zone, SavedZone = CurrentZone;
+  uint8_t Block;
+  int32_t Slot;
+  uint32_t i;
+
+  NAND_Merge(NAND_BLOCK_SIZE);
+  if (Ckpt_Stale == 0)
+  {
+    return NAND_OK;
+  }
+
+  /* Prefer the other block to keep the valid checkpoint until this one is done */
+  for (Block = 0; Block < NAND_CKPT_BLOCKS; Block++)
+  {
+    if ((Ckpt_Usable & (1 << Block)) && (Block != Ckpt_Block))
+    {
+      break;
+    }
+  }
+  if (Block == NAND_CKPT_BLOCKS)
+  {
+    if (Ckpt_Block == NAND_NO_CKPT)
+    {
+      return NAND_FAIL;
+    }
+    Block = Ckpt_Block;
+  }
+
+  if (FSMC_NAND_EraseBlock(NAND_CkptAddress(Block, 0)) != NAND_READY)
+  {
+    Ckpt_Usable &= ~(1 << Block);
+    return NAND_FAIL;
+  }
+  if (Block == Ckpt_Block)
+  {
+    Ckpt_Block = NAND_NO_CKPT;
+  }
+  for (i = 0; i < 8; i++)
+  {
+    tempSpareArea [i] = 0xFFFF;
+  }
+  tempSpareArea [0] = NAND_CKPT_MARK;
+  FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, NAND_CkptAddress(Block, 0), 1);
+
+  for (Zone = 0; Zone < NAND_MAX_ZONE; Zone++)
+  {
+    Slot = NAND_FindZone(Zone);
+    if ((Slot < 0) && !(Ckpt_Stale & (1 << Zone)) && (Ckpt_Block != NAND_NO_CKPT))
+    {
+      /* Unchanged and not in RAM: copy it from the valid checkpoint */
+      NAND_Copy(NAND_CkptAddress(Ckpt_Block, Zone * NAND_CKPT_ZONE_PAGES),
+                NAND_CkptAddress(Block, Zone * NAND_CKPT_ZONE_PAGES), NAND_CKPT_ZONE_PAGES);
+      Sum[Zone] = Ckpt_Sum[Zone];
+      continue;
+    }
+    if (Slot < 0)
+    {
+      NAND_SelectZone(Zone);
+      Slot = NAND_FindZone(Zone);
+    }
+    Sum[Zone] = NAND_TableSum(LUT_Table[Slot]);
+    FSMC_NAND_WriteSmallPage((uint8_t *)LUT_Table[Slot],
+                             NAND_CkptAddress(Block, Zone * NAND_CKPT_ZONE_PAGES), NAND_CKPT_ZONE_PAGES);
+  }
+
+  /* The header goes last: a checkpoint without header is ignored */
+  for (i = 0; i < (NAND_PAGE_SIZE / 4); i++)
+  {
+    Ckpt_Page[i] = 0xFFFFFFFF;
+  }
+  Header->Magic = NAND_CKPT_MAGIC;
+  Header->Sequence = Ckpt_Sequence + 1;
+  Header->Zones = NAND_MAX_ZONE;
+  Header->Blocks = MAX_PHY_BLOCKS_PER_ZONE;
+  for (Zone = 0; Zone < NAND_MAX_ZONE; Zone++)
+  {
+    Header->Sum[Zone] = Ckpt_Sum[Zone] = Sum[Zone];
+  }
+  if (!(FSMC_NAND_WriteSmallPage((uint8_t *)Ckpt_Page, NAND_CkptAddress(Block, NAND_CKPT_HEADER_PAGE), 1) & NAND_READY))
+  {
+    return NAND_FAIL;
+  }
+
+  Ckpt_Block = Block;
+  Ckpt_Sequence++;
+  Ckpt_Stale = 0;
+
+  if (SavedZone != NAND_NO_ZONE)
+  {
+    NAND_SelectZone(SavedZone);
+  }
   return NAND_OK;
 }
 
 /*******************************************************************************
-* Function Name  : NAND_Write_Cleanup
-* Description    : None
+* Function Name  : NAND_Mount
+* Description    : Find the newest valid checkpoint in the reserved blocks and
+*                  drop the zone tables kept in RAM.
 * Input          : None
 * Output         : None
+* Return         : None
+*******************************************************************************/
+static void NAND_Mount (void)
+{
+  NAND_CKPT_HEADER *Header = (NAND_CKPT_HEADER *)Ckpt_Page;
+  uint16_t tempSpareArea [8];
+  SPARE_AREA SpareArea;
+  uint16_t Zone;
+  uint8_t Block, Stale;
+
+  for (Block = 0; Block < NAND_LUT_ZONES; Block++)
+  {
+    LUT_Zone[Block] = NAND_NO_ZONE;
+    LUT_Age[Block] = 0;
+  }
+  LUT = 0;
+  CurrentZone = NAND_NO_ZONE;
+  Open_Block.Zone = NAND_NO_ZONE;
+
+  Ckpt_Block = NAND_NO_CKPT;
+  Ckpt_Usable = 0;
+  Ckpt_Stale = NAND_ALL_ZONES;
+
+  for (Block = 0; Block < NAND_CKPT_BLOCKS; Block++)
+  {
+    SpareArea = ReadSpareArea(((NAND_CKPT_ZONE * MAX_PHY_BLOCKS_PER_ZONE) + NAND_CKPT_FIRST_BLOCK + Block) * NAND_BLOCK_SIZE);
+    if ((SpareArea.DataStatus == 0) || (SpareArea.BlockStatus == 0))
+    {
+      continue;
+    }
+    if (SpareArea.LogicalIndex == 0xFFFF)
+    {
+      Ckpt_Usable |= 1 << Block;
+      continue;
+    }
+    if (SpareArea.LogicalIndex != NAND_CKPT_MARK)
+    {
+      /* Data block written before the blocks were reserved */
+      continue;
+    }
+    Ckpt_Usable |= 1 << Block;
+
+    FSMC_NAND_ReadSmallPage((uint8_t *)Ckpt_Page, NAND_CkptAddress(Block, NAND_CKPT_HEADER_PAGE), 1);
+    if ((Header->Magic != NAND_CKPT_MAGIC) || (Header->Zones != NAND_MAX_ZONE)
+        || (Header->Blocks != MAX_PHY_BLOCKS_PER_ZONE))
+    {
+      continue;
+    }
+    if ((Ckpt_Block != NAND_NO_CKPT) && ((int32_t)(Header->Sequence - Ckpt_Sequence) <= 0))
+    {
+      continue;
+    }
+    Ckpt_Sequence = Header->Sequence;
+
+    /* The zones written since this checkpoint have their stale page marked */
+    Stale = 0;
+    for (Zone = 0; Zone < NAND_MAX_ZONE; Zone++)
+    {
+      Ckpt_Sum[Zone] = Header->Sum[Zone];
+      FSMC_NAND_ReadSpareArea((uint8_t *)tempSpareArea, NAND_CkptAddress(Block, NAND_CKPT_STALE_PAGE(Zone)), 1);
+      if (tempSpareArea [0] != 0xFFFF)
+      {
+        Stale |= 1 << Zone;
+      }
+    }
+    Ckpt_Block = Block;
+    Ckpt_Stale = Stale;
+  }
+}
+
+/*******************************************************************************
+* Function Name  : NAND_FindZone
+* Description    : Look for the table of a zone among the tables kept in RAM
+* Input          : Zone number
+* Output         : None
+* Return         : Table index, or -1 if the zone table is not in RAM
+*******************************************************************************/
+static int32_t NAND_FindZone (uint16_t ZoneNbr)
+{
+  int32_t Slot;
+
+  for (Slot = 0; Slot < NAND_LUT_ZONES; Slot++)
+  {
+    if (LUT_Zone[Slot] == ZoneNbr)
+    {
+      return Slot;
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************
+* Function Name  : NAND_SelectZone
+* Description    : Make LUT point to the table of a zone. A table not in RAM
+*                  replaces the least recently used one and is read from the
+*                  checkpoint when the zone has not changed since, else built
+*                  by NAND_BuildLUT(); the erase counts of its free blocks are
+*                  then read.
+* Input          : Zone number
+* Output         : None
 * Return         : Status
 *******************************************************************************/
-static uint16_t NAND_Write_Cleanup (void)
+static uint16_t NAND_SelectZone (uint16_t ZoneNbr)
 {
-  uint16_t  tempSpareArea [8];
-  uint16_t  Page_Back;
+  uint16_t Status;
+  int32_t Slot, i;
+
+  if (ZoneNbr == CurrentZone)
+  {
+    return NAND_OK;
+  }
 
-  if ( Block_State == OLD_BLOCK )
+  Slot = NAND_FindZone(ZoneNbr);
+  if (Slot >= 0)
   {
-    /* precopy old first pages */
-    if (Initial_Page != 0)
+    LUT = LUT_Table[Slot];
+    LUT_Age[Slot] = ++LUT_Clock;
+    CurrentZone = ZoneNbr;
+    return NAND_OK;
+  }
+
+  Slot = 0;
+  for (i = 1; i < NAND_LUT_ZONES; i++)
+  {
+    if (LUT_Age[i] < LUT_Age[Slot])
     {
-      Page_Back = wAddress.Page;
-      fAddress.Page = wAddress.Page = 0;
-      NAND_Copy (wAddress, fAddress, Initial_Page);
-      wAddress.Page =  Page_Back ;
+      Slot = i;
     }
+  }
+  if (LUT_Zone[Slot] == Open_Block.Zone)
+  {
+    /* The open block needs its zone table until merged */
+    NAND_Merge(NAND_BLOCK_SIZE);
+  }
+  LUT = LUT_Table[Slot];
+  LUT_Zone[Slot] = ZoneNbr;
+  LUT_Age[Slot] = ++LUT_Clock;
+  CurrentZone = ZoneNbr;
 
-    /* postcopy remaining pages */
-    if ((NAND_BLOCK_SIZE - (wAddress.Page + 1)) != 0)
+  if ((ZoneNbr < NAND_MAX_ZONE) && !(Ckpt_Stale & (1 << ZoneNbr)) && (Ckpt_Block != NAND_NO_CKPT))
+  {
+    FSMC_NAND_ReadSmallPage((uint8_t *)LUT, NAND_CkptAddress(Ckpt_Block, ZoneNbr * NAND_CKPT_ZONE_PAGES), NAND_CKPT_ZONE_PAGES);
+    if (NAND_TableSum(LUT) == Ckpt_Sum[ZoneNbr])
     {
-      FSMC_NAND_AddressIncrement(&wAddress);
-      fAddress.Page = wAddress.Page;
-      NAND_Copy (wAddress, fAddress, NAND_BLOCK_SIZE - wAddress.Page);
+      NAND_LoadWear(Slot);
+      return NAND_OK;
     }
+  }
+  Status = NAND_BuildLUT(ZoneNbr);
+  NAND_LoadWear(Slot);
+  return Status;
+}
 
-    /* assign logical address to new block */
-    tempSpareArea [0] = LogAddress | USED_BLOCK ;
-    tempSpareArea [1] = 0xFFFF;
-    tempSpareArea [2] = 0xFFFF;
+/*******************************************************************************
+* Function Name  : NAND_MarkStale
+* Description    : Record that the table of a zone is about to change: the
+*                  checkpoint copy must no longer be used, even after a reset.
+* Input          : Zone number
+* Output         : None
+* Return         : None
+*******************************************************************************/
+static void NAND_MarkStale (uint16_t ZoneNbr)
+{
+  uint16_t tempSpareArea [8];
+  uint32_t i;
 
-    fAddress.Page     = 0x00;
-    FSMC_NAND_WriteSpareArea( (uint8_t *)tempSpareArea , fAddress , 1);
+  if ((ZoneNbr >= NAND_MAX_ZONE) || (Ckpt_Stale & (1 << ZoneNbr)))
+  {
+    return;
+  }
+  Ckpt_Stale |= 1 << ZoneNbr;
 
-    /* erase old block */
-    FSMC_NAND_EraseBlock(wAddress);
-    NAND_CleanLUT(wAddress.Zone);
+  if (Ckpt_Block != NAND_NO_CKPT)
+  {
+    for (i = 0; i < 8; i++)
+    {
+      tempSpareArea [i] = 0xFFFF;
+    }
+    tempSpareArea [0] = 0;
+    FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea, NAND_CkptAddress(Ckpt_Block, NAND_CKPT_STALE_PAGE(ZoneNbr)), 1);
   }
-  else
-  {/* unused block case */
-    /* assign logical address to the new used block */
-    tempSpareArea [0] = LogAddress | USED_BLOCK ;
-    tempSpareArea [1] = 0xFFFF;
-    tempSpareArea [2] = 0xFFFF;
+}
 
-    wAddress.Page     = 0x00;
-    FSMC_NAND_WriteSpareArea((uint8_t *)tempSpareArea , wAddress, 1);
-    NAND_CleanLUT(wAddress.Zone);
+/*******************************************************************************
+* Function Name  : NAND_TableSum
+* Description    : Checksum of a zone look up table
+* Input          : Table
+* Output         : None
+* Return         : Checksum
+*******************************************************************************/
+static uint16_t NAND_TableSum (uint16_t *Table)
+{
+  uint16_t Sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < MAX_PHY_BLOCKS_PER_ZONE; i++)
+  {
+    Sum = (uint16_t)(((Sum << 1) | (Sum >> 15)) + Table[i]);
   }
-  return NAND_OK;
+  return Sum;
+}
+
+/*******************************************************************************
+* Function Name  : NAND_CkptAddress
+* Description    : Address of a page of a checkpoint block
+* Input          : Checkpoint block (0 to NAND_CKPT_BLOCKS - 1), page
+* Output         : None
+* Return         : Address
+*******************************************************************************/
+static NAND_ADDRESS NAND_CkptAddress (uint8_t Block, uint16_t Page)
+{
+  NAND_ADDRESS Address_t;
+
+  Address_t.Zone  = NAND_CKPT_ZONE;
+  Address_t.Block = NAND_CKPT_FIRST_BLOCK + Block;
+  Address_t.Page  = Page;
+  return Address_t;
 }
 
 /*******************************************************************************
@@ -518,6 +987,12 @@ static uint16_t NAND_BuildLUT (uint8_t ZoneNbr)
         return NAND_FAIL;
       }
     }
+    else if ((ZoneNbr == NAND_CKPT_ZONE) && (pCurrentBlock >= NAND_CKPT_FIRST_BLOCK)
+             && ((SpareArea.LogicalIndex == 0xFFFF) || (SpareArea.LogicalIndex == NAND_CKPT_MARK)))
+    {
+      /* Checkpoint block: out of the free blocks */
+      LUT[pCurrentBlock] &= (uint16_t)( ~FREE_BLOCK);
+    }
     else if (SpareArea.LogicalIndex != 0xFFFF)
     {
 
@@ -76,7 +76,7 @@ void Mass_Storage_In (void)
       switch (CBW.CB[0])
       {
         case SCSI_READ10:
-          SCSI_Read10_Cmd(CBW.bLUN , SCSI_LBA , SCSI_BlkLen);
+          Read_Memory_In();
           break;
       }
       break;
@@ -102,6 +102,13 @@ void Mass_Storage_Out (void)
   uint8_t CMD;
   CMD = CBW.CB[0];
 
+  if ((Bot_State == BOT_DATA_OUT) && (CMD == SCSI_WRITE10))
+  {
+    /* WRITE(10) data: the packet goes straight to its block buffer */
+    Write_Memory_Out();
+    return;
+  }
+
   Data_Len = USB_SIL_Read(EP2_OUT, Bulk_Data_Buff);
 
   switch (Bot_State)
@@ -110,11 +117,6 @@ void Mass_Storage_Out (void)
       CBW_Decode();
       break;
     case BOT_DATA_OUT:
-      if (CMD == SCSI_WRITE10)
-      {
-        SCSI_Write10_Cmd(CBW.bLUN , SCSI_LBA , SCSI_BlkLen);
-        break;
-      }
       Bot_Abort(DIR_OUT);
       Set_Scsi_Sense_Data(CBW.bLUN, ILLEGAL_REQUEST, INVALID_FIELED_IN_COMMAND);
       Set_CSW (CSW_PHASE_ERROR, SEND_CSW_DISABLE);
@@ -253,6 +255,9 @@ void CBW_Decode(void)
         case SCSI_VERIFY16:
           SCSI_Verify16_Cmd(CBW.bLUN);
           break;
+        case SCSI_SYNCHRONIZE_CACHE10:
+          SCSI_Synchronize_Cache_Cmd(CBW.bLUN);
+          break;
 
         default:
         {
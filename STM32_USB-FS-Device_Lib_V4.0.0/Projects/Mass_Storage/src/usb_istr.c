@@ -79,6 +79,7 @@ void (*pEpInt_OUT[7])(void) =
 void USB_Istr(void)
 {
   wIstr = _GetISTR();
+  USB_TRACE_EVENT(USB_TRACE_ISR_ENTER, 0, wIstr);
 
 #if (IMR_MSK & ISTR_CTR)
   if (wIstr & ISTR_CTR & wInterrupt_Mask)
@@ -97,6 +98,7 @@ void USB_Istr(void)
   {
     _SetISTR((uint16_t)CLR_RESET);
     Device_Property.Reset();
+    USB_TRACE_EVENT(USB_TRACE_RESET, 0, 0);
 #ifdef RESET_CALLBACK
     RESET_Callback();
 #endif
@@ -128,6 +130,7 @@ void USB_Istr(void)
   {
     _SetISTR((uint16_t)CLR_WKUP);
     Resume(RESUME_EXTERNAL);
+    USB_TRACE_EVENT(USB_TRACE_WKUP, 0, 0);
 #ifdef WKUP_CALLBACK
     WKUP_Callback();
 #endif
@@ -150,6 +153,7 @@ void USB_Istr(void)
     }
     /* clear of the ISTR bit must be done after setting of CNTR_FSUSP */
     _SetISTR((uint16_t)CLR_SUSP);
+    USB_TRACE_EVENT(USB_TRACE_SUSP, 0, 0);
 #ifdef SUSP_CALLBACK
     SUSP_Callback();
 #endif
@@ -161,6 +165,7 @@ void USB_Istr(void)
   {
     _SetISTR((uint16_t)CLR_SOF);
     bIntPackSOF++;
+    USB_TRACE_EVENT(USB_TRACE_SOF, 0, _GetFNR() & FNR_FN);
 
 #ifdef SOF_CALLBACK
     SOF_Callback();
@@ -180,6 +185,7 @@ void USB_Istr(void)
 #endif
   }
 #endif
+  USB_TRACE_EVENT(USB_TRACE_ISR_EXIT, 0, 0);
 } /* USB_Istr */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
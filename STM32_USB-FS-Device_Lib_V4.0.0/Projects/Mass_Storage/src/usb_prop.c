@@ -34,6 +34,7 @@
 #include "usb_bot.h"
 #include "memory.h"
 #include "mass_mal.h"
+#include "mass_vdisk.h"
 #include "usb_prop.h"
 
 /* Private typedef -----------------------------------------------------------*/
@@ -42,6 +43,8 @@
 /* Private variables ---------------------------------------------------------*/
 #if defined (USE_STM3210E_EVAL)
 uint32_t Max_Lun = 1;
+#elif defined (VDISK_LUN)
+uint32_t Max_Lun = VDISK_LUN;
 #else
 uint32_t Max_Lun = 0;
 #endif
@@ -142,32 +145,42 @@ void MASS_init()
 *******************************************************************************/
 void MASS_Reset()
 {
+  uint32_t Status;
+
   /* Set the device as not configured */
   Device_Info.Current_Configuration = 0;
 
   /* Current Feature initialization */
   pInformation->Current_Feature = MASS_ConfigDescriptor[7];
 
-  SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  if (Status == USB_SUCCESS)
+  {
+    Status = USB_PMA_ConfigEndpoints(MASS_ConfigDescriptor, 0);
+  }
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
 
   /* Initialize Endpoint 0 */
   SetEPType(ENDP0, EP_CONTROL);
   SetEPTxStatus(ENDP0, EP_TX_NAK);
-  SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
-  SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   Clear_Status_Out(ENDP0);
   SetEPRxValid(ENDP0);
 
   /* Initialize Endpoint 1 */
   SetEPType(ENDP1, EP_BULK);
-  SetEPTxAddr(ENDP1, ENDP1_TXADDR);
   SetEPTxStatus(ENDP1, EP_TX_NAK);
   SetEPRxStatus(ENDP1, EP_RX_DIS);
 
   /* Initialize Endpoint 2 */
   SetEPType(ENDP2, EP_BULK);
-  SetEPRxAddr(ENDP2, ENDP2_RXADDR);
   SetEPRxCount(ENDP2, Device_Property.MaxPacketSize);
   SetEPRxStatus(ENDP2, EP_RX_VALID);
   SetEPTxStatus(ENDP2, EP_TX_DIS);
@@ -33,6 +33,7 @@
 #include "usb_bot.h"
 #include "usb_regs.h"
 #include "memory.h"
+#include "mass_cache.h"
 #include "platform_config.h"
 #include "usb_lib.h"
 
@@ -44,6 +45,9 @@
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+/* Cache flush of the SYNCHRONIZE CACHE command: the CSW waits for it */
+static MAL_Request_TypeDef Sync_Request;
+
 /* External variables --------------------------------------------------------*/
 extern uint8_t Bulk_Data_Buff[BULK_MAX_PACKET_SIZE];  /* data buffer*/
 extern uint8_t Bot_State;
@@ -54,6 +58,8 @@ extern uint32_t Mass_Block_Size[2];
 extern uint32_t Mass_Block_Count[2];
 
 /* Private function prototypes -----------------------------------------------*/
+static void SCSI_Synchronize_Cache_Done(MAL_Request_TypeDef *Request);
+
 /* Private functions ---------------------------------------------------------*/
 
 /*******************************************************************************
@@ -209,13 +215,56 @@ void Set_Scsi_Sense_Data(uint8_t lun, uint8_t Sens_Key, uint8_t Asc)
 
 /*******************************************************************************
 * Function Name  : SCSI_Start_Stop_Unit_Cmd
-* Description    : SCSI Start_Stop_Unit Command routine.
+* Description    : SCSI Start_Stop_Unit Command routine: the cached writes are
+*                  flushed, the media may be removed next.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void SCSI_Start_Stop_Unit_Cmd(uint8_t lun)
 {
+  SCSI_Synchronize_Cache_Cmd(lun);
+}
+
+/*******************************************************************************
+* Function Name  : SCSI_Synchronize_Cache_Cmd
+* Description    : SCSI Synchronize_Cache Command routine: write the cached
+*                  blocks to the media, then checkpoint the media state. The
+*                  blocks are written from the main loop, the CSW is sent by
+*                  SCSI_Synchronize_Cache_Done().
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void SCSI_Synchronize_Cache_Cmd(uint8_t lun)
+{
+  Sync_Request.Lun = lun;
+  Sync_Request.Complete = SCSI_Synchronize_Cache_Done;
+  if (Cache_SubmitFlush(&Sync_Request) != MAL_OK)
+  {
+    Set_Scsi_Sense_Data(lun, MEDIUM_ERROR, WRITE_ERROR);
+    Set_CSW (CSW_CMD_FAILED, SEND_CSW_ENABLE);
+  }
+}
+
+/*******************************************************************************
+* Function Name  : SCSI_Synchronize_Cache_Done
+* Description    : Completion of the cache flush of SCSI_Synchronize_Cache_Cmd(),
+*                  from the endpoint routine or from Cache_Poll() with the USB
+*                  interrupt masked: send the CSW.
+* Input          : - Request: the flush request.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void SCSI_Synchronize_Cache_Done(MAL_Request_TypeDef *Request)
+{
+  if (Request->Status != MAL_OK)
+  {
+    Set_Scsi_Sense_Data(Request->Lun, MEDIUM_ERROR, WRITE_ERROR);
+    Set_CSW (CSW_CMD_FAILED, SEND_CSW_ENABLE);
+    return;
+  }
+  MAL_Sync(Request->Lun);
   Set_CSW (CSW_CMD_PASSED, SEND_CSW_ENABLE);
 }
 
@@ -237,6 +286,7 @@ void SCSI_Read10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr)
 
     if ((CBW.bmFlags & 0x80) != 0)
     {
+      /* The data packets are then sent by Read_Memory_In() */
       Bot_State = BOT_DATA_IN;
       Read_Memory(lun, LBA , BlockNbr);
     }
@@ -246,11 +296,6 @@ void SCSI_Read10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr)
       Set_Scsi_Sense_Data(CBW.bLUN, ILLEGAL_REQUEST, INVALID_FIELED_IN_COMMAND);
       Set_CSW (CSW_CMD_FAILED, SEND_CSW_ENABLE);
     }
-    return;
-  }
-  else if (Bot_State == BOT_DATA_IN)
-  {
-    Read_Memory(lun , LBA , BlockNbr);
   }
 }
 
@@ -272,7 +317,9 @@ void SCSI_Write10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr)
 
     if ((CBW.bmFlags & 0x80) == 0)
     {
+      /* The data packets are then received by Write_Memory_Out() */
       Bot_State = BOT_DATA_OUT;
+      Write_Memory(lun, LBA , BlockNbr);
       SetEPRxStatus(ENDP2, EP_RX_VALID);
     }
     else
@@ -281,11 +328,6 @@ void SCSI_Write10_Cmd(uint8_t lun , uint32_t LBA , uint32_t BlockNbr)
       Set_Scsi_Sense_Data(CBW.bLUN, ILLEGAL_REQUEST, INVALID_FIELED_IN_COMMAND);
       Set_CSW (CSW_CMD_FAILED, SEND_CSW_DISABLE);
     }
-    return;
-  }
-  else if (Bot_State == BOT_DATA_OUT)
-  {
-    Write_Memory(lun , LBA , BlockNbr);
   }
 }
 
@@ -367,6 +409,7 @@ void SCSI_Format_Cmd(uint8_t lun)
 #ifdef USE_STM3210E_EVAL
   else
   {
+    Cache_Invalidate(lun);
     NAND_Format();
     Set_CSW (CSW_CMD_PASSED, SEND_CSW_ENABLE);
   }
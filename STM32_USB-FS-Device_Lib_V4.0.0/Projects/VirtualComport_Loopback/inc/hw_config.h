@@ -43,6 +43,8 @@
 #define LED_ON                0xF0
 #define LED_OFF               0xFF
 
+#define LOOPBACK_QUEUE_SIZE   8     /* echo queue, packets, power of two */
+
 /* Exported functions ------------------------------------------------------- */
 void Set_System(void);
 void Set_USBClock(void);
@@ -52,8 +54,10 @@ void USB_Interrupts_Config(void);
 void USB_Cable_Config (FunctionalState NewState);
 void Get_SerialNum(void);
 void LCD_Control(void);
-uint32_t CDC_Send_DATA (uint8_t *ptrBuffer, uint8_t Send_length);
-uint32_t CDC_Receive_DATA(void);
+void Loopback_Init(void);
+void Loopback_Receive(void);
+void Loopback_Transmit(void);
+void Loopback_Sent(void);
 /* External variables --------------------------------------------------------*/
 
 #endif  /*__HW_CONFIG_H*/
@@ -40,14 +40,16 @@
 /* Private variables ---------------------------------------------------------*/
 ErrorStatus HSEStartUpStatus;
 EXTI_InitTypeDef EXTI_InitStructure;
-extern __IO uint32_t packet_sent;
-extern __IO uint8_t Send_Buffer[VIRTUAL_COM_PORT_DATA_SIZE] ;
-extern __IO  uint32_t packet_receive;
-extern __IO uint8_t Receive_length;
 
-uint8_t Receive_Buffer[64];
-uint32_t Send_length;
+/* Echo queue: the OUT packets not yet written to an IN buffer. Word aligned
+   for the PMA copy routines */
+static uint32_t Loopback_Buffer[LOOPBACK_QUEUE_SIZE][VIRTUAL_COM_PORT_DATA_SIZE / 4];
+static uint16_t Loopback_Length[LOOPBACK_QUEUE_SIZE];
+static uint32_t Loopback_Head;          /* packets received        */
+static uint32_t Loopback_Tail;          /* packets written to IN   */
+static uint8_t  Loopback_Out_Held;      /* OUT packet not acquired */
 static void IntToUnicode (uint32_t value , uint8_t *pbuf , uint8_t len);
+static void Loopback_Queue (void);
 /* Extern variables ----------------------------------------------------------*/
 
 extern LINE_CODING linecoding;
@@ -336,44 +338,113 @@ static void IntToUnicode (uint32_t value , uint8_t *pbuf , uint8_t len)
 }
 
 /*******************************************************************************
-* Function Name  : Send DATA .
-* Description    : send the data received from the STM32 to the PC through USB  
+* Function Name  : Loopback_Init.
+* Description    : empty the echo queue, to be called on USB reset once the
+*                  double-buffered endpoints are set up by USB_SIL_DblBufInit.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
-uint32_t CDC_Send_DATA (uint8_t *ptrBuffer, uint8_t Send_length)
+void Loopback_Init(void)
 {
-  /*if max buffer is Not reached*/
-  if(Send_length < VIRTUAL_COM_PORT_DATA_SIZE)     
+  Loopback_Head = 0;
+  Loopback_Tail = 0;
+  Loopback_Out_Held = 0;
+}
+
+/*******************************************************************************
+* Function Name  : Loopback_Receive.
+* Description    : queue the packet received on the OUT endpoint and echo it,
+*                  to be called from the OUT endpoint callback. The other OUT
+*                  buffer goes back to the USB right away, so the host can
+*                  send the next packet while this one is echoed, unless the
+*                  queue has no room left: then the packet stays in its buffer
+*                  and the OUT endpoint NAKs till Loopback_Transmit() makes
+*                  room.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Loopback_Receive(void)
+{
+  if ((Loopback_Head - Loopback_Tail) < LOOPBACK_QUEUE_SIZE)
   {
-    /*Sent flag*/
-    packet_sent = 0;
-    /* send  packet to PMA*/
-    UserToPMABufferCopy((unsigned char*)ptrBuffer, ENDP1_TXADDR, Send_length);
-    SetEPTxCount(ENDP1, Send_length);
-    SetEPTxValid(ENDP1);
+    Loopback_Queue();
   }
   else
   {
-    return 0;
-  } 
-  return 1;
+    Loopback_Out_Held = 1;
+  }
+
+  Loopback_Transmit();
+}
+
+/*******************************************************************************
+* Function Name  : Loopback_Queue.
+* Description    : copy the received OUT packet into the echo queue.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void Loopback_Queue(void)
+{
+  USB_SIL_PMABuf_TypeDef Reader;
+  uint16_t wLength;
+
+  wLength = USB_SIL_DblBufReadAcquire(EP3_OUT, &Reader);
+  USB_SIL_ReadData(&Reader, (uint8_t *)Loopback_Buffer[Loopback_Head & (LOOPBACK_QUEUE_SIZE - 1)], wLength);
+  Loopback_Length[Loopback_Head & (LOOPBACK_QUEUE_SIZE - 1)] = wLength;
+  Loopback_Head++;
+}
+
+/*******************************************************************************
+* Function Name  : Loopback_Transmit.
+* Description    : move the queued packets to the IN endpoint: one buffer is
+*                  written while the USB sends the other. Packets keep their
+*                  length, so a short or zero length packet ending an OUT
+*                  transfer also ends its echo. To be called from the endpoint
+*                  callbacks.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void Loopback_Transmit(void)
+{
+  USB_SIL_PMABuf_TypeDef Writer;
+
+  while (Loopback_Tail != Loopback_Head)
+  {
+    /* Both IN buffers are filled: the IN callback frees one */
+    if (USB_SIL_DblBufWriteReserve(EP1_IN, &Writer, VIRTUAL_COM_PORT_DATA_SIZE) != 0)
+    {
+      break;
+    }
+    USB_SIL_WriteData(&Writer, (uint8_t *)Loopback_Buffer[Loopback_Tail & (LOOPBACK_QUEUE_SIZE - 1)],
+                      Loopback_Length[Loopback_Tail & (LOOPBACK_QUEUE_SIZE - 1)]);
+    USB_SIL_DblBufWriteCommit(&Writer);
+    Loopback_Tail++;
+
+    /* The queue has room again for the held OUT packet */
+    if (Loopback_Out_Held != 0)
+    {
+      Loopback_Out_Held = 0;
+      Loopback_Queue();
+    }
+  }
 }
 
 /*******************************************************************************
-* Function Name  : Receive DATA .
-* Description    : receive the data from the PC to STM32 and send it through USB
+* Function Name  : Loopback_Sent.
+* Description    : the USB sent an IN buffer: release the next one, to be
+*                  called from the IN endpoint callback.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
-uint32_t CDC_Receive_DATA(void)
-{ 
-  /*Receive flag*/
-  packet_receive = 0;
-  SetEPRxValid(ENDP3); 
-  return 1 ;
+void Loopback_Sent(void)
+{
+  USB_SIL_DblBufInComplete(EP1_IN);
+  Loopback_Transmit();
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -38,12 +38,6 @@
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 /* Extern variables ----------------------------------------------------------*/
-extern __IO uint8_t Receive_Buffer[64];
-extern __IO  uint32_t Receive_length ;
-extern __IO  uint32_t length ;
-uint8_t Send_Buffer[64];
-uint32_t packet_sent=1;
-uint32_t packet_receive=1;
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
@@ -60,19 +54,9 @@ int main(void)
   USB_Interrupts_Config();
   USB_Init();
   
+  /* The data is echoed from the endpoint callbacks, see Loopback_Receive() */
   while (1)
   {
-    if (bDeviceState == CONFIGURED)
-    {
-      CDC_Receive_DATA();
-      /*Check to see if we have data yet */
-      if (Receive_length  != 0)
-      {
-        if (packet_sent == 1)
-          CDC_Send_DATA ((unsigned char*)Receive_Buffer,Receive_length);
-        Receive_length = 0;
-      }
-    }
   }
 } 
 
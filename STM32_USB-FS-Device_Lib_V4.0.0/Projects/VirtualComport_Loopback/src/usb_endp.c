@@ -41,16 +41,12 @@
 #define VCOMPORT_IN_FRAME_INTERVAL             5
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-extern __IO uint32_t packet_sent;
-extern __IO uint32_t packet_receive;
-extern __IO uint8_t Receive_Buffer[64];
-uint32_t Receive_length;
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
 /*******************************************************************************
 * Function Name  : EP1_IN_Callback
-* Description    :
+* Description    : Echo IN buffer sent.
 * Input          : None.
 * Output         : None.
 * Return         : None.
@@ -58,21 +54,19 @@ uint32_t Receive_length;
 
 void EP1_IN_Callback (void)
 {
-  packet_sent = 1;
+  Loopback_Sent();
 }
 
 /*******************************************************************************
 * Function Name  : EP3_OUT_Callback
-* Description    :
+* Description    : Packet to echo received.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void EP3_OUT_Callback(void)
 {
-  packet_receive = 1;
-  Receive_length = GetEPRxCount(ENDP3);
-  PMAToUserBufferCopy((unsigned char*)Receive_Buffer, ENDP3_RXADDR, Receive_length);
+  Loopback_Receive();
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -43,7 +43,33 @@
 #define LED_ON                0xF0
 #define LED_OFF               0xFF
 
-#define USART_RX_DATA_SIZE   2048
+#define USART_RX_DATA_SIZE   2048   /* circular DMA buffer, power of two */
+#define USART_TX_DATA_SIZE   1024   /* USB OUT data ring, power of two */
+
+/* IN transfer scheduling: a transfer is started as soon as VCOMPORT_IN_WATERMARK
+   bytes are buffered or the USART line stays idle for VCOMPORT_IN_IDLE_BITS bit
+   times (one character time on devices without receiver timeout) */
+#define VCOMPORT_IN_WATERMARK   64
+#define VCOMPORT_IN_IDLE_BITS   20
+
+/* Largest error between the requested and the achieved baud rate, in per
+   mille: SET_LINE_CODING requests beyond it are refused */
+#define VCOMPORT_BAUD_TOLERANCE 20
+
+/* Frame aware IN packing, for framed traffic such as MAVLink telemetry: when
+   VCOMPORT_FRAMING is defined the IN transfers end on frame boundaries. A
+   frame starts with VCOMPORT_FRAME_START and is VCOMPORT_FRAME_OVERHEAD bytes
+   longer than the payload length byte found VCOMPORT_FRAME_LENGTH_OFFSET bytes
+   after the start (MAVLink v1 here). Whole frames are sent as soon as they
+   fill a packet or when the oldest one has waited VCOMPORT_FRAME_DEADLINE ms;
+   a frame left incomplete for VCOMPORT_FRAME_TIMEOUT ms is sent as it is.
+   Bytes found between frames are passed on without waiting */
+/* #define VCOMPORT_FRAMING */
+#define VCOMPORT_FRAME_START          0xFE
+#define VCOMPORT_FRAME_LENGTH_OFFSET  1
+#define VCOMPORT_FRAME_OVERHEAD       8
+#define VCOMPORT_FRAME_DEADLINE       2
+#define VCOMPORT_FRAME_TIMEOUT        20
 /* Exported functions ------------------------------------------------------- */
 void Set_System(void);
 void Set_USBClock(void);
@@ -51,11 +77,15 @@ void Enter_LowPowerMode(void);
 void Leave_LowPowerMode(void);
 void USB_Interrupts_Config(void);
 void USB_Cable_Config (FunctionalState NewState);
-void USART_Config_Default(void);
-bool USART_Config(void);
-void USB_To_USART_Send_Data(uint8_t* data_buffer, uint8_t Nb_bytes);
-void USART_To_USB_Send_Data(void);
+void USART_Config_Default(uint8_t bPort);
+bool USART_Config(uint8_t bPort);
+void USB_To_USART_Send_Data(uint8_t bPort);
+void USB_Rx_Enable (uint8_t bPort);
+void USB_Tx_Complete (uint8_t bPort);
 void Handle_USBAsynchXfer (void);
+void Handle_USBAsynchRequest (void);
+void Handle_USARTAsynchXfer (uint8_t bPort);
+void USART_Rx_Kick (uint8_t bPort, uint32_t Watermark);
 void Get_SerialNum(void);
 
 /* External variables --------------------------------------------------------*/
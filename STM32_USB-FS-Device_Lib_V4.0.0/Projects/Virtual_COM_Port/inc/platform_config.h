@@ -153,6 +153,79 @@
  #define EVAL_COM1_IRQHandler              USART1_IRQHandler
 #endif
 
+/* DMA1 channels serving the EVAL_COM1 receiver and transmitter */
+#if defined (USE_STM32L152_EVAL) || defined (USE_STM32373C_EVAL)
+ #define EVAL_COM1_RX_DMA_CHANNEL            DMA1_Channel6
+ #define EVAL_COM1_RX_DMA_IRQn               DMA1_Channel6_IRQn
+ #define EVAL_COM1_RX_DMA_IRQHandler         DMA1_Channel6_IRQHandler
+ #define EVAL_COM1_RX_DMA_IT_HT              DMA1_IT_HT6
+ #define EVAL_COM1_RX_DMA_IT_TC              DMA1_IT_TC6
+ #define EVAL_COM1_TX_DMA_CHANNEL            DMA1_Channel7
+ #define EVAL_COM1_TX_DMA_IRQn               DMA1_Channel7_IRQn
+ #define EVAL_COM1_TX_DMA_IRQHandler         DMA1_Channel7_IRQHandler
+ #define EVAL_COM1_TX_DMA_IT_TC              DMA1_IT_TC7
+#else /* EVAL_COM1 is USART1 */
+ #define EVAL_COM1_RX_DMA_CHANNEL            DMA1_Channel5
+ #define EVAL_COM1_RX_DMA_IRQn               DMA1_Channel5_IRQn
+ #define EVAL_COM1_RX_DMA_IRQHandler         DMA1_Channel5_IRQHandler
+ #define EVAL_COM1_RX_DMA_IT_HT              DMA1_IT_HT5
+ #define EVAL_COM1_RX_DMA_IT_TC              DMA1_IT_TC5
+ #define EVAL_COM1_TX_DMA_CHANNEL            DMA1_Channel4
+ #define EVAL_COM1_TX_DMA_IRQn               DMA1_Channel4_IRQn
+ #define EVAL_COM1_TX_DMA_IRQHandler         DMA1_Channel4_IRQHandler
+ #define EVAL_COM1_TX_DMA_IT_TC              DMA1_IT_TC4
+#endif
+
+/* USARTs of the additional virtual COM ports (VCP_PORT_NUM > 1 in usb_conf.h),
+   port 0 is EVAL_COM1. Change the pins to match the board wiring */
+#if defined (USE_STM32373C_EVAL)
+ /* Port 1: USART1, TX on PB.06, RX on PB.07 */
+ #define VCP_COM2                            USART1
+ #define VCP_COM2_CLK                        RCC_APB2Periph_USART1
+ #define VCP_COM2_CLK_CMD                    RCC_APB2PeriphClockCmd
+ #define VCP_COM2_GPIO_PORT                  GPIOB
+ #define VCP_COM2_GPIO_CLK                   RCC_AHBPeriph_GPIOB
+ #define VCP_COM2_TX_PIN                     GPIO_Pin_6
+ #define VCP_COM2_TX_SOURCE                  GPIO_PinSource6
+ #define VCP_COM2_RX_PIN                     GPIO_Pin_7
+ #define VCP_COM2_RX_SOURCE                  GPIO_PinSource7
+ #define VCP_COM2_AF                         GPIO_AF_7
+ #define VCP_COM2_IRQn                       USART1_IRQn
+ #define VCP_COM2_IRQHandler                 USART1_IRQHandler
+ #define VCP_COM2_RX_DMA_CHANNEL             DMA1_Channel5
+ #define VCP_COM2_RX_DMA_IRQn                DMA1_Channel5_IRQn
+ #define VCP_COM2_RX_DMA_IRQHandler          DMA1_Channel5_IRQHandler
+ #define VCP_COM2_RX_DMA_IT_HT               DMA1_IT_HT5
+ #define VCP_COM2_RX_DMA_IT_TC               DMA1_IT_TC5
+ #define VCP_COM2_TX_DMA_CHANNEL             DMA1_Channel4
+ #define VCP_COM2_TX_DMA_IRQn                DMA1_Channel4_IRQn
+ #define VCP_COM2_TX_DMA_IRQHandler          DMA1_Channel4_IRQHandler
+ #define VCP_COM2_TX_DMA_IT_TC               DMA1_IT_TC4
+
+ /* Port 2: USART3, TX on PD.08, RX on PD.09 */
+ #define VCP_COM3                            USART3
+ #define VCP_COM3_CLK                        RCC_APB1Periph_USART3
+ #define VCP_COM3_CLK_CMD                    RCC_APB1PeriphClockCmd
+ #define VCP_COM3_GPIO_PORT                  GPIOD
+ #define VCP_COM3_GPIO_CLK                   RCC_AHBPeriph_GPIOD
+ #define VCP_COM3_TX_PIN                     GPIO_Pin_8
+ #define VCP_COM3_TX_SOURCE                  GPIO_PinSource8
+ #define VCP_COM3_RX_PIN                     GPIO_Pin_9
+ #define VCP_COM3_RX_SOURCE                  GPIO_PinSource9
+ #define VCP_COM3_AF                         GPIO_AF_7
+ #define VCP_COM3_IRQn                       USART3_IRQn
+ #define VCP_COM3_IRQHandler                 USART3_IRQHandler
+ #define VCP_COM3_RX_DMA_CHANNEL             DMA1_Channel3
+ #define VCP_COM3_RX_DMA_IRQn                DMA1_Channel3_IRQn
+ #define VCP_COM3_RX_DMA_IRQHandler          DMA1_Channel3_IRQHandler
+ #define VCP_COM3_RX_DMA_IT_HT               DMA1_IT_HT3
+ #define VCP_COM3_RX_DMA_IT_TC               DMA1_IT_TC3
+ #define VCP_COM3_TX_DMA_CHANNEL             DMA1_Channel2
+ #define VCP_COM3_TX_DMA_IRQn                DMA1_Channel2_IRQn
+ #define VCP_COM3_TX_DMA_IRQHandler          DMA1_Channel2_IRQHandler
+ #define VCP_COM3_TX_DMA_IT_TC               DMA1_IT_TC2
+#endif /* USE_STM32373C_EVAL */
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 
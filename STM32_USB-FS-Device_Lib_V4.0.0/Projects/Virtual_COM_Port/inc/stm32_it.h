@@ -32,6 +32,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "platform_config.h"
+#include "usb_conf.h"
 
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
@@ -54,6 +55,18 @@ void USART2_IRQHandler(void);
 #else
 void USART1_IRQHandler(void);
 #endif /* USE_STM32L152_EVAL */
+void EVAL_COM1_RX_DMA_IRQHandler(void);
+void EVAL_COM1_TX_DMA_IRQHandler(void);
+#if VCP_PORT_NUM > 1
+void VCP_COM2_IRQHandler(void);
+void VCP_COM2_RX_DMA_IRQHandler(void);
+void VCP_COM2_TX_DMA_IRQHandler(void);
+#endif /* VCP_PORT_NUM > 1 */
+#if VCP_PORT_NUM > 2
+void VCP_COM3_IRQHandler(void);
+void VCP_COM3_RX_DMA_IRQHandler(void);
+void VCP_COM3_TX_DMA_IRQHandler(void);
+#endif /* VCP_PORT_NUM > 2 */
 #endif /* __STM32_IT_H */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -37,12 +37,26 @@
 /* Exported functions ------------------------------------------------------- */
 /* External variables --------------------------------------------------------*/
 
+/*-------------------------------------------------------------*/
+/* VCP_PORT_NUM */
+/* number of virtual COM ports, from 1 to 3. Each port is a CDC */
+/* ACM function bridged to its own USART, see platform_config.h */
+/*-------------------------------------------------------------*/
+#ifndef VCP_PORT_NUM
+ #define VCP_PORT_NUM                   (1)
+#endif /* VCP_PORT_NUM */
+
+#if (VCP_PORT_NUM < 1) || (VCP_PORT_NUM > 3)
+ #error "VCP_PORT_NUM: the USB peripheral has endpoints for 1 to 3 ports"
+#endif
+
 /*-------------------------------------------------------------*/
 /* EP_NUM */
 /* defines how many endpoints are used by the device */
 /*-------------------------------------------------------------*/
 
-#define EP_NUM                          (4)
+/* port 0 uses EP1 to EP3, ports 1 and 2 two endpoints each */
+#define EP_NUM                          (2 + 2 * VCP_PORT_NUM)
 
 /*-------------------------------------------------------------*/
 /* --------------   Buffer Description Table  -----------------*/
@@ -51,17 +65,8 @@
 /* buffer table base address */
 #define BTABLE_ADDRESS      (0x00)
 
-/* EP0  */
-/* rx/tx buffer base address */
-#define ENDP0_RXADDR        (0x40)
-#define ENDP0_TXADDR        (0x80)
-
-/* EP1  */
-/* tx buffer base address */
-#define ENDP1_TXADDR        (0xC0)
-#define ENDP2_TXADDR        (0x100)
-#define ENDP3_RXADDR        (0x110)
-
+/* endpoint buffers are allocated into PMA by the Reset routine, */
+/* see USB_PMA_Init() and USB_PMA_ConfigEndpoints() */
 
 /*-------------------------------------------------------------*/
 /* -------------------   ISTR events  -------------------------*/
@@ -80,22 +85,48 @@
 /*#define RESET_CALLBACK*/
 #define SOF_CALLBACK
 /*#define ESOF_CALLBACK*/
+
+/* USB event trace, add usb_trace.c to the project when enabled */
+/*#define USB_TRACE*/
+
+/* usb_regs.c functions expanded inline (usb_regs_inline.h) */
+/*#define USB_REGS_INLINE*/
+
+/* run the endpoint service routines from USB_Poll() instead of CTR_LP */
+/*#define CTR_DEFERRED*/
+
+/* Not supported by this project: the USART and DMA interrupts start the IN
+   transfers and resume the OUT endpoints by pending the USB interrupt, and
+   share the port state (USB_Tx_State, USB_Rx_Stalled) with the endpoint
+   routines unmasked, which assumes these run in that interrupt */
+#ifdef CTR_DEFERRED
+ #error "CTR_DEFERRED: the Virtual COM Port endpoint routines must run in the USB interrupt"
+#endif /* CTR_DEFERRED */
+
 /* CTR service routines */
 /* associated to defined endpoints */
 /*#define  EP1_IN_Callback   NOP_Process*/
 #define  EP2_IN_Callback   NOP_Process
 #define  EP3_IN_Callback   NOP_Process
+#if VCP_PORT_NUM < 2
 #define  EP4_IN_Callback   NOP_Process
+#endif
 #define  EP5_IN_Callback   NOP_Process
+#if VCP_PORT_NUM < 3
 #define  EP6_IN_Callback   NOP_Process
+#endif
 #define  EP7_IN_Callback   NOP_Process
 
 #define  EP1_OUT_Callback   NOP_Process
 #define  EP2_OUT_Callback   NOP_Process
 /*#define  EP3_OUT_Callback   NOP_Process*/
+#if VCP_PORT_NUM < 2
 #define  EP4_OUT_Callback   NOP_Process
+#endif
 #define  EP5_OUT_Callback   NOP_Process
+#if VCP_PORT_NUM < 3
 #define  EP6_OUT_Callback   NOP_Process
+#endif
 #define  EP7_OUT_Callback   NOP_Process
 
 #endif /* __USB_CONF_H */
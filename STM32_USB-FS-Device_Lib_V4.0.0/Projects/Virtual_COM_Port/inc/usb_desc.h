@@ -41,11 +41,39 @@
 #define USB_INTERFACE_DESCRIPTOR_TYPE           0x04
 #define USB_ENDPOINT_DESCRIPTOR_TYPE            0x05
 
+#define USB_INTERFACE_ASSOCIATION_DESC_TYPE     0x0B
+
 #define VIRTUAL_COM_PORT_DATA_SIZE              64
 #define VIRTUAL_COM_PORT_INT_SIZE               8
 
+/* Endpoint addresses of each virtual COM port (VCP_PORT_NUM in usb_conf.h) */
+#define VCP0_DATA_IN_EP                         0x81
+#define VCP0_INT_EP                             0x82
+#define VCP0_DATA_OUT_EP                        0x03
+#define VCP1_DATA_IN_EP                         0x84
+#define VCP1_INT_EP                             0x85
+#define VCP1_DATA_OUT_EP                        0x04
+#define VCP2_DATA_IN_EP                         0x86
+#define VCP2_INT_EP                             0x87
+#define VCP2_DATA_OUT_EP                        0x06
+
+/* The buffers of three ports leave 32 bytes of packet memory to EP0 */
+#if VCP_PORT_NUM > 2
+ #define VIRTUAL_COM_PORT_EP0_SIZE              16
+#else
+ #define VIRTUAL_COM_PORT_EP0_SIZE              64
+#endif
+
+/* Interfaces of one port, preceded by an interface association descriptor
+   when the device is a composite device */
+#if VCP_PORT_NUM > 1
+ #define VIRTUAL_COM_PORT_SIZ_FUNCTION_DESC     66
+#else
+ #define VIRTUAL_COM_PORT_SIZ_FUNCTION_DESC     58
+#endif
+
 #define VIRTUAL_COM_PORT_SIZ_DEVICE_DESC        18
-#define VIRTUAL_COM_PORT_SIZ_CONFIG_DESC        67
+#define VIRTUAL_COM_PORT_SIZ_CONFIG_DESC        (9 + VCP_PORT_NUM * VIRTUAL_COM_PORT_SIZ_FUNCTION_DESC)
 #define VIRTUAL_COM_PORT_SIZ_STRING_LANGID      4
 #define VIRTUAL_COM_PORT_SIZ_STRING_VENDOR      38
 #define VIRTUAL_COM_PORT_SIZ_STRING_PRODUCT     50
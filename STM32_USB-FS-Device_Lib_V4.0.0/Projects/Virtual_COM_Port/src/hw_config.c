@@ -37,24 +37,164 @@
 
 
 /* Private typedef -----------------------------------------------------------*/
+/* One virtual COM port: the USART it is bridged to, its DMA channels and
+   endpoints, and the state of both data directions */
+typedef struct
+{
+  USART_TypeDef       *USARTx;
+  IRQn_Type            USART_IRQn;
+  DMA_Channel_TypeDef *Rx_DMA_Channel;
+  IRQn_Type            Rx_DMA_IRQn;
+  DMA_Channel_TypeDef *Tx_DMA_Channel;
+  IRQn_Type            Tx_DMA_IRQn;
+  uint8_t              bInEp;           /* bulk IN endpoint number  */
+  uint8_t              bOutEp;          /* bulk OUT endpoint number */
+  LINE_CODING          LineCoding;      /* line coding in use       */
+
+  /* USART data ring: filled by the receive DMA, drained by the USB IN pipe.
+     USART_Rx_length is what is left to send of the IN transfer */
+  USB_Ring_TypeDef     USART_Rx_Ring;
+  uint32_t             USART_Rx_length;
+  uint8_t              USB_Tx_State;
+  __IO uint8_t         USB_Tx_Request;
+  /* The last IN packet was full: the host sees the end of the transfer only
+     once a short or zero length packet follows */
+  uint8_t              USB_Tx_Full;
+#ifdef VCOMPORT_FRAMING
+  /* Frame aware packing, offsets from the read index of the ring: the data
+     before wFrameScan is made of whole frames, hFrameStamp is the USB frame
+     number when they started waiting and hDataStamp the one when wFrameHead,
+     the end of the data, last moved */
+  uint32_t             wFrameScan;
+  uint32_t             wFrameHead;
+  uint16_t             hFrameStamp;
+  uint16_t             hDataStamp;
+#endif /* VCOMPORT_FRAMING */
+
+  /* USB OUT data ring: filled by the OUT callback, drained by the transmit
+     DMA. USART_Tx_length is the transfer in progress, only the DMA interrupt
+     writes it */
+  USB_Ring_TypeDef     USART_Tx_Ring;
+  __IO uint32_t        USART_Tx_length;
+  __IO uint8_t         USB_Rx_Stalled;
+} VCP_Port_TypeDef;
+
+#if VCP_PORT_NUM > 1
+/* Pins and clock of an additional port, port 0 is set up by STM_EVAL_COMInit */
+typedef struct
+{
+  GPIO_TypeDef *GPIOx;
+  uint32_t      GPIO_CLK;
+  uint16_t      TX_Pin;
+  uint16_t      RX_Pin;
+  uint8_t       TX_Source;
+  uint8_t       RX_Source;
+  uint8_t       AF;
+  void        (*USART_ClockCmd)(uint32_t Periph, FunctionalState NewState);
+  uint32_t      USART_CLK;
+} VCP_COM_TypeDef;
+#endif /* VCP_PORT_NUM > 1 */
+
 /* Private define ------------------------------------------------------------*/
+#if (VCP_PORT_NUM > 1) && !defined (VCP_COM2)
+ #error "VCP_PORT_NUM > 1: define the USART of port 1 in platform_config.h"
+#endif
+#if (VCP_PORT_NUM > 2) && !defined (VCP_COM3)
+ #error "VCP_PORT_NUM > 2: define the USART of port 2 in platform_config.h"
+#endif
+
+#if defined(STM32L1XX_MD) || defined(STM32L1XX_HD)|| defined(STM32L1XX_MD_PLUS)|| defined (STM32F37X)
+ #define USB_LP_IRQ   USB_LP_IRQn
+#else
+ #define USB_LP_IRQ   USB_LP_CAN1_RX0_IRQn
+#endif
+
+/* Smallest USART clock divider (cycles per bit): 8 with 8x oversampling,
+   which the STM32F10x USARTs do not have */
+#if defined(STM32F10X_MD) || defined(STM32F10X_HD) || defined(STM32F10X_XL)
+ #define USART_DIV_MIN   16
+#else
+ #define USART_DIV_MIN   8
+#endif
+#define USART_DIV_MAX    0xFFFF
+
+#if defined(STM32F37X) || defined(STM32F30X)
+ #define USART_RX_ADDRESS(USARTx)   ((uint32_t)&(USARTx)->RDR)
+ #define USART_TX_ADDRESS(USARTx)   ((uint32_t)&(USARTx)->TDR)
+#else
+ #define USART_RX_ADDRESS(USARTx)   ((uint32_t)&(USARTx)->DR)
+ #define USART_TX_ADDRESS(USARTx)   ((uint32_t)&(USARTx)->DR)
+#endif
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 ErrorStatus HSEStartUpStatus;
-USART_InitTypeDef USART_InitStructure;
 EXTI_InitTypeDef EXTI_InitStructure;
-uint8_t  USART_Rx_Buffer [USART_RX_DATA_SIZE]; 
-uint32_t USART_Rx_ptr_in = 0;
-uint32_t USART_Rx_ptr_out = 0;
-uint32_t USART_Rx_length  = 0;
+uint8_t  USART_Rx_Buffer [VCP_PORT_NUM][USART_RX_DATA_SIZE]; 
+uint8_t  USART_Tx_Buffer [VCP_PORT_NUM][USART_TX_DATA_SIZE];
+
+static VCP_Port_TypeDef VCP_Port[VCP_PORT_NUM] =
+  {
+    {
+      EVAL_COM1, EVAL_COM1_IRQn,
+      EVAL_COM1_RX_DMA_CHANNEL, EVAL_COM1_RX_DMA_IRQn,
+      EVAL_COM1_TX_DMA_CHANNEL, EVAL_COM1_TX_DMA_IRQn,
+      VCP0_DATA_IN_EP & 0x7F, VCP0_DATA_OUT_EP
+    },
+#if VCP_PORT_NUM > 1
+    {
+      VCP_COM2, VCP_COM2_IRQn,
+      VCP_COM2_RX_DMA_CHANNEL, VCP_COM2_RX_DMA_IRQn,
+      VCP_COM2_TX_DMA_CHANNEL, VCP_COM2_TX_DMA_IRQn,
+      VCP1_DATA_IN_EP & 0x7F, VCP1_DATA_OUT_EP
+    },
+#endif
+#if VCP_PORT_NUM > 2
+    {
+      VCP_COM3, VCP_COM3_IRQn,
+      VCP_COM3_RX_DMA_CHANNEL, VCP_COM3_RX_DMA_IRQn,
+      VCP_COM3_TX_DMA_CHANNEL, VCP_COM3_TX_DMA_IRQn,
+      VCP2_DATA_IN_EP & 0x7F, VCP2_DATA_OUT_EP
+    },
+#endif
+  };
+
+#if VCP_PORT_NUM > 1
+static const VCP_COM_TypeDef VCP_COM[VCP_PORT_NUM - 1] =
+  {
+    {
+      VCP_COM2_GPIO_PORT, VCP_COM2_GPIO_CLK, VCP_COM2_TX_PIN, VCP_COM2_RX_PIN,
+      VCP_COM2_TX_SOURCE, VCP_COM2_RX_SOURCE, VCP_COM2_AF,
+      VCP_COM2_CLK_CMD, VCP_COM2_CLK
+    },
+#if VCP_PORT_NUM > 2
+    {
+      VCP_COM3_GPIO_PORT, VCP_COM3_GPIO_CLK, VCP_COM3_TX_PIN, VCP_COM3_RX_PIN,
+      VCP_COM3_TX_SOURCE, VCP_COM3_RX_SOURCE, VCP_COM3_AF,
+      VCP_COM3_CLK_CMD, VCP_COM3_CLK
+    },
+#endif
+  };
+#endif /* VCP_PORT_NUM > 1 */
 
-uint8_t  USB_Tx_State = 0;
 static void IntToUnicode (uint32_t value , uint8_t *pbuf , uint8_t len);
 /* Extern variables ----------------------------------------------------------*/
 
-extern LINE_CODING linecoding;
+extern LINE_CODING linecoding[VCP_PORT_NUM];
 
 /* Private function prototypes -----------------------------------------------*/
+static void USART_COMInit (uint8_t bPort, USART_InitTypeDef *USART_InitStruct);
+static uint32_t USART_GetClock (USART_TypeDef *USARTx, uint32_t wBaudRate, uint32_t *pwClkSource);
+static uint32_t USART_BaudDivider (uint32_t wClock, uint32_t wBaudRate);
+static void USART_SetDivider (USART_TypeDef *USARTx, uint32_t wClkSource, uint32_t wDiv);
+static void USART_Rx_DMA_Config (uint8_t bPort);
+static void USART_Tx_DMA_Config (uint8_t bPort);
+static void USART_Rx_SendPacket (uint8_t bPort);
+static void USART_Rx_Strip (uint8_t bPort, uint8_t *pbuf, uint32_t length);
+#ifdef VCOMPORT_FRAMING
+static uint32_t USART_Rx_Framed (uint8_t bPort, uint32_t length);
+#endif /* VCOMPORT_FRAMING */
+
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
 * Function Name  : Set_System
@@ -208,6 +348,7 @@ void Leave_LowPowerMode(void)
 void USB_Interrupts_Config(void)
 {
   NVIC_InitTypeDef NVIC_InitStructure; 
+  uint8_t i;
   
   /* 2 bit for pre-emption priority, 2 bits for subpriority */
   NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);  
@@ -252,10 +393,23 @@ void USB_Interrupts_Config(void)
   NVIC_Init(&NVIC_InitStructure);
 #endif /* STM32L1XX_XD */
 
-  /* Enable USART Interrupt */
-  NVIC_InitStructure.NVIC_IRQChannel = EVAL_COM1_IRQn;
-  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
-  NVIC_Init(&NVIC_InitStructure);
+  for (i = 0; i < VCP_PORT_NUM; i++)
+  {
+    /* Enable USART Interrupt */
+    NVIC_InitStructure.NVIC_IRQChannel = VCP_Port[i].USART_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_Init(&NVIC_InitStructure);
+
+    /* Enable the USART receive DMA Interrupt */
+    NVIC_InitStructure.NVIC_IRQChannel = VCP_Port[i].Rx_DMA_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_Init(&NVIC_InitStructure);
+
+    /* Enable the USART transmit DMA Interrupt */
+    NVIC_InitStructure.NVIC_IRQChannel = VCP_Port[i].Tx_DMA_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_Init(&NVIC_InitStructure);
+  }
 }
 
 /*******************************************************************************
@@ -290,14 +444,18 @@ void USB_Cable_Config (FunctionalState NewState)
 
 /*******************************************************************************
 * Function Name  :  USART_Config_Default.
-* Description    :  configure the EVAL_COM1 with default values.
-* Input          :  None.
+* Description    :  configure the USART of a port with default values.
+* Input          :  bPort: virtual COM port.
 * Return         :  None.
 *******************************************************************************/
-void USART_Config_Default(void)
+void USART_Config_Default(uint8_t bPort)
 {
-  /* EVAL_COM1 default configuration */
-  /* EVAL_COM1 configured as follow:
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  USART_InitTypeDef USART_InitStructure;
+  uint32_t wClock, wClkSource, wDiv;
+
+  /* USART default configuration */
+  /* USART configured as follow:
         - BaudRate = 9600 baud  
         - Word Length = 8 Bits
         - One Stop Bit
@@ -313,25 +471,58 @@ void USART_Config_Default(void)
   USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
 
   /* Configure and enable the USART */
-  STM_EVAL_COMInit(COM1, &USART_InitStructure);
+  wClock = USART_GetClock(pPort->USARTx, USART_InitStructure.USART_BaudRate, &wClkSource);
+  wDiv = USART_BaudDivider(wClock, USART_InitStructure.USART_BaudRate);
+  USART_COMInit(bPort, &USART_InitStructure);
+  USART_SetDivider(pPort->USARTx, wClkSource, wDiv);
 
-  /* Enable the USART Receive interrupt */
-  USART_ITConfig(EVAL_COM1, USART_IT_RXNE, ENABLE);
+  /* Report the default line coding: 7 data bits, odd parity */
+  pPort->LineCoding.bitrate = (wClock + wDiv / 2) / wDiv;
+  pPort->LineCoding.format = 0;
+  pPort->LineCoding.paritytype = 2;
+  pPort->LineCoding.datatype = 7;
+  linecoding[bPort] = pPort->LineCoding;
+
+  /* Receive into USART_Rx_Buffer and transmit from USART_Tx_Buffer by DMA */
+  USART_Rx_DMA_Config(bPort);
+  USART_Tx_DMA_Config(bPort);
+
+  /* Receive errors are reported through the error interrupt in DMA mode */
+  USART_ITConfig(pPort->USARTx, USART_IT_ERR, ENABLE);
+
+  /* Enable the line idle interrupt, it flushes a partial IN packet */
+#if defined(STM32F37X) || defined(STM32F30X)
+  USART_SetReceiverTimeOut(pPort->USARTx, VCOMPORT_IN_IDLE_BITS);
+  USART_ReceiverTimeOutCmd(pPort->USARTx, ENABLE);
+  USART_ITConfig(pPort->USARTx, USART_IT_RTO, ENABLE);
+#else
+  USART_ITConfig(pPort->USARTx, USART_IT_IDLE, ENABLE);
+#endif
 }
 
 /*******************************************************************************
 * Function Name  :  USART_Config.
-* Description    :  Configure the EVAL_COM1 according to the line coding structure.
-* Input          :  None.
+* Description    :  Configure the USART of a port according to its line coding
+*                   structure. The clock divider and oversampling giving the
+*                   smallest baud rate error are used and the achieved rate
+*                   is written back to the line coding. A rate that cannot be
+*                   reached within VCOMPORT_BAUD_TOLERANCE is refused: the
+*                   USART and the line coding are left as they were.
+*                   Otherwise the receive DMA restarts on an empty ring.
+* Input          :  bPort: virtual COM port.
 * Return         :  Configuration status
                     TRUE : configuration done with success
                     FALSE : configuration aborted.
 *******************************************************************************/
-bool USART_Config(void)
+bool USART_Config(uint8_t bPort)
 {
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  LINE_CODING *pLineCoding = &linecoding[bPort];
+  USART_InitTypeDef USART_InitStructure;
+  uint32_t wClock, wClkSource, wDiv, wBaudRate, wError;
 
   /* set the Stop bit*/
-  switch (linecoding.format)
+  switch (pLineCoding->format)
   {
     case 0:
       USART_InitStructure.USART_StopBits = USART_StopBits_1;
@@ -344,13 +535,13 @@ bool USART_Config(void)
       break;
     default :
     {
-      USART_Config_Default();
+      USART_Config_Default(bPort);
       return (FALSE);
     }
   }
 
   /* set the parity bit*/
-  switch (linecoding.paritytype)
+  switch (pLineCoding->paritytype)
   {
     case 0:
       USART_InitStructure.USART_Parity = USART_Parity_No;
@@ -363,13 +554,13 @@ bool USART_Config(void)
       break;
     default :
     {
-      USART_Config_Default();
+      USART_Config_Default(bPort);
       return (FALSE);
     }
   }
 
   /*set the data type : only 8bits and 9bits is supported */
-  switch (linecoding.datatype)
+  switch (pLineCoding->datatype)
   {
     case 0x07:
       /* With this configuration a parity (Even or Odd) should be set */
@@ -388,124 +579,698 @@ bool USART_Config(void)
       break;
     default :
     {
-      USART_Config_Default();
+      USART_Config_Default(bPort);
       return (FALSE);
     }
   }
 
-  USART_InitStructure.USART_BaudRate = linecoding.bitrate;
+  /* Check the baud rate error of the best divider */
+  wClock = USART_GetClock(pPort->USARTx, pLineCoding->bitrate, &wClkSource);
+  wDiv = USART_BaudDivider(wClock, pLineCoding->bitrate);
+  wBaudRate = (wClock + wDiv / 2) / wDiv;
+  wError = (wBaudRate > pLineCoding->bitrate) ? (wBaudRate - pLineCoding->bitrate) :
+                                                (pLineCoding->bitrate - wBaudRate);
+  if ((pLineCoding->bitrate == 0) ||
+      ((uint64_t)wError * 1000 > (uint64_t)pLineCoding->bitrate * VCOMPORT_BAUD_TOLERANCE))
+  {
+    *pLineCoding = pPort->LineCoding;
+    return (FALSE);
+  }
+
+  USART_InitStructure.USART_BaudRate = wBaudRate;
   USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
   USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
  
   /* Configure and enable the USART */
-  STM_EVAL_COMInit(COM1, &USART_InitStructure);
+  USART_COMInit(bPort, &USART_InitStructure);
+  USART_SetDivider(pPort->USARTx, wClkSource, wDiv);
+
+  /* The bytes received with the former coding are dropped: restart the
+     circular receive DMA on an empty ring */
+  USART_Rx_DMA_Config(bPort);
+
+  /* Report the achieved rate */
+  pLineCoding->bitrate = wBaudRate;
+  pPort->LineCoding = *pLineCoding;
 
   return (TRUE);
 }
 
 /*******************************************************************************
 * Function Name  : USB_To_USART_Send_Data.
-* Description    : send the received data from USB to the UART 0.
-* Input          : data_buffer: data address.
-                   Nb_bytes: number of bytes to send.
+* Description    : queue the data received on the OUT endpoint of a port for
+*                  the USART transmit DMA. The caller only re-enables the
+*                  endpoint when the ring has room for a full packet
+*                  (USB_Rx_Enable).
+* Input          : bPort: virtual COM port.
 * Return         : none.
 *******************************************************************************/
-void USB_To_USART_Send_Data(uint8_t* data_buffer, uint8_t Nb_bytes)
+void USB_To_USART_Send_Data(uint8_t bPort)
 {
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  USB_SIL_PMABuf_TypeDef USB_Rx;
+  uint8_t *pbuf;
+  uint32_t length, span;
   
-  uint32_t i;
+  length = USB_SIL_ReadAcquire(pPort->bOutEp, &USB_Rx);
   
-  for (i = 0; i < Nb_bytes; i++)
+  /* Copy straight from the packet memory, in two parts at the ring end */
+  while (length != 0)
   {
-    USART_SendData(EVAL_COM1, *(data_buffer + i));
-    while(USART_GetFlagStatus(EVAL_COM1, USART_FLAG_TXE) == RESET); 
-  }  
+    span = USB_Ring_WritePeek(&pPort->USART_Tx_Ring, &pbuf);
+    if (span == 0)
+    {
+      break;
+    }
+    span = USB_SIL_ReadData(&USB_Rx, pbuf, span);
+    USB_Ring_WriteCommit(&pPort->USART_Tx_Ring, span);
+    length -= span;
+  }
+  
+  /* Start the DMA if it is idle */
+  if (pPort->USART_Tx_length == 0)
+  {
+    NVIC_SetPendingIRQ(pPort->Tx_DMA_IRQn);
+  }
+}
+/*******************************************************************************
+* Function Name  : USB_Rx_Enable.
+* Description    : enable the reception on the OUT endpoint of a port if its
+*                  USART transmit ring has room for a full packet. Otherwise
+*                  leave the endpoint NAKing: Handle_USBAsynchRequest() enables
+*                  it once the transmit DMA has freed enough room.
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+void USB_Rx_Enable (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+
+  if (USB_Ring_Space(&pPort->USART_Tx_Ring) >= VIRTUAL_COM_PORT_DATA_SIZE)
+  {
+    SetEPRxValid(pPort->bOutEp);
+  }
+  else
+  {
+    pPort->USB_Rx_Stalled = 1;
+    
+    /* The DMA may have freed the ring in the meantime */
+    NVIC_SetPendingIRQ(USB_LP_IRQ);
+  }
 }
 
+/*******************************************************************************
+* Function Name  : Handle_USARTAsynchXfer.
+* Description    : retire the completed USART transmit DMA transfer of a port
+*                  and start the next one, to be called from the transmit DMA
+*                  interrupt of the port.
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+void Handle_USARTAsynchXfer (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  uint8_t *pbuf;
+  uint32_t length;
+  
+  if ((pPort->USART_Tx_length != 0) && (DMA_GetCurrDataCounter(pPort->Tx_DMA_Channel) == 0))
+  {
+    USB_Ring_ReadCommit(&pPort->USART_Tx_Ring, pPort->USART_Tx_length);
+    pPort->USART_Tx_length = 0;
+    
+    /* Room was freed: let the USB interrupt resume a throttled OUT endpoint */
+    if (pPort->USB_Rx_Stalled != 0)
+    {
+      NVIC_SetPendingIRQ(USB_LP_IRQ);
+    }
+  }
+  
+  if (pPort->USART_Tx_length == 0)
+  {
+    /* Send the contiguous part, the rest follows on completion */
+    length = USB_Ring_ReadPeek(&pPort->USART_Tx_Ring, &pbuf);
+    if (length != 0)
+    {
+      pPort->USART_Tx_length = length;
+      
+      DMA_Cmd(pPort->Tx_DMA_Channel, DISABLE);
+      pPort->Tx_DMA_Channel->CMAR = (uint32_t)pbuf;
+      DMA_SetCurrDataCounter(pPort->Tx_DMA_Channel, length);
+      DMA_Cmd(pPort->Tx_DMA_Channel, ENABLE);
+    }
+  }
+}
 /*******************************************************************************
 * Function Name  : Handle_USBAsynchXfer.
-* Description    : send data to USB.
+* Description    : send data to USB, on every port with an idle IN endpoint.
 * Input          : None.
 * Return         : none.
 *******************************************************************************/
 void Handle_USBAsynchXfer (void)
 {
+  VCP_Port_TypeDef *pPort;
+  uint8_t bPort;
+
+  for (bPort = 0; bPort < VCP_PORT_NUM; bPort++)
+  {
+    pPort = &VCP_Port[bPort];
+
+    if(pPort->USB_Tx_State != 1)
+    {
+      USB_Ring_WriteSync(&pPort->USART_Rx_Ring, &pPort->Rx_DMA_Channel->CNDTR);
+      
+      /* Send what is buffered now, packet by packet from USB_Tx_Complete() */
+      pPort->USART_Rx_length = USB_Ring_Count(&pPort->USART_Rx_Ring);
+#ifdef VCOMPORT_FRAMING
+      pPort->USART_Rx_length = USART_Rx_Framed(bPort, pPort->USART_Rx_length);
+#endif /* VCOMPORT_FRAMING */
+      if ((pPort->USART_Rx_length == 0) && (pPort->USB_Tx_Full == 0))
+      {
+        pPort->USB_Tx_State = 0; 
+        continue;
+      }
+      
+      /* With no data, a zero length packet ends the previous transfer */
+      pPort->USB_Tx_State = 1; 
+      USART_Rx_SendPacket(bPort);
+    }  
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USB_Tx_Complete.
+* Description    : send the next packet of the IN transfer of a port, or
+*                  chain the next transfer, or end one which ended on a full
+*                  packet with a zero length packet. To be called from the IN
+*                  endpoint callback of the port.
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+void USB_Tx_Complete (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+
+  if (pPort->USB_Tx_State == 1)
+  {
+    if (pPort->USART_Rx_length == 0) 
+    {
+      pPort->USB_Tx_State = 0;
+      
+      /* Chain the next transfer if a full packet came in meanwhile */
+      USART_Rx_Kick(bPort, VCOMPORT_IN_WATERMARK);
+      
+      if ((pPort->USB_Tx_Full != 0) && (pPort->USB_Tx_Request == 0))
+      {
+        /* Nothing chained after a full packet: end the transfer with a zero
+           length packet, the next completion makes the endpoint idle */
+        pPort->USB_Tx_State = 1;
+        USART_Rx_SendPacket(bPort);
+      }
+    }
+    else 
+    {
+      USART_Rx_SendPacket(bPort);
+    }
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USART_Rx_SendPacket.
+* Description    : copy the next packet of USART data to the IN endpoint of a
+*                  port and enable it. The packet stops at the ring end, so it
+*                  is copied in one go from the ring storage into the packet
+*                  memory.
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+static void USART_Rx_SendPacket (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  uint8_t *pbuf;
+  uint32_t length;
   
-  uint16_t USB_Tx_ptr;
-  uint16_t USB_Tx_length;
+  length = USB_Ring_ReadPeek(&pPort->USART_Rx_Ring, &pbuf);
+  if (length > pPort->USART_Rx_length)
+  {
+    length = pPort->USART_Rx_length;
+  }
+  if (length > VIRTUAL_COM_PORT_DATA_SIZE)
+  {
+    length = VIRTUAL_COM_PORT_DATA_SIZE;
+  }
+  
+  USART_Rx_Strip(bPort, pbuf, length);
+  UserToPMABufferCopy(pbuf, GetEPTxAddr(pPort->bInEp), length);
+  USB_Ring_ReadCommit(&pPort->USART_Rx_Ring, length);
+  pPort->USART_Rx_length -= length;
+#ifdef VCOMPORT_FRAMING
+  /* Keep the frame offsets on the data left */
+  pPort->wFrameScan -= (length < pPort->wFrameScan) ? length : pPort->wFrameScan;
+  pPort->wFrameHead -= (length < pPort->wFrameHead) ? length : pPort->wFrameHead;
+#endif /* VCOMPORT_FRAMING */
+  pPort->USB_Tx_Full = (length == VIRTUAL_COM_PORT_DATA_SIZE);
   
-  if(USB_Tx_State != 1)
+  SetEPTxCount(pPort->bInEp, length);
+  SetEPTxValid(pPort->bInEp); 
+}
+#ifdef VCOMPORT_FRAMING
+/*******************************************************************************
+* Function Name  : USART_Rx_Framed.
+* Description    : frame aware packing: parse the newly received data of a
+*                  port for frames and tell how much of it to send now. That
+*                  is the whole frames once they fill a packet or when the
+*                  oldest has waited VCOMPORT_FRAME_DEADLINE ms, everything
+*                  once an incomplete frame got no byte for
+*                  VCOMPORT_FRAME_TIMEOUT ms, nothing otherwise. To be called
+*                  from the USB interrupt, which owns the ring read side.
+* Input          : bPort: virtual COM port.
+*                  length: number of buffered bytes.
+* Return         : number of bytes to send.
+*******************************************************************************/
+static uint32_t USART_Rx_Framed (uint8_t bPort, uint32_t length)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  USB_Ring_TypeDef *pRing = &pPort->USART_Rx_Ring;
+  uint32_t wScan = pPort->wFrameScan;
+  uint32_t wFrame;
+  uint16_t hFrameNum = GetFNR() & FNR_FN;
+
+  /* Nothing scanned of a ring restarted meanwhile */
+  if (wScan > length)
+  {
+    wScan = 0;
+  }
+  if (length != pPort->wFrameHead)
+  {
+    pPort->wFrameHead = length;
+    pPort->hDataStamp = hFrameNum;
+  }
+  if (wScan == 0)
   {
-    if (USART_Rx_ptr_out == USART_RX_DATA_SIZE)
+    pPort->hFrameStamp = hFrameNum;
+  }
+
+  /* Skip the whole frames and the bytes out of any frame */
+  while (wScan != length)
+  {
+    if (USB_Ring_PeekAt(pRing, wScan) != VCOMPORT_FRAME_START)
     {
-      USART_Rx_ptr_out = 0;
+      wScan++;
+      continue;
+    }
+    if ((length - wScan) <= VCOMPORT_FRAME_LENGTH_OFFSET)
+    {
+      break;
+    }
+    wFrame = USB_Ring_PeekAt(pRing, wScan + VCOMPORT_FRAME_LENGTH_OFFSET) +
+             VCOMPORT_FRAME_OVERHEAD;
+    if ((length - wScan) < wFrame)
+    {
+      break;
+    }
+    wScan += wFrame;
+  }
+  pPort->wFrameScan = wScan;
+
+  if (wScan != 0)
+  {
+    if ((wScan >= VIRTUAL_COM_PORT_DATA_SIZE) ||
+        (((hFrameNum - pPort->hFrameStamp) & FNR_FN) >= VCOMPORT_FRAME_DEADLINE))
+    {
+      return wScan;
+    }
+  }
+  else if ((length != 0) &&
+           (((hFrameNum - pPort->hDataStamp) & FNR_FN) >= VCOMPORT_FRAME_TIMEOUT))
+  {
+    return length;
+  }
+
+  return 0;
+}
+#endif /* VCOMPORT_FRAMING */
+
+/*******************************************************************************
+* Function Name  : Handle_USBAsynchRequest.
+* Description    : start the IN transfers requested by USART_Rx_Kick() and
+*                  resume the OUT endpoints throttled by USB_Rx_Enable(), to
+*                  be called from the USB low priority interrupt. All the ports
+*                  are served in one pass.
+* Input          : None.
+* Return         : none.
+*******************************************************************************/
+void Handle_USBAsynchRequest (void)
+{
+  VCP_Port_TypeDef *pPort;
+  uint8_t bPort, bRequest = 0;
+
+  for (bPort = 0; bPort < VCP_PORT_NUM; bPort++)
+  {
+    pPort = &VCP_Port[bPort];
+
+    /* Resume the OUT endpoint once the USART transmit ring has room for a
+       packet */
+    if (pPort->USB_Rx_Stalled != 0)
+    {
+      if (USB_Ring_Space(&pPort->USART_Tx_Ring) >= VIRTUAL_COM_PORT_DATA_SIZE)
+      {
+        pPort->USB_Rx_Stalled = 0;
+        SetEPRxValid(pPort->bOutEp);
+      }
     }
     
-    if(USART_Rx_ptr_out == USART_Rx_ptr_in) 
+    if (pPort->USB_Tx_Request != 0)
     {
-      USB_Tx_State = 0; 
-      return;
+      pPort->USB_Tx_Request = 0;
+      bRequest = 1;
     }
+  }
+
+  if ((bRequest != 0) && (bDeviceState == CONFIGURED))
+  {
+    Handle_USBAsynchXfer();
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USART_Rx_Kick.
+* Description    : request an IN transfer on a port if its IN endpoint is idle
+*                  and at least Watermark bytes wait in its receive buffer. The
+*                  transfer itself is started from the USB interrupt (pended
+*                  here), so that the IN endpoints are only ever armed from
+*                  that context.
+* Input          : bPort: virtual COM port.
+*                  Watermark: minimum number of buffered bytes.
+* Return         : none.
+*******************************************************************************/
+void USART_Rx_Kick (uint8_t bPort, uint32_t Watermark)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  uint32_t length;
+  
+  if ((pPort->USB_Tx_State != 1) && (pPort->USB_Tx_Request == 0))
+  {
+    USB_Ring_WriteSync(&pPort->USART_Rx_Ring, &pPort->Rx_DMA_Channel->CNDTR);
+    length = USB_Ring_Count(&pPort->USART_Rx_Ring);
     
-    if(USART_Rx_ptr_out > USART_Rx_ptr_in) /* rollback */
-    { 
-      USART_Rx_length = USART_RX_DATA_SIZE - USART_Rx_ptr_out;
+    if ((length != 0) && (length >= Watermark))
+    {
+      pPort->USB_Tx_Request = 1;
+      NVIC_SetPendingIRQ(USB_LP_IRQ);
     }
-    else 
+  }
+}
+
+/*******************************************************************************
+* Function Name  : USART_COMInit.
+* Description    : set up the pins and clock of the USART of a port, then
+*                  configure and enable the USART.
+* Input          : bPort: virtual COM port.
+*                  USART_InitStruct: USART configuration.
+* Return         : none.
+*******************************************************************************/
+static void USART_COMInit (uint8_t bPort, USART_InitTypeDef *USART_InitStruct)
+{
+#if VCP_PORT_NUM > 1
+  const VCP_COM_TypeDef *pCom;
+  GPIO_InitTypeDef GPIO_InitStructure;
+#endif /* VCP_PORT_NUM > 1 */
+
+  if (bPort == 0)
+  {
+    STM_EVAL_COMInit(COM1, USART_InitStruct);
+    return;
+  }
+
+#if VCP_PORT_NUM > 1
+  pCom = &VCP_COM[bPort - 1];
+
+  /* Enable GPIO and USART clocks */
+  RCC_AHBPeriphClockCmd(pCom->GPIO_CLK, ENABLE);
+  pCom->USART_ClockCmd(pCom->USART_CLK, ENABLE);
+
+  /* Connect the pins to the USART */
+  GPIO_PinAFConfig(pCom->GPIOx, pCom->TX_Source, pCom->AF);
+  GPIO_PinAFConfig(pCom->GPIOx, pCom->RX_Source, pCom->AF);
+
+  /* Configure USART Tx and Rx as alternate function push-pull */
+  GPIO_InitStructure.GPIO_Pin = pCom->TX_Pin | pCom->RX_Pin;
+  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
+  GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+  GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+  GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+  GPIO_Init(pCom->GPIOx, &GPIO_InitStructure);
+
+  /* USART configuration */
+  USART_Init(VCP_Port[bPort].USARTx, USART_InitStruct);
+
+  /* Enable USART */
+  USART_Cmd(VCP_Port[bPort].USARTx, ENABLE);
+#endif /* VCP_PORT_NUM > 1 */
+}
+
+/*******************************************************************************
+* Function Name  : USART_GetClock.
+* Description    : choose the clock of a USART for a baud rate. On STM32F37x
+*                  and STM32F30x devices the USART runs from SYSCLK, for the
+*                  highest rates and the finest divider, unless the rate is too
+*                  low for the divider range: then it runs from its APB clock.
+*                  Other devices always use the APB clock.
+* Input          : USARTx: USART.
+*                  wBaudRate: requested baud rate.
+* Output         : pwClkSource: clock source for USART_SetDivider().
+* Return         : clock frequency in Hz.
+*******************************************************************************/
+static uint32_t USART_GetClock (USART_TypeDef *USARTx, uint32_t wBaudRate, uint32_t *pwClkSource)
+{
+  RCC_ClocksTypeDef RCC_Clocks;
+  uint32_t wPclk;
+
+  RCC_GetClocksFreq(&RCC_Clocks);
+  wPclk = (USARTx == USART1) ? RCC_Clocks.PCLK2_Frequency : RCC_Clocks.PCLK1_Frequency;
+  *pwClkSource = 0;
+
+#if defined(STM32F37X) || defined(STM32F30X)
+  if ((wBaudRate == 0) || ((RCC_Clocks.SYSCLK_Frequency / wBaudRate) <= USART_DIV_MAX))
+  {
+    if (USARTx == USART1)
     {
-      USART_Rx_length = USART_Rx_ptr_in - USART_Rx_ptr_out;
+      *pwClkSource = RCC_USART1CLK_SYSCLK;
     }
-    
-    if (USART_Rx_length > VIRTUAL_COM_PORT_DATA_SIZE)
+    else if (USARTx == USART2)
     {
-      USB_Tx_ptr = USART_Rx_ptr_out;
-      USB_Tx_length = VIRTUAL_COM_PORT_DATA_SIZE;
-      
-      USART_Rx_ptr_out += VIRTUAL_COM_PORT_DATA_SIZE;	
-      USART_Rx_length -= VIRTUAL_COM_PORT_DATA_SIZE;	
+      *pwClkSource = RCC_USART2CLK_SYSCLK;
     }
     else
     {
-      USB_Tx_ptr = USART_Rx_ptr_out;
-      USB_Tx_length = USART_Rx_length;
-      
-      USART_Rx_ptr_out += USART_Rx_length;
-      USART_Rx_length = 0;
+      *pwClkSource = RCC_USART3CLK_SYSCLK;
     }
-    USB_Tx_State = 1; 
-    UserToPMABufferCopy(&USART_Rx_Buffer[USB_Tx_ptr], ENDP1_TXADDR, USB_Tx_length);
-    SetEPTxCount(ENDP1, USB_Tx_length);
-    SetEPTxValid(ENDP1); 
-  }  
-  
+    return RCC_Clocks.SYSCLK_Frequency;
+  }
+
+  if (USARTx == USART1)
+  {
+    *pwClkSource = RCC_USART1CLK_PCLK;
+  }
+  else if (USARTx == USART2)
+  {
+    *pwClkSource = RCC_USART2CLK_PCLK;
+  }
+  else
+  {
+    *pwClkSource = RCC_USART3CLK_PCLK;
+  }
+#endif
+
+  return wPclk;
 }
+
 /*******************************************************************************
-* Function Name  : UART_To_USB_Send_Data.
-* Description    : send the received data from UART 0 to USB.
-* Input          : None.
+* Function Name  : USART_BaudDivider.
+* Description    : pick the USART clock divider, in clock cycles per bit, that
+*                  gives the baud rate closest to the requested one. Dividers
+*                  from 16 up run with 16x oversampling, 8 to 15 need 8x
+*                  oversampling. The divider is clamped to the USART range: the
+*                  caller checks the resulting error.
+* Input          : wClock: USART clock in Hz.
+*                  wBaudRate: requested baud rate.
+* Return         : clock divider.
+*******************************************************************************/
+static uint32_t USART_BaudDivider (uint32_t wClock, uint32_t wBaudRate)
+{
+  uint64_t wDiv;
+
+  if (wBaudRate == 0)
+  {
+    return USART_DIV_MAX;
+  }
+
+  /* Of floor(clock / baud) and the next divider, keep the one whose rate is
+     the closest: clock / d - baud <= baud - clock / (d + 1) */
+  wDiv = wClock / wBaudRate;
+  if (((wClock - wDiv * wBaudRate) * (wDiv + 1)) > (((wDiv + 1) * wBaudRate - wClock) * wDiv))
+  {
+    wDiv++;
+  }
+
+  if (wDiv < USART_DIV_MIN)
+  {
+    wDiv = USART_DIV_MIN;
+  }
+  else if (wDiv > USART_DIV_MAX)
+  {
+    wDiv = USART_DIV_MAX;
+  }
+  return (uint32_t)wDiv;
+}
+
+/*******************************************************************************
+* Function Name  : USART_SetDivider.
+* Description    : program the clock, the oversampling mode and the baud rate
+*                  register of a USART for a divider from USART_BaudDivider().
+*                  The USART is disabled while doing so.
+* Input          : USARTx: USART.
+*                  wClkSource: clock source from USART_GetClock().
+*                  wDiv: clock cycles per bit.
 * Return         : none.
 *******************************************************************************/
-void USART_To_USB_Send_Data(void)
+static void USART_SetDivider (USART_TypeDef *USARTx, uint32_t wClkSource, uint32_t wDiv)
 {
-  
-  if (linecoding.datatype == 7)
+  USART_Cmd(USARTx, DISABLE);
+
+#if defined(STM32F37X) || defined(STM32F30X)
+  RCC_USARTCLKConfig(wClkSource);
+#else
+  (void)wClkSource;
+#endif
+
+#if (USART_DIV_MIN < 16)
+  if (wDiv < 16)
   {
-    USART_Rx_Buffer[USART_Rx_ptr_in] = USART_ReceiveData(EVAL_COM1) & 0x7F;
+    /* 8x oversampling: BRR[2:0] holds the eighths of a sample period */
+    USART_OverSampling8Cmd(USARTx, ENABLE);
+    USARTx->BRR = (uint16_t)(((wDiv & ~7) << 1) | (wDiv & 7));
   }
-  else if (linecoding.datatype == 8)
+  else
   {
-    USART_Rx_Buffer[USART_Rx_ptr_in] = USART_ReceiveData(EVAL_COM1);
+    USART_OverSampling8Cmd(USARTx, DISABLE);
+    USARTx->BRR = (uint16_t)wDiv;
   }
+#else
+  USARTx->BRR = (uint16_t)wDiv;
+#endif
+
+  USART_Cmd(USARTx, ENABLE);
+}
+
+/*******************************************************************************
+* Function Name  : USART_Rx_DMA_Config.
+* Description    : receive the USART of a port into its receive buffer with a
+*                  circular DMA channel. The half and full transfer interrupts,
+*                  together with the line idle interrupt, publish the received
+*                  data.
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+static void USART_Rx_DMA_Config (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  DMA_InitTypeDef DMA_InitStructure;
+  
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
   
-  USART_Rx_ptr_in++;
+  DMA_Cmd(pPort->Rx_DMA_Channel, DISABLE);
+  DMA_DeInit(pPort->Rx_DMA_Channel);
   
-  /* To avoid buffer overflow */
-  if(USART_Rx_ptr_in == USART_RX_DATA_SIZE)
+  DMA_InitStructure.DMA_PeripheralBaseAddr = USART_RX_ADDRESS(pPort->USARTx);
+  DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)USART_Rx_Buffer[bPort];
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+  DMA_InitStructure.DMA_BufferSize = USART_RX_DATA_SIZE;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+  DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+  DMA_Init(pPort->Rx_DMA_Channel, &DMA_InitStructure);
+  
+  /* The DMA write position restarts at the beginning of the buffer */
+  USB_Ring_Init(&pPort->USART_Rx_Ring, USART_Rx_Buffer[bPort], USART_RX_DATA_SIZE);
+  pPort->USART_Rx_length = 0;
+#ifdef VCOMPORT_FRAMING
+  pPort->wFrameScan = 0;
+  pPort->wFrameHead = 0;
+#endif /* VCOMPORT_FRAMING */
+  
+  DMA_ITConfig(pPort->Rx_DMA_Channel, DMA_IT_HT | DMA_IT_TC, ENABLE);
+  DMA_Cmd(pPort->Rx_DMA_Channel, ENABLE);
+  
+  USART_DMACmd(pPort->USARTx, USART_DMAReq_Rx, ENABLE);
+}
+
+/*******************************************************************************
+* Function Name  : USART_Tx_DMA_Config.
+* Description    : transmit the USB OUT data ring of a port to its USART with
+*                  a DMA channel, programmed by Handle_USARTAsynchXfer().
+* Input          : bPort: virtual COM port.
+* Return         : none.
+*******************************************************************************/
+static void USART_Tx_DMA_Config (uint8_t bPort)
+{
+  VCP_Port_TypeDef *pPort = &VCP_Port[bPort];
+  DMA_InitTypeDef DMA_InitStructure;
+  
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+  
+  DMA_Cmd(pPort->Tx_DMA_Channel, DISABLE);
+  DMA_DeInit(pPort->Tx_DMA_Channel);
+  
+  DMA_InitStructure.DMA_PeripheralBaseAddr = USART_TX_ADDRESS(pPort->USARTx);
+  DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)USART_Tx_Buffer[bPort];
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+  DMA_InitStructure.DMA_BufferSize = USART_TX_DATA_SIZE;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+  DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+  DMA_Init(pPort->Tx_DMA_Channel, &DMA_InitStructure);
+  
+  /* Drop the data not sent yet */
+  USB_Ring_Init(&pPort->USART_Tx_Ring, USART_Tx_Buffer[bPort], USART_TX_DATA_SIZE);
+  pPort->USART_Tx_length = 0;
+  if (pPort->USB_Rx_Stalled != 0)
   {
-    USART_Rx_ptr_in = 0;
+    NVIC_SetPendingIRQ(USB_LP_IRQ);
   }
+  
+  DMA_ITConfig(pPort->Tx_DMA_Channel, DMA_IT_TC, ENABLE);
+  
+  USART_DMACmd(pPort->USARTx, USART_DMAReq_Tx, ENABLE);
 }
 
+/*******************************************************************************
+* Function Name  : USART_Rx_Strip.
+* Description    : clear the parity bit the USART leaves in bit 7 of 7-bit
+*                  characters, before they are sent to USB.
+* Input          : bPort: virtual COM port.
+*                  pbuf: first byte.
+                   length: number of bytes.
+* Return         : none.
+*******************************************************************************/
+static void USART_Rx_Strip (uint8_t bPort, uint8_t *pbuf, uint32_t length)
+{
+  if (linecoding[bPort].datatype == 7)
+  {
+    while (length-- != 0)
+    {
+      *pbuf++ &= 0x7F;
+    }
+  }
+}
 /*******************************************************************************
 * Function Name  : Get_SerialNum.
 * Description    : Create the serial number string descriptor.
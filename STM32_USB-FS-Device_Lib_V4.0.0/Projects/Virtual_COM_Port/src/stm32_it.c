@@ -38,6 +38,10 @@
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
+static void VCP_USART_IRQHandler(USART_TypeDef *USARTx, uint8_t bPort);
+static void VCP_Rx_DMA_IRQHandler(uint32_t HT_IT, uint32_t TC_IT, uint8_t bPort);
+static void VCP_Tx_DMA_IRQHandler(uint32_t TC_IT, uint8_t bPort);
+
 /* Private functions ---------------------------------------------------------*/
 /******************************************************************************/
 /*            Cortex-M Processor Exceptions Handlers                         */
@@ -173,6 +177,9 @@ void USB_LP_CAN1_RX0_IRQHandler(void)
 #endif
 {
   USB_Istr();
+  
+  /* IN transfer requested by the USART receiver */
+  Handle_USBAsynchRequest();
 }
 
 /*******************************************************************************
@@ -184,18 +191,85 @@ void USB_LP_CAN1_RX0_IRQHandler(void)
 *******************************************************************************/
 void EVAL_COM1_IRQHandler(void)
 {
-  if (USART_GetITStatus(EVAL_COM1, USART_IT_RXNE) != RESET)
-  {
-    /* Send the received data to the PC Host*/
-    USART_To_USB_Send_Data();
-  }
+  VCP_USART_IRQHandler(EVAL_COM1, 0);
+}
 
-  /* If overrun condition occurs, clear the ORE flag and recover communication */
-  if (USART_GetFlagStatus(EVAL_COM1, USART_FLAG_ORE) != RESET)
-  {
-    (void)USART_ReceiveData(EVAL_COM1);
-  }
+/*******************************************************************************
+* Function Name  : EVAL_COM1_RX_DMA_IRQHandler
+* Description    : This function handles the EVAL_COM1 receive DMA channel
+*                  half and full transfer interrupts.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void EVAL_COM1_RX_DMA_IRQHandler(void)
+{
+  VCP_Rx_DMA_IRQHandler(EVAL_COM1_RX_DMA_IT_HT, EVAL_COM1_RX_DMA_IT_TC, 0);
+}
+
+/*******************************************************************************
+* Function Name  : EVAL_COM1_TX_DMA_IRQHandler
+* Description    : This function handles the EVAL_COM1 transmit DMA channel
+*                  transfer complete interrupt, also pended by software to
+*                  start a transfer.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void EVAL_COM1_TX_DMA_IRQHandler(void)
+{
+  VCP_Tx_DMA_IRQHandler(EVAL_COM1_TX_DMA_IT_TC, 0);
+}
+
+#if VCP_PORT_NUM > 1
+/*******************************************************************************
+* Function Name  : VCP_COM2_IRQHandler, VCP_COM2_RX/TX_DMA_IRQHandler
+* Description    : These functions handle the interrupts of the USART of
+*                  virtual COM port 1 and of its DMA channels.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void VCP_COM2_IRQHandler(void)
+{
+  VCP_USART_IRQHandler(VCP_COM2, 1);
+}
+
+void VCP_COM2_RX_DMA_IRQHandler(void)
+{
+  VCP_Rx_DMA_IRQHandler(VCP_COM2_RX_DMA_IT_HT, VCP_COM2_RX_DMA_IT_TC, 1);
+}
+
+void VCP_COM2_TX_DMA_IRQHandler(void)
+{
+  VCP_Tx_DMA_IRQHandler(VCP_COM2_TX_DMA_IT_TC, 1);
+}
+#endif /* VCP_PORT_NUM > 1 */
+
+#if VCP_PORT_NUM > 2
+/*******************************************************************************
+* Function Name  : VCP_COM3_IRQHandler, VCP_COM3_RX/TX_DMA_IRQHandler
+* Description    : These functions handle the interrupts of the USART of
+*                  virtual COM port 2 and of its DMA channels.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void VCP_COM3_IRQHandler(void)
+{
+  VCP_USART_IRQHandler(VCP_COM3, 2);
+}
+
+void VCP_COM3_RX_DMA_IRQHandler(void)
+{
+  VCP_Rx_DMA_IRQHandler(VCP_COM3_RX_DMA_IT_HT, VCP_COM3_RX_DMA_IT_TC, 2);
+}
+
+void VCP_COM3_TX_DMA_IRQHandler(void)
+{
+  VCP_Tx_DMA_IRQHandler(VCP_COM3_TX_DMA_IT_TC, 2);
 }
+#endif /* VCP_PORT_NUM > 2 */
 
 /*******************************************************************************
 * Function Name  : USB_FS_WKUP_IRQHandler
@@ -214,6 +288,91 @@ void USBWakeUp_IRQHandler(void)
   EXTI_ClearITPendingBit(EXTI_Line18);
 }
 
+/*******************************************************************************
+* Function Name  : VCP_USART_IRQHandler
+* Description    : Handles the global interrupt of the USART of a virtual COM
+*                  port: line idle and receive errors.
+* Input          : USARTx: USART of the port.
+*                  bPort: virtual COM port.
+* Output         : None
+* Return         : None
+*******************************************************************************/
+static void VCP_USART_IRQHandler(USART_TypeDef *USARTx, uint8_t bPort)
+{
+  /* The line went idle: flush the partial IN packet */
+#if defined(STM32F37X) || defined(STM32F30X)
+  if (USART_GetITStatus(USARTx, USART_IT_RTO) != RESET)
+  {
+    USART_ClearITPendingBit(USARTx, USART_IT_RTO);
+    USART_Rx_Kick(bPort, 1);
+  }
+#else
+  if (USART_GetITStatus(USARTx, USART_IT_IDLE) != RESET)
+  {
+    /* IDLE is cleared by reading SR then DR */
+    (void)USART_ReceiveData(USARTx);
+    USART_Rx_Kick(bPort, 1);
+  }
+#endif
+
+  /* If a receive error occurs, clear the error flags and recover communication */
+#if defined(STM32F37X) || defined(STM32F30X)
+  USART_ClearFlag(USARTx, USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE);
+#else
+  if ((USART_GetFlagStatus(USARTx, USART_FLAG_ORE) != RESET) ||
+      (USART_GetFlagStatus(USARTx, USART_FLAG_NE) != RESET) ||
+      (USART_GetFlagStatus(USARTx, USART_FLAG_FE) != RESET))
+  {
+    (void)USART_ReceiveData(USARTx);
+  }
+#endif
+}
+
+/*******************************************************************************
+* Function Name  : VCP_Rx_DMA_IRQHandler
+* Description    : Handles the half and full transfer interrupts of the
+*                  receive DMA channel of a virtual COM port.
+* Input          : HT_IT, TC_IT: interrupt flags of the channel.
+*                  bPort: virtual COM port.
+* Output         : None
+* Return         : None
+*******************************************************************************/
+static void VCP_Rx_DMA_IRQHandler(uint32_t HT_IT, uint32_t TC_IT, uint8_t bPort)
+{
+  if (DMA_GetITStatus(HT_IT) != RESET)
+  {
+    DMA_ClearITPendingBit(HT_IT);
+  }
+  if (DMA_GetITStatus(TC_IT) != RESET)
+  {
+    DMA_ClearITPendingBit(TC_IT);
+  }
+
+  /* Half of the buffer was filled: send it to the PC Host */
+  USART_Rx_Kick(bPort, VCOMPORT_IN_WATERMARK);
+}
+
+/*******************************************************************************
+* Function Name  : VCP_Tx_DMA_IRQHandler
+* Description    : Handles the transfer complete interrupt of the transmit DMA
+*                  channel of a virtual COM port, also pended by software to
+*                  start a transfer.
+* Input          : TC_IT: transfer complete flag of the channel.
+*                  bPort: virtual COM port.
+* Output         : None
+* Return         : None
+*******************************************************************************/
+static void VCP_Tx_DMA_IRQHandler(uint32_t TC_IT, uint8_t bPort)
+{
+  if (DMA_GetITStatus(TC_IT) != RESET)
+  {
+    DMA_ClearITPendingBit(TC_IT);
+  }
+
+  /* Send the next data received from the PC Host */
+  Handle_USARTAsynchXfer(bPort);
+}
+
 /******************************************************************************/
 /*                 STM32 Peripherals Interrupt Handlers                   */
 /*  Add here the Interrupt Handler for the used peripheral(s) (PPP), for the  */
@@ -37,10 +37,16 @@ const uint8_t Virtual_Com_Port_DeviceDescriptor[] =
     USB_DEVICE_DESCRIPTOR_TYPE,     /* bDescriptorType */
     0x00,
     0x02,   /* bcdUSB = 2.00 */
+#if VCP_PORT_NUM > 1
+    0xEF,   /* bDeviceClass: Miscellaneous */
+    0x02,   /* bDeviceSubClass: Common Class */
+    0x01,   /* bDeviceProtocol: Interface Association Descriptor */
+#else
     0x02,   /* bDeviceClass: CDC */
     0x00,   /* bDeviceSubClass */
     0x00,   /* bDeviceProtocol */
-    0x40,   /* bMaxPacketSize0 */
+#endif
+    VIRTUAL_COM_PORT_EP0_SIZE,   /* bMaxPacketSize0 */
     0x83,
     0x04,   /* idVendor = 0x0483 */
     0x40,
@@ -53,6 +59,96 @@ const uint8_t Virtual_Com_Port_DeviceDescriptor[] =
     0x01    /* bNumConfigurations */
   };
 
+/* One CDC ACM function: communication interface bCommIf with its
+   notification endpoint and data interface bCommIf + 1 with the bulk
+   endpoints. A composite device starts each function with an interface
+   association descriptor */
+#if VCP_PORT_NUM > 1
+ #define VIRTUAL_COM_PORT_IAD_DESC(bCommIf) \
+    /*Interface Association Descriptor*/ \
+    0x08,   /* bLength: Interface Association Descriptor size */ \
+    USB_INTERFACE_ASSOCIATION_DESC_TYPE,   /* bDescriptorType */ \
+    (bCommIf),   /* bFirstInterface */ \
+    0x02,   /* bInterfaceCount */ \
+    0x02,   /* bFunctionClass: Communication Interface Class */ \
+    0x02,   /* bFunctionSubClass: Abstract Control Model */ \
+    0x01,   /* bFunctionProtocol: Common AT commands */ \
+    0x00,   /* iFunction */
+#else
+ #define VIRTUAL_COM_PORT_IAD_DESC(bCommIf)
+#endif
+
+#define VIRTUAL_COM_PORT_FUNCTION_DESC(bCommIf, bInEp, bOutEp, bIntEp) \
+    VIRTUAL_COM_PORT_IAD_DESC(bCommIf) \
+    /*Interface Descriptor*/ \
+    0x09,   /* bLength: Interface Descriptor size */ \
+    USB_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType: Interface */ \
+    /* Interface descriptor type */ \
+    (bCommIf),   /* bInterfaceNumber: Number of Interface */ \
+    0x00,   /* bAlternateSetting: Alternate setting */ \
+    0x01,   /* bNumEndpoints: One endpoints used */ \
+    0x02,   /* bInterfaceClass: Communication Interface Class */ \
+    0x02,   /* bInterfaceSubClass: Abstract Control Model */ \
+    0x01,   /* bInterfaceProtocol: Common AT commands */ \
+    0x00,   /* iInterface: */ \
+    /*Header Functional Descriptor*/ \
+    0x05,   /* bLength: Endpoint Descriptor size */ \
+    0x24,   /* bDescriptorType: CS_INTERFACE */ \
+    0x00,   /* bDescriptorSubtype: Header Func Desc */ \
+    0x10,   /* bcdCDC: spec release number */ \
+    0x01, \
+    /*Call Management Functional Descriptor*/ \
+    0x05,   /* bFunctionLength */ \
+    0x24,   /* bDescriptorType: CS_INTERFACE */ \
+    0x01,   /* bDescriptorSubtype: Call Management Func Desc */ \
+    0x00,   /* bmCapabilities: D0+D1 */ \
+    (bCommIf) + 1,   /* bDataInterface */ \
+    /*ACM Functional Descriptor*/ \
+    0x04,   /* bFunctionLength */ \
+    0x24,   /* bDescriptorType: CS_INTERFACE */ \
+    0x02,   /* bDescriptorSubtype: Abstract Control Management desc */ \
+    0x02,   /* bmCapabilities */ \
+    /*Union Functional Descriptor*/ \
+    0x05,   /* bFunctionLength */ \
+    0x24,   /* bDescriptorType: CS_INTERFACE */ \
+    0x06,   /* bDescriptorSubtype: Union func desc */ \
+    (bCommIf),   /* bMasterInterface: Communication class interface */ \
+    (bCommIf) + 1,   /* bSlaveInterface0: Data Class Interface */ \
+    /*Notification Endpoint Descriptor*/ \
+    0x07,   /* bLength: Endpoint Descriptor size */ \
+    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */ \
+    (bIntEp),   /* bEndpointAddress */ \
+    0x03,   /* bmAttributes: Interrupt */ \
+    VIRTUAL_COM_PORT_INT_SIZE,      /* wMaxPacketSize: */ \
+    0x00, \
+    0xFF,   /* bInterval: */ \
+    /*Data class interface descriptor*/ \
+    0x09,   /* bLength: Endpoint Descriptor size */ \
+    USB_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType: */ \
+    (bCommIf) + 1,   /* bInterfaceNumber: Number of Interface */ \
+    0x00,   /* bAlternateSetting: Alternate setting */ \
+    0x02,   /* bNumEndpoints: Two endpoints used */ \
+    0x0A,   /* bInterfaceClass: CDC */ \
+    0x00,   /* bInterfaceSubClass: */ \
+    0x00,   /* bInterfaceProtocol: */ \
+    0x00,   /* iInterface: */ \
+    /*Data OUT Endpoint Descriptor*/ \
+    0x07,   /* bLength: Endpoint Descriptor size */ \
+    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */ \
+    (bOutEp),   /* bEndpointAddress */ \
+    0x02,   /* bmAttributes: Bulk */ \
+    VIRTUAL_COM_PORT_DATA_SIZE,             /* wMaxPacketSize: */ \
+    0x00, \
+    0x00,   /* bInterval: ignore for Bulk transfer */ \
+    /*Data IN Endpoint Descriptor*/ \
+    0x07,   /* bLength: Endpoint Descriptor size */ \
+    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */ \
+    (bInEp),   /* bEndpointAddress */ \
+    0x02,   /* bmAttributes: Bulk */ \
+    VIRTUAL_COM_PORT_DATA_SIZE,             /* wMaxPacketSize: */ \
+    0x00, \
+    0x00,   /* bInterval */
+
 const uint8_t Virtual_Com_Port_ConfigDescriptor[] =
   {
     /*Configuration Descriptor*/
@@ -60,79 +156,21 @@ const uint8_t Virtual_Com_Port_ConfigDescriptor[] =
     USB_CONFIGURATION_DESCRIPTOR_TYPE,      /* bDescriptorType: Configuration */
     VIRTUAL_COM_PORT_SIZ_CONFIG_DESC,       /* wTotalLength:no of returned bytes */
     0x00,
-    0x02,   /* bNumInterfaces: 2 interface */
+    2 * VCP_PORT_NUM,   /* bNumInterfaces: 2 interfaces per port */
     0x01,   /* bConfigurationValue: Configuration value */
     0x00,   /* iConfiguration: Index of string descriptor describing the configuration */
     0xC0,   /* bmAttributes: self powered */
     0x32,   /* MaxPower 0 mA */
-    /*Interface Descriptor*/
-    0x09,   /* bLength: Interface Descriptor size */
-    USB_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType: Interface */
-    /* Interface descriptor type */
-    0x00,   /* bInterfaceNumber: Number of Interface */
-    0x00,   /* bAlternateSetting: Alternate setting */
-    0x01,   /* bNumEndpoints: One endpoints used */
-    0x02,   /* bInterfaceClass: Communication Interface Class */
-    0x02,   /* bInterfaceSubClass: Abstract Control Model */
-    0x01,   /* bInterfaceProtocol: Common AT commands */
-    0x00,   /* iInterface: */
-    /*Header Functional Descriptor*/
-    0x05,   /* bLength: Endpoint Descriptor size */
-    0x24,   /* bDescriptorType: CS_INTERFACE */
-    0x00,   /* bDescriptorSubtype: Header Func Desc */
-    0x10,   /* bcdCDC: spec release number */
-    0x01,
-    /*Call Management Functional Descriptor*/
-    0x05,   /* bFunctionLength */
-    0x24,   /* bDescriptorType: CS_INTERFACE */
-    0x01,   /* bDescriptorSubtype: Call Management Func Desc */
-    0x00,   /* bmCapabilities: D0+D1 */
-    0x01,   /* bDataInterface: 1 */
-    /*ACM Functional Descriptor*/
-    0x04,   /* bFunctionLength */
-    0x24,   /* bDescriptorType: CS_INTERFACE */
-    0x02,   /* bDescriptorSubtype: Abstract Control Management desc */
-    0x02,   /* bmCapabilities */
-    /*Union Functional Descriptor*/
-    0x05,   /* bFunctionLength */
-    0x24,   /* bDescriptorType: CS_INTERFACE */
-    0x06,   /* bDescriptorSubtype: Union func desc */
-    0x00,   /* bMasterInterface: Communication class interface */
-    0x01,   /* bSlaveInterface0: Data Class Interface */
-    /*Endpoint 2 Descriptor*/
-    0x07,   /* bLength: Endpoint Descriptor size */
-    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */
-    0x82,   /* bEndpointAddress: (IN2) */
-    0x03,   /* bmAttributes: Interrupt */
-    VIRTUAL_COM_PORT_INT_SIZE,      /* wMaxPacketSize: */
-    0x00,
-    0xFF,   /* bInterval: */
-    /*Data class interface descriptor*/
-    0x09,   /* bLength: Endpoint Descriptor size */
-    USB_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType: */
-    0x01,   /* bInterfaceNumber: Number of Interface */
-    0x00,   /* bAlternateSetting: Alternate setting */
-    0x02,   /* bNumEndpoints: Two endpoints used */
-    0x0A,   /* bInterfaceClass: CDC */
-    0x00,   /* bInterfaceSubClass: */
-    0x00,   /* bInterfaceProtocol: */
-    0x00,   /* iInterface: */
-    /*Endpoint 3 Descriptor*/
-    0x07,   /* bLength: Endpoint Descriptor size */
-    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */
-    0x03,   /* bEndpointAddress: (OUT3) */
-    0x02,   /* bmAttributes: Bulk */
-    VIRTUAL_COM_PORT_DATA_SIZE,             /* wMaxPacketSize: */
-    0x00,
-    0x00,   /* bInterval: ignore for Bulk transfer */
-    /*Endpoint 1 Descriptor*/
-    0x07,   /* bLength: Endpoint Descriptor size */
-    USB_ENDPOINT_DESCRIPTOR_TYPE,   /* bDescriptorType: Endpoint */
-    0x81,   /* bEndpointAddress: (IN1) */
-    0x02,   /* bmAttributes: Bulk */
-    VIRTUAL_COM_PORT_DATA_SIZE,             /* wMaxPacketSize: */
-    0x00,
-    0x00    /* bInterval */
+    /*Port 0: interfaces 0 and 1, IN1 / OUT3 / notification IN2*/
+    VIRTUAL_COM_PORT_FUNCTION_DESC(0, VCP0_DATA_IN_EP, VCP0_DATA_OUT_EP, VCP0_INT_EP)
+#if VCP_PORT_NUM > 1
+    /*Port 1: interfaces 2 and 3, IN4 / OUT4 / notification IN5*/
+    VIRTUAL_COM_PORT_FUNCTION_DESC(2, VCP1_DATA_IN_EP, VCP1_DATA_OUT_EP, VCP1_INT_EP)
+#endif
+#if VCP_PORT_NUM > 2
+    /*Port 2: interfaces 4 and 5, IN6 / OUT6 / notification IN7*/
+    VIRTUAL_COM_PORT_FUNCTION_DESC(4, VCP2_DATA_IN_EP, VCP2_DATA_OUT_EP, VCP2_INT_EP)
+#endif
   };
 
 /* USB String Descriptors */
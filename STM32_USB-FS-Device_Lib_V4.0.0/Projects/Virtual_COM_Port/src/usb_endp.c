@@ -37,85 +37,102 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 
-/* Interval between sending IN packets in frame number (1 frame = 1ms) */
-#define VCOMPORT_IN_FRAME_INTERVAL             5
+/* Interval between two flushes of the IN pipe from SOF, in frame number
+   (1 frame = 1ms); transfers are normally started by USART_Rx_Kick(). The
+   frame aware packing checks its deadlines on every frame */
+#ifdef VCOMPORT_FRAMING
+ #define VCOMPORT_IN_FRAME_INTERVAL            0
+#else
+ #define VCOMPORT_IN_FRAME_INTERVAL            5
+#endif /* VCOMPORT_FRAMING */
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-uint8_t USB_Rx_Buffer[VIRTUAL_COM_PORT_DATA_SIZE];
-extern  uint8_t USART_Rx_Buffer[];
-extern uint32_t USART_Rx_ptr_out;
-extern uint32_t USART_Rx_length;
-extern uint8_t  USB_Tx_State;
-
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
 /*******************************************************************************
 * Function Name  : EP1_IN_Callback
-* Description    :
+* Description    : Port 0 data IN.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void EP1_IN_Callback (void)
 {
-  uint16_t USB_Tx_ptr;
-  uint16_t USB_Tx_length;
-  
-  if (USB_Tx_State == 1)
-  {
-    if (USART_Rx_length == 0) 
-    {
-      USB_Tx_State = 0;
-    }
-    else 
-    {
-      if (USART_Rx_length > VIRTUAL_COM_PORT_DATA_SIZE){
-        USB_Tx_ptr = USART_Rx_ptr_out;
-        USB_Tx_length = VIRTUAL_COM_PORT_DATA_SIZE;
-        
-        USART_Rx_ptr_out += VIRTUAL_COM_PORT_DATA_SIZE;
-        USART_Rx_length -= VIRTUAL_COM_PORT_DATA_SIZE;    
-      }
-      else 
-      {
-        USB_Tx_ptr = USART_Rx_ptr_out;
-        USB_Tx_length = USART_Rx_length;
-        
-        USART_Rx_ptr_out += USART_Rx_length;
-        USART_Rx_length = 0;
-      }
-      UserToPMABufferCopy(&USART_Rx_Buffer[USB_Tx_ptr], ENDP1_TXADDR, USB_Tx_length);
-      SetEPTxCount(ENDP1, USB_Tx_length);
-      SetEPTxValid(ENDP1); 
-    }
-  }
+  USB_Tx_Complete(0);
 }
 
 /*******************************************************************************
 * Function Name  : EP3_OUT_Callback
-* Description    :
+* Description    : Port 0 data OUT.
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
 void EP3_OUT_Callback(void)
 {
-  uint16_t USB_Rx_Cnt;
-  
-  /* Get the received data buffer and update the counter */
-  USB_Rx_Cnt = USB_SIL_Read(EP3_OUT, USB_Rx_Buffer);
-  
-  /* USB data will be immediately processed, this allow next USB traffic being 
-  NAKed till the end of the USART Xfer */
-  
-  USB_To_USART_Send_Data(USB_Rx_Buffer, USB_Rx_Cnt);
+  /* Queue the received data for the USART transmit DMA */
+  USB_To_USART_Send_Data(0);
  
-  /* Enable the receive of data on EP3 */
-  SetEPRxValid(ENDP3);
+  /* Enable the receive of data on EP3, unless the queue is full: then the
+  next USB traffic is NAKed till the USART has sent enough data */
+  USB_Rx_Enable(0);
 }
 
+#if VCP_PORT_NUM > 1
+/*******************************************************************************
+* Function Name  : EP4_IN_Callback
+* Description    : Port 1 data IN.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP4_IN_Callback (void)
+{
+  USB_Tx_Complete(1);
+}
+
+/*******************************************************************************
+* Function Name  : EP4_OUT_Callback
+* Description    : Port 1 data OUT.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP4_OUT_Callback(void)
+{
+  USB_To_USART_Send_Data(1);
+  USB_Rx_Enable(1);
+}
+#endif /* VCP_PORT_NUM > 1 */
+
+#if VCP_PORT_NUM > 2
+/*******************************************************************************
+* Function Name  : EP6_IN_Callback
+* Description    : Port 2 data IN.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP6_IN_Callback (void)
+{
+  USB_Tx_Complete(2);
+}
+
+/*******************************************************************************
+* Function Name  : EP6_OUT_Callback
+* Description    : Port 2 data OUT.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP6_OUT_Callback(void)
+{
+  USB_To_USART_Send_Data(2);
+  USB_Rx_Enable(2);
+}
+#endif /* VCP_PORT_NUM > 2 */
 
 /*******************************************************************************
 * Function Name  : SOF_Callback / INTR_SOFINTR_Callback
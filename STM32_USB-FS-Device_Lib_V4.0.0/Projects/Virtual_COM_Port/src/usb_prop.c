@@ -39,13 +39,34 @@
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 uint8_t Request = 0;
+uint8_t RequestPort = 0;    /* port addressed by the class request */
 
-LINE_CODING linecoding =
+LINE_CODING linecoding[VCP_PORT_NUM] =
   {
-    115200, /* baud rate*/
-    0x00,   /* stop bits-1*/
-    0x00,   /* parity - none*/
-    0x08    /* no. of bits 8*/
+    {
+      115200, /* baud rate*/
+      0x00,   /* stop bits-1*/
+      0x00,   /* parity - none*/
+      0x08    /* no. of bits 8*/
+    },
+#if VCP_PORT_NUM > 1
+    { 115200, 0x00, 0x00, 0x08 },
+#endif
+#if VCP_PORT_NUM > 2
+    { 115200, 0x00, 0x00, 0x08 },
+#endif
+  };
+
+/* Bulk IN, bulk OUT and notification endpoints of each port */
+static const uint8_t PortEndpoints[VCP_PORT_NUM][3] =
+  {
+    { VCP0_DATA_IN_EP & 0x7F, VCP0_DATA_OUT_EP, VCP0_INT_EP & 0x7F },
+#if VCP_PORT_NUM > 1
+    { VCP1_DATA_IN_EP & 0x7F, VCP1_DATA_OUT_EP, VCP1_INT_EP & 0x7F },
+#endif
+#if VCP_PORT_NUM > 2
+    { VCP2_DATA_IN_EP & 0x7F, VCP2_DATA_OUT_EP, VCP2_INT_EP & 0x7F },
+#endif
   };
 
 /* -------------------------------------------------------------------------- */
@@ -71,7 +92,7 @@ DEVICE_PROP Device_Property =
     Virtual_Com_Port_GetConfigDescriptor,
     Virtual_Com_Port_GetStringDescriptor,
     0,
-    0x40 /*MAX PACKET SIZE*/
+    VIRTUAL_COM_PORT_EP0_SIZE /*MAX PACKET SIZE*/
   };
 
 USER_STANDARD_REQUESTS User_Standard_Requests =
@@ -120,6 +141,7 @@ ONE_DESCRIPTOR String_Descriptor[4] =
 *******************************************************************************/
 void Virtual_Com_Port_init(void)
 {
+  uint8_t i;
 
   /* Update the serial number string descriptor with the data from the unique
   ID*/
@@ -133,8 +155,11 @@ void Virtual_Com_Port_init(void)
   /* Perform basic device initialization operations */
   USB_SIL_Init();
 
-  /* configure the USART to the default settings */
-  USART_Config_Default();
+  /* configure the USARTs to the default settings */
+  for (i = 0; i < VCP_PORT_NUM; i++)
+  {
+    USART_Config_Default(i);
+  }
 
   bDeviceState = UNCONNECTED;
 }
@@ -148,6 +173,9 @@ void Virtual_Com_Port_init(void)
 *******************************************************************************/
 void Virtual_Com_Port_Reset(void)
 {
+  uint32_t Status;
+  uint8_t i, bInEp, bOutEp, bIntEp;
+
   /* Set Virtual_Com_Port DEVICE as not configured */
   pInformation->Current_Configuration = 0;
 
@@ -157,35 +185,57 @@ void Virtual_Com_Port_Reset(void)
   /* Set Virtual_Com_Port DEVICE with the default Interface*/
   pInformation->Current_Interface = 0;
 
-  SetBTABLE(BTABLE_ADDRESS);
+  /* Lay out the buffer table and the endpoint buffers into PMA */
+  USB_PMA_Init(BTABLE_ADDRESS, EP_NUM);
+  Status = USB_PMA_ConfigEP0(Device_Property.MaxPacketSize);
+  if (Status == USB_SUCCESS)
+  {
+    Status = USB_PMA_ConfigEndpoints(Virtual_Com_Port_ConfigDescriptor, 0);
+  }
+  /* More endpoint buffers than PMA_SIZE bytes: the endpoints stay disabled
+     and the host fails the enumeration */
+  assert_param(Status == USB_SUCCESS);
+  if (Status != USB_SUCCESS)
+  {
+    return;
+  }
 
   /* Initialize Endpoint 0 */
   SetEPType(ENDP0, EP_CONTROL);
   SetEPTxStatus(ENDP0, EP_TX_STALL);
-  SetEPRxAddr(ENDP0, ENDP0_RXADDR);
-  SetEPTxAddr(ENDP0, ENDP0_TXADDR);
   Clear_Status_Out(ENDP0);
-  SetEPRxCount(ENDP0, Device_Property.MaxPacketSize);
   SetEPRxValid(ENDP0);
 
-  /* Initialize Endpoint 1 */
-  SetEPType(ENDP1, EP_BULK);
-  SetEPTxAddr(ENDP1, ENDP1_TXADDR);
-  SetEPTxStatus(ENDP1, EP_TX_NAK);
-  SetEPRxStatus(ENDP1, EP_RX_DIS);
-
-  /* Initialize Endpoint 2 */
-  SetEPType(ENDP2, EP_INTERRUPT);
-  SetEPTxAddr(ENDP2, ENDP2_TXADDR);
-  SetEPRxStatus(ENDP2, EP_RX_DIS);
-  SetEPTxStatus(ENDP2, EP_TX_NAK);
-
-  /* Initialize Endpoint 3 */
-  SetEPType(ENDP3, EP_BULK);
-  SetEPRxAddr(ENDP3, ENDP3_RXADDR);
-  SetEPRxCount(ENDP3, VIRTUAL_COM_PORT_DATA_SIZE);
-  SetEPRxStatus(ENDP3, EP_RX_VALID);
-  SetEPTxStatus(ENDP3, EP_TX_DIS);
+  /* Initialize the endpoints of each port; the bulk IN and OUT endpoints
+     of ports 1 and 2 share one endpoint register */
+  for (i = 0; i < VCP_PORT_NUM; i++)
+  {
+    bInEp = PortEndpoints[i][0];
+    bOutEp = PortEndpoints[i][1];
+    bIntEp = PortEndpoints[i][2];
+
+    /* Bulk IN endpoint */
+    SetEPType(bInEp, EP_BULK);
+    SetEPTxStatus(bInEp, EP_TX_NAK);
+    if (bInEp != bOutEp)
+    {
+      SetEPRxStatus(bInEp, EP_RX_DIS);
+    }
+
+    /* Notification endpoint */
+    SetEPType(bIntEp, EP_INTERRUPT);
+    SetEPRxStatus(bIntEp, EP_RX_DIS);
+    SetEPTxStatus(bIntEp, EP_TX_NAK);
+
+    /* Bulk OUT endpoint */
+    SetEPType(bOutEp, EP_BULK);
+    SetEPRxCount(bOutEp, VIRTUAL_COM_PORT_DATA_SIZE);
+    SetEPRxStatus(bOutEp, EP_RX_VALID);
+    if (bInEp != bOutEp)
+    {
+      SetEPTxStatus(bOutEp, EP_TX_DIS);
+    }
+  }
 
   /* Set this device to response on default address */
   SetDeviceAddress(0);
@@ -234,7 +284,7 @@ void Virtual_Com_Port_Status_In(void)
 {
   if (Request == SET_LINE_CODING)
   {
-    USART_Config();
+    USART_Config(RequestPort);
     Request = 0;
   }
 }
@@ -251,7 +301,8 @@ void Virtual_Com_Port_Status_Out(void)
 
 /*******************************************************************************
 * Function Name  : Virtual_Com_Port_Data_Setup
-* Description    : handle the data class specific requests
+* Description    : handle the data class specific requests, addressed to the
+*                  communication interface of a port (wIndex = 2 * port).
 * Input          : Request Nb.
 * Output         : None.
 * Return         : USB_UNSUPPORT or USB_SUCCESS.
@@ -262,6 +313,12 @@ RESULT Virtual_Com_Port_Data_Setup(uint8_t RequestNo)
 
   CopyRoutine = NULL;
 
+  if ((pInformation->USBwIndex0 >> 1) >= VCP_PORT_NUM)
+  {
+    return USB_UNSUPPORT;
+  }
+  RequestPort = pInformation->USBwIndex0 >> 1;
+
   if (RequestNo == GET_LINE_CODING)
   {
     if (Type_Recipient == (CLASS_REQUEST | INTERFACE_RECIPIENT))
@@ -373,7 +430,7 @@ RESULT Virtual_Com_Port_Get_Interface_Setting(uint8_t Interface, uint8_t Alterna
   {
     return USB_UNSUPPORT;
   }
-  else if (Interface > 1)
+  else if (Interface > (2 * VCP_PORT_NUM - 1))
   {
     return USB_UNSUPPORT;
   }
@@ -382,7 +439,7 @@ RESULT Virtual_Com_Port_Get_Interface_Setting(uint8_t Interface, uint8_t Alterna
 
 /*******************************************************************************
 * Function Name  : Virtual_Com_Port_GetLineCoding.
-* Description    : send the linecoding structure to the PC host.
+* Description    : send the linecoding structure of the port to the PC host.
 * Input          : Length.
 * Output         : None.
 * Return         : Linecoding structure base address.
@@ -391,15 +448,15 @@ uint8_t *Virtual_Com_Port_GetLineCoding(uint16_t Length)
 {
   if (Length == 0)
   {
-    pInformation->Ctrl_Info.Usb_wLength = sizeof(linecoding);
+    pInformation->Ctrl_Info.Usb_wLength = sizeof(linecoding[0]);
     return NULL;
   }
-  return(uint8_t *)&linecoding;
+  return(uint8_t *)&linecoding[RequestPort];
 }
 
 /*******************************************************************************
 * Function Name  : Virtual_Com_Port_SetLineCoding.
-* Description    : Set the linecoding structure fields.
+* Description    : Set the linecoding structure fields of the port.
 * Input          : Length.
 * Output         : None.
 * Return         : Linecoding structure base address.
@@ -408,10 +465,10 @@ uint8_t *Virtual_Com_Port_SetLineCoding(uint16_t Length)
 {
   if (Length == 0)
   {
-    pInformation->Ctrl_Info.Usb_wLength = sizeof(linecoding);
+    pInformation->Ctrl_Info.Usb_wLength = sizeof(linecoding[0]);
     return NULL;
   }
-  return(uint8_t *)&linecoding;
+  return(uint8_t *)&linecoding[RequestPort];
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Echo throughput of the VirtualComport_Loopback device.
+
+Writes a pseudo random stream to the virtual COM port from one thread while
+another reads the echo back and checks it, then prints the echo rate (each
+direction carries that much data) and the time to the first echoed byte.
+
+  python3 loopback_bench.py /dev/ttyACM0            (Linux)
+  python3 loopback_bench.py COM5 --size 16M         (Windows)
+
+Requires pyserial. The line coding is ignored by the loopback device.
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+import serial
+
+
+def parse_size(text):
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    if text[-1].upper() in units:
+        return int(text[:-1]) * units[text[-1].upper()]
+    return int(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--size", default="4M", type=parse_size,
+                        help="bytes to echo, K/M/G suffixes allowed (4M)")
+    parser.add_argument("--chunk", default=4096, type=int,
+                        help="bytes per write call (4096)")
+    parser.add_argument("--timeout", default=5.0, type=float,
+                        help="seconds without echo before giving up (5)")
+    args = parser.parse_args()
+
+    data = os.urandom(args.size)
+    port = serial.Serial(args.port, timeout=args.timeout)
+    port.reset_input_buffer()
+
+    first_echo = [None]
+
+    def writer():
+        for offset in range(0, len(data), args.chunk):
+            port.write(data[offset:offset + args.chunk])
+
+    start = time.perf_counter()
+    thread = threading.Thread(target=writer, daemon=True)
+    thread.start()
+
+    received = bytearray()
+    while len(received) < len(data):
+        block = port.read(min(65536, len(data) - len(received)))
+        if not block:
+            break
+        if first_echo[0] is None:
+            first_echo[0] = time.perf_counter() - start
+        received += block
+    elapsed = time.perf_counter() - start
+    thread.join(args.timeout)
+    port.close()
+
+    if len(received) != len(data):
+        print("timeout: %d of %d bytes echoed" % (len(received), len(data)))
+        return 1
+    if received != data:
+        bad = next(i for i in range(len(data)) if received[i] != data[i])
+        print("echo mismatch at byte %d" % bad)
+        return 1
+
+    rate = len(data) / elapsed
+    print("%d bytes echoed in %.3f s: %.1f KB/s each way, %.1f KB/s on the bus"
+          % (len(data), elapsed, rate / 1024, 2 * rate / 1024))
+    print("first echo after %.2f ms" % (first_echo[0] * 1000))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -444,6 +444,9 @@ void SD_LowLevel_Init(void)
   /*!< SD_SPI Periph clock enable */
   RCC_APB1PeriphClockCmd(SD_SPI_CLK, ENABLE); 
 
+  /*!< SD_SPI DMA clock enable */
+  RCC_AHBPeriphClockCmd(SD_SPI_DMA_CLK, ENABLE);
+
   /*!< Configure SD_SPI pins: SCK */
   GPIO_InitStructure.GPIO_Pin = SD_SPI_SCK_PIN;
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
@@ -490,7 +493,7 @@ void SD_LowLevel_Init(void)
   SPI_InitStructure.SPI_CPOL = SPI_CPOL_High;
   SPI_InitStructure.SPI_CPHA = SPI_CPHA_2Edge;
   SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
-  SPI_InitStructure.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_2;
+  SPI_InitStructure.SPI_BaudRatePrescaler = SD_SPI_INIT_BAUDRATEPRESCALER;
 
   SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
   SPI_InitStructure.SPI_CRCPolynomial = 7;
@@ -306,6 +306,22 @@ typedef enum
 #define SD_DETECT_EXTI_PORT_SOURCE       EXTI_PortSourceGPIOE
 #define SD_DETECT_EXTI_IRQn              EXTI3_IRQn
 
+/**
+  * @brief  SD SPI DMA channels: the 512 bytes of the data blocks
+  */
+#define SD_SPI_DMA_CLK                   RCC_AHBPeriph_DMA2
+#define SD_SPI_DMA_RX_CHANNEL            DMA2_Channel1
+#define SD_SPI_DMA_TX_CHANNEL            DMA2_Channel2
+#define SD_SPI_DMA_RX_TCFLAG             DMA2_FLAG_TC1
+#define SD_SPI_DMA_TX_TCFLAG             DMA2_FLAG_TC2
+
+/**
+  * @brief  SD SPI clock: 400 KHz at most during the card identification, then
+  *         PCLK1 / 2 (18 MHz) for the data transfers
+  */
+#define SD_SPI_INIT_BAUDRATEPRESCALER    SPI_BaudRatePrescaler_128
+#define SD_SPI_BAUDRATEPRESCALER         SPI_BaudRatePrescaler_2
+
 /**
   * @}
   */
@@ -94,7 +94,8 @@
 /** @defgroup STM32373C_EVAL_SPI_SD_Private_Variables
   * @{
   */ 
-
+static const uint8_t SD_DummyTx = SD_DUMMY_BYTE; /*!< Clocks out the bytes read by DMA */
+static uint8_t SD_DummyRx;                       /*!< Drops the bytes received during a DMA write */
 /**
   * @}
   */ 
@@ -103,6 +104,8 @@
 /** @defgroup STM32373C_EVAL_SPI_SD_Private_Function_Prototypes
   * @{
   */
+static void SD_DMATransfer(uint8_t* pRxBuffer, const uint8_t* pTxBuffer, uint16_t Length);
+static uint8_t SD_GetR1(void);
 /**
   * @}
   */ 
@@ -149,7 +152,17 @@ SD_Error SD_Init(void)
   
   /*------------Put SD in SPI mode--------------*/
   /*!< SD initialized and set to SPI mode properly */
-  return (SD_GoIdleState());
+  if (SD_GoIdleState() != SD_RESPONSE_NO_ERROR)
+  {
+    return SD_RESPONSE_FAILURE;
+  }
+
+  /*!< Identification done: switch SD_SPI to the data transfer clock */
+  SPI_Cmd(SD_SPI, DISABLE);
+  SD_SPI->CR1 = (SD_SPI->CR1 & ~SPI_CR1_BR) | SD_SPI_BAUDRATEPRESCALER;
+  SPI_Cmd(SD_SPI, ENABLE);
+
+  return SD_RESPONSE_NO_ERROR;
 }
 
 /**
@@ -246,7 +259,8 @@ SD_Error SD_ReadBlock(uint8_t* pBuffer, uint32_t ReadAddr, uint16_t BlockSize)
 }
 
 /**
-  * @brief  Reads multiple block of data from the SD.
+  * @brief  Reads multiple block of data from the SD: one CMD18 transfer, the
+  *         block data is received by DMA.
   * @param  pBuffer: pointer to the buffer that receives the data read from the 
   *                  SD.
   * @param  ReadAddr: SD's internal address to read from.
@@ -258,45 +272,41 @@ SD_Error SD_ReadBlock(uint8_t* pBuffer, uint32_t ReadAddr, uint16_t BlockSize)
   */
 SD_Error SD_ReadMultiBlocks(uint8_t* pBuffer, uint32_t ReadAddr, uint16_t BlockSize, uint32_t NumberOfBlocks)
 {
-  uint32_t i = 0, Offset = 0;
   SD_Error rvalue = SD_RESPONSE_FAILURE;
   
   /*!< SD chip select low */
   SD_CS_LOW();
-  /*!< Data transfer */
-  while (NumberOfBlocks--)
+  /*!< Send CMD18 (SD_CMD_READ_MULT_BLOCK): the card streams the blocks until CMD12 */
+  SD_SendCmd(SD_CMD_READ_MULT_BLOCK, ReadAddr, 0xFF);
+  /*!< Check if the SD acknowledged the read block command: R1 response (0x00: no errors) */
+  if (!SD_GetResponse(SD_RESPONSE_NO_ERROR))
   {
-    /*!< Send CMD17 (SD_CMD_READ_SINGLE_BLOCK) to read one block */
-    SD_SendCmd (SD_CMD_READ_SINGLE_BLOCK, ReadAddr + Offset, 0xFF);
-    /*!< Check if the SD acknowledged the read block command: R1 response (0x00: no errors) */
-    if (SD_GetResponse(SD_RESPONSE_NO_ERROR))
-    {
-      return  SD_RESPONSE_FAILURE;
-    }
-    /*!< Now look for the data token to signify the start of the data */
-    if (!SD_GetResponse(SD_START_DATA_SINGLE_BLOCK_READ))
+    rvalue = SD_RESPONSE_NO_ERROR;
+    /*!< Data transfer */
+    while (NumberOfBlocks--)
     {
-      /*!< Read the SD block data : read NumByteToRead data */
-      for (i = 0; i < BlockSize; i++)
+      /*!< Now look for the data token to signify the start of the data */
+      if (SD_GetResponse(SD_START_DATA_MULTIPLE_BLOCK_READ))
       {
-        /*!< Read the pointed data */
-        *pBuffer = SD_ReadByte();
-        /*!< Point to the next location where the byte read will be saved */
-        pBuffer++;
+        rvalue = SD_RESPONSE_FAILURE;
+        break;
       }
-      /*!< Set next read address*/
-      Offset += 512;
+      /*!< Read the SD block data by DMA */
+      SD_DMATransfer(pBuffer, 0, BlockSize);
+      pBuffer += BlockSize;
       /*!< get CRC bytes (not really needed by us, but required by SD) */
       SD_ReadByte();
       SD_ReadByte();
-      /*!< Set response value to success */
-      rvalue = SD_RESPONSE_NO_ERROR;
     }
-    else
+    /*!< Send CMD12 (SD_CMD_STOP_TRANSMISSION), skip the stuff byte and wait
+         for the R1b response: R1 then busy */
+    SD_SendCmd(SD_CMD_STOP_TRANSMISSION, 0, 0xFF);
+    SD_ReadByte();
+    if (SD_GetR1() != SD_RESPONSE_NO_ERROR)
     {
-      /*!< Set response value to failure */
       rvalue = SD_RESPONSE_FAILURE;
     }
+    while (SD_ReadByte() == 0);
   }
   /*!< SD chip select high */
   SD_CS_HIGH();
@@ -363,7 +373,8 @@ SD_Error SD_WriteBlock(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t BlockSize)
 }
 
 /**
-  * @brief  Writes many blocks on the SD
+  * @brief  Writes many blocks on the SD: one CMD25 transfer of blocks
+  *         pre-erased by ACMD23, the block data is sent by DMA.
   * @param  pBuffer: pointer to the buffer containing the data to be written on 
   *                  the SD.
   * @param  WriteAddr: address to write on.
@@ -375,49 +386,49 @@ SD_Error SD_WriteBlock(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t BlockSize)
   */
 SD_Error SD_WriteMultiBlocks(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t BlockSize, uint32_t NumberOfBlocks)
 {
-  uint32_t i = 0, Offset = 0;
   SD_Error rvalue = SD_RESPONSE_FAILURE;
 
   /*!< SD chip select low */
   SD_CS_LOW();
-  /*!< Data transfer */
-  while (NumberOfBlocks--)
+  /*!< Send ACMD23 (SD_ACMD_SET_WR_BLK_ERASE_COUNT) so that the card pre-erases
+       the blocks. Optional: cards without it (MMC) reject CMD55 */
+  SD_SendCmd(SD_CMD_APP_CMD, 0, 0xFF);
+  if (SD_GetR1() == SD_RESPONSE_NO_ERROR)
   {
-    /*!< Send CMD24 (SD_CMD_WRITE_SINGLE_BLOCK) to write blocks */
-    SD_SendCmd(SD_CMD_WRITE_SINGLE_BLOCK, WriteAddr + Offset, 0xFF);
-    /*!< Check if the SD acknowledged the write block command: R1 response (0x00: no errors) */
-    if (SD_GetResponse(SD_RESPONSE_NO_ERROR))
-    {
-      return SD_RESPONSE_FAILURE;
-    }
+    SD_SendCmd(SD_ACMD_SET_WR_BLK_ERASE_COUNT, NumberOfBlocks, 0xFF);
+    SD_GetR1();
+  }
+  /*!< Send CMD25 (SD_CMD_WRITE_MULT_BLOCK) to write blocks */
+  SD_SendCmd(SD_CMD_WRITE_MULT_BLOCK, WriteAddr, 0xFF);
+  /*!< Check if the SD acknowledged the write block command: R1 response (0x00: no errors) */
+  if (!SD_GetResponse(SD_RESPONSE_NO_ERROR))
+  {
+    rvalue = SD_RESPONSE_NO_ERROR;
     /*!< Send dummy byte */
     SD_WriteByte(SD_DUMMY_BYTE);
-    /*!< Send the data token to signify the start of the data */
-    SD_WriteByte(SD_START_DATA_SINGLE_BLOCK_WRITE);
-    /*!< Write the block data to SD : write count data by block */
-    for (i = 0; i < BlockSize; i++)
+    /*!< Data transfer */
+    while (NumberOfBlocks--)
     {
-      /*!< Send the pointed byte */
-      SD_WriteByte(*pBuffer);
-      /*!< Point to the next location where the byte read will be saved */
-      pBuffer++;
+      /*!< Send the data token to signify the start of the data */
+      SD_WriteByte(SD_START_DATA_MULTIPLE_BLOCK_WRITE);
+      /*!< Write the block data to SD by DMA */
+      SD_DMATransfer(0, pBuffer, BlockSize);
+      pBuffer += BlockSize;
+      /*!< Put CRC bytes (not really needed by us, but required by SD) */
+      SD_ReadByte();
+      SD_ReadByte();
+      /*!< Read data response, then wait for the end of the programming */
+      if (SD_GetDataResponse() != SD_DATA_OK)
+      {
+        /*!< Set response value to failure */
+        rvalue = SD_RESPONSE_FAILURE;
+        break;
+      }
     }
-    /*!< Set next write address */
-    Offset += 512;
-    /*!< Put CRC bytes (not really needed by us, but required by SD) */
-    SD_ReadByte();
+    /*!< Send the stop token, skip the stuff byte and wait while busy */
+    SD_WriteByte(SD_STOP_DATA_MULTIPLE_BLOCK_WRITE);
     SD_ReadByte();
-    /*!< Read data response */
-    if (SD_GetDataResponse() == SD_DATA_OK)
-    {
-      /*!< Set response value to success */
-      rvalue = SD_RESPONSE_NO_ERROR;
-    }
-    else
-    {
-      /*!< Set response value to failure */
-      rvalue = SD_RESPONSE_FAILURE;
-    }
+    while (SD_ReadByte() == 0);
   }
   /*!< SD chip select high */
   SD_CS_HIGH();
@@ -832,6 +843,92 @@ SD_Error SD_GoIdleState(void)
   return SD_RESPONSE_NO_ERROR;
 }
 
+/**
+  * @brief  Transfers a data block by DMA: both SD_SPI channels run together,
+  *         the TX channel clocks the bytes out and the RX channel empties the
+  *         RX FIFO. Returns once the last byte is received.
+  * @param  pRxBuffer: buffer of the bytes received, or 0 to drop them.
+  * @param  pTxBuffer: bytes to send, or 0 to send dummy bytes.
+  * @param  Length: number of bytes.
+  * @retval None
+  */
+static void SD_DMATransfer(uint8_t* pRxBuffer, const uint8_t* pTxBuffer, uint16_t Length)
+{
+  DMA_InitTypeDef DMA_InitStructure;
+
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&SD_SPI->DR;
+  DMA_InitStructure.DMA_BufferSize = Length;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+  DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+
+  /*!< RX channel: SD_SPI data register to memory */
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+  if (pRxBuffer != 0)
+  {
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)pRxBuffer;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  }
+  else
+  {
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)&SD_DummyRx;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Disable;
+  }
+  DMA_Init(SD_SPI_DMA_RX_CHANNEL, &DMA_InitStructure);
+
+  /*!< TX channel: memory to SD_SPI data register */
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+  if (pTxBuffer != 0)
+  {
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)pTxBuffer;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  }
+  else
+  {
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)&SD_DummyTx;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Disable;
+  }
+  DMA_Init(SD_SPI_DMA_TX_CHANNEL, &DMA_InitStructure);
+
+  /*!< Enable the channels, then the SD_SPI requests: RX first so that no
+       received byte is missed */
+  DMA_Cmd(SD_SPI_DMA_RX_CHANNEL, ENABLE);
+  DMA_Cmd(SD_SPI_DMA_TX_CHANNEL, ENABLE);
+  SPI_I2S_DMACmd(SD_SPI, SPI_I2S_DMAReq_Rx, ENABLE);
+  SPI_I2S_DMACmd(SD_SPI, SPI_I2S_DMAReq_Tx, ENABLE);
+
+  /*!< Wait for the last received byte */
+  while (DMA_GetFlagStatus(SD_SPI_DMA_RX_TCFLAG) == RESET)
+  {
+  }
+  DMA_ClearFlag(SD_SPI_DMA_RX_TCFLAG | SD_SPI_DMA_TX_TCFLAG);
+
+  SPI_I2S_DMACmd(SD_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
+  DMA_Cmd(SD_SPI_DMA_TX_CHANNEL, DISABLE);
+  DMA_Cmd(SD_SPI_DMA_RX_CHANNEL, DISABLE);
+}
+
+/**
+  * @brief  Returns the R1 response of the last command: the first byte with
+  *         bit 7 low, within the 8 bytes of the command response time.
+  * @param  None
+  * @retval The R1 response, or SD_RESPONSE_FAILURE if none.
+  */
+static uint8_t SD_GetR1(void)
+{
+  uint32_t i;
+  uint8_t Response = SD_RESPONSE_FAILURE;
+
+  for (i = 0; (i < 8) && (Response & 0x80); i++)
+  {
+    Response = SD_ReadByte();
+  }
+  return Response;
+}
+
 /**
   * @brief  Write a byte on the SD.
   * @param  Data: byte to send.